@@ -38,4 +38,17 @@ TEST(AlphaDivisionEffectTest, ZeroAlphaIsPreserved) {
 	EXPECT_EQ(0.0f, out_data[7]);
 }
 
+#ifdef HAVE_BENCHMARK
+// Premultiplied in, postmultiplied out, so the chain is just the input
+// and an AlphaDivisionEffect. (Premultiplied input needs to be linear,
+// so there is no 8-bit version.)
+void BM_AlphaDivisionEffect(benchmark::State &state)
+{
+	EffectBenchmark bench(state, BENCHMARK_FP16, 1, FORMAT_RGBA_PREMULTIPLIED_ALPHA);
+	bench.run(OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+}
+BENCHMARK(BM_AlphaDivisionEffect)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -28,4 +28,17 @@ TEST(AlphaMultiplicationEffectTest, SimpleTest) {
 	expect_equal(expected_data, out_data, 4, size);
 }
 
+#ifdef HAVE_BENCHMARK
+// Postmultiplied in, premultiplied out, so the chain is just the input
+// and an AlphaMultiplicationEffect.
+void BM_AlphaMultiplicationEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format, 1, FORMAT_RGBA_POSTMULTIPLIED_ALPHA);
+	bench.run(OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+}
+BENCHMARK_CAPTURE(BM_AlphaMultiplicationEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_AlphaMultiplicationEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -137,6 +137,25 @@ string SingleBlurPassEffect::output_fragment_shader()
 	return buf + read_file("blur_effect.frag");
 }
 
+Region SingleBlurPassEffect::get_needed_input_region(unsigned input_num, const Region &output_region) const
+{
+	// The samples go out to <num_taps> texels on each side (of our own
+	// output size, which is also the size of the mipmap level we sample from).
+	// Add a bit extra, so that the mipmap texels we sample are computed
+	// entirely from the part of the input that is valid.
+	Region ret = output_region;
+	if (direction == HORIZONTAL) {
+		const float padding = (num_taps + 2) / float(width);
+		ret.x0 -= padding;
+		ret.x1 += padding;
+	} else {
+		const float padding = (num_taps + 2) / float(height);
+		ret.y0 -= padding;
+		ret.y1 += padding;
+	}
+	return ret;
+}
+
 void SingleBlurPassEffect::set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num)
 {
 	Effect::set_gl_state(glsl_program_num, prefix, sampler_num);
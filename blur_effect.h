@@ -88,6 +88,8 @@ public:
 		*virtual_height = this->virtual_height;
 	}
 
+	Region get_needed_input_region(unsigned input_num, const Region &output_region) const override;
+
 	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
 	void clear_gl_state() override;
 	
@@ -133,4 +133,19 @@ TEST(BlurEffectTest, BlurTwoDotsSmallRadiusFewerTaps) {
 	expect_equal(expected_data, out_data, size, size, 1e-3, 1e-5);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_BlurEffect(benchmark::State &state, BenchmarkFormat format, float radius)
+{
+	EffectBenchmark bench(state, format);
+	Effect *blur_effect = bench.add_effect(new BlurEffect());
+	ASSERT_TRUE(blur_effect->set_float("radius", radius));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_BlurEffect, Int8Radius3, BENCHMARK_INT8, 3.0f)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_BlurEffect, Int8Radius20, BENCHMARK_INT8, 20.0f)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_BlurEffect, Float16Radius3, BENCHMARK_FP16, 3.0f)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_BlurEffect, Float16Radius20, BENCHMARK_FP16, 20.0f)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
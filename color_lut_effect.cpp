@@ -0,0 +1,85 @@
+#include <epoxy/gl.h>
+#include <assert.h>
+
+#include "color_lut_effect.h"
+#include "effect_util.h"
+#include "util.h"
+
+using namespace std;
+
+namespace movit {
+
+ColorLUTEffect::ColorLUTEffect(unsigned lut_size)
+	: texnum(0),
+	  uniform_lut_size(lut_size),
+	  uniform_lut_scale(lut_size - 1)
+{
+	assert(lut_size >= 2);
+	uniform_inv_lut_texture_size[0] = 1.0f / (lut_size * lut_size);
+	uniform_inv_lut_texture_size[1] = 1.0f / lut_size;
+
+	register_uniform_sampler2d("lut", &uniform_lut);
+	register_uniform_float("lut_size", &uniform_lut_size);
+	register_uniform_float("lut_scale", &uniform_lut_scale);
+	register_uniform_vec2("inv_lut_texture_size", uniform_inv_lut_texture_size);
+}
+
+string ColorLUTEffect::output_fragment_shader()
+{
+	return read_file("color_lut_effect.frag");
+}
+
+void ColorLUTEffect::set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num)
+{
+	Effect::set_gl_state(glsl_program_num, prefix, sampler_num);
+
+	assert(texnum != 0);
+	glActiveTexture(GL_TEXTURE0 + *sampler_num);
+	check_error();
+	glBindTexture(GL_TEXTURE_2D, texnum);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	check_error();
+
+	uniform_lut = *sampler_num;
+	++*sampler_num;
+}
+
+ColorLUTLatticeInput::ColorLUTLatticeInput(unsigned lut_size, Colorspace color_space, GammaCurve gamma_curve)
+	: lut_size(lut_size),
+	  color_space(color_space),
+	  gamma_curve(gamma_curve),
+	  uniform_lut_size(lut_size),
+	  uniform_inv_lut_scale(1.0f / (lut_size - 1))
+{
+	assert(lut_size >= 2);
+	uniform_texture_size[0] = lut_size * lut_size;
+	uniform_texture_size[1] = lut_size;
+
+	register_uniform_float("lut_size", &uniform_lut_size);
+	register_uniform_float("inv_lut_scale", &uniform_inv_lut_scale);
+	register_uniform_vec2("texture_size", uniform_texture_size);
+}
+
+string ColorLUTLatticeInput::output_fragment_shader()
+{
+	return read_file("color_lut_lattice_input.frag");
+}
+
+bool ColorLUTLatticeInput::set_int(const std::string& key, int value)
+{
+	if (key == "needs_mipmaps") {
+		// The lattice is computed from the texel position,
+		// so we cannot supply mipmaps.
+		return (value == 0);
+	}
+	return Effect::set_int(key, value);
+}
+
+}  // namespace movit
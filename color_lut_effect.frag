@@ -0,0 +1,23 @@
+// Implicit uniforms:
+// uniform sampler2D PREFIX(lut);
+// uniform float PREFIX(lut_size);  // N.
+// uniform float PREFIX(lut_scale);  // N - 1.
+// uniform vec2 PREFIX(inv_lut_texture_size);  // 1 / (N*N, N).
+
+vec4 FUNCNAME(vec2 tc) {
+	vec4 x = INPUT(tc);
+
+	// Position in the lattice, from 0 to N - 1 along each axis.
+	vec3 pos = clamp(x.rgb, 0.0, 1.0) * PREFIX(lut_scale);
+
+	// Find the two B slices to interpolate between. The texel centers
+	// are at half-integer coordinates, so R and G need to be offset
+	// by a half texel for the hardware to interpolate correctly.
+	float slice = min(floor(pos.b), PREFIX(lut_scale) - 1.0);
+	float frac_b = pos.b - slice;
+	vec2 lo_tc = vec2(slice * PREFIX(lut_size) + pos.r + 0.5, pos.g + 0.5) * PREFIX(inv_lut_texture_size);
+	vec2 hi_tc = lo_tc + vec2(PREFIX(lut_size) * PREFIX(inv_lut_texture_size).x, 0.0);
+
+	x.rgb = mix(tex2D(PREFIX(lut), lo_tc).rgb, tex2D(PREFIX(lut), hi_tc).rgb, frac_b);
+	return x;
+}
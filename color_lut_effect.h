@@ -0,0 +1,89 @@
+#ifndef _MOVIT_COLOR_LUT_EFFECT_H
+#define _MOVIT_COLOR_LUT_EFFECT_H 1
+
+// An effect that stands in for a run of per-pixel color effects
+// (see Effect::is_color_function()), by looking up the color in a 3D LUT.
+// Inserted by EffectChain during finalize() if enable_color_lut_baking()
+// is set; see there for more information. The original effects are kept,
+// so that the user can keep changing their parameters as usual, and
+// EffectChain bakes the LUT anew (by rendering those effects on the
+// lattice given by ColorLUTLatticeInput) whenever any of them change.
+//
+// The LUT is stored as a 2D texture of N slices of NxN texels each,
+// laid out horizontally, with R increasing along x and G along y within
+// each slice, and B increasing from slice to slice. We use the hardware
+// for bilinear interpolation within a slice, and interpolate between
+// slices ourselves, which is the same as trilinear interpolation.
+// (Storing it as a 2D texture means we can use the normal phase machinery
+// to render it, and that we don't need support for 3D textures.)
+
+#include <epoxy/gl.h>
+#include <string>
+
+#include "effect.h"
+#include "image_format.h"
+#include "input.h"
+
+namespace movit {
+
+class ColorLUTEffect : public Effect {
+private:
+	// Should not be instantiated by end users;
+	// call EffectChain::enable_color_lut_baking() instead.
+	explicit ColorLUTEffect(unsigned lut_size);
+	friend class EffectChain;
+
+public:
+	std::string effect_type_id() const override { return "ColorLUTEffect"; }
+	std::string output_fragment_shader() override;
+
+	// The baked effects might have had different requirements here,
+	// but they have already been taken care of when we are inserted.
+	bool needs_srgb_primaries() const override { return false; }
+	AlphaHandling alpha_handling() const override { return DONT_CARE_ALPHA_TYPE; }
+	bool strong_one_to_one_sampling() const override { return true; }
+
+	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
+
+private:
+	// Owned by EffectChain.
+	GLuint texnum;
+
+	int uniform_lut;
+	float uniform_lut_size, uniform_lut_scale;
+	float uniform_inv_lut_texture_size[2];
+};
+
+// An input that outputs the lattice that ColorLUTEffect expects,
+// ie., the identity LUT. Only used by EffectChain for baking.
+class ColorLUTLatticeInput : public Input {
+private:
+	ColorLUTLatticeInput(unsigned lut_size, Colorspace color_space, GammaCurve gamma_curve);
+	friend class EffectChain;
+
+public:
+	std::string effect_type_id() const override { return "ColorLUTLatticeInput"; }
+	std::string output_fragment_shader() override;
+	AlphaHandling alpha_handling() const override { return OUTPUT_BLANK_ALPHA; }
+
+	bool can_output_linear_gamma() const override { return false; }
+	bool can_supply_mipmaps() const override { return false; }
+	unsigned get_width() const override { return lut_size * lut_size; }
+	unsigned get_height() const override { return lut_size; }
+	Colorspace get_color_space() const override { return color_space; }
+	GammaCurve get_gamma_curve() const override { return gamma_curve; }
+
+	bool set_int(const std::string& key, int value) override;
+
+private:
+	unsigned lut_size;
+	Colorspace color_space;
+	GammaCurve gamma_curve;
+
+	float uniform_lut_size, uniform_inv_lut_scale;
+	float uniform_texture_size[2];
+};
+
+}  // namespace movit
+
+#endif // !defined(_MOVIT_COLOR_LUT_EFFECT_H)
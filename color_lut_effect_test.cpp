@@ -0,0 +1,131 @@
+// Unit tests for ColorLUTEffect, ie., baking runs of per-pixel color effects
+// (see Effect::is_color_function()) into a LUT in EffectChain.
+
+#include <epoxy/gl.h>
+#include <stdlib.h>
+
+#include "effect_chain.h"
+#include "gtest/gtest.h"
+#include "image_format.h"
+#include "lift_gamma_gain_effect.h"
+#include "saturation_effect.h"
+#include "test_util.h"
+
+namespace movit {
+
+namespace {
+
+// Sets up sRGB input -> lift/gamma/gain -> saturation -> sRGB output,
+// which becomes gamma expansion -> lift/gamma/gain -> saturation ->
+// gamma compression after finalize(); if baking is enabled,
+// all of them can go into a single LUT.
+void add_grading_effects(EffectChainTester *tester, Effect **lgg_effect, Effect **saturation_effect)
+{
+	*lgg_effect = tester->get_chain()->add_effect(new LiftGammaGainEffect());
+	*saturation_effect = tester->get_chain()->add_effect(new SaturationEffect());
+
+	const float lift[] = { 0.05f, 0.0f, 0.02f };
+	const float gamma[] = { 1.2f, 0.9f, 1.0f };
+	const float gain[] = { 0.9f, 1.1f, 1.0f };
+	ASSERT_TRUE((*lgg_effect)->set_vec3("lift", lift));
+	ASSERT_TRUE((*lgg_effect)->set_vec3("gamma", gamma));
+	ASSERT_TRUE((*lgg_effect)->set_vec3("gain", gain));
+	ASSERT_TRUE((*saturation_effect)->set_float("saturation", 0.8f));
+}
+
+}  // namespace
+
+TEST(ColorLUTEffectTest, BakedLUTMatchesOriginalEffects) {
+	const unsigned width = 32, height = 32;
+	float data[width * height * 3];
+	srand(1234);
+	for (unsigned i = 0; i < width * height * 3; ++i) {
+		data[i] = rand() / (RAND_MAX + 1.0f);
+	}
+	float expected_data[width * height * 4], out_data[width * height * 4];
+
+	Effect *lgg_effect, *saturation_effect;
+	{
+		EffectChainTester tester(data, width, height, FORMAT_RGB, COLORSPACE_sRGB, GAMMA_sRGB, GL_RGBA32F);
+		add_grading_effects(&tester, &lgg_effect, &saturation_effect);
+		tester.run(expected_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_sRGB);
+	}
+
+	EffectChainTester tester(data, width, height, FORMAT_RGB, COLORSPACE_sRGB, GAMMA_sRGB, GL_RGBA32F);
+	add_grading_effects(&tester, &lgg_effect, &saturation_effect);
+	tester.get_chain()->enable_color_lut_baking(33);
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_sRGB);
+
+	EXPECT_TRUE(tester.get_chain()->find_node_for_effect(lgg_effect)->disabled);
+	EXPECT_TRUE(tester.get_chain()->find_node_for_effect(saturation_effect)->disabled);
+	EXPECT_EQ(1u, tester.get_chain()->get_num_color_lut_bakes());
+
+	// The LUT is only an approximation, of course. The largest errors are
+	// in the darkest shadows, where the sRGB curve (and the 1/2.2 power
+	// in lift/gamma/gain) is steep; on average, we are well within
+	// one level in 8-bit.
+	expect_equal(expected_data, out_data, 4 * width, height, 6.0 / 255.0, 0.25 / 255.0);
+}
+
+TEST(ColorLUTEffectTest, RebakesOnlyWhenParametersChange) {
+	float data[] = {
+		0.0f, 0.0f, 0.0f,
+		0.5f, 0.5f, 0.5f,
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
+	};
+	float expected_data[] = {
+		0.0f, 0.0f, 0.0f, 1.0f,
+		0.5f, 0.5f, 0.5f, 1.0f,
+		0.2126f, 0.2126f, 0.2126f, 1.0f,
+		0.7152f, 0.7152f, 0.7152f, 1.0f,
+		0.0722f, 0.0722f, 0.0722f, 1.0f,
+	};
+	float out_data[5 * 4];
+	EffectChainTester tester(data, 5, 1, FORMAT_RGB, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	tester.get_chain()->add_effect(new LiftGammaGainEffect());
+	Effect *saturation_effect = tester.get_chain()->add_effect(new SaturationEffect());
+	tester.get_chain()->enable_color_lut_baking(17);
+
+	// With the default parameters, the LUT is the identity.
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(1u, tester.get_chain()->get_num_color_lut_bakes());
+	for (unsigned i = 0; i < 5; ++i) {
+		EXPECT_NEAR(data[i * 3 + 0], out_data[i * 4 + 0], 1e-3);
+		EXPECT_NEAR(data[i * 3 + 1], out_data[i * 4 + 1], 1e-3);
+		EXPECT_NEAR(data[i * 3 + 2], out_data[i * 4 + 2], 1e-3);
+		EXPECT_FLOAT_EQ(1.0f, out_data[i * 4 + 3]);
+	}
+
+	// Remove all color; the LUT should follow. (Saturation is linear,
+	// so the LUT is exact here, up to the precision of the texture.)
+	ASSERT_TRUE(saturation_effect->set_float("saturation", 0.0f));
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(2u, tester.get_chain()->get_num_color_lut_bakes());
+	expect_equal(expected_data, out_data, 4, 5);
+
+	// Setting a parameter to the same value does not cause a new bake.
+	ASSERT_TRUE(saturation_effect->set_float("saturation", 0.0f));
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(2u, tester.get_chain()->get_num_color_lut_bakes());
+	expect_equal(expected_data, out_data, 4, 5);
+}
+
+#ifdef HAVE_BENCHMARK
+void BM_ColorLUTEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format, 1, FORMAT_RGB);
+	Effect *lgg_effect, *saturation_effect;
+	add_grading_effects(bench.get_tester(), &lgg_effect, &saturation_effect);
+	bench.get_chain()->enable_color_lut_baking(33);
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_ColorLUTEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ColorLUTEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ColorLUTEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
+}  // namespace movit
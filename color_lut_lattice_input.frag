@@ -0,0 +1,12 @@
+// Implicit uniforms:
+// uniform float PREFIX(lut_size);  // N.
+// uniform float PREFIX(inv_lut_scale);  // 1 / (N - 1).
+// uniform vec2 PREFIX(texture_size);  // (N*N, N).
+
+vec4 FUNCNAME(vec2 tc) {
+	// Integer texel coordinates; see ColorLUTEffect for the layout.
+	vec2 pos = floor(tc * PREFIX(texture_size));
+	float slice = floor((pos.x + 0.5) / PREFIX(lut_size));
+	vec3 rgb = vec3(pos.x - slice * PREFIX(lut_size), pos.y, slice) * PREFIX(inv_lut_scale);
+	return vec4(rgb, 1.0);
+}
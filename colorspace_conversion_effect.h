@@ -29,6 +29,8 @@ public:
 	bool needs_srgb_primaries() const override { return false; }
 	AlphaHandling alpha_handling() const override { return DONT_CARE_ALPHA_TYPE; }
 	bool strong_one_to_one_sampling() const override { return true; }
+	bool is_color_matrix() const override { return true; }
+	Eigen::Matrix3d get_color_matrix() const override;
 
 	// Get a conversion matrix from the given color space to XYZ.
 	static Eigen::Matrix3d get_xyz_matrix(Colorspace space);
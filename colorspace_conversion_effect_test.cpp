@@ -1,6 +1,9 @@
 // Unit tests for ColorspaceConversionEffect.
 
 #include <epoxy/gl.h>
+#include <stdlib.h>
+
+#include <memory>
 
 #include "colorspace_conversion_effect.h"
 #include "gtest/gtest.h"
@@ -281,4 +284,23 @@ TEST(ColorspaceConversionEffectTest, sRGBToRec601_525) {
 	expect_equal(expected_data, out_data, 4, 6);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_ColorspaceConversionEffect(benchmark::State &state, Colorspace input_color_space)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	std::unique_ptr<fp16_int_t[]> data(new fp16_int_t[width * height * 4]);
+	std::unique_ptr<fp16_int_t[]> out_data(new fp16_int_t[width * height * 4]);
+	for (unsigned i = 0; i < width * height * 4; ++i) {
+		data[i] = fp32_to_fp16(rand() / (RAND_MAX + 1.0));
+	}
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA16F);
+	tester.add_input(data.get(), FORMAT_RGBA_POSTMULTIPLIED_ALPHA, input_color_space, GAMMA_LINEAR);
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+}
+BENCHMARK_CAPTURE(BM_ColorspaceConversionEffect, Rec601_525, COLORSPACE_REC_601_525)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ColorspaceConversionEffect, Rec2020, COLORSPACE_REC_2020)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
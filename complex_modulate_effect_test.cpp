@@ -96,4 +96,16 @@ TEST(ComplexModulateEffectTest, Repeat) {
 	expect_equal(expected_data, out_data, 4, size * repeats);
 }
 
+#ifdef HAVE_BENCHMARK
+// Complex numbers need more precision than 8 bits, so we only test fp16.
+void BM_ComplexModulateEffect(benchmark::State &state)
+{
+	EffectBenchmark bench(state, BENCHMARK_FP16, 2, FORMAT_RGBA_PREMULTIPLIED_ALPHA);
+	bench.add_effect(new ComplexModulateEffect());
+	bench.run(OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+}
+BENCHMARK(BM_ComplexModulateEffect)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
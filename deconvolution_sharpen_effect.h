@@ -43,6 +43,14 @@ public:
 		this->height = height;
 	}
 
+	// Samples R texels in each direction.
+	Region get_needed_input_region(unsigned input_num, const Region &output_region) const override
+	{
+		const float padding_x = (R + 1) / float(width), padding_y = (R + 1) / float(height);
+		return Region(output_region.x0 - padding_x, output_region.y0 - padding_y,
+		              output_region.x1 + padding_x, output_region.y1 + padding_y);
+	}
+
 	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
 	AlphaHandling alpha_handling() const override { return INPUT_PREMULTIPLIED_ALPHA_KEEP_BLANK; }
 
@@ -4,11 +4,14 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include <memory>
+
 #include "deconvolution_sharpen_effect.h"
 #include "effect_chain.h"
 #include "gtest/gtest.h"
 #include "image_format.h"
 #include "test_util.h"
+#include "util.h"
 
 namespace movit {
 
@@ -235,4 +238,40 @@ TEST(DeconvolutionSharpenEffectTest, CircularDeconvolutionKeepsAlpha) {
 	expect_equal(expected_alpha, out_data, size, size);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_DeconvolutionSharpenEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	bench.add_effect(new DeconvolutionSharpenEffect());
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_DeconvolutionSharpenEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_DeconvolutionSharpenEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Measures solving for the deconvolution kernel, which happens on the CPU
+// whenever a parameter changes. The image is tiny, so that the rendering
+// does not matter.
+void BM_DeconvolutionSharpenEffectKernelUpdate(benchmark::State &state)
+{
+	const unsigned size = 16;
+	std::unique_ptr<float[]> data(new float[size * size * 4]);
+	std::unique_ptr<float[]> out_data(new float[size * size * 4]);
+	for (unsigned i = 0; i < size * size * 4; ++i) {
+		data[i] = rand() / (RAND_MAX + 1.0);
+	}
+
+	EffectChainTester tester(data.get(), size, size, FORMAT_RGBA_PREMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	Effect *deconvolution_effect = tester.get_chain()->add_effect(new DeconvolutionSharpenEffect());
+	ASSERT_TRUE(deconvolution_effect->set_int("matrix_size", state.range(0)));
+
+	unsigned frame_num = 0;
+	tester.set_benchmark_frame_callback([deconvolution_effect, &frame_num] {
+		CHECK(deconvolution_effect->set_float("noise", (++frame_num % 2) ? 0.01f : 0.02f));
+	});
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+}
+BENCHMARK(BM_DeconvolutionSharpenEffectKernelUpdate)->Arg(3)->Arg(5)->Arg(7)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
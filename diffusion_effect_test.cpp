@@ -65,4 +65,18 @@ TEST(DiffusionEffectTest, FlattensOutWhitePyramid) {
 	expect_equal(expected_data, out_data, size, size, 0.05f, 0.002);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_DiffusionEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *diffusion_effect = bench.add_effect(new DiffusionEffect());
+	ASSERT_TRUE(diffusion_effect->set_float("radius", 3.0f));
+	ASSERT_TRUE(diffusion_effect->set_float("blurred_mix_amount", 0.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_DiffusionEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_DiffusionEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
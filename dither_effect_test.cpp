@@ -5,10 +5,15 @@
 
 #include <epoxy/gl.h>
 #include <math.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
 
 #include "effect_chain.h"
 #include "gtest/gtest.h"
 #include "image_format.h"
+#include "resource_pool.h"
 #include "test_util.h"
 #include "util.h"
 
@@ -65,4 +70,44 @@ TEST(DitherEffectTest, SinusoidBelowOneLevelComesThrough) {
 	EXPECT_NEAR(amplitude, sum / (size * 255.0f), 1.1e-5);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_DitherEffect(benchmark::State &state, BenchmarkFormat format, unsigned num_bits)
+{
+	EffectBenchmark bench(state, format);
+	bench.get_chain()->set_dither_bits(num_bits);
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_DitherEffect, Int8, BENCHMARK_INT8, 8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_DitherEffect, Int10, BENCHMARK_INT10, 10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Measures regenerating the dither texture, which happens whenever the output
+// size changes. We alternate between two sizes to force that every frame;
+// the rendering itself is small compared to the CPU work.
+void BM_DitherEffectUpdateTexture(benchmark::State &state)
+{
+	const unsigned size = 128;  // The largest dither texture we make.
+	std::unique_ptr<float[]> data(new float[size * size]);
+	std::unique_ptr<unsigned char[]> out_data(new unsigned char[size * size]);
+	for (unsigned i = 0; i < size * size; ++i) {
+		data[i] = rand() / (RAND_MAX + 1.0);
+	}
+
+	EffectChainTester tester(data.get(), size, size, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA8);
+	tester.get_chain()->set_dither_bits(8);
+	tester.run(out_data.get(), GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	ResourcePool *resource_pool = tester.get_chain()->get_resource_pool();
+	GLuint texnum = resource_pool->create_2d_texture(GL_RGBA8, size, size);
+	const std::vector<EffectChain::DestinationTexture> destinations = { { texnum, GL_RGBA8 } };
+	unsigned frame_num = 0;
+	for (auto _ : state) {
+		tester.get_chain()->render_to_texture(destinations, size - (++frame_num % 2), size);
+	}
+	glFinish();
+	resource_pool->release_2d_texture(texnum);
+}
+BENCHMARK(BM_DitherEffectUpdateTexture)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -17,7 +17,10 @@ bool Effect::set_int(const string &key, int value)
 	if (params_int.count(key) == 0) {
 		return false;
 	}
-	*params_int[key] = value;
+	if (*params_int[key] != value) {
+		*params_int[key] = value;
+		bump_generation();
+	}
 	return true;
 }
 
@@ -26,7 +29,10 @@ bool Effect::set_ivec2(const string &key, const int *values)
 	if (params_ivec2.count(key) == 0) {
 		return false;
 	}
-	memcpy(params_ivec2[key], values, sizeof(int) * 2);
+	if (memcmp(params_ivec2[key], values, sizeof(int) * 2) != 0) {
+		memcpy(params_ivec2[key], values, sizeof(int) * 2);
+		bump_generation();
+	}
 	return true;
 }
 
@@ -35,7 +41,10 @@ bool Effect::set_float(const string &key, float value)
 	if (params_float.count(key) == 0) {
 		return false;
 	}
-	*params_float[key] = value;
+	if (*params_float[key] != value) {
+		*params_float[key] = value;
+		bump_generation();
+	}
 	return true;
 }
 
@@ -44,7 +53,10 @@ bool Effect::set_vec2(const string &key, const float *values)
 	if (params_vec2.count(key) == 0) {
 		return false;
 	}
-	memcpy(params_vec2[key], values, sizeof(float) * 2);
+	if (memcmp(params_vec2[key], values, sizeof(float) * 2) != 0) {
+		memcpy(params_vec2[key], values, sizeof(float) * 2);
+		bump_generation();
+	}
 	return true;
 }
 
@@ -53,7 +65,10 @@ bool Effect::set_vec3(const string &key, const float *values)
 	if (params_vec3.count(key) == 0) {
 		return false;
 	}
-	memcpy(params_vec3[key], values, sizeof(float) * 3);
+	if (memcmp(params_vec3[key], values, sizeof(float) * 3) != 0) {
+		memcpy(params_vec3[key], values, sizeof(float) * 3);
+		bump_generation();
+	}
 	return true;
 }
 
@@ -62,7 +77,10 @@ bool Effect::set_vec4(const string &key, const float *values)
 	if (params_vec4.count(key) == 0) {
 		return false;
 	}
-	memcpy(params_vec4[key], values, sizeof(float) * 4);
+	if (memcmp(params_vec4[key], values, sizeof(float) * 4) != 0) {
+		memcpy(params_vec4[key], values, sizeof(float) * 4);
+		bump_generation();
+	}
 	return true;
 }
 
@@ -52,6 +52,20 @@ struct RGBATuple {
 	float r, g, b, a;
 };
 
+// A rectangle in normalized texture coordinates, ie., (0,0) is the
+// bottom-left corner of the image and (1,1) is the top-right corner.
+// Used for region-of-interest rendering; see Effect::get_needed_input_region().
+// The region is empty if x0 >= x1 or y0 >= y1.
+struct Region {
+	Region() {}
+	Region(float x0, float y0, float x1, float y1)
+		: x0(x0), y0(y0), x1(x1), y1(y1) {}
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+
+	float x0, y0, x1, y1;
+};
+
 // Represents a registered uniform.
 template<class T>
 struct Uniform {
@@ -60,6 +74,17 @@ struct Uniform {
 	size_t num_values;  // Number of elements; for arrays only. _Not_ the vector length.
 	std::string prefix;  // Filled in only after phases have been constructed.
 	GLint location;  // Filled in only after phases have been constructed. -1 if no location.
+
+	// If the uniform lives in the phase's uniform block instead of having
+	// a location, its byte offset within the block (and the strides for arrays
+	// and matrix columns, as given by std140 layout). -1 if not in a block.
+	// Filled in only after phases have been constructed.
+	GLint ubo_offset = -1, ubo_array_stride = -1, ubo_matrix_stride = -1;
+
+	// The values that were last given to OpenGL for this uniform, so that
+	// EffectChain can skip setting it again if it has not changed.
+	// Only used if the uniform has a location.
+	std::vector<T> last_uploaded;
 };
 
 class Effect {
@@ -232,6 +257,30 @@ public:
 	// An effect that it strong one-to-one must also be one-to-one.
 	virtual bool strong_one_to_one_sampling() const { return false; }
 
+	// Whether this effect is nothing but a linear transformation of the
+	// color values, ie., out.rgb = M * in.rgb for some 3x3 matrix M
+	// (alpha is left alone), where M is given by get_color_matrix().
+	// If so, EffectChain will combine runs of such effects into a single
+	// matrix multiplication during finalize(). The effect will then not get
+	// set_gl_state() calls; instead, get_color_matrix() will be called
+	// every frame, so it must reflect the current parameters.
+	//
+	// The effect must also have strong_one_to_one_sampling(), and be
+	// indifferent to the alpha type (since M is linear, it is the same
+	// for premultiplied and postmultiplied alpha).
+	virtual bool is_color_matrix() const { return false; }
+	virtual Eigen::Matrix3d get_color_matrix() const { assert(false); return Eigen::Matrix3d::Identity(); }
+
+	// Whether this effect is a pure per-pixel color function, ie., the output
+	// RGB values depend only on the input RGB values in the same pixel
+	// (given blank alpha), and alpha is left alone. If so, and the user
+	// has asked for it (see EffectChain::enable_color_lut_baking()),
+	// runs of such effects can be baked into a 3D LUT.
+	//
+	// Like for is_color_matrix(), the effect must have
+	// strong_one_to_one_sampling(). All color matrices are color functions.
+	virtual bool is_color_function() const { return is_color_matrix(); }
+
 	// Whether this effect wants to output to a different size than
 	// its input(s) (see inform_input_size(), below). See also
 	// sets_virtual_output_size() below.
@@ -279,6 +328,29 @@ public:
 		assert(false);
 	}
 
+	// For region-of-interest rendering (see EffectChain::render_region_to_fbo()):
+	// Given that only <output_region> of this effect's output is needed,
+	// return which part of input <input_num> is needed to compute it.
+	// Both are in normalized coordinates; the result will be clipped
+	// to the input afterwards, so you can return too large a region
+	// near the edges. inform_input_size() will have been called
+	// for the current frame before this.
+	//
+	// Returning too large a region is always safe, but costs performance;
+	// returning too small a region will give wrong results near its edges.
+	// Thus, the default is to be exact for effects with strong one-to-one
+	// sampling (which by definition need exactly the same region), and to
+	// ask for the entire input for everything else. Effects that sample
+	// a neighborhood (blurs, scalers and so on) should override this
+	// and add their own padding.
+	virtual Region get_needed_input_region(unsigned input_num, const Region &output_region) const {
+		if (strong_one_to_one_sampling()) {
+			return output_region;
+		} else {
+			return Region(0.0f, 0.0f, 1.0f, 1.0f);
+		}
+	}
+
 	// Whether this effect uses a compute shader instead of a regular fragment shader.
 	// Compute shaders are more flexible in that they can have multiple outputs
 	// for each invocation and also communicate between instances (by using shared
@@ -381,7 +453,23 @@ public:
 	virtual bool set_vec3(const std::string &key, const float *values) MUST_CHECK_RESULT;
 	virtual bool set_vec4(const std::string &key, const float *values) MUST_CHECK_RESULT;
 
+	// A counter that changes whenever something that could change this
+	// effect's output (other than its inputs) has changed, such as
+	// a parameter being set to a new value. Used by EffectChain to find
+	// phases it does not need to render again, if memoization is enabled
+	// (see EffectChain::enable_phase_memoization()).
+	//
+	// set_*() take care of this for you, and so do the inputs that come
+	// with Movit when their pixel data is changed or invalidated.
+	// If your effect's output can change in other ways (e.g. through
+	// a custom setter or internal state), call bump_generation() when
+	// it does, or override this.
+	virtual unsigned get_generation() const { return generation; }
+
 protected:
+	// See get_generation().
+	void bump_generation() { ++generation; }
+
 	// Register a parameter. Whenever set_*() is called with the same key,
 	// it will update the value in the given pointer (typically a pointer
 	// to some private member variable in your effect). It will also
@@ -401,8 +489,9 @@ protected:
 	// Register uniforms, such that they will automatically be set
 	// before the shader runs. This is more efficient than set_uniform_*
 	// in effect_util.h, because it doesn't need to do name lookups
-	// every time. Also, in the future, it will use uniform buffer objects
-	// (UBOs) if available to reduce the number of calls into the driver.
+	// every time. Also, it will use uniform buffer objects (UBOs) if
+	// available to reduce the number of calls into the driver; all the
+	// uniforms for a phase (except samplers) are then uploaded in one go.
 	//
 	// May not be called after output_fragment_shader() has returned.
 	// The pointer must be valid for the entire lifetime of the Effect,
@@ -433,6 +522,8 @@ protected:
 	void register_uniform_mat3(const std::string &key, const Eigen::Matrix3d *matrix);
 
 private:
+	unsigned generation = 0;
+
 	std::map<std::string, int *> params_int;
 	std::map<std::string, int *> params_ivec2;
 	std::map<std::string, float *> params_float;
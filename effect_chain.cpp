@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <set>
 #include <stack>
 #include <utility>
@@ -14,11 +16,13 @@
 
 #include "alpha_division_effect.h"
 #include "alpha_multiplication_effect.h"
+#include "color_lut_effect.h"
 #include "colorspace_conversion_effect.h"
 #include "dither_effect.h"
 #include "effect.h"
 #include "effect_chain.h"
 #include "effect_util.h"
+#include "fused_color_matrix_effect.h"
 #include "gamma_compression_effect.h"
 #include "gamma_expansion_effect.h"
 #include "init.h"
@@ -34,6 +38,32 @@ namespace movit {
 
 namespace {
 
+// For phase timing; see EffectChain::get_phase_timing_trace().
+uint64_t steady_clock_ns()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Labels and group names longer than what the driver accepts (including the
+// terminating zero) give GL_INVALID_VALUE, so cut them off instead.
+string truncate_debug_string(const string &str, int max_length)
+{
+	assert(max_length > 0);
+	if (str.size() < size_t(max_length)) {
+		return str;
+	}
+	return str.substr(0, max_length - 1);
+}
+
+// Nanoseconds as microseconds with three decimals, as the trace format wants.
+string format_trace_microseconds(uint64_t ns)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.3f", ns * 1e-3);
+	return buf;
+}
+
 // An effect whose only purpose is to sit in a phase on its own and take the
 // texture output from a compute shader and display it to the normal backbuffer
 // (or any FBO). That phase can be skipped when rendering using render_to_textures().
@@ -45,6 +75,81 @@ public:
 	bool needs_texture_bounce() const override { return true; }
 };
 
+// An effect that marks where an output is taken from the graph. It does nothing
+// by itself, but it gives the output a node of its own that has no outgoing
+// links, so that the output can get its own conversions (and phase).
+// Used for extra outputs (see EffectChain::add_extra_output()), and for
+// the main output if its last effect is also used for an extra output.
+class OutputTapEffect : public Effect {
+public:
+	explicit OutputTapEffect(int extra_output_num) : extra_output_num(extra_output_num) {}
+	string effect_type_id() const override { return "OutputTapEffect"; }
+	string output_fragment_shader() override { return read_file("identity.frag"); }
+	bool needs_linear_light() const override { return false; }
+	bool needs_srgb_primaries() const override { return false; }
+	AlphaHandling alpha_handling() const override { return DONT_CARE_ALPHA_TYPE; }
+	bool strong_one_to_one_sampling() const override { return true; }
+
+	// -1 for the main output.
+	const int extra_output_num;
+};
+
+// The number of bytes per pixel glReadPixels() will write for the given
+// format and type, assuming GL_PACK_ALIGNMENT is 1.
+size_t bytes_per_pixel_for_readback(GLenum format, GLenum type)
+{
+	switch (type) {
+	case GL_UNSIGNED_INT_2_10_10_10_REV:
+	case GL_UNSIGNED_INT_8_8_8_8_REV:
+	case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		return 4;
+	default:
+		break;
+	}
+
+	size_t num_components;
+	switch (format) {
+	case GL_RED:
+	case GL_RED_INTEGER:
+		num_components = 1;
+		break;
+	case GL_RG:
+	case GL_RG_INTEGER:
+		num_components = 2;
+		break;
+	case GL_RGB:
+	case GL_BGR:
+	case GL_RGB_INTEGER:
+		num_components = 3;
+		break;
+	case GL_RGBA:
+	case GL_BGRA:
+	case GL_RGBA_INTEGER:
+		num_components = 4;
+		break;
+	default:
+		fprintf(stderr, "Unsupported readback format 0x%x\n", format);
+		abort();
+	}
+
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+	case GL_BYTE:
+		return num_components;
+	case GL_UNSIGNED_SHORT:
+	case GL_SHORT:
+	case GL_HALF_FLOAT:
+		return num_components * 2;
+	case GL_UNSIGNED_INT:
+	case GL_INT:
+	case GL_FLOAT:
+		return num_components * 4;
+	default:
+		fprintf(stderr, "Unsupported readback type 0x%x\n", type);
+		abort();
+	}
+}
+
 }  // namespace
 
 EffectChain::EffectChain(float aspect_nom, float aspect_denom, ResourcePool *resource_pool)
@@ -59,8 +164,24 @@ EffectChain::EffectChain(float aspect_nom, float aspect_denom, ResourcePool *res
 	  num_dither_bits(0),
 	  output_origin(OUTPUT_ORIGIN_BOTTOM_LEFT),
 	  finalized(false),
+	  asynchronous_compilation(false),
+	  color_lut_size(0),
+	  num_color_lut_bakes(0),
 	  resource_pool(resource_pool),
-	  do_phase_timing(false) {
+	  do_phase_timing(false),
+	  do_phase_memoization(false),
+	  do_debug_labels(false),
+	  peak_intermediate_bytes(0),
+	  num_elided_gl_calls(0),
+	  uniform_buffer(0),
+	  uniform_buffer_mapped(nullptr),
+	  uniform_buffer_frame_size(0),
+	  uniform_buffer_frame(0),
+	  uniform_buffer_allocated(false) {
+	for (unsigned i = 0; i < num_uniform_buffer_frames; ++i) {
+		uniform_buffer_fences[i] = nullptr;
+	}
+
 	if (resource_pool == nullptr) {
 		this->resource_pool = new ResourcePool();
 		owns_resource_pool = true;
@@ -83,10 +204,45 @@ EffectChain::~EffectChain()
 		delete nodes[i]->effect;
 		delete nodes[i];
 	}
+	release_intermediate_textures();
+	for (Phase *phase : phases) {
+		release_memoized_texture(phase);
+	}
+	for (unsigned i = 0; i < num_uniform_buffer_frames; ++i) {
+		if (uniform_buffer_fences[i] != nullptr) {
+			glDeleteSync(uniform_buffer_fences[i]);
+			check_error();
+		}
+	}
+	if (uniform_buffer != 0) {
+		// Also unmaps it, if needed.
+		glDeleteBuffers(1, &uniform_buffer);
+		check_error();
+	}
+	for (ReadbackBuffer &buffer : readback_buffers) {
+		if (buffer.fence != nullptr) {
+			glDeleteSync(buffer.fence);
+			check_error();
+		}
+		if (buffer.pbo != 0) {
+			// Also unmaps it, if needed.
+			glDeleteBuffers(1, &buffer.pbo);
+			check_error();
+		}
+	}
 	for (unsigned i = 0; i < phases.size(); ++i) {
 		resource_pool->release_glsl_program(phases[i]->glsl_program_num);
 		delete phases[i];
 	}
+	for (const ColorLUTBake &bake : color_lut_bakes) {
+		if (bake.phase != nullptr) {
+			resource_pool->release_glsl_program(bake.phase->glsl_program_num);
+			delete bake.phase;
+		}
+		if (bake.texnum != 0) {
+			resource_pool->release_2d_texture(bake.texnum);
+		}
+	}
 	if (owns_resource_pool) {
 		delete resource_pool;
 	}
@@ -138,6 +294,13 @@ void EffectChain::add_ycbcr_output(const ImageFormat &format, OutputAlphaFormat
 	assert(ycbcr_format.chroma_subsampling_y == 1);
 }
 
+void EffectChain::add_extra_output(Effect *effect, const ImageFormat &format, OutputAlphaFormat alpha_format)
+{
+	assert(!finalized);
+	assert(node_map.count(effect) != 0);
+	extra_outputs.push_back(ExtraOutput{ effect, format, alpha_format });
+}
+
 void EffectChain::change_ycbcr_output_format(const YCbCrFormat &ycbcr_format)
 {
 	assert(num_output_color_ycbcr > 0);
@@ -314,10 +477,13 @@ string replace_prefix(const string &text, const string &prefix)
 
 namespace {
 
+// If <in_block> is true, the declarations are meant to go inside a uniform block,
+// so they should not have the “uniform” qualifier.
 template<class T>
 void extract_uniform_declarations(const vector<Uniform<T>> &effect_uniforms,
                                   const string &type_specifier,
                                   const string &effect_id,
+                                  bool in_block,
                                   vector<Uniform<T>> *phase_uniforms,
                                   string *glsl_string)
 {
@@ -325,7 +491,7 @@ void extract_uniform_declarations(const vector<Uniform<T>> &effect_uniforms,
 		phase_uniforms->push_back(effect_uniforms[i]);
 		phase_uniforms->back().prefix = effect_id;
 
-		*glsl_string += string("uniform ") + type_specifier + " " + effect_id
+		*glsl_string += string(in_block ? "\t" : "uniform ") + type_specifier + " " + effect_id
 			+ "_" + effect_uniforms[i].name + ";\n";
 	}
 }
@@ -334,6 +500,7 @@ template<class T>
 void extract_uniform_array_declarations(const vector<Uniform<T>> &effect_uniforms,
                                         const string &type_specifier,
                                         const string &effect_id,
+                                        bool in_block,
                                         vector<Uniform<T>> *phase_uniforms,
                                         string *glsl_string)
 {
@@ -342,7 +509,8 @@ void extract_uniform_array_declarations(const vector<Uniform<T>> &effect_uniform
 		phase_uniforms->back().prefix = effect_id;
 
 		char buf[256];
-		snprintf(buf, sizeof(buf), "uniform %s %s_%s[%d];\n",
+		snprintf(buf, sizeof(buf), "%s%s %s_%s[%d];\n",
+			in_block ? "\t" : "uniform ",
 			type_specifier.c_str(), effect_id.c_str(),
 			effect_uniforms[i].name.c_str(),
 			int(effect_uniforms[i].num_values));
@@ -359,6 +527,76 @@ void collect_uniform_locations(GLuint glsl_program_num, vector<Uniform<T>> *phas
 	}
 }
 
+// Same, for uniforms that are in the uniform block. std140 layout is fully
+// specified, but asking the driver is less error-prone than duplicating
+// the rules here.
+template<class T>
+void collect_uniform_block_offsets(GLuint glsl_program_num, vector<Uniform<T>> *phase_uniforms)
+{
+	for (unsigned i = 0; i < phase_uniforms->size(); ++i) {
+		Uniform<T> &uniform = (*phase_uniforms)[i];
+		const string name = uniform.prefix + "_" + uniform.name;
+		const GLchar *name_ptr = name.c_str();
+		GLuint index;
+		glGetUniformIndices(glsl_program_num, 1, &name_ptr, &index);
+		check_error();
+		if (index == GL_INVALID_INDEX) {
+			uniform.ubo_offset = -1;
+			continue;
+		}
+		glGetActiveUniformsiv(glsl_program_num, 1, &index, GL_UNIFORM_OFFSET, &uniform.ubo_offset);
+		glGetActiveUniformsiv(glsl_program_num, 1, &index, GL_UNIFORM_ARRAY_STRIDE, &uniform.ubo_array_stride);
+		glGetActiveUniformsiv(glsl_program_num, 1, &index, GL_UNIFORM_MATRIX_STRIDE, &uniform.ubo_matrix_stride);
+		check_error();
+	}
+}
+
+// Whether the given uniform needs to be set (again), given that the program
+// instance has the last uploaded values if <uniforms_preserved> is true.
+// If so, also remembers the current value as the last uploaded one.
+template<class T>
+bool uniform_needs_upload(Uniform<T> *uniform, size_t num_components, bool uniforms_preserved)
+{
+	const size_t num_elements = uniform->num_values * num_components;
+	if (uniforms_preserved &&
+	    uniform->last_uploaded.size() == num_elements &&
+	    equal(uniform->value, uniform->value + num_elements, uniform->last_uploaded.begin())) {
+		return false;
+	}
+	uniform->last_uploaded.assign(uniform->value, uniform->value + num_elements);
+	return true;
+}
+
+// Write the values of the given uniforms into their places in the uniform
+// block (see collect_uniform_block_offsets()), converting each component
+// to <GLType> (GLint or GLfloat; std140 stores bools as 32-bit integers).
+template<class GLType, class T>
+void write_uniform_block_values(const vector<Uniform<T>> &phase_uniforms, unsigned num_components, unsigned char *block)
+{
+	for (const Uniform<T> &uniform : phase_uniforms) {
+		if (uniform.ubo_offset == -1) {
+			continue;
+		}
+		for (size_t i = 0; i < uniform.num_values; ++i) {
+			GLType *dst = (GLType *)(block + uniform.ubo_offset + i * uniform.ubo_array_stride);
+			for (unsigned j = 0; j < num_components; ++j) {
+				dst[j] = uniform.value[i * num_components + j];
+			}
+		}
+	}
+}
+
+// Append the raw bytes of the current values of the given uniforms to <out>,
+// so that two snapshots can be compared with memcmp.
+template<class T>
+void append_uniform_values(const vector<Uniform<T>> &phase_uniforms, unsigned num_components, vector<unsigned char> *out)
+{
+	for (const Uniform<T> &uniform : phase_uniforms) {
+		const unsigned char *src = (const unsigned char *)uniform.value;
+		out->insert(out->end(), src, src + uniform.num_values * num_components * sizeof(T));
+	}
+}
+
 }  // namespace
 
 void EffectChain::compile_glsl_program(Phase *phase)
@@ -469,9 +707,21 @@ void EffectChain::compile_glsl_program(Phase *phase)
 		frag_shader += string("#define INPUT ") + phase->effect_ids[make_pair(phase->effects.back(), IN_SAME_PHASE)] + "\n";
 	}
 
+	// Phases that bake LUTs end in a node that has no outgoing links,
+	// but they are obviously not the last phase.
+	bool is_lut_bake = false;
+	for (const ColorLUTBake &bake : color_lut_bakes) {
+		is_lut_bake |= (bake.output_node == phase->output_node);
+	}
+
+	// Extra outputs (see add_extra_output()) are also phases that end
+	// in a node without outgoing links, but they are always RGBA.
+	const bool is_extra_output = phase->output_node->outgoing_links.empty() && !is_lut_bake &&
+		find_extra_output_num(phase->output_node) != -1;
+
 	// If we're the last phase, add the right #defines for Y'CbCr multi-output as needed.
 	vector<string> frag_shader_outputs;  // In order.
-	if (phase->output_node->outgoing_links.empty() && num_output_color_ycbcr > 0) {
+	if (phase->output_node->outgoing_links.empty() && !is_lut_bake && !is_extra_output && num_output_color_ycbcr > 0) {
 		switch (output_ycbcr_splitting[0]) {
 		case YCBCR_OUTPUT_INTERLEAVED:
 			// No #defines set.
@@ -545,26 +795,39 @@ void EffectChain::compile_glsl_program(Phase *phase)
 	// before in the output source, since output_fragment_shader() is allowed
 	// to register new uniforms (e.g. arrays that are of unknown length until
 	// finalization time).
-	// TODO: Make a uniform block for platforms that support it.
+	//
+	// If we can, we put all the uniforms (except samplers and images, which are
+	// opaque types and cannot be in uniform blocks) into a single uniform block,
+	// so that setup_uniforms() can upload them all at once.
+	const bool in_block = movit_uniform_buffers_supported;
 	string frag_shader_uniforms = "";
+	string frag_shader_uniform_block = "";
+	string *block_uniforms = in_block ? &frag_shader_uniform_block : &frag_shader_uniforms;
 	for (unsigned i = 0; i < phase->effects.size(); ++i) {
 		Node *node = phase->effects[i];
 		Effect *effect = node->effect;
 		const string effect_id = phase->effect_ids[make_pair(node, IN_SAME_PHASE)];
-		extract_uniform_declarations(effect->uniforms_image2d, "image2D", effect_id, &phase->uniforms_image2d, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_sampler2d, "sampler2D", effect_id, &phase->uniforms_sampler2d, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_bool, "bool", effect_id, &phase->uniforms_bool, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_int, "int", effect_id, &phase->uniforms_int, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_ivec2, "ivec2", effect_id, &phase->uniforms_ivec2, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_float, "float", effect_id, &phase->uniforms_float, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_vec2, "vec2", effect_id, &phase->uniforms_vec2, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_vec3, "vec3", effect_id, &phase->uniforms_vec3, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_vec4, "vec4", effect_id, &phase->uniforms_vec4, &frag_shader_uniforms);
-		extract_uniform_array_declarations(effect->uniforms_float_array, "float", effect_id, &phase->uniforms_float, &frag_shader_uniforms);
-		extract_uniform_array_declarations(effect->uniforms_vec2_array, "vec2", effect_id, &phase->uniforms_vec2, &frag_shader_uniforms);
-		extract_uniform_array_declarations(effect->uniforms_vec3_array, "vec3", effect_id, &phase->uniforms_vec3, &frag_shader_uniforms);
-		extract_uniform_array_declarations(effect->uniforms_vec4_array, "vec4", effect_id, &phase->uniforms_vec4, &frag_shader_uniforms);
-		extract_uniform_declarations(effect->uniforms_mat3, "mat3", effect_id, &phase->uniforms_mat3, &frag_shader_uniforms);
+		extract_uniform_declarations(effect->uniforms_image2d, "image2D", effect_id, false, &phase->uniforms_image2d, &frag_shader_uniforms);
+		extract_uniform_declarations(effect->uniforms_sampler2d, "sampler2D", effect_id, false, &phase->uniforms_sampler2d, &frag_shader_uniforms);
+		extract_uniform_declarations(effect->uniforms_bool, "bool", effect_id, in_block, &phase->uniforms_bool, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_int, "int", effect_id, in_block, &phase->uniforms_int, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_ivec2, "ivec2", effect_id, in_block, &phase->uniforms_ivec2, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_float, "float", effect_id, in_block, &phase->uniforms_float, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_vec2, "vec2", effect_id, in_block, &phase->uniforms_vec2, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_vec3, "vec3", effect_id, in_block, &phase->uniforms_vec3, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_vec4, "vec4", effect_id, in_block, &phase->uniforms_vec4, block_uniforms);
+		extract_uniform_array_declarations(effect->uniforms_float_array, "float", effect_id, in_block, &phase->uniforms_float, block_uniforms);
+		extract_uniform_array_declarations(effect->uniforms_vec2_array, "vec2", effect_id, in_block, &phase->uniforms_vec2, block_uniforms);
+		extract_uniform_array_declarations(effect->uniforms_vec3_array, "vec3", effect_id, in_block, &phase->uniforms_vec3, block_uniforms);
+		extract_uniform_array_declarations(effect->uniforms_vec4_array, "vec4", effect_id, in_block, &phase->uniforms_vec4, block_uniforms);
+		extract_uniform_declarations(effect->uniforms_mat3, "mat3", effect_id, in_block, &phase->uniforms_mat3, block_uniforms);
+	}
+	phase->has_uniform_block = !frag_shader_uniform_block.empty();
+	phase->uniform_block_size = 0;
+	phase->uniform_block_offset = 0;
+	phase->uniform_block_uploaded_frames = 0;
+	if (phase->has_uniform_block) {
+		frag_shader_uniforms += "layout(std140) uniform MovitUniforms {\n" + frag_shader_uniform_block + "};\n";
 	}
 
 	string vert_shader = read_version_dependent_file("vs", "vert");
@@ -572,11 +835,13 @@ void EffectChain::compile_glsl_program(Phase *phase)
 	// If we're the last phase and need to flip the picture to compensate for
 	// the origin, tell the vertex or compute shader so.
 	bool is_last_phase;
-	if (has_dummy_effect) {
+	if (is_extra_output) {
+		is_last_phase = true;
+	} else if (has_dummy_effect) {
 		is_last_phase = (phase->output_node->outgoing_links.size() == 1 &&
 			phase->output_node->outgoing_links[0]->effect->effect_type_id() == "ComputeShaderOutputDisplayEffect");
 	} else {
-		is_last_phase = phase->output_node->outgoing_links.empty();
+		is_last_phase = phase->output_node->outgoing_links.empty() && !is_lut_bake;
 	}
 	if (is_last_phase && output_origin == OUTPUT_ORIGIN_TOP_LEFT) {
 		if (phase->is_compute_shader) {
@@ -593,7 +858,7 @@ void EffectChain::compile_glsl_program(Phase *phase)
 	frag_shader = frag_shader_header + frag_shader_uniforms + frag_shader;
 
 	if (phase->is_compute_shader) {
-		phase->glsl_program_num = resource_pool->compile_glsl_compute_program(frag_shader);
+		phase->glsl_program_num = resource_pool->start_compile_glsl_compute_program(frag_shader);
 
 		Uniform<int> uniform;
 		uniform.name = "outbuf";
@@ -603,8 +868,15 @@ void EffectChain::compile_glsl_program(Phase *phase)
 		uniform.location = -1;
 		phase->uniforms_image2d.push_back(uniform);
 	} else {
-		phase->glsl_program_num = resource_pool->compile_glsl_program(vert_shader, frag_shader, frag_shader_outputs);
+		phase->glsl_program_num = resource_pool->start_compile_glsl_program(vert_shader, frag_shader, frag_shader_outputs);
 	}
+	phase->program_ready = false;
+}
+
+void EffectChain::finish_glsl_program(Phase *phase)
+{
+	resource_pool->finish_glsl_program(phase->glsl_program_num);
+
 	GLint position_attribute_index = glGetAttribLocation(phase->glsl_program_num, "position");
 	GLint texcoord_attribute_index = glGetAttribLocation(phase->glsl_program_num, "texcoord");
 	if (position_attribute_index != -1) {
@@ -625,6 +897,25 @@ void EffectChain::compile_glsl_program(Phase *phase)
 	collect_uniform_locations(phase->glsl_program_num, &phase->uniforms_vec3);
 	collect_uniform_locations(phase->glsl_program_num, &phase->uniforms_vec4);
 	collect_uniform_locations(phase->glsl_program_num, &phase->uniforms_mat3);
+
+	if (phase->has_uniform_block) {
+		// We rely on the block being bound to binding point 0, which is the default.
+		GLuint block_index = glGetUniformBlockIndex(phase->glsl_program_num, "MovitUniforms");
+		check_error();
+		assert(block_index != GL_INVALID_INDEX);
+		glGetActiveUniformBlockiv(phase->glsl_program_num, block_index, GL_UNIFORM_BLOCK_DATA_SIZE, &phase->uniform_block_size);
+		check_error();
+
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_bool);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_int);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_ivec2);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_float);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_vec2);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_vec3);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_vec4);
+		collect_uniform_block_offsets(phase->glsl_program_num, &phase->uniforms_mat3);
+	}
+	phase->program_ready = true;
 }
 
 // Construct GLSL programs, starting at the given effect and following
@@ -643,6 +934,7 @@ Phase *EffectChain::construct_phase(Node *output, map<Node *, Phase *> *complete
 
 	Phase *phase = new Phase;
 	phase->output_node = output;
+	phase->extra_output_num = -1;
 	phase->is_compute_shader = false;
 	phase->compute_shader_node = nullptr;
 
@@ -822,6 +1114,12 @@ Phase *EffectChain::construct_phase(Node *output, map<Node *, Phase *> *complete
 	// We added the effects from the output and back, but we need to output
 	// them in topological sort order in the shader.
 	phase->effects = topological_sort(phase->effects);
+	for (unsigned i = 0; i < phase->effects.size(); ++i) {
+		if (i != 0) {
+			phase->effect_names += ", ";
+		}
+		phase->effect_names += phase->effects[i]->effect->effect_type_id();
+	}
 
 	// Figure out if we need mipmaps or not, and if so, tell the inputs that.
 	// (RTT inputs have different logic, which is checked in execute_phase().)
@@ -842,14 +1140,18 @@ Phase *EffectChain::construct_phase(Node *output, map<Node *, Phase *> *complete
 		phase->effects[i]->containing_phase = phase;
 	}
 
-	// Actually make the shader for this phase.
+	// Actually make the shader for this phase. Note that this does not wait
+	// for the compile to finish, so that the driver can work on all
+	// the phases at the same time; see wait_until_ready().
 	compile_glsl_program(phase);
 
+	phase->output_generation = 0;
+	phase->memoized_texture = 0;
+	phase->num_reused = 0;
+
 	// Initialize timers.
-	if (movit_timer_queries_supported) {
-		phase->time_elapsed_ns = 0;
-		phase->num_measured_iterations = 0;
-	}
+	reset_phase_timing(phase);
+	phase->output_format = GL_NONE;
 
 	assert(completed_effects->count(output) == 0);
 	completed_effects->insert(make_pair(output, phase));
@@ -1556,43 +1858,51 @@ void EffectChain::fix_internal_alpha(unsigned step)
 	}
 }
 
-// Make so that the output is in the desired color space.
+// Make so that the outputs are in the desired color space.
 void EffectChain::fix_output_color_space()
 {
-	Node *output = find_output_node();
-	if (output->output_color_space != output_format.color_space) {
-		Node *conversion = add_node(new ColorspaceConversionEffect());
-		CHECK(conversion->effect->set_int("source_space", output->output_color_space));
-		CHECK(conversion->effect->set_int("destination_space", output_format.color_space));
-		conversion->output_color_space = output_format.color_space;
-		connect_nodes(output, conversion);
-		propagate_alpha();
-		propagate_gamma_and_color_space();
+	for (Node *output : find_all_output_nodes()) {
+		ImageFormat format;
+		OutputAlphaFormat alpha_format;
+		get_output_format(output, &format, &alpha_format);
+		if (output->output_color_space != format.color_space) {
+			Node *conversion = add_node(new ColorspaceConversionEffect());
+			CHECK(conversion->effect->set_int("source_space", output->output_color_space));
+			CHECK(conversion->effect->set_int("destination_space", format.color_space));
+			conversion->output_color_space = format.color_space;
+			connect_nodes(output, conversion);
+			propagate_alpha();
+			propagate_gamma_and_color_space();
+		}
 	}
 }
 
-// Make so that the output is in the desired pre-/postmultiplication alpha state.
+// Make so that the outputs are in the desired pre-/postmultiplication alpha state.
 void EffectChain::fix_output_alpha()
 {
-	Node *output = find_output_node();
-	assert(output->output_alpha_type != ALPHA_INVALID);
-	if (output->output_alpha_type == ALPHA_BLANK) {
-		// No alpha output, so we don't care.
-		return;
-	}
-	if (output->output_alpha_type == ALPHA_PREMULTIPLIED &&
-	    output_alpha_format == OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED) {
-		Node *conversion = add_node(new AlphaDivisionEffect());
-		connect_nodes(output, conversion);
-		propagate_alpha();
-		propagate_gamma_and_color_space();
-	}
-	if (output->output_alpha_type == ALPHA_POSTMULTIPLIED &&
-	    output_alpha_format == OUTPUT_ALPHA_FORMAT_PREMULTIPLIED) {
-		Node *conversion = add_node(new AlphaMultiplicationEffect());
-		connect_nodes(output, conversion);
-		propagate_alpha();
-		propagate_gamma_and_color_space();
+	for (Node *output : find_all_output_nodes()) {
+		ImageFormat format;
+		OutputAlphaFormat alpha_format;
+		get_output_format(output, &format, &alpha_format);
+		assert(output->output_alpha_type != ALPHA_INVALID);
+		if (output->output_alpha_type == ALPHA_BLANK) {
+			// No alpha output, so we don't care.
+			continue;
+		}
+		if (output->output_alpha_type == ALPHA_PREMULTIPLIED &&
+		    alpha_format == OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED) {
+			Node *conversion = add_node(new AlphaDivisionEffect());
+			connect_nodes(output, conversion);
+			propagate_alpha();
+			propagate_gamma_and_color_space();
+		}
+		if (output->output_alpha_type == ALPHA_POSTMULTIPLIED &&
+		    alpha_format == OUTPUT_ALPHA_FORMAT_PREMULTIPLIED) {
+			Node *conversion = add_node(new AlphaMultiplicationEffect());
+			connect_nodes(output, conversion);
+			propagate_alpha();
+			propagate_gamma_and_color_space();
+		}
 	}
 }
 
@@ -1612,9 +1922,13 @@ bool EffectChain::node_needs_gamma_fix(Node *node)
 	// This needs to be before everything else, since it could
 	// even apply to inputs (if they are the only effect).
 	if (node->outgoing_links.empty() &&
-	    node->output_gamma_curve != output_format.gamma_curve &&
 	    node->output_gamma_curve != GAMMA_LINEAR) {
-		return true;
+		ImageFormat format;
+		OutputAlphaFormat alpha_format;
+		get_output_format(node, &format, &alpha_format);
+		if (node->output_gamma_curve != format.gamma_curve) {
+			return true;
+		}
 	}
 
 	if (node->effect->num_inputs() == 0) {
@@ -1750,17 +2064,21 @@ void EffectChain::fix_internal_gamma_by_inserting_nodes(unsigned step)
 	}
 }
 
-// Make so that the output is in the desired gamma.
+// Make so that the outputs are in the desired gamma.
 // Note that this assumes linear input gamma, so it might create the need
 // for another pass of fix_internal_gamma().
 void EffectChain::fix_output_gamma()
 {
-	Node *output = find_output_node();
-	if (output->output_gamma_curve != output_format.gamma_curve) {
-		Node *conversion = add_node(new GammaCompressionEffect());
-		CHECK(conversion->effect->set_int("destination_curve", output_format.gamma_curve));
-		conversion->output_gamma_curve = output_format.gamma_curve;
-		connect_nodes(output, conversion);
+	for (Node *output : find_all_output_nodes()) {
+		ImageFormat format;
+		OutputAlphaFormat alpha_format;
+		get_output_format(output, &format, &alpha_format);
+		if (output->output_gamma_curve != format.gamma_curve) {
+			Node *conversion = add_node(new GammaCompressionEffect());
+			CHECK(conversion->effect->set_int("destination_curve", format.gamma_curve));
+			conversion->output_gamma_curve = format.gamma_curve;
+			connect_nodes(output, conversion);
+		}
 	}
 }
 
@@ -1798,6 +2116,25 @@ void EffectChain::add_dither_if_needed()
 
 namespace {
 
+// The smallest region that contains both <a> and <b>.
+Region union_regions(const Region &a, const Region &b)
+{
+	if (a.empty()) {
+		return b;
+	}
+	if (b.empty()) {
+		return a;
+	}
+	return Region(min(a.x0, b.x0), min(a.y0, b.y0), max(a.x1, b.x1), max(a.y1, b.y1));
+}
+
+// Clip the region to the image itself, ie., [0, 1] in both directions.
+Region clip_region(const Region &region)
+{
+	return Region(max(region.x0, 0.0f), max(region.y0, 0.0f),
+	              min(region.x1, 1.0f), min(region.y1, 1.0f));
+}
+
 // Whether this effect will cause the phase it is in to become a compute shader phase.
 bool induces_compute_shader(Node *node)
 {
@@ -1834,9 +2171,120 @@ void EffectChain::add_dummy_effect_if_needed()
 	}
 }
 
-// Find the output node. This is, simply, one that has no outgoing links.
-// If there are multiple ones, the graph is malformed (we do not support
-// multiple outputs right now).
+vector<vector<Node *>> EffectChain::find_node_runs(function<bool(Node *)> pred)
+{
+	auto in_run = [&pred](Node *node) {
+		return !node->disabled && node->incoming_links.size() == 1 && pred(node);
+	};
+
+	vector<vector<Node *>> runs;
+	for (Node *node : nodes) {
+		if (!in_run(node)) {
+			continue;
+		}
+
+		// Only start at the beginning of a run; intermediate results
+		// that are used by anything else need to stay.
+		Node *sender = node->incoming_links[0];
+		if (in_run(sender) && sender->outgoing_links.size() == 1) {
+			continue;
+		}
+		vector<Node *> run{ node };
+		while (run.back()->outgoing_links.size() == 1 &&
+		       in_run(run.back()->outgoing_links[0])) {
+			run.push_back(run.back()->outgoing_links[0]);
+		}
+		if (run.size() >= 2) {
+			runs.push_back(run);
+		}
+	}
+	return runs;
+}
+
+void EffectChain::fuse_color_matrices()
+{
+	for (const vector<Node *> &run : find_node_runs([](Node *node) { return node->effect->is_color_matrix(); })) {
+		vector<const Effect *> sources;
+		for (Node *source : run) {
+			sources.push_back(source->effect);
+		}
+		Node *fused_node = add_node(new FusedColorMatrixEffect(sources));
+		fused_node->output_color_space = run.back()->output_color_space;
+		fused_node->output_gamma_curve = run.back()->output_gamma_curve;
+		fused_node->output_alpha_type = run.back()->output_alpha_type;
+
+		replace_receiver(run.front(), fused_node);
+		replace_sender(run.back(), fused_node);
+		for (Node *source : run) {
+			source->incoming_links.clear();
+			source->outgoing_links.clear();
+			source->disabled = true;
+		}
+	}
+}
+
+void EffectChain::replace_color_functions_with_luts()
+{
+	if (color_lut_size == 0) {
+		return;
+	}
+	for (const vector<Node *> &run : find_node_runs([](Node *node) { return node->effect->is_color_function(); })) {
+		// The LUT only makes sense if the functions really only depend
+		// on RGB, and not alpha.
+		Node *sender = run.front()->incoming_links[0];
+		if (sender->output_alpha_type != ALPHA_BLANK) {
+			continue;
+		}
+
+		ColorLUTEffect *lut_effect = new ColorLUTEffect(color_lut_size);
+		Node *lut_node = add_node(lut_effect);
+		lut_node->output_color_space = run.back()->output_color_space;
+		lut_node->output_gamma_curve = run.back()->output_gamma_curve;
+		lut_node->output_alpha_type = run.back()->output_alpha_type;
+		replace_receiver(run.front(), lut_node);
+		replace_sender(run.back(), lut_node);
+
+		// Hook the run up to a lattice input instead, so that we can render
+		// it into the LUT. All of these are disabled, so that they are not
+		// part of the normal graph. (The links within the run stay.)
+		Node *lattice_node = add_node(new ColorLUTLatticeInput(
+			color_lut_size, sender->output_color_space, sender->output_gamma_curve));
+		lattice_node->output_color_space = sender->output_color_space;
+		lattice_node->output_gamma_curve = sender->output_gamma_curve;
+		lattice_node->output_alpha_type = ALPHA_BLANK;
+		connect_nodes(lattice_node, run.front());
+		lattice_node->disabled = true;
+		for (Node *node : run) {
+			node->disabled = true;
+		}
+
+		ColorLUTBake bake;
+		bake.lut_effect = lut_effect;
+		bake.output_node = run.back();
+		bake.phase = nullptr;
+		bake.texnum = 0;
+		color_lut_bakes.push_back(bake);
+	}
+}
+
+void EffectChain::construct_color_lut_bake_phases()
+{
+	for (ColorLUTBake &bake : color_lut_bakes) {
+		// Since all the effects have strong one-to-one sampling
+		// and the input is not a texture, this is always a single phase.
+		map<Node *, Phase *> completed_effects;
+		const size_t num_phases = phases.size();
+		bake.phase = construct_phase(bake.output_node, &completed_effects);
+		assert(phases.size() == num_phases + 1);
+		assert(phases.back() == bake.phase);
+		assert(bake.phase->inputs.empty());
+		phases.pop_back();
+	}
+}
+
+// Find the output node. This is, simply, one that has no outgoing links
+// (and is not the end of an extra output; see add_extra_output()).
+// If there are multiple ones, the graph is malformed.
 Node *EffectChain::find_output_node()
 {
 	vector<Node *> output_nodes;
@@ -1845,7 +2293,7 @@ Node *EffectChain::find_output_node()
 		if (node->disabled) {
 			continue;
 		}
-		if (node->outgoing_links.empty()) {
+		if (node->outgoing_links.empty() && find_extra_output_num(node) == -1) {
 			output_nodes.push_back(node);
 		}
 	}
@@ -1853,11 +2301,82 @@ Node *EffectChain::find_output_node()
 	return output_nodes[0];
 }
 
+void EffectChain::add_extra_output_nodes()
+{
+	if (extra_outputs.empty()) {
+		return;
+	}
+	Node *main_output = find_output_node();
+	for (unsigned i = 0; i < extra_outputs.size(); ++i) {
+		Node *tap = add_node(new OutputTapEffect(i));
+		connect_nodes(find_node_for_effect(extra_outputs[i].effect), tap);
+	}
+
+	// If the main output is also used for an extra output, it is no longer
+	// at the end of the graph, so it needs a node to end in, too. (It will
+	// end up in a phase of its own, since its output needs to go into
+	// a texture for the extra output to read.)
+	if (!main_output->outgoing_links.empty()) {
+		Node *tap = add_node(new OutputTapEffect(-1));
+		connect_nodes(main_output, tap);
+	}
+}
+
+int EffectChain::find_extra_output_num(Node *output)
+{
+	// Everything between the tap and the end of the output has been
+	// added by us, and is in a straight line.
+	for (Node *node = output; ; node = node->incoming_links[0]) {
+		if (node->effect->effect_type_id() == "OutputTapEffect") {
+			return static_cast<OutputTapEffect *>(node->effect)->extra_output_num;
+		}
+		if (node->incoming_links.size() != 1) {
+			return -1;
+		}
+	}
+}
+
+vector<Node *> EffectChain::find_all_output_nodes()
+{
+	vector<Node *> output_nodes(extra_outputs.size() + 1, nullptr);
+	output_nodes[0] = find_output_node();
+	for (Node *node : nodes) {
+		if (node->disabled || !node->outgoing_links.empty()) {
+			continue;
+		}
+		int extra_output_num = find_extra_output_num(node);
+		if (extra_output_num != -1) {
+			assert(output_nodes[extra_output_num + 1] == nullptr);
+			output_nodes[extra_output_num + 1] = node;
+		}
+	}
+	for (Node *node : output_nodes) {
+		assert(node != nullptr);
+	}
+	return output_nodes;
+}
+
+void EffectChain::get_output_format(Node *output, ImageFormat *format, OutputAlphaFormat *alpha_format)
+{
+	int extra_output_num = find_extra_output_num(output);
+	if (extra_output_num == -1) {
+		*format = output_format;
+		*alpha_format = output_alpha_format;
+	} else {
+		*format = extra_outputs[extra_output_num].format;
+		*alpha_format = extra_outputs[extra_output_num].alpha_format;
+	}
+}
+
 void EffectChain::finalize()
 {
 	// Output the graph as it is before we do any conversions on it.
 	output_dot("step0-start.dot");
 
+	// This needs to come before the effects rewrite the graph,
+	// so that the extra outputs follow along if they are rewritten.
+	add_extra_output_nodes();
+
 	// Give each effect in turn a chance to rewrite its own part of the graph.
 	// Note that if more effects are added as part of this, they will be
 	// picked up as part of the same for loop, since they are added at the end.
@@ -1905,6 +2424,11 @@ void EffectChain::finalize()
 	output_dot("step18-before-dither.dot");
 	add_dither_if_needed();
 
+	// This needs to come after all the conversions have been inserted,
+	// since they can make for longer runs.
+	fuse_color_matrices();
+	replace_color_functions_with_luts();
+
 	output_dot("step19-before-dummy-effect.dot");
 	add_dummy_effect_if_needed();
 
@@ -1935,120 +2459,616 @@ void EffectChain::finalize()
 
 	output_dot("step22-dummy-phase-removal.dot");
 
+	// Now the extra outputs, if any. Whatever they share with the main output
+	// (or each other) is already in <completed_effects>, so it is only
+	// computed once.
+	vector<Node *> output_nodes = find_all_output_nodes();
+	for (unsigned i = 1; i < output_nodes.size(); ++i) {
+		Phase *phase = construct_phase(output_nodes[i], &completed_effects);
+		assert(!phase->is_compute_shader);
+		phase->extra_output_num = i - 1;
+	}
+
+	plan_phase_order();
+	construct_color_lut_bake_phases();
+
 	assert(phases[0]->inputs.empty());
 	
 	finalized = true;
+
+	if (!asynchronous_compilation) {
+		wait_until_ready();
+	}
 }
 
-void EffectChain::render_to_fbo(GLuint dest_fbo, unsigned width, unsigned height)
+unsigned EffectChain::estimate_textures_needed(Phase *phase, map<Phase *, unsigned> *textures_needed)
 {
-	// Save original viewport.
-	GLuint x = 0, y = 0;
+	if (textures_needed->count(phase)) {
+		return (*textures_needed)[phase];
+	}
 
-	if (width == 0 && height == 0) {
-		GLint viewport[4];
-		glGetIntegerv(GL_VIEWPORT, viewport);
-		x = viewport[0];
-		y = viewport[1];
-		width = viewport[2];
-		height = viewport[3];
+	// This is the classic Sethi-Ullman numbering for expression trees:
+	// If we evaluate the inputs in order of decreasing cost, input number i
+	// (counting from zero) needs its own cost plus the i textures holding
+	// the outputs of the inputs we have already computed. Finally, we need
+	// all the inputs plus our own output at the same time. Our graphs are
+	// DAGs and not trees (shared inputs are counted once per user), so this
+	// is only a heuristic, but it is exact for the common tree-like cases.
+	vector<unsigned> input_costs;
+	for (Phase *input : phase->inputs) {
+		input_costs.push_back(estimate_textures_needed(input, textures_needed));
 	}
+	sort(input_costs.begin(), input_costs.end(), greater<unsigned>());
 
-	render(dest_fbo, {}, x, y, width, height);
+	unsigned cost = phase->inputs.size() + 1;
+	for (unsigned i = 0; i < input_costs.size(); ++i) {
+		cost = max(cost, input_costs[i] + i);
+	}
+	textures_needed->insert(make_pair(phase, cost));
+	return cost;
 }
 
-void EffectChain::render_to_texture(const vector<DestinationTexture> &destinations, unsigned width, unsigned height)
+void EffectChain::plan_phase_order_visit(Phase *phase, const map<Phase *, unsigned> &textures_needed,
+                                         set<Phase *> *visited, vector<Phase *> *ordered_phases)
 {
-	assert(finalized);
-	assert(!destinations.empty());
+	if (visited->count(phase)) {
+		return;
+	}
+	visited->insert(phase);
 
-	if (!has_dummy_effect) {
-		// We don't end in a compute shader, so there's nothing specific for us to do.
-		// Create an FBO for this set of textures, and just render to that.
-		GLuint texnums[4] = { 0, 0, 0, 0 };
-		for (unsigned i = 0; i < destinations.size() && i < 4; ++i) {
-			texnums[i] = destinations[i].texnum;
+	// Visit the most expensive inputs first (stable, so that ties
+	// keep the original order).
+	vector<Phase *> inputs = phase->inputs;
+	stable_sort(inputs.begin(), inputs.end(), [&textures_needed](Phase *a, Phase *b) {
+		return textures_needed.find(a)->second > textures_needed.find(b)->second;
+	});
+	for (Phase *input : inputs) {
+		plan_phase_order_visit(input, textures_needed, visited, ordered_phases);
+	}
+	ordered_phases->push_back(phase);
+}
+
+void EffectChain::plan_phase_order()
+{
+	// construct_phase() gives us a valid order already, but it is simply
+	// the order of a depth-first search, which can keep many more outputs
+	// alive than needed on wide graphs (e.g. many overlays, each with their
+	// own blur). Note that the main output's phase stays last of the phases
+	// it needs, since they are all inputs to it; in particular, the dummy
+	// phase (if any) stays there, with the compute shader phase right before
+	// it. Whatever is only needed for extra outputs comes after that,
+	// so that it can be skipped if only the main output is rendered.
+	vector<Phase *> output_phases;  // The main output first.
+	for (Node *output : find_all_output_nodes()) {
+		auto it = find_if(phases.begin(), phases.end(), [output](Phase *phase) {
+			return phase->output_node == output;
+		});
+		assert(it != phases.end());
+		output_phases.push_back(*it);
+	}
+
+	map<Phase *, unsigned> textures_needed;
+	for (Phase *phase : output_phases) {
+		estimate_textures_needed(phase, &textures_needed);
+	}
+
+	set<Phase *> visited;
+	vector<Phase *> ordered_phases;
+	for (Phase *phase : output_phases) {
+		plan_phase_order_visit(phase, textures_needed, &visited, &ordered_phases);
+		if (phase == output_phases[0]) {
+			num_main_phases = ordered_phases.size();
+		}
+	}
+	assert(ordered_phases.size() == phases.size());
+	phases = ordered_phases;
+
+	// Now find out where each output is used for the last time.
+	for (unsigned phase_num = 0; phase_num < phases.size(); ++phase_num) {
+		phases[phase_num]->output_last_used = phase_num;
+		for (Phase *input : phases[phase_num]->inputs) {
+			input->output_last_used = phase_num;  // We are going in order, so this is the highest.
 		}
-		GLuint dest_fbo = resource_pool->create_fbo(texnums[0], texnums[1], texnums[2], texnums[3]);
-		render(dest_fbo, {}, 0, 0, width, height);
-		resource_pool->release_fbo(dest_fbo);
-	} else {
-		render((GLuint)-1, destinations, 0, 0, width, height);
 	}
 }
 
-void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &destinations, unsigned x, unsigned y, unsigned width, unsigned height)
+GLuint EffectChain::get_intermediate_texture(Phase *phase, unsigned phase_num, vector<int> *texture_free_after)
 {
-	assert(finalized);
-	assert(destinations.size() <= 1);
+	// A simple linear scan, like a register allocator would do:
+	// Give the phase the first texture of the right size whose previous
+	// user is no longer needed, or a new one if there is none. An output
+	// is alive from the phase that renders it up to and including the last
+	// phase that reads it, so a phase will never render into the same
+	// texture as one of its inputs. Since this is deterministic, we will
+	// find the same textures as last frame unless the sizes have changed.
+	for (unsigned i = 0; i < intermediate_textures.size(); ++i) {
+		if ((*texture_free_after)[i] < int(phase_num) &&
+		    intermediate_textures[i].width == phase->output_width &&
+		    intermediate_textures[i].height == phase->output_height) {
+			(*texture_free_after)[i] = phase->output_last_used;
+			return intermediate_textures[i].texnum;
+		}
+	}
+
+	IntermediateTexture texture;
+	texture.texnum = resource_pool->create_2d_texture(intermediate_format, phase->output_width, phase->output_height);
+	texture.width = phase->output_width;
+	texture.height = phase->output_height;
+	intermediate_textures.push_back(texture);
+	texture_free_after->push_back(phase->output_last_used);
+	peak_intermediate_bytes += ResourcePool::estimate_texture_size(intermediate_format, texture.width, texture.height);
+	return texture.texnum;
+}
 
-	// This needs to be set anew, in case we are coming from a different context
-	// from when we initialized.
-	check_error();
-	glDisable(GL_DITHER);
-	check_error();
+void EffectChain::release_unused_intermediate_textures(const vector<int> &texture_free_after)
+{
+	assert(texture_free_after.size() == intermediate_textures.size());
+	vector<IntermediateTexture> used_textures;
+	for (unsigned i = 0; i < intermediate_textures.size(); ++i) {
+		const IntermediateTexture &texture = intermediate_textures[i];
+		if (texture_free_after[i] == -1) {
+			rtt_sampler_states.erase(texture.texnum);
+			resource_pool->release_2d_texture(texture.texnum);
+			peak_intermediate_bytes -= ResourcePool::estimate_texture_size(intermediate_format, texture.width, texture.height);
+		} else {
+			used_textures.push_back(texture);
+		}
+	}
+	swap(intermediate_textures, used_textures);
+}
 
-	const bool final_srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
-	check_error();
-	bool current_srgb = final_srgb;
+void EffectChain::release_intermediate_textures()
+{
+	for (const IntermediateTexture &texture : intermediate_textures) {
+		resource_pool->release_2d_texture(texture.texnum);
+	}
+	intermediate_textures.clear();
+	rtt_sampler_states.clear();
+	peak_intermediate_bytes = 0;
+}
 
-	// Basic state.
-	check_error();
-	glDisable(GL_BLEND);
-	check_error();
-	glDisable(GL_DEPTH_TEST);
-	check_error();
-	glDepthMask(GL_FALSE);
-	check_error();
+GLuint EffectChain::get_memoized_texture(Phase *phase, bool can_memoize, bool *reused)
+{
+	*reused = false;
+	if (!do_phase_memoization) {
+		release_memoized_texture(phase);
+		return 0;
+	}
+
+	vector<unsigned> signature;
+	signature.reserve(phase->effects.size() + phase->inputs.size() + 2);
+	for (Node *node : phase->effects) {
+		signature.push_back(node->effect->get_generation());
+	}
+	for (Phase *input : phase->inputs) {
+		signature.push_back(input->output_generation);
+	}
+	signature.push_back(phase->output_width);
+	signature.push_back(phase->output_height);
+
+	if (signature != phase->memo_signature) {
+		// Something changed, so we need to render, and whatever we had
+		// is now useless. We don't try to keep the new output, since
+		// many things change every frame; if the phase is still unchanged
+		// next frame, we render it once more into a texture of its own.
+		release_memoized_texture(phase);
+		phase->memo_signature = move(signature);
+		++phase->output_generation;
+		return 0;
+	}
+	if (phase->memoized_texture != 0) {
+		*reused = true;
+		return phase->memoized_texture;
+	}
+	if (!can_memoize) {
+		return 0;
+	}
+	phase->memoized_texture = resource_pool->create_2d_texture(intermediate_format, phase->output_width, phase->output_height);
+	return phase->memoized_texture;
+}
 
-	set<Phase *> generated_mipmaps;
+void EffectChain::release_memoized_texture(Phase *phase)
+{
+	if (phase->memoized_texture != 0) {
+		rtt_sampler_states.erase(phase->memoized_texture);
+		resource_pool->release_2d_texture(phase->memoized_texture);
+		phase->memoized_texture = 0;
+	}
+}
 
-	// We keep one texture per output, but only for as long as we actually have any
-	// phases that need it as an input. (We don't make any effort to reorder phases
-	// to minimize the number of textures in play, as register allocation can be
-	// complicated and we rarely have much to gain, since our graphs are typically
-	// pretty linear.)
-	map<Phase *, GLuint> output_textures;
-	map<Phase *, int> ref_counts;
+bool EffectChain::is_ready()
+{
+	assert(finalized);
+	vector<Phase *> all_phases = phases;
+	for (const ColorLUTBake &bake : color_lut_bakes) {
+		all_phases.push_back(bake.phase);
+	}
+	for (Phase *phase : all_phases) {
+		if (phase->program_ready) {
+			continue;
+		}
+		if (!resource_pool->is_glsl_program_ready(phase->glsl_program_num)) {
+			return false;
+		}
+		// This won't block, so we might as well do it right away.
+		finish_glsl_program(phase);
+	}
+	return true;
+}
+
+void EffectChain::wait_until_ready()
+{
+	assert(finalized);
 	for (Phase *phase : phases) {
-		for (Phase *input : phase->inputs) {
-			++ref_counts[input];
+		if (!phase->program_ready) {
+			finish_glsl_program(phase);
 		}
 	}
+	for (const ColorLUTBake &bake : color_lut_bakes) {
+		if (!bake.phase->program_ready) {
+			finish_glsl_program(bake.phase);
+		}
+	}
+}
+
+void EffectChain::render_to_fbo(GLuint dest_fbo, unsigned width, unsigned height)
+{
+	// Save original viewport.
+	GLuint x = 0, y = 0;
 
-	size_t num_phases = phases.size();
+	if (width == 0 && height == 0) {
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		x = viewport[0];
+		y = viewport[1];
+		width = viewport[2];
+		height = viewport[3];
+	}
+
+	render(dest_fbo, {}, {}, x, y, width, height);
+}
+
+void EffectChain::render_region_to_fbo(GLuint dest_fbo, unsigned width, unsigned height,
+                                      unsigned region_x, unsigned region_y,
+                                      unsigned region_width, unsigned region_height)
+{
+	assert(region_x + region_width <= width);
+	assert(region_y + region_height <= height);
+
+	// Convert to the texture coordinates of the last phase,
+	// which are flipped if the output origin is top-left.
+	Region region;
+	region.x0 = float(region_x) / width;
+	region.x1 = float(region_x + region_width) / width;
+	if (output_origin == OUTPUT_ORIGIN_TOP_LEFT) {
+		region.y0 = 1.0f - float(region_y + region_height) / height;
+		region.y1 = 1.0f - float(region_y) / height;
+	} else {
+		region.y0 = float(region_y) / height;
+		region.y1 = float(region_y + region_height) / height;
+	}
+
+	render(dest_fbo, {}, {}, 0, 0, width, height, &region);
+}
+
+void EffectChain::render_to_texture(const vector<DestinationTexture> &destinations, unsigned width, unsigned height)
+{
+	assert(finalized);
+	assert(destinations.size() > extra_outputs.size());
+
+	// The extra outputs (if any) come last.
+	const size_t num_main_destinations = destinations.size() - extra_outputs.size();
+	const vector<DestinationTexture> main_destinations(destinations.begin(), destinations.begin() + num_main_destinations);
+	const vector<DestinationTexture> extra_destinations(destinations.begin() + num_main_destinations, destinations.end());
+
+	if (!has_dummy_effect) {
+		// We don't end in a compute shader, so there's nothing specific for us to do.
+		// Create an FBO for this set of textures, and just render to that.
+		GLuint texnums[4] = { 0, 0, 0, 0 };
+		for (unsigned i = 0; i < main_destinations.size() && i < 4; ++i) {
+			texnums[i] = main_destinations[i].texnum;
+		}
+		GLuint dest_fbo = resource_pool->create_fbo(texnums[0], texnums[1], texnums[2], texnums[3]);
+		render(dest_fbo, {}, extra_destinations, 0, 0, width, height);
+		resource_pool->release_fbo(dest_fbo);
+	} else {
+		render((GLuint)-1, main_destinations, extra_destinations, 0, 0, width, height);
+	}
+}
+
+void EffectChain::set_readback_ring_size(unsigned num_buffers)
+{
+	assert(num_buffers >= 1);
+	assert(readback_buffers.empty());
+	readback_ring_size = num_buffers;
+}
+
+EffectChain::ReadbackTicket EffectChain::render_to_readback(GLenum internal_format, unsigned width, unsigned height, GLenum format, GLenum type)
+{
+	assert(finalized);
+	assert(extra_outputs.empty());
+	assert(width > 0 && height > 0);
+
+	if (readback_buffers.empty()) {
+		readback_buffers.resize(readback_ring_size);
+	}
+
+	// Go through the ring in order, so that the buffer we pick is normally
+	// the one that has been free the longest. If the user has not released
+	// an old frame yet, we skip past it.
+	ReadbackBuffer *buffer = nullptr;
+	for (unsigned i = 0; i < readback_ring_size; ++i) {
+		unsigned buffer_num = (next_readback_buffer + i) % readback_ring_size;
+		if (readback_buffers[buffer_num].ticket == 0) {
+			buffer = &readback_buffers[buffer_num];
+			next_readback_buffer = (buffer_num + 1) % readback_ring_size;
+			break;
+		}
+	}
+	// If this triggers, too many tickets have not been released;
+	// see set_readback_ring_size().
+	assert(buffer != nullptr);
+
+	// Render the chain. The texture can go back to the pool as soon as
+	// the glReadPixels() call has been issued; OpenGL makes sure that
+	// the read sees the texture as it was at that point.
+	GLuint texnum = resource_pool->create_2d_texture(internal_format, width, height);
+	render_to_texture({{texnum, internal_format}}, width, height);
+
+	buffer->num_bytes = size_t(width) * height * bytes_per_pixel_for_readback(format, type);
+	if (buffer->pbo == 0) {
+		glGenBuffers(1, &buffer->pbo);
+		check_error();
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer->pbo);
+	check_error();
+	if (buffer->allocated_bytes < buffer->num_bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, buffer->num_bytes, nullptr, GL_STREAM_READ);
+		check_error();
+		buffer->allocated_bytes = buffer->num_bytes;
+	}
+
+	GLuint fbo = resource_pool->create_fbo(texnum);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	check_error();
+
+	GLint old_pack_alignment;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &old_pack_alignment);
+	check_error();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	check_error();
+	glReadPixels(0, 0, width, height, format, type, BUFFER_OFFSET(0));
+	check_error();
+	glPixelStorei(GL_PACK_ALIGNMENT, old_pack_alignment);
+	check_error();
+
+	// Flush, so that the fence is guaranteed to signal eventually
+	// even if the user only polls it with is_readback_ready().
+	buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	check_error();
+	glFlush();
+	check_error();
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	check_error();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	check_error();
+	resource_pool->release_fbo(fbo);
+	resource_pool->release_2d_texture(texnum);
+
+	buffer->ticket = next_readback_ticket++;
+	return buffer->ticket;
+}
+
+EffectChain::ReadbackBuffer *EffectChain::find_readback_buffer(ReadbackTicket ticket)
+{
+	for (ReadbackBuffer &buffer : readback_buffers) {
+		if (ticket != 0 && buffer.ticket == ticket) {
+			return &buffer;
+		}
+	}
+	assert(false);  // Unknown or already released ticket.
+	return nullptr;
+}
+
+void EffectChain::wait_for_readback_fence(ReadbackBuffer *buffer, bool block)
+{
+	if (buffer->fence == nullptr) {
+		return;
+	}
+	GLenum ret;
+	do {
+		ret = glClientWaitSync(buffer->fence, 0, block ? 1000000000 : 0);  // 1 second.
+		check_error();
+	} while (block && ret == GL_TIMEOUT_EXPIRED);
+	assert(ret != GL_WAIT_FAILED);
+	if (ret == GL_ALREADY_SIGNALED || ret == GL_CONDITION_SATISFIED) {
+		glDeleteSync(buffer->fence);
+		check_error();
+		buffer->fence = nullptr;
+	}
+}
+
+bool EffectChain::is_readback_ready(ReadbackTicket ticket)
+{
+	ReadbackBuffer *buffer = find_readback_buffer(ticket);
+	wait_for_readback_fence(buffer, /*block=*/false);
+	return buffer->fence == nullptr;
+}
+
+const void *EffectChain::map_readback(ReadbackTicket ticket)
+{
+	ReadbackBuffer *buffer = find_readback_buffer(ticket);
+	if (buffer->mapped != nullptr) {
+		return buffer->mapped;
+	}
+	wait_for_readback_fence(buffer, /*block=*/true);
+
+	// Since the fence has signaled, this should not need to wait
+	// for the GPU; with most drivers, the pointer goes straight
+	// to the memory the GPU wrote into.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer->pbo);
+	check_error();
+	buffer->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, buffer->num_bytes, GL_MAP_READ_BIT);
+	check_error();
+	assert(buffer->mapped != nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	check_error();
+	return buffer->mapped;
+}
+
+void EffectChain::release_readback(ReadbackTicket ticket)
+{
+	ReadbackBuffer *buffer = find_readback_buffer(ticket);
+	if (buffer->fence != nullptr) {
+		// Released without ever being looked at; the GPU might still
+		// be writing into the buffer, but that's fine, since the next
+		// glReadPixels() into it will be ordered after this one.
+		glDeleteSync(buffer->fence);
+		check_error();
+		buffer->fence = nullptr;
+	}
+	if (buffer->mapped != nullptr) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer->pbo);
+		check_error();
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		check_error();
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		check_error();
+		buffer->mapped = nullptr;
+	}
+	buffer->ticket = 0;
+}
+
+void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &destinations,
+                         const vector<DestinationTexture> &extra_destinations,
+                         unsigned x, unsigned y, unsigned width, unsigned height,
+                         const Region *output_region)
+{
+	assert(finalized);
+	assert(destinations.size() <= 1);
+	assert(extra_destinations.empty() || extra_destinations.size() == extra_outputs.size());
+	assert(extra_destinations.empty() || output_region == nullptr);
+
+	// In case asynchronous compilation is not done yet.
+	wait_until_ready();
+
+	if (!uniform_buffer_allocated) {
+		allocate_uniform_buffer();
+	}
+	begin_uniform_buffer_frame();
+	num_elided_gl_calls = 0;
+
+	// This needs to be set anew, in case we are coming from a different context
+	// from when we initialized.
+	check_error();
+	glDisable(GL_DITHER);
+	check_error();
+
+	const bool final_srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	check_error();
+	bool current_srgb = final_srgb;
+
+	// Basic state.
+	check_error();
+	glDisable(GL_BLEND);
+	check_error();
+	glDisable(GL_DEPTH_TEST);
+	check_error();
+	glDepthMask(GL_FALSE);
+	check_error();
+
+	// Any LUTs need to be up-to-date before the phases that use them.
+	for (ColorLUTBake &bake : color_lut_bakes) {
+		bake_color_lut(&bake);
+	}
+
+	set<Phase *> generated_mipmaps;
+
+	// Phase outputs go into the intermediate textures assigned by
+	// get_intermediate_texture(); several phases can share the same
+	// texture, as long as they are not needed at the same time.
+	map<Phase *, GLuint> output_textures;
+
+	// The phase that renders the main output. The phases after that
+	// are only needed for the extra outputs (see plan_phase_order()).
+	unsigned main_output_phase_num = num_main_phases - 1;
 	if (destinations.empty()) {
 		assert(dest_fbo != (GLuint)-1);
 	} else {
 		assert(has_dummy_effect);
 		assert(x == 0);
 		assert(y == 0);
-		assert(num_phases >= 2);
-		assert(!phases.back()->is_compute_shader);
-		assert(phases[phases.size() - 2]->is_compute_shader);
-		assert(phases.back()->effects.size() == 1);
-		assert(phases.back()->effects[0]->effect->effect_type_id() == "ComputeShaderOutputDisplayEffect");
+		assert(num_main_phases >= 2);
+		assert(!phases[num_main_phases - 1]->is_compute_shader);
+		assert(phases[num_main_phases - 2]->is_compute_shader);
+		assert(phases[num_main_phases - 1]->effects.size() == 1);
+		assert(phases[num_main_phases - 1]->effects[0]->effect->effect_type_id() == "ComputeShaderOutputDisplayEffect");
 
 		// We are rendering to a set of textures, so we can run the compute shader
 		// directly and skip the dummy phase.
-		--num_phases;
+		--main_output_phase_num;
+	}
+	const size_t num_phases = extra_destinations.empty() ? main_output_phase_num + 1 : phases.size();
+
+	// For each of our intermediate textures, the last phase (this frame)
+	// that needs its current contents, or -1 if it has not been used yet.
+	vector<int> texture_free_after(intermediate_textures.size(), -1);
+
+	if (output_region != nullptr) {
+		// We need to know the sizes of all phases up-front,
+		// so that we can convert between texels and normalized coordinates.
+		for (unsigned phase_num = 0; phase_num < num_phases; ++phase_num) {
+			inform_input_sizes(phases[phase_num]);
+			find_output_size(phases[phase_num]);
+		}
+		compute_needed_regions(*output_region, num_phases);
+		glEnable(GL_SCISSOR_TEST);
+		check_error();
 	}
 
 	for (unsigned phase_num = 0; phase_num < num_phases; ++phase_num) {
+		if (phase_num > main_output_phase_num && phase_num < num_main_phases) {
+			// The dummy phase, which we skip (see above).
+			continue;
+		}
 		Phase *phase = phases[phase_num];
+		bool last_phase = (phase_num == main_output_phase_num);
+		bool extra_output_phase = (phase->extra_output_num != -1);
+
+		// See if we can skip this phase entirely (see enable_phase_memoization()).
+		inform_input_sizes(phase);
+		find_output_size(phase);
+		GLuint memoized_texture = 0;
+		if (!last_phase && !extra_output_phase) {
+			bool reused;
+			memoized_texture = get_memoized_texture(phase, output_region == nullptr, &reused);
+			if (reused) {
+				output_textures[phase] = memoized_texture;
+				++phase->num_reused;
+				continue;
+			}
+		}
+
+		if (do_debug_labels) {
+			const string group_name = truncate_debug_string(
+				"Movit phase " + to_string(phase_num) + " [" + phase->effect_names + "]",
+				movit_max_debug_message_length);
+			glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, phase_num, -1, group_name.c_str());
+			check_error();
+		}
 
+		Phase::RunningTimerQuery timer_query;
 		if (do_phase_timing) {
-			GLuint timer_query_object;
 			if (phase->timer_query_objects_free.empty()) {
-				glGenQueries(1, &timer_query_object);
+				glGenQueries(1, &timer_query.query_object);
 			} else {
-				timer_query_object = phase->timer_query_objects_free.front();
+				timer_query.query_object = phase->timer_query_objects_free.front();
 				phase->timer_query_objects_free.pop_front();
 			}
-			glBeginQuery(GL_TIME_ELAPSED, timer_query_object);
-			phase->timer_query_objects_running.push_back(timer_query_object);
+			timer_query.cpu_start_ns = steady_clock_ns();
+			glBeginQuery(GL_TIME_ELAPSED, timer_query.query_object);
 		}
-		bool last_phase = (phase_num == num_phases - 1);
 		if (last_phase) {
 			// Last phase goes to the output the user specified.
 			if (!phase->is_compute_shader) {
@@ -2065,10 +3085,20 @@ void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &dest
 			}
 		}
 
+		// Extra outputs go to their own textures, at the same size as the main output.
+		GLuint extra_output_fbo = 0;
+		if (extra_output_phase) {
+			extra_output_fbo = resource_pool->create_fbo(extra_destinations[phase->extra_output_num].texnum);
+			glBindFramebuffer(GL_FRAMEBUFFER, extra_output_fbo);
+			check_error();
+			glViewport(0, 0, width, height);
+			check_error();
+		}
+
 		// Enable sRGB rendering for intermediates in case we are
 		// rendering to an sRGB format.
 		// TODO: Support this for compute shaders.
-		bool needs_srgb = last_phase ? final_srgb : true;
+		bool needs_srgb = (last_phase || extra_output_phase) ? final_srgb : true;
 		if (needs_srgb && !current_srgb) {
 			glEnable(GL_FRAMEBUFFER_SRGB);
 			check_error();
@@ -2080,45 +3110,95 @@ void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &dest
 		}
 
 		// Find a texture for this phase.
-		inform_input_sizes(phase);
-		find_output_size(phase);
 		vector<DestinationTexture> phase_destinations;
-		if (!last_phase) {
-			GLuint tex_num = resource_pool->create_2d_texture(intermediate_format, phase->output_width, phase->output_height);
-			output_textures.insert(make_pair(phase, tex_num));
+		if (!last_phase && !extra_output_phase) {
+			GLuint tex_num = memoized_texture;
+			if (tex_num == 0) {
+				tex_num = get_intermediate_texture(phase, phase_num, &texture_free_after);
+			}
+			output_textures[phase] = tex_num;
 			phase_destinations.push_back(DestinationTexture{ tex_num, intermediate_format });
+			phase->output_format = intermediate_format;
+			if (do_debug_labels) {
+				// Intermediate textures are reused between phases,
+				// so this needs to be set anew every frame.
+				const string label = truncate_debug_string(
+					"Movit output of [" + phase->effect_names + "]", movit_max_label_length);
+				glObjectLabel(GL_TEXTURE, tex_num, -1, label.c_str());
+				check_error();
+			}
 
 			// The output texture needs to have valid state to be written to by a compute shader.
-			glActiveTexture(GL_TEXTURE0);
-			check_error();
-			glBindTexture(GL_TEXTURE_2D, tex_num);
-			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			check_error();
+			// This is only a problem if the last reader wanted mipmaps (or if we don't
+			// know who the last reader was); if so, it will need to set up the sampler
+			// state again.
+			const auto state_it = rtt_sampler_states.find(tex_num);
+			if (state_it == rtt_sampler_states.end() || state_it->second.use_mipmaps) {
+				glActiveTexture(GL_TEXTURE0);
+				check_error();
+				glBindTexture(GL_TEXTURE_2D, tex_num);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				check_error();
+				if (state_it != rtt_sampler_states.end()) {
+					rtt_sampler_states.erase(state_it);
+				}
+			} else {
+				num_elided_gl_calls += 3;
+			}
 		} else if (phase->is_compute_shader) {
 			assert(!destinations.empty());
 			phase_destinations = destinations;
+			phase->output_format = destinations[0].format;
+		} else if (extra_output_phase) {
+			phase->output_format = extra_destinations[phase->extra_output_num].format;
+		} else {
+			phase->output_format = GL_NONE;
+		}
+
+		if (output_region != nullptr) {
+			if (last_phase) {
+				// Back to pixels on the output (see render_region_to_fbo()).
+				float y0 = output_region->y0, y1 = output_region->y1;
+				if (output_origin == OUTPUT_ORIGIN_TOP_LEFT) {
+					y0 = 1.0f - output_region->y1;
+					y1 = 1.0f - output_region->y0;
+				}
+				glScissor(x + lrintf(output_region->x0 * width), y + lrintf(y0 * height),
+				          lrintf((output_region->x1 - output_region->x0) * width),
+				          lrintf((y1 - y0) * height));
+				check_error();
+			} else {
+				set_scissor_for_phase(phase);
+			}
 		}
 
 		execute_phase(phase, output_textures, phase_destinations, &generated_mipmaps);
+		if (extra_output_fbo != 0) {
+			resource_pool->release_fbo(extra_output_fbo);
+		}
 		if (do_phase_timing) {
 			glEndQuery(GL_TIME_ELAPSED);
+			timer_query.cpu_end_ns = steady_clock_ns();
+			phase->timer_query_objects_running.push_back(timer_query);
 		}
-
-		// Drop any input textures we don't need anymore.
-		for (Phase *input : phase->inputs) {
-			assert(ref_counts[input] > 0);
-			if (--ref_counts[input] == 0) {
-				resource_pool->release_2d_texture(output_textures[input]);
-				output_textures.erase(input);
-			}
+		if (do_debug_labels) {
+			glPopDebugGroup();
+			check_error();
 		}
 	}
 
-	for (const auto &phase_and_texnum : output_textures) {
-		resource_pool->release_2d_texture(phase_and_texnum.second);
+	if (output_region != nullptr) {
+		glDisable(GL_SCISSOR_TEST);
+		check_error();
 	}
 
+	// Give back any textures we didn't need this time
+	// (e.g. because the input sizes changed).
+	release_unused_intermediate_textures(texture_free_after);
+
+	end_uniform_buffer_frame();
+
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	check_error();
 	glUseProgram(0);
@@ -2135,14 +3215,34 @@ void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &dest
 			Phase *phase = phases[phase_num];
 			for (auto timer_it = phase->timer_query_objects_running.cbegin();
 			     timer_it != phase->timer_query_objects_running.cend(); ) {
-				GLint timer_query_object = *timer_it;
+				GLuint timer_query_object = timer_it->query_object;
 				GLint available;
 				glGetQueryObjectiv(timer_query_object, GL_QUERY_RESULT_AVAILABLE, &available);
 				if (available) {
 					GLuint64 time_elapsed;
 					glGetQueryObjectui64v(timer_query_object, GL_QUERY_RESULT, &time_elapsed);
+					if (phase->num_measured_iterations == 0) {
+						phase->min_time_elapsed_ns = phase->max_time_elapsed_ns = time_elapsed;
+					} else {
+						phase->min_time_elapsed_ns = min<uint64_t>(phase->min_time_elapsed_ns, time_elapsed);
+						phase->max_time_elapsed_ns = max<uint64_t>(phase->max_time_elapsed_ns, time_elapsed);
+					}
 					phase->time_elapsed_ns += time_elapsed;
 					++phase->num_measured_iterations;
+
+					unsigned bucket = 0;
+					while (bucket < Phase::num_time_elapsed_buckets - 1 &&
+					       time_elapsed >= (uint64_t(1000) << bucket)) {
+						++bucket;
+					}
+					++phase->time_elapsed_histogram[bucket];
+
+					phase_trace_events.push_back(PhaseTraceEvent{
+						phase_num, timer_it->cpu_start_ns, timer_it->cpu_end_ns, time_elapsed });
+					if (phase_trace_events.size() > max_phase_trace_events) {
+						phase_trace_events.pop_front();
+					}
+
 					phase->timer_query_objects_free.push_back(timer_query_object);
 					phase->timer_query_objects_running.erase(timer_it++);
 				} else {
@@ -2153,6 +3253,75 @@ void EffectChain::render(GLuint dest_fbo, const vector<DestinationTexture> &dest
 	}
 }
 
+void EffectChain::compute_needed_regions(const Region &output_region, size_t num_phases)
+{
+	for (unsigned phase_num = 0; phase_num < num_phases; ++phase_num) {
+		phases[phase_num]->needed_region = Region(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+	phases[num_phases - 1]->needed_region = output_region;
+
+	// Phases are in topological order, so going backwards,
+	// we know about all the users of a phase before we get to it.
+	for (int phase_num = num_phases - 1; phase_num >= 0; --phase_num) {
+		Phase *phase = phases[phase_num];
+		if (phase->needed_region.empty()) {
+			continue;
+		}
+		if (phase->is_compute_shader) {
+			// We always run these in full.
+			for (Phase *input : phase->inputs) {
+				input->needed_region = Region(0.0f, 0.0f, 1.0f, 1.0f);
+			}
+			continue;
+		}
+
+		// Same thing within the phase; <effects> is also topologically sorted.
+		map<Node *, Region> node_regions;
+		node_regions[phase->output_node] = phase->needed_region;
+		for (auto node_it = phase->effects.rbegin(); node_it != phase->effects.rend(); ++node_it) {
+			Node *node = *node_it;
+			const auto region_it = node_regions.find(node);
+			if (region_it == node_regions.end() || region_it->second.empty()) {
+				continue;
+			}
+			for (unsigned i = 0; i < node->incoming_links.size(); ++i) {
+				Region input_region = clip_region(
+					node->effect->get_needed_input_region(i, region_it->second));
+				if (node->incoming_link_type[i] == IN_SAME_PHASE) {
+					Node *dep = node->incoming_links[i];
+					if (node_regions.count(dep)) {
+						node_regions[dep] = union_regions(node_regions[dep], input_region);
+					} else {
+						node_regions[dep] = input_region;
+					}
+				} else {
+					for (Phase *input : phase->inputs) {
+						if (input->output_node == node->incoming_links[i]) {
+							input->needed_region = union_regions(input->needed_region, input_region);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void EffectChain::set_scissor_for_phase(Phase *phase)
+{
+	// Round outwards, and add an extra texel of margin for safety
+	// (e.g. for bilinear sampling right at the edge).
+	const Region &region = phase->needed_region;
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	if (!region.empty()) {
+		x0 = max<int>(lrintf(floor(region.x0 * phase->output_width)) - 1, 0);
+		y0 = max<int>(lrintf(floor(region.y0 * phase->output_height)) - 1, 0);
+		x1 = min<int>(lrintf(ceil(region.x1 * phase->output_width)) + 1, phase->output_width);
+		y1 = min<int>(lrintf(ceil(region.y1 * phase->output_height)) + 1, phase->output_height);
+	}
+	glScissor(x0, y0, x1 - x0, y1 - y0);
+	check_error();
+}
+
 void EffectChain::enable_phase_timing(bool enable)
 {
 	if (enable) {
@@ -2164,10 +3333,45 @@ void EffectChain::enable_phase_timing(bool enable)
 void EffectChain::reset_phase_timing()
 {
 	for (unsigned phase_num = 0; phase_num < phases.size(); ++phase_num) {
-		Phase *phase = phases[phase_num];
-		phase->time_elapsed_ns = 0;
-		phase->num_measured_iterations = 0;
+		reset_phase_timing(phases[phase_num]);
 	}
+	phase_trace_events.clear();
+}
+
+void EffectChain::reset_phase_timing(Phase *phase)
+{
+	phase->time_elapsed_ns = 0;
+	phase->num_measured_iterations = 0;
+	phase->min_time_elapsed_ns = phase->max_time_elapsed_ns = 0;
+	for (unsigned bucket = 0; bucket < Phase::num_time_elapsed_buckets; ++bucket) {
+		phase->time_elapsed_histogram[bucket] = 0;
+	}
+	phase->set_gl_state_ns = phase->setup_uniforms_ns = phase->draw_ns = 0;
+	phase->num_cpu_measured_iterations = 0;
+	phase->num_reused = 0;
+}
+
+void EffectChain::enable_debug_labels(bool enable)
+{
+	if (enable) {
+		assert(movit_debug_labels_supported);
+		resource_pool->enable_debug_labels(true);
+	}
+	this->do_debug_labels = enable;
+}
+
+void EffectChain::enable_phase_memoization(bool enable)
+{
+	this->do_phase_memoization = enable;
+}
+
+uint64_t EffectChain::get_num_reused_phases() const
+{
+	uint64_t num_reused = 0;
+	for (const Phase *phase : phases) {
+		num_reused += phase->num_reused;
+	}
+	return num_reused;
 }
 
 void EffectChain::print_phase_timing()
@@ -2175,7 +3379,10 @@ void EffectChain::print_phase_timing()
 	double total_time_ms = 0.0;
 	for (unsigned phase_num = 0; phase_num < phases.size(); ++phase_num) {
 		Phase *phase = phases[phase_num];
-		double avg_time_ms = phase->time_elapsed_ns * 1e-6 / phase->num_measured_iterations;
+		double avg_time_ms = 0.0;
+		if (phase->num_measured_iterations > 0) {
+			avg_time_ms = phase->time_elapsed_ns * 1e-6 / phase->num_measured_iterations;
+		}
 		printf("Phase %d: %5.1f ms  [", phase_num, avg_time_ms);
 		for (unsigned effect_num = 0; effect_num < phase->effects.size(); ++effect_num) {
 			if (effect_num != 0) {
@@ -2183,12 +3390,85 @@ void EffectChain::print_phase_timing()
 			}
 			printf("%s", phase->effects[effect_num]->effect->effect_type_id().c_str());
 		}
-		printf("]\n");
+		printf("]");
+		if (do_phase_memoization || phase->num_reused > 0) {
+			// The time above is only for the frames where we actually rendered.
+			printf("  reused %llu times", (unsigned long long)phase->num_reused);
+		}
+		printf("\n");
 		total_time_ms += avg_time_ms;
 	}
 	printf("Total:   %5.1f ms\n", total_time_ms);
 }
 
+vector<EffectChain::PhaseTiming> EffectChain::get_phase_timing() const
+{
+	vector<PhaseTiming> timings;
+	for (const Phase *phase : phases) {
+		PhaseTiming timing;
+		for (const Node *node : phase->effects) {
+			timing.effects.push_back(node->effect->effect_type_id());
+		}
+		timing.output_width = phase->output_width;
+		timing.output_height = phase->output_height;
+		timing.output_format = phase->output_format;
+
+		timing.num_gpu_measurements = phase->num_measured_iterations;
+		timing.gpu_min_ms = phase->min_time_elapsed_ns * 1e-6;
+		timing.gpu_max_ms = phase->max_time_elapsed_ns * 1e-6;
+		timing.gpu_avg_ms = 0.0;
+		if (phase->num_measured_iterations > 0) {
+			timing.gpu_avg_ms = phase->time_elapsed_ns * 1e-6 / phase->num_measured_iterations;
+		}
+		timing.gpu_histogram.assign(phase->time_elapsed_histogram,
+		                            phase->time_elapsed_histogram + Phase::num_time_elapsed_buckets);
+
+		timing.num_cpu_measurements = phase->num_cpu_measured_iterations;
+		timing.cpu_set_gl_state_ms = timing.cpu_setup_uniforms_ms = timing.cpu_draw_ms = 0.0;
+		if (phase->num_cpu_measured_iterations > 0) {
+			const double scale = 1e-6 / phase->num_cpu_measured_iterations;
+			timing.cpu_set_gl_state_ms = phase->set_gl_state_ns * scale;
+			timing.cpu_setup_uniforms_ms = phase->setup_uniforms_ns * scale;
+			timing.cpu_draw_ms = phase->draw_ns * scale;
+		}
+
+		timing.num_reused = phase->num_reused;
+		timings.push_back(timing);
+	}
+	return timings;
+}
+
+string EffectChain::get_phase_timing_trace(int pid) const
+{
+	// Effect type IDs are C++ identifiers, so they need no escaping.
+	vector<string> phase_names;
+	for (unsigned phase_num = 0; phase_num < phases.size(); ++phase_num) {
+		phase_names.push_back("Phase " + to_string(phase_num) + " [" + phases[phase_num]->effect_names + "]");
+	}
+
+	// CPU events go on thread 1, GPU events on thread 2. The names can be
+	// arbitrarily long (many effects in one phase), so no fixed-size buffers.
+	const string pid_str = to_string(pid);
+	string json = "{\"traceEvents\":[\n";
+	json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid_str + ",\"tid\":1,\"args\":{\"name\":\"Movit CPU\"}},\n";
+	json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid_str + ",\"tid\":2,\"args\":{\"name\":\"Movit GPU\"}}";
+	for (const PhaseTraceEvent &event : phase_trace_events) {
+		assert(event.phase_num < phases.size());
+		const Phase *phase = phases[event.phase_num];
+		const string &name = phase_names[event.phase_num];
+		json += ",\n{\"name\":\"" + name + "\",\"cat\":\"movit\",\"ph\":\"X\",\"pid\":" + pid_str +
+			",\"tid\":1,\"ts\":" + format_trace_microseconds(event.cpu_start_ns) +
+			",\"dur\":" + format_trace_microseconds(event.cpu_end_ns - event.cpu_start_ns) +
+			",\"args\":{\"width\":" + to_string(phase->output_width) +
+			",\"height\":" + to_string(phase->output_height) + "}}";
+		json += ",\n{\"name\":\"" + name + "\",\"cat\":\"movit\",\"ph\":\"X\",\"pid\":" + pid_str +
+			",\"tid\":2,\"ts\":" + format_trace_microseconds(event.cpu_start_ns) +
+			",\"dur\":" + format_trace_microseconds(event.gpu_ns) + "}";
+	}
+	json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return json;
+}
+
 void EffectChain::execute_phase(Phase *phase,
                                 const map<Phase *, GLuint> &output_textures,
                                 const vector<DestinationTexture> &destinations,
@@ -2232,12 +3512,25 @@ void EffectChain::execute_phase(Phase *phase,
 			check_error();
 			generated_mipmaps->insert(input);
 		}
-		setup_rtt_sampler(sampler, any_needs_mipmaps);
+		if (rtt_sampler_state_is_current(it->second, phase, sampler, any_needs_mipmaps)) {
+			num_elided_gl_calls += 4;
+		} else {
+			setup_rtt_sampler(sampler, any_needs_mipmaps);
+		}
 		phase->input_samplers[sampler] = sampler;  // Bind the sampler to the right uniform.
 	}
 
-	GLuint instance_program_num = resource_pool->use_glsl_program(phase->glsl_program_num);
+	bool uniforms_preserved;
+	GLuint instance_program_num = resource_pool->use_glsl_program(phase->glsl_program_num, phase, &uniforms_preserved);
 	check_error();
+	if (do_debug_labels) {
+		// Identical phases in other chains may share the same instances,
+		// but then the label is still right.
+		const string label = truncate_debug_string(
+			"Movit program for [" + phase->effect_names + "]", movit_max_label_length);
+		glObjectLabel(GL_PROGRAM, instance_program_num, -1, label.c_str());
+		check_error();
+	}
 
 	// And now the output.
 	GLuint fbo = 0;
@@ -2258,11 +3551,18 @@ void EffectChain::execute_phase(Phase *phase,
 	} else if (!destinations.empty()) {
 		assert(destinations.size() == 1);
 		fbo = resource_pool->create_fbo(destinations[0].texnum);
+		if (do_debug_labels) {
+			const string label = truncate_debug_string(
+				"Movit FBO for [" + phase->effect_names + "]", movit_max_label_length);
+			glObjectLabel(GL_FRAMEBUFFER, fbo, -1, label.c_str());
+			check_error();
+		}
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 		glViewport(0, 0, phase->output_width, phase->output_height);
 	}
 
 	// Give the required parameters to all the effects.
+	uint64_t start_ns = do_phase_timing ? steady_clock_ns() : 0;
 	unsigned sampler_num = phase->inputs.size();
 	for (unsigned i = 0; i < phase->effects.size(); ++i) {
 		Node *node = phase->effects[i];
@@ -2278,21 +3578,35 @@ void EffectChain::execute_phase(Phase *phase,
 		}
 	}
 
+	uint64_t set_gl_state_end_ns = 0, setup_uniforms_end_ns = 0;
 	if (phase->is_compute_shader) {
 		unsigned x, y, z;
 		phase->compute_shader_node->effect->get_compute_dimensions(phase->output_width, phase->output_height, &x, &y, &z);
+		if (do_phase_timing) {
+			set_gl_state_end_ns = steady_clock_ns();
+		}
 
 		// Uniforms need to come after set_gl_state() _and_ get_compute_dimensions(),
 		// since they can be updated from there.
-		setup_uniforms(phase);
+		setup_uniforms(phase, uniforms_preserved);
+		if (do_phase_timing) {
+			setup_uniforms_end_ns = steady_clock_ns();
+		}
 		glDispatchCompute(x, y, z);
 		check_error();
 		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
 		check_error();
 	} else {
+		if (do_phase_timing) {
+			set_gl_state_end_ns = steady_clock_ns();
+		}
+
 		// Uniforms need to come after set_gl_state(), since they can be updated
 		// from there.
-		setup_uniforms(phase);
+		setup_uniforms(phase, uniforms_preserved);
+		if (do_phase_timing) {
+			setup_uniforms_end_ns = steady_clock_ns();
+		}
 
 		// Bind the vertex data.
 		GLuint vao = resource_pool->create_vec2_vao(phase->attribute_indexes, vbo);
@@ -2303,6 +3617,12 @@ void EffectChain::execute_phase(Phase *phase,
 
 		resource_pool->release_vec2_vao(vao);
 	}
+	if (do_phase_timing) {
+		phase->set_gl_state_ns += set_gl_state_end_ns - start_ns;
+		phase->setup_uniforms_ns += setup_uniforms_end_ns - set_gl_state_end_ns;
+		phase->draw_ns += steady_clock_ns() - setup_uniforms_end_ns;
+		++phase->num_cpu_measured_iterations;
+	}
 	
 	for (unsigned i = 0; i < phase->effects.size(); ++i) {
 		Node *node = phase->effects[i];
@@ -2316,77 +3636,308 @@ void EffectChain::execute_phase(Phase *phase,
 	}
 }
 
-void EffectChain::setup_uniforms(Phase *phase)
+void EffectChain::bake_color_lut(ColorLUTBake *bake)
 {
-	// TODO: Use UBO blocks.
-	for (size_t i = 0; i < phase->uniforms_image2d.size(); ++i) {
-		const Uniform<int> &uniform = phase->uniforms_image2d[i];
+	Phase *phase = bake->phase;
+	const unsigned lut_size = color_lut_size;
+	inform_input_sizes(phase);
+	find_output_size(phase);
+	assert(phase->output_width == lut_size * lut_size);
+	assert(phase->output_height == lut_size);
+
+	if (bake->texnum == 0) {
+		// 16-bit float is plenty for a LUT that is interpolated anyway,
+		// and matches the default intermediate format.
+		bake->texnum = resource_pool->create_2d_texture(GL_RGBA16F, lut_size * lut_size, lut_size);
+		bake->lut_effect->texnum = bake->texnum;
+	}
+
+	bool uniforms_preserved;
+	GLuint instance_program_num = resource_pool->use_glsl_program(phase->glsl_program_num, phase, &uniforms_preserved);
+	check_error();
+
+	// The effects compute their uniforms in set_gl_state(), so we need
+	// to call that before we can know whether anything has changed.
+	unsigned sampler_num = 0;
+	for (Node *node : phase->effects) {
+		node->effect->set_gl_state(instance_program_num, phase->effect_ids[make_pair(node, IN_SAME_PHASE)], &sampler_num);
+		check_error();
+	}
+
+	vector<unsigned char> uniform_values;
+	append_uniform_values(phase->uniforms_bool, 1, &uniform_values);
+	append_uniform_values(phase->uniforms_int, 1, &uniform_values);
+	append_uniform_values(phase->uniforms_ivec2, 2, &uniform_values);
+	append_uniform_values(phase->uniforms_float, 1, &uniform_values);
+	append_uniform_values(phase->uniforms_vec2, 2, &uniform_values);
+	append_uniform_values(phase->uniforms_vec3, 3, &uniform_values);
+	append_uniform_values(phase->uniforms_vec4, 4, &uniform_values);
+	append_uniform_values(phase->uniforms_mat3, 1, &uniform_values);
+
+	if (uniform_values != bake->uniform_values) {
+		GLuint fbo = resource_pool->create_fbo(bake->texnum);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		check_error();
+		glViewport(0, 0, phase->output_width, phase->output_height);
+		check_error();
+
+		setup_uniforms(phase, uniforms_preserved);
+
+		GLuint vao = resource_pool->create_vec2_vao(phase->attribute_indexes, vbo);
+		glBindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		check_error();
+		resource_pool->release_vec2_vao(vao);
+
+		resource_pool->release_fbo(fbo);
+		bake->uniform_values = move(uniform_values);
+		bake->lut_effect->bump_generation();
+		++num_color_lut_bakes;
+	}
+
+	for (Node *node : phase->effects) {
+		node->effect->clear_gl_state();
+	}
+	resource_pool->unuse_glsl_program(instance_program_num);
+}
+
+void EffectChain::allocate_uniform_buffer()
+{
+	assert(!uniform_buffer_allocated);
+	uniform_buffer_allocated = true;
+
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	check_error();
+
+	vector<Phase *> all_phases = phases;
+	for (const ColorLUTBake &bake : color_lut_bakes) {
+		all_phases.push_back(bake.phase);
+	}
+
+	size_t max_block_size = 0;
+	uniform_buffer_frame_size = 0;
+	for (Phase *phase : all_phases) {
+		if (!phase->has_uniform_block) {
+			continue;
+		}
+		phase->uniform_block_offset = uniform_buffer_frame_size;
+		uniform_buffer_frame_size += (phase->uniform_block_size + alignment - 1) / alignment * alignment;
+		max_block_size = max<size_t>(max_block_size, phase->uniform_block_size);
+	}
+	if (uniform_buffer_frame_size == 0) {
+		return;
+	}
+
+	const size_t total_size = uniform_buffer_frame_size * num_uniform_buffer_frames;
+	glGenBuffers(1, &uniform_buffer);
+	check_error();
+	glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+	check_error();
+	if (movit_persistent_buffers_supported) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, total_size, nullptr, flags);
+		check_error();
+		uniform_buffer_mapped = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, total_size, flags);
+		check_error();
+		assert(uniform_buffer_mapped != nullptr);
+	} else {
+		glBufferData(GL_UNIFORM_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+		check_error();
+		uniform_buffer_staging.resize(max_block_size);
+		uniform_buffer_shadow.resize(total_size);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	check_error();
+}
+
+void EffectChain::begin_uniform_buffer_frame()
+{
+	if (uniform_buffer == 0) {
+		return;
+	}
+	uniform_buffer_frame = (uniform_buffer_frame + 1) % num_uniform_buffer_frames;
+
+	GLsync fence = uniform_buffer_fences[uniform_buffer_frame];
+	if (fence != nullptr) {
+		// With three frames in the ring, this should essentially never block.
+		GLenum ret;
+		do {
+			ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);  // 1 second.
+			check_error();
+		} while (ret == GL_TIMEOUT_EXPIRED);
+		assert(ret != GL_WAIT_FAILED);
+		glDeleteSync(fence);
+		check_error();
+		uniform_buffer_fences[uniform_buffer_frame] = nullptr;
+	}
+}
+
+void EffectChain::end_uniform_buffer_frame()
+{
+	if (uniform_buffer_mapped == nullptr) {
+		// glBufferSubData() does its own synchronization.
+		return;
+	}
+	assert(uniform_buffer_fences[uniform_buffer_frame] == nullptr);
+	uniform_buffer_fences[uniform_buffer_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	check_error();
+}
+
+void EffectChain::setup_uniforms(Phase *phase, bool uniforms_preserved)
+{
+	if (phase->has_uniform_block) {
+		// Write all the values into the block, then upload it (if needed)
+		// and bind it, in one go.
+		const size_t offset = uniform_buffer_frame * uniform_buffer_frame_size + phase->uniform_block_offset;
+		unsigned char *block;
+		if (uniform_buffer_mapped != nullptr) {
+			block = uniform_buffer_mapped + offset;
+		} else {
+			// Clear the padding, so that we can compare against the shadow below.
+			block = uniform_buffer_staging.data();
+			memset(block, 0, phase->uniform_block_size);
+		}
+		write_uniform_block_values<GLint>(phase->uniforms_bool, 1, block);
+		write_uniform_block_values<GLint>(phase->uniforms_int, 1, block);
+		write_uniform_block_values<GLint>(phase->uniforms_ivec2, 2, block);
+		write_uniform_block_values<GLfloat>(phase->uniforms_float, 1, block);
+		write_uniform_block_values<GLfloat>(phase->uniforms_vec2, 2, block);
+		write_uniform_block_values<GLfloat>(phase->uniforms_vec3, 3, block);
+		write_uniform_block_values<GLfloat>(phase->uniforms_vec4, 4, block);
+		for (const Uniform<Matrix3d> &uniform : phase->uniforms_mat3) {
+			assert(uniform.num_values == 1);
+			if (uniform.ubo_offset == -1) {
+				continue;
+			}
+			// Column-major, with each column padded (typically to a vec4).
+			for (unsigned x = 0; x < 3; ++x) {
+				GLfloat *column = (GLfloat *)(block + uniform.ubo_offset + x * uniform.ubo_matrix_stride);
+				for (unsigned y = 0; y < 3; ++y) {
+					column[y] = (*uniform.value)(y, x);
+				}
+			}
+		}
+
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniform_buffer, offset, phase->uniform_block_size);
+		check_error();
+		if (uniform_buffer_mapped == nullptr) {
+			unsigned char *shadow = uniform_buffer_shadow.data() + offset;
+			const unsigned frame_bit = 1u << uniform_buffer_frame;
+			if ((phase->uniform_block_uploaded_frames & frame_bit) &&
+			    memcmp(shadow, block, phase->uniform_block_size) == 0) {
+				++num_elided_gl_calls;
+			} else {
+				phase->uniform_block_uploaded_frames |= frame_bit;
+				memcpy(shadow, block, phase->uniform_block_size);
+				glBufferSubData(GL_UNIFORM_BUFFER, offset, phase->uniform_block_size, block);
+				check_error();
+			}
+		}
+	}
+
+	// Samplers and images are never in the uniform block. For everything
+	// else, these loops will find no locations if the block was used.
+	for (Uniform<int> &uniform : phase->uniforms_image2d) {
 		if (uniform.location != -1) {
-			glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+				glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_sampler2d.size(); ++i) {
-		const Uniform<int> &uniform = phase->uniforms_sampler2d[i];
+	for (Uniform<int> &uniform : phase->uniforms_sampler2d) {
 		if (uniform.location != -1) {
-			glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+				glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_bool.size(); ++i) {
-		const Uniform<bool> &uniform = phase->uniforms_bool[i];
+	for (Uniform<bool> &uniform : phase->uniforms_bool) {
 		assert(uniform.num_values == 1);
 		if (uniform.location != -1) {
-			glUniform1i(uniform.location, *uniform.value);
+			if (uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+				glUniform1i(uniform.location, *uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_int.size(); ++i) {
-		const Uniform<int> &uniform = phase->uniforms_int[i];
+	for (Uniform<int> &uniform : phase->uniforms_int) {
 		if (uniform.location != -1) {
-			glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+				glUniform1iv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_ivec2.size(); ++i) {
-		const Uniform<int> &uniform = phase->uniforms_ivec2[i];
+	for (Uniform<int> &uniform : phase->uniforms_ivec2) {
 		if (uniform.location != -1) {
-			glUniform2iv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 2, uniforms_preserved)) {
+				glUniform2iv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_float.size(); ++i) {
-		const Uniform<float> &uniform = phase->uniforms_float[i];
+	for (Uniform<float> &uniform : phase->uniforms_float) {
 		if (uniform.location != -1) {
-			glUniform1fv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+				glUniform1fv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_vec2.size(); ++i) {
-		const Uniform<float> &uniform = phase->uniforms_vec2[i];
+	for (Uniform<float> &uniform : phase->uniforms_vec2) {
 		if (uniform.location != -1) {
-			glUniform2fv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 2, uniforms_preserved)) {
+				glUniform2fv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_vec3.size(); ++i) {
-		const Uniform<float> &uniform = phase->uniforms_vec3[i];
+	for (Uniform<float> &uniform : phase->uniforms_vec3) {
 		if (uniform.location != -1) {
-			glUniform3fv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 3, uniforms_preserved)) {
+				glUniform3fv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_vec4.size(); ++i) {
-		const Uniform<float> &uniform = phase->uniforms_vec4[i];
+	for (Uniform<float> &uniform : phase->uniforms_vec4) {
 		if (uniform.location != -1) {
-			glUniform4fv(uniform.location, uniform.num_values, uniform.value);
+			if (uniform_needs_upload(&uniform, 4, uniforms_preserved)) {
+				glUniform4fv(uniform.location, uniform.num_values, uniform.value);
+			} else {
+				++num_elided_gl_calls;
+			}
 		}
 	}
-	for (size_t i = 0; i < phase->uniforms_mat3.size(); ++i) {
-		const Uniform<Matrix3d> &uniform = phase->uniforms_mat3[i];
+	for (Uniform<Matrix3d> &uniform : phase->uniforms_mat3) {
 		assert(uniform.num_values == 1);
-		if (uniform.location != -1) {
-			// Convert to float (GLSL has no double matrices).
-		        float matrixf[9];
-			for (unsigned y = 0; y < 3; ++y) {
-				for (unsigned x = 0; x < 3; ++x) {
-					matrixf[y + x * 3] = (*uniform.value)(y, x);
-				}
+		if (uniform.location == -1) {
+			continue;
+		}
+		if (!uniform_needs_upload(&uniform, 1, uniforms_preserved)) {
+			++num_elided_gl_calls;
+			continue;
+		}
+
+		// Convert to float (GLSL has no double matrices).
+		float matrixf[9];
+		for (unsigned y = 0; y < 3; ++y) {
+			for (unsigned x = 0; x < 3; ++x) {
+				matrixf[y + x * 3] = (*uniform.value)(y, x);
 			}
-			glUniformMatrix3fv(uniform.location, 1, GL_FALSE, matrixf);
 		}
+		glUniformMatrix3fv(uniform.location, 1, GL_FALSE, matrixf);
 	}
 }
 
@@ -2407,4 +3958,16 @@ void EffectChain::setup_rtt_sampler(int sampler_num, bool use_mipmaps)
 	check_error();
 }
 
+bool EffectChain::rtt_sampler_state_is_current(GLuint texnum, Phase *phase, unsigned sampler_num, bool use_mipmaps)
+{
+	RTTSamplerState &state = rtt_sampler_states[texnum];
+	if (state.phase == phase && state.sampler_num == sampler_num && state.use_mipmaps == use_mipmaps) {
+		return true;
+	}
+	state.phase = phase;
+	state.sampler_num = sampler_num;
+	state.use_mipmaps = use_mipmaps;
+	return false;
+}
+
 }  // namespace movit
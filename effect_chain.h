@@ -23,6 +23,8 @@
 
 #include <epoxy/gl.h>
 #include <stdio.h>
+#include <deque>
+#include <functional>
 #include <list>
 #include <map>
 #include <set>
@@ -36,6 +38,7 @@
 
 namespace movit {
 
+class ColorLUTEffect;
 class Effect;
 class Input;
 struct Phase;
@@ -181,6 +184,27 @@ struct Phase {
 
 	GLuint glsl_program_num;  // Owned by the resource_pool.
 
+	// The index in EffectChain::phases of the last phase that reads this
+	// phase's output. See plan_phase_order().
+	unsigned output_last_used;
+
+	// Whether the non-opaque uniforms are declared in a uniform block
+	// (see EffectChain::setup_uniforms()), and if so, the size of that block
+	// and where in each frame's part of EffectChain::uniform_buffer it goes.
+	bool has_uniform_block;
+	GLint uniform_block_size;
+	size_t uniform_block_offset;
+
+	// A bitmask of which frames of EffectChain::uniform_buffer we have
+	// uploaded this phase's block to, and thus have a valid copy of in
+	// EffectChain::uniform_buffer_shadow.
+	unsigned uniform_block_uploaded_frames;
+
+	// Whether the program has finished compiling and linking, and we have
+	// collected the attribute and uniform locations below. See
+	// EffectChain::enable_asynchronous_compilation().
+	bool program_ready;
+
 	// Position and texcoord attribute indexes, although it doesn't matter
 	// which is which, because they contain the same data.
 	std::set<GLint> attribute_indexes;
@@ -193,8 +217,39 @@ struct Phase {
 	// to hold the value for the uniform.
 	std::vector<int> input_samplers;
 	std::vector<Node *> effects;  // In order.
+
+	// The effect_type_id() of each effect, comma-separated; used for
+	// naming the phase in timing output and debug labels.
+	std::string effect_names;
 	unsigned output_width, output_height, virtual_output_width, virtual_output_height;
 
+	// The part of the output that is needed for the current frame, in
+	// normalized coordinates. Only used for region-of-interest rendering;
+	// see EffectChain::render_region_to_fbo() and compute_needed_regions().
+	Region needed_region;
+
+	// For memoization (see EffectChain::enable_phase_memoization()):
+	// The generation of each effect in the phase, the <output_generation>
+	// of each input phase, and the output size, as of the last render.
+	// If these are unchanged, so is the output.
+	std::vector<unsigned> memo_signature;
+
+	// Changes whenever this phase's output may have changed.
+	unsigned output_generation;
+
+	// A texture holding the output from an earlier frame, or 0 if none.
+	// Owned by the resource pool, but kept by the EffectChain; not one
+	// of its intermediate textures (see get_intermediate_texture()).
+	GLuint memoized_texture;
+
+	// The number of frames this phase has not been rendered,
+	// because <memoized_texture> could be used instead.
+	uint64_t num_reused;
+
+	// If this phase renders one of the extra outputs (see
+	// EffectChain::add_extra_output()), which one; otherwise -1.
+	int extra_output_num;
+
 	// Whether this phase is compiled as a compute shader, ie., the last effect is
 	// marked as one.
 	bool is_compute_shader;
@@ -225,11 +280,32 @@ struct Phase {
 	std::vector<Uniform<float>> uniforms_vec4;
 	std::vector<Uniform<Eigen::Matrix3d>> uniforms_mat3;
 
-	// For measurement of GPU time used.
-	std::list<GLuint> timer_query_objects_running;
+	// For measurement of GPU time used. Each running query also remembers
+	// when (in steady_clock nanoseconds) the CPU started and finished
+	// submitting the phase, for the trace (see EffectChain::get_phase_timing_trace()).
+	struct RunningTimerQuery {
+		GLuint query_object;
+		uint64_t cpu_start_ns, cpu_end_ns;
+	};
+	std::list<RunningTimerQuery> timer_query_objects_running;
 	std::list<GLuint> timer_query_objects_free;
 	uint64_t time_elapsed_ns;
 	uint64_t num_measured_iterations;
+	uint64_t min_time_elapsed_ns, max_time_elapsed_ns;
+
+	// Bucket i counts measurements of less than 2^i microseconds
+	// (but not less than 2^(i-1)); the last bucket also counts everything longer.
+	static const unsigned num_time_elapsed_buckets = 24;
+	uint64_t time_elapsed_histogram[num_time_elapsed_buckets];
+
+	// For measurement of CPU time used in execute_phase(), in nanoseconds,
+	// summed over <num_cpu_measured_iterations> renders.
+	uint64_t set_gl_state_ns, setup_uniforms_ns, draw_ns;
+	uint64_t num_cpu_measured_iterations;
+
+	// The internal format of what we rendered to the last time,
+	// or GL_NONE if it was a framebuffer given by the user.
+	GLenum output_format;
 };
 
 class EffectChain {
@@ -319,6 +395,20 @@ public:
 			      YCbCrOutputSplitting output_splitting = YCBCR_OUTPUT_INTERLEAVED,
 	                      GLenum output_type = GL_UNSIGNED_BYTE);
 
+	// Adds an extra RGBA output, taken from the output of <effect> (which must
+	// already be in the chain) instead of from the end of the chain. This is
+	// useful if you need e.g. a preview of the picture before some graphics
+	// are put on top, in addition to the main output; everything the outputs
+	// have in common is then only computed once. Each extra output gets its
+	// own conversions to <format> and <alpha_format>, but never dither or
+	// Y'CbCr, and it always costs a separate phase, which also means that
+	// the output of <effect> needs to be bounced to a texture.
+	//
+	// Extra outputs can only be had from render_to_texture(); their textures
+	// come after the ones for the main output, in the order the outputs were
+	// added. The other render functions only render the main output.
+	void add_extra_output(Effect *effect, const ImageFormat &format, OutputAlphaFormat alpha_format);
+
 	// Change Y'CbCr output format. (This can be done also after finalize()).
 	// Note that you are not allowed to change subsampling parameters;
 	// however, you can change the color space parameters, ie.,
@@ -388,6 +478,58 @@ public:
 
 	void finalize();
 
+	// Normally, finalize() waits until all the GLSL programs for the chain
+	// are compiled and linked, which can take a long time (tens of milliseconds
+	// or more) for large chains. If asynchronous compilation is enabled
+	// (before calling finalize()), finalize() instead submits all the programs
+	// to the driver and returns right away, letting the driver compile them
+	// in the background (and in parallel, if it supports
+	// GL_KHR_parallel_shader_compile). You can then poll is_ready() and keep
+	// rendering something else until it returns true.
+	//
+	// Rendering a chain that is not ready is allowed, but will block
+	// until it is, just like wait_until_ready(). is_ready() and
+	// wait_until_ready() must be called from a context that shares
+	// resources with the one finalize() was called in.
+	void enable_asynchronous_compilation(bool enable)
+	{
+		assert(!finalized);
+		this->asynchronous_compilation = enable;
+	}
+	bool is_ready();
+	void wait_until_ready();
+
+	// If set to a nonzero value (before calling finalize()), runs of two
+	// or more effects that are pure per-pixel color functions (see
+	// Effect::is_color_function(); e.g. gamma expansion, lift/gamma/gain,
+	// saturation, white balance and gamma compression) are replaced by
+	// a lookup in a 3D LUT with <lut_size> entries along each axis
+	// (33 or 65 are typical values), with trilinear interpolation.
+	// The LUT is baked on the GPU by rendering the original effects,
+	// the first time the chain is rendered and then whenever any of their
+	// parameters change.
+	//
+	// This is much cheaper per pixel than running the effects, but is
+	// only approximate; the error grows with the curvature of the combined
+	// function and shrinks quadratically with <lut_size>. For instance,
+	// sRGB expansion -> lift/gamma/gain -> saturation -> sRGB compression
+	// with moderate settings has an RMS error of less than 0.2/255 at
+	// <lut_size> = 33, but up to about 5/255 in the darkest shadows, where
+	// the curves are steep. Colors that get clipped at the edge of the gamut
+	// give similar errors. Also, input values outside [0, 1] are clamped,
+	// and alpha is not part of the LUT, so only runs whose input has blank
+	// alpha are baked.
+	void enable_color_lut_baking(unsigned lut_size)
+	{
+		assert(!finalized);
+		assert(lut_size == 0 || lut_size >= 2);
+		this->color_lut_size = lut_size;
+	}
+
+	// The number of times a LUT has been baked (see enable_color_lut_baking())
+	// since the chain was created. Mostly useful for statistics.
+	unsigned get_num_color_lut_bakes() const { return num_color_lut_bakes; }
+
 	// Measure the GPU time used for each actual phase during rendering.
 	// Note that this is only available if GL_ARB_timer_query
 	// (or, equivalently, OpenGL 3.3) is available. Also note that measurement
@@ -397,6 +539,81 @@ public:
 	void reset_phase_timing();
 	void print_phase_timing();
 
+	// The same information as print_phase_timing() prints, and more,
+	// for programmatic use (e.g. exporting to a monitoring system).
+	// One element per phase, in the order they are rendered.
+	// CPU times are the time spent in execute_phase() setting up
+	// and submitting the phase; they are only measured while phase
+	// timing is enabled.
+	struct PhaseTiming {
+		std::vector<std::string> effects;  // As given by effect_type_id().
+		unsigned output_width, output_height;  // As of the last render.
+		GLenum output_format;  // GL_NONE if rendered to a user-given framebuffer.
+
+		// From the GL_TIME_ELAPSED queries. All zero if there are
+		// no measurements yet. <gpu_histogram> has the same number of
+		// buckets for every phase; bucket i counts measurements shorter
+		// than 2^i microseconds (but not shorter than 2^(i-1)),
+		// and the last bucket also counts everything longer.
+		uint64_t num_gpu_measurements;
+		double gpu_min_ms, gpu_avg_ms, gpu_max_ms;
+		std::vector<uint64_t> gpu_histogram;
+
+		// Averages per render.
+		uint64_t num_cpu_measurements;
+		double cpu_set_gl_state_ms, cpu_setup_uniforms_ms, cpu_draw_ms;
+
+		// See enable_phase_memoization().
+		uint64_t num_reused;
+	};
+	std::vector<PhaseTiming> get_phase_timing() const;
+
+	// Returns the measurements of the last renders (up to a few thousand
+	// phases, as long as phase timing has been enabled) in Chrome's
+	// trace event format (JSON), which can be loaded into chrome://tracing
+	// or Perfetto, or merged with traces from other parts of your pipeline
+	// by concatenating the "traceEvents" arrays. The CPU track has the
+	// time spent submitting each phase; the GPU track has the time
+	// the GPU spent on it, as measured by GL_TIME_ELAPSED. Since OpenGL does
+	// not tell us when the GPU started, GPU events are drawn as starting
+	// when the CPU started submitting the phase; the durations are exact,
+	// but the GPU will usually be somewhat behind. Timestamps are in
+	// microseconds from std::chrono::steady_clock (CLOCK_MONOTONIC on Linux).
+	std::string get_phase_timing_trace(int pid = 1) const;
+
+	// If enabled, each phase is wrapped in a debug group (glPushDebugGroup())
+	// named after the phase number and its effects, and the program instance,
+	// output texture and FBO it uses are labeled accordingly (glObjectLabel()),
+	// so that GPU debuggers and profilers show what each draw is. This also
+	// enables labels in the ResourcePool (see ResourcePool::enable_debug_labels());
+	// disabling it here leaves the pool alone, since it may be shared.
+	// Requires movit_debug_labels_supported. When disabled (the default),
+	// no extra OpenGL calls are made. Can be changed at any time.
+	void enable_debug_labels(bool enable);
+
+	// If enabled, phases whose output cannot have changed since the last
+	// frame (that is, neither the effects in them nor any of their input
+	// phases have changed; see Effect::get_generation()) are not rendered
+	// again; instead, their output is kept from frame to frame. This is
+	// useful if you have branches of the chain that are static, such as
+	// a logo or a still background being scaled or blurred.
+	//
+	// The cost is that each such phase holds on to its own output texture
+	// (not counted in get_peak_intermediate_bytes()), and that a phase
+	// is rendered one extra time when it first becomes static. Also, all
+	// effects and inputs must report every change that could affect their
+	// output; Movit's own do, but make sure to call set_texture_num() or
+	// invalidate_pixel_data() on inputs if you change the data behind them.
+	// The last phase is always rendered. Can be changed at any time.
+	void enable_phase_memoization(bool enable);
+
+	// The number of times a phase has been skipped due to memoization
+	// (see enable_phase_memoization()), summed over all phases,
+	// since the chain was created or reset_phase_timing() was called.
+	// Mostly useful for statistics; print_phase_timing() gives
+	// the count for each phase.
+	uint64_t get_num_reused_phases() const;
+
 	// Note: If you already know the width and height of the viewport,
 	// calling render_to_fbo() directly will be slightly more efficient,
 	// as it saves it from getting it from OpenGL.
@@ -409,13 +626,30 @@ public:
 	// the current viewport.
 	void render_to_fbo(GLuint fbo, unsigned width, unsigned height);
 
+	// Like render_to_fbo(), but only renders the pixels within the given
+	// rectangle of the FBO (in the same coordinate system as glViewport()
+	// and glScissor(), ie., with the origin in the bottom-left corner);
+	// the rest of the FBO is left untouched. The pixels that are rendered
+	// are the same that render_to_fbo() would give. Useful if you only need
+	// to update or look at a small part of a large frame.
+	//
+	// Each phase will only compute the part of its output that the later
+	// phases need, as found by asking each effect what part of its input(s)
+	// it needs (see Effect::get_needed_input_region()). Effects that do not
+	// know are assumed to need all of their input, so how much is saved
+	// depends on the chain. Phases that are compute shaders are always run
+	// in full.
+	void render_region_to_fbo(GLuint fbo, unsigned width, unsigned height,
+	                          unsigned region_x, unsigned region_y,
+	                          unsigned region_width, unsigned region_height);
+
 	// Render the effect chain to the given set of textures. This is equivalent
 	// to render_to_fbo() with a freshly created FBO bound to the given textures,
 	// except that it is more efficient if the last phase contains a compute shader.
 	// Thus, prefer this to render_to_fbo() where possible.
 	//
-	// Only one destination texture is supported. This restriction will be lifted
-	// in the future.
+	// If there are extra outputs (see add_extra_output()), there must be
+	// exactly one texture for each of them, after the ones for the main output.
 	//
 	// All destination textures must be exactly of size <width> x <height>,
 	// and must either come from the same ResourcePool the effect uses, or outlive
@@ -430,6 +664,51 @@ public:
 	};
 	void render_to_texture(const std::vector<DestinationTexture> &destinations, unsigned width, unsigned height);
 
+	// Asynchronous readback, for when you need the rendered frames on the CPU
+	// (e.g. for encoding) but don't want to stall on glReadPixels() every frame.
+	// render_to_readback() renders the chain into an internal texture of the
+	// given size and internal format (e.g. GL_RGBA8), starts reading it back
+	// into one of a ring of pixel pack buffers in the given format and type
+	// (as in glReadPixels(), e.g. GL_RGBA and GL_UNSIGNED_BYTE), and returns
+	// immediately with a ticket for the frame. Later, typically after
+	// rendering the next frame or two, you call map_readback() with the ticket
+	// to get a pointer to the pixels, which stays valid until you call
+	// release_readback(). is_readback_ready() tells you whether
+	// map_readback() would block. Rows are tightly packed (no alignment),
+	// and as usual with OpenGL, the first row is the bottom one.
+	//
+	// There can be at most get_readback_ring_size() tickets that have not
+	// been released at any given time. Tickets can be released in any order.
+	// Extra outputs (see add_extra_output()) are not supported.
+	typedef uint64_t ReadbackTicket;
+	ReadbackTicket render_to_readback(GLenum internal_format, unsigned width, unsigned height, GLenum format, GLenum type);
+	bool is_readback_ready(ReadbackTicket ticket);
+	const void *map_readback(ReadbackTicket ticket);
+	void release_readback(ReadbackTicket ticket);
+
+	// The number of pixel pack buffers used by render_to_readback(); the default
+	// is three, which allows for reading back one frame while rendering
+	// the next and still having one left to process on the CPU. Can only
+	// be changed before the first call to render_to_readback().
+	void set_readback_ring_size(unsigned num_buffers);
+	unsigned get_readback_ring_size() const { return readback_ring_size; }
+
+	// Intermediate textures (for phase outputs that are read by later phases)
+	// are kept from frame to frame, and shared between phases whose outputs
+	// are never needed at the same time. This returns an estimate (see
+	// ResourcePool::estimate_texture_size()) of how many bytes of such
+	// textures the chain currently holds, which is also the peak amount
+	// needed at any one point during rendering (given that the phase
+	// output sizes are as they were in the last render). Zero before the
+	// first render.
+	size_t get_peak_intermediate_bytes() const { return peak_intermediate_bytes; }
+
+	// Uniforms, uniform blocks and sampler state that have not changed
+	// since the last time a phase was rendered are not given to OpenGL again.
+	// This returns the number of OpenGL calls that were skipped this way
+	// during the last render, which is mostly useful for statistics.
+	unsigned get_num_elided_gl_calls() const { return num_elided_gl_calls; }
+
 	Effect *last_added_effect() {
 		if (nodes.empty()) {
 			return nullptr;
@@ -491,19 +770,84 @@ private:
 	void find_all_nonlinear_inputs(Node *effect, std::vector<Node *> *nonlinear_inputs);
 
 	// Create a GLSL program computing the effects for this phase in order.
+	// The program is only submitted to the driver; see finish_glsl_program().
 	void compile_glsl_program(Phase *phase);
 
+	// Wait for the program for this phase to be done compiling, and then
+	// collect the attribute and uniform locations from it.
+	void finish_glsl_program(Phase *phase);
+
 	// Create all GLSL programs needed to compute the given effect, and all outputs
 	// that depend on it (whenever possible). Returns the phase that has <output>
 	// as the last effect. Also pushes all phases in order onto <phases>.
 	Phase *construct_phase(Node *output, std::map<Node *, Phase *> *completed_effects);
 
+	// Reorder <phases> so that we try to minimize the number of phase outputs
+	// that need to be alive at the same time, and find out when each output
+	// can be freed (output_last_used).
+	void plan_phase_order();
+
+	// Helpers for plan_phase_order(). The first estimates how many
+	// intermediate textures are needed to compute the given phase;
+	// the second does a depth-first search, visiting the most expensive
+	// inputs first.
+	unsigned estimate_textures_needed(Phase *phase, std::map<Phase *, unsigned> *textures_needed);
+	void plan_phase_order_visit(Phase *phase, const std::map<Phase *, unsigned> &textures_needed,
+	                            std::set<Phase *> *visited, std::vector<Phase *> *ordered_phases);
+
+	// Find an intermediate texture for the output of the given phase
+	// (which must already have its output size set by find_output_size()),
+	// creating one if needed. Phases can share a texture if they have
+	// the same size and their outputs are not needed at the same time.
+	// <texture_free_after> tracks when each texture is free again
+	// during the current frame; see render().
+	GLuint get_intermediate_texture(Phase *phase, unsigned phase_num, std::vector<int> *texture_free_after);
+
+	// Give back the intermediate textures that were not used during
+	// the last frame (see get_intermediate_texture()) to the ResourcePool.
+	void release_unused_intermediate_textures(const std::vector<int> &texture_free_after);
+
+	// Give back all the intermediate textures to the ResourcePool.
+	void release_intermediate_textures();
+
+	// For memoization (see enable_phase_memoization()): Given a phase other
+	// than the last, with its sizes computed (see find_output_size()),
+	// check whether its output can have changed since the last frame.
+	// If not, and we have it from before, sets <reused> to true and returns
+	// the texture holding it. Otherwise, returns the texture the phase should
+	// be rendered into to be kept for later frames, or 0 if it should go
+	// into a regular intermediate texture. <can_memoize> is false if
+	// only part of the output is to be rendered, since that cannot be kept.
+	GLuint get_memoized_texture(Phase *phase, bool can_memoize, bool *reused);
+
+	// Give back the phase's <memoized_texture>, if any, to the ResourcePool.
+	void release_memoized_texture(Phase *phase);
+
 	// Do the actual rendering of the chain. If <dest_fbo> is not (GLuint)-1,
 	// renders to that FBO. If <destinations> is non-empty, render to that set
 	// of textures (last phase, save for the dummy phase, must be a compute shader),
-	// with x/y ignored. Having both set is an error.
+	// with x/y ignored. Having both set is an error. If <extra_destinations>
+	// is non-empty, it must have one texture for each extra output, which
+	// will then be rendered too. If <output_region> is not nullptr, only that
+	// part (in normalized coordinates of the final phase) of the output is
+	// rendered; see render_region_to_fbo().
 	void render(GLuint dest_fbo, const std::vector<DestinationTexture> &destinations,
-	            unsigned x, unsigned y, unsigned width, unsigned height);
+	            const std::vector<DestinationTexture> &extra_destinations,
+	            unsigned x, unsigned y, unsigned width, unsigned height,
+	            const Region *output_region = nullptr);
+
+	// For region-of-interest rendering: Given the needed part of the output
+	// of the last of the first <num_phases> phases, set <needed_region>
+	// for all of them, working backwards through the chain. All phases
+	// must have their sizes computed (see find_output_size()).
+	void compute_needed_regions(const Region &output_region, size_t num_phases);
+
+	// Limit rendering of the given phase to its <needed_region>
+	// (converted to texels, and rounded outwards).
+	void set_scissor_for_phase(Phase *phase);
+
+	// Clear all timing measurements for the given phase.
+	void reset_phase_timing(Phase *phase);
 
 	// Execute one phase, ie. set up all inputs, effects and outputs, and render the quad.
 	// If <destinations> is empty, uses whatever output is current (and the phase must not be
@@ -514,11 +858,28 @@ private:
 	                   std::set<Phase *> *generated_mipmaps);
 
 	// Set up uniforms for one phase. The program must already be bound.
-	void setup_uniforms(Phase *phase);
+	// If <uniforms_preserved> is true, the program instance still has
+	// the values we set the last time, so only changed ones need to be set.
+	void setup_uniforms(Phase *phase, bool uniforms_preserved);
+
+	// Assign each phase's uniform block a place in <uniform_buffer>,
+	// and allocate it. Called on the first render.
+	void allocate_uniform_buffer();
+
+	// Wait until the GPU is done with the part of <uniform_buffer> we are
+	// about to overwrite, and mark the current part as used after rendering.
+	void begin_uniform_buffer_frame();
+	void end_uniform_buffer_frame();
 
 	// Set up the given sampler number for sampling from an RTT texture.
 	void setup_rtt_sampler(int sampler_num, bool use_mipmaps);
 
+	// Whether the given intermediate texture was last sampled from by the
+	// given phase and sampler number, with the same mipmap setting,
+	// so that setup_rtt_sampler() can be skipped. Also records that it
+	// will be from now on.
+	bool rtt_sampler_state_is_current(GLuint texnum, Phase *phase, unsigned sampler_num, bool use_mipmaps);
+
 	// Output the current graph to the given file in a Graphviz-compatible format;
 	// only useful for debugging.
 	void output_dot(const char *filename);
@@ -549,6 +910,19 @@ private:
 	void propagate_gamma_and_color_space();
 	Node *find_output_node();
 
+	// For extra outputs (see add_extra_output()). The first connects a node
+	// marking each extra output to the effect it is taken from, so that
+	// the branch can get its own conversions like the main output does.
+	// The second finds which extra output a node with no outgoing links
+	// is the end of, or -1 if it is the main output. The third returns
+	// all nodes with no outgoing links, the main output first and then
+	// the extra outputs in order, and the fourth finds the format
+	// wanted for any of them.
+	void add_extra_output_nodes();
+	int find_extra_output_num(Node *output);
+	std::vector<Node *> find_all_output_nodes();
+	void get_output_format(Node *output, ImageFormat *format, OutputAlphaFormat *alpha_format);
+
 	bool node_needs_colorspace_fix(Node *node);
 	void fix_internal_color_spaces();
 	void fix_output_color_space();
@@ -565,6 +939,26 @@ private:
 	void add_dither_if_needed();
 	void add_dummy_effect_if_needed();
 
+	// Find all runs of (at least two) enabled nodes in a straight line that
+	// fulfill the given predicate and have a single input, where no node
+	// except the last has its output used by anything outside the run.
+	std::vector<std::vector<Node *>> find_node_runs(std::function<bool(Node *)> pred);
+
+	// Replace runs of effects that are pure color matrices
+	// (see Effect::is_color_matrix()) by a single FusedColorMatrixEffect.
+	void fuse_color_matrices();
+
+	// Replace runs of color functions by ColorLUTEffects, if
+	// enable_color_lut_baking() is set. The phases that bake the LUTs
+	// are made by construct_color_lut_bake_phases(), since they should
+	// not be in <phases>.
+	void replace_color_functions_with_luts();
+	void construct_color_lut_bake_phases();
+
+	// Render the given LUT, unless the uniforms are the same as last time.
+	struct ColorLUTBake;
+	void bake_color_lut(ColorLUTBake *bake);
+
 	float aspect_nom, aspect_denom;
 	ImageFormat output_format;
 	OutputAlphaFormat output_alpha_format;
@@ -575,6 +969,14 @@ private:
 	GLenum output_ycbcr_type;                        // If num_output_color_ycbcr is > 0.
 	YCbCrOutputSplitting output_ycbcr_splitting[2];  // If num_output_color_ycbcr is > N.
 
+	// See add_extra_output().
+	struct ExtraOutput {
+		Effect *effect;
+		ImageFormat format;
+		OutputAlphaFormat alpha_format;
+	};
+	std::vector<ExtraOutput> extra_outputs;
+
 	std::vector<Node *> nodes;
 	std::map<Effect *, Node *> node_map;
 	Effect *dither_effect;
@@ -588,6 +990,24 @@ private:
 	unsigned num_dither_bits;
 	OutputOrigin output_origin;
 	bool finalized;
+	bool asynchronous_compilation;
+
+	// See enable_color_lut_baking(). Each ColorLUTEffect in the graph
+	// has a separate phase (not in <phases>) that renders the effects it
+	// replaced, starting from a ColorLUTLatticeInput, into its LUT texture.
+	unsigned color_lut_size;
+	struct ColorLUTBake {
+		ColorLUTEffect *lut_effect;  // Owned by its node.
+		Node *output_node;  // The last of the baked effects.
+		Phase *phase;  // Owned by us.
+		GLuint texnum;  // Zero if not allocated yet.
+
+		// The values of all of the phase's uniforms the last time
+		// we baked, or empty if we have not baked yet.
+		std::vector<unsigned char> uniform_values;
+	};
+	std::vector<ColorLUTBake> color_lut_bakes;
+	unsigned num_color_lut_bakes;
 	GLuint vbo;  // Contains vertex and texture coordinate data.
 
 	// Whether the last effect (which will then be in a phase all by itself)
@@ -596,10 +1016,91 @@ private:
 	// the phase can be skipped if we are _not_ rendering to the backbuffer.
 	bool has_dummy_effect = false;
 
+	// The number of phases needed for the main output. These come first
+	// in <phases>; the rest are only needed for the extra outputs.
+	unsigned num_main_phases = 0;
+
 	ResourcePool *resource_pool;
 	bool owns_resource_pool;
 
 	bool do_phase_timing;
+	bool do_phase_memoization;
+	bool do_debug_labels;
+
+	// Finished phase timing measurements, oldest first, for
+	// get_phase_timing_trace(). Times are steady_clock nanoseconds,
+	// except <gpu_ns>, which is a duration.
+	struct PhaseTraceEvent {
+		unsigned phase_num;
+		uint64_t cpu_start_ns, cpu_end_ns, gpu_ns;
+	};
+	std::deque<PhaseTraceEvent> phase_trace_events;
+	static const size_t max_phase_trace_events = 4096;
+
+	// Textures that phase outputs are rendered to, kept from frame to frame;
+	// see get_intermediate_texture().
+	struct IntermediateTexture {
+		GLuint texnum;
+		unsigned width, height;
+	};
+	std::vector<IntermediateTexture> intermediate_textures;
+	size_t peak_intermediate_bytes;
+
+	// For each intermediate texture, who last set up its sampler state.
+	// Effects can change the state further in set_gl_state() (e.g. to
+	// GL_REPEAT), but since they will do the same every time, the texture
+	// will end up in the same state as long as the reader is the same.
+	// Entries are removed when we give the texture back to the pool.
+	struct RTTSamplerState {
+		Phase *phase;
+		unsigned sampler_num;
+		bool use_mipmaps;
+	};
+	std::map<GLuint, RTTSamplerState> rtt_sampler_states;
+
+	// See get_num_elided_gl_calls().
+	unsigned num_elided_gl_calls;
+
+	// A ring of <num_uniform_buffer_frames> parts of <uniform_buffer_frame_size>
+	// bytes each, each holding the uniform blocks of all phases for one
+	// render. If persistent mapping is supported, we write directly into
+	// <uniform_buffer_mapped> and use fences to make sure we don't overwrite
+	// anything the GPU still needs; if not, we assemble each block in
+	// <uniform_buffer_staging> and upload it with glBufferSubData(),
+	// (still cycling through the ring, to avoid implicit synchronization).
+	// In the latter case, <uniform_buffer_shadow> holds a copy of what
+	// we have uploaded, so that we can skip uploads that would change nothing.
+	// <uniform_buffer> is zero if no phase has a uniform block.
+	static const unsigned num_uniform_buffer_frames = 3;
+	GLuint uniform_buffer;
+	unsigned char *uniform_buffer_mapped;
+	std::vector<unsigned char> uniform_buffer_staging, uniform_buffer_shadow;
+	size_t uniform_buffer_frame_size;
+	unsigned uniform_buffer_frame;
+	GLsync uniform_buffer_fences[num_uniform_buffer_frames];
+	bool uniform_buffer_allocated;
+
+	// For render_to_readback(). Each buffer is in one of three states:
+	// free (<ticket> is zero), in flight (<fence> is set; the GPU may still
+	// be rendering or copying into it) or done (<fence> is nullptr, and
+	// <mapped> may be set if the user has called map_readback()).
+	// The buffer object itself is kept around between uses, and only
+	// reallocated if it is too small.
+	struct ReadbackBuffer {
+		GLuint pbo = 0;
+		size_t allocated_bytes = 0;
+		ReadbackTicket ticket = 0;
+		size_t num_bytes = 0;
+		GLsync fence = nullptr;
+		const void *mapped = nullptr;
+	};
+	ReadbackBuffer *find_readback_buffer(ReadbackTicket ticket);
+	void wait_for_readback_fence(ReadbackBuffer *buffer, bool block);
+
+	unsigned readback_ring_size = 3;
+	std::vector<ReadbackBuffer> readback_buffers;
+	unsigned next_readback_buffer = 0;
+	ReadbackTicket next_readback_ticket = 1;
 };
 
 }  // namespace movit
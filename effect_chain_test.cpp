@@ -2,6 +2,10 @@
 //
 // Note that this also contains the tests for some of the simpler effects.
 
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <locale>
 #include <sstream>
 #include <string>
@@ -9,6 +13,7 @@
 #include <epoxy/gl.h>
 #include <assert.h>
 
+#include "blur_effect.h"
 #include "effect.h"
 #include "effect_chain.h"
 #include "flat_input.h"
@@ -17,6 +22,8 @@
 #include "input.h"
 #include "mirror_effect.h"
 #include "multiply_effect.h"
+#include "padding_effect.h"
+#include "resample_effect.h"
 #include "resize_effect.h"
 #include "resource_pool.h"
 #include "test_util.h"
@@ -1632,6 +1639,220 @@ TEST(EffectChainTest, ProgramsAreClonedForMultipleThreads) {
 	expect_equal(data, out_data, 3, 2);
 }
 
+TEST(EffectChainTest, IntermediateTexturesAreShared) {
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+
+	// Five phases in a straight line; the four intermediate outputs should be
+	// able to ping-pong between two textures (of 3x2 RGBA16F).
+	EXPECT_EQ(2 * 3 * 2 * 8u, tester.get_chain()->get_peak_intermediate_bytes());
+
+	// Rendering again should keep the same textures.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+	EXPECT_EQ(2 * 3 * 2 * 8u, tester.get_chain()->get_peak_intermediate_bytes());
+}
+
+TEST(EffectChainTest, AsynchronousCompilation) {
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.get_chain()->add_effect(new IdentityEffect());
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->enable_asynchronous_compilation(true);
+	tester.finalize_chain(COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	// Poll like a client rendering something else in the meantime would.
+	// Without GL_KHR_parallel_shader_compile, this is true right away.
+	bool ready = false;
+	for (unsigned i = 0; i < 10000 && !ready; ++i) {
+		ready = tester.get_chain()->is_ready();
+		if (!ready) {
+			usleep(1000);
+		}
+	}
+	ASSERT_TRUE(ready);
+
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+	EXPECT_TRUE(tester.get_chain()->is_ready());
+}
+
+TEST(EffectChainTest, AsynchronousCompilationRenderBeforeReady) {
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.get_chain()->add_effect(new IdentityEffect());
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->enable_asynchronous_compilation(true);
+	tester.finalize_chain(COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	// Render right away, without asking is_ready(). As documented,
+	// this should block until the programs are done, and then
+	// render correctly.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+
+	// Nothing should be left pending after that, so this must not block.
+	EXPECT_TRUE(tester.get_chain()->is_ready());
+	tester.get_chain()->wait_until_ready();
+}
+
+// Renders a few frames with a uniform that changes between them, so that
+// we go more than once around the ring of uniform buffer frames.
+void run_changing_uniform_frames()
+{
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float expected_data[6];
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	MultiplyEffect *mul_effect = new MultiplyEffect();
+	tester.get_chain()->add_effect(mul_effect);
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+
+	for (unsigned frame = 0; frame < 5; ++frame) {
+		const float f = 1.0f / (frame + 1);
+		const float factor[] = { f, f, f, 1.0f };
+		ASSERT_TRUE(mul_effect->set_vec4("factor", factor));
+		for (unsigned i = 0; i < 6; ++i) {
+			expected_data[i] = data[i] * f;
+		}
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+		expect_equal(expected_data, out_data, 3, 2);
+	}
+}
+
+TEST(EffectChainTest, UniformBuffers) {
+	const bool old_uniform_buffers_supported = movit_uniform_buffers_supported;
+	const bool old_persistent_buffers_supported = movit_persistent_buffers_supported;
+
+	// Whatever the platform supports.
+	run_changing_uniform_frames();
+
+	// Uniform buffers, but uploaded with glBufferSubData().
+	movit_persistent_buffers_supported = false;
+	run_changing_uniform_frames();
+
+	// Plain uniforms, like on GLSL 1.30.
+	movit_uniform_buffers_supported = false;
+	run_changing_uniform_frames();
+
+	movit_uniform_buffers_supported = old_uniform_buffers_supported;
+	movit_persistent_buffers_supported = old_persistent_buffers_supported;
+}
+
+TEST(EffectChainTest, UnchangedStateIsNotSetAgain) {
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float expected_data[] = {
+		0.0f, 0.125f, 0.15f,
+		0.375f, 0.5f, 0.5f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	MultiplyEffect *mul_effect = new MultiplyEffect();
+	tester.get_chain()->add_effect(new BouncingIdentityEffect());
+	tester.get_chain()->add_effect(mul_effect);
+
+	// The first time, everything needs to be set.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+	EXPECT_EQ(0u, tester.get_chain()->get_num_elided_gl_calls());
+
+	// The second time, at least the sampler state for the bounce is unchanged.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 3, 2);
+	EXPECT_GT(tester.get_chain()->get_num_elided_gl_calls(), 0u);
+
+	// Changed uniforms must still get through.
+	const float half[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+	ASSERT_TRUE(mul_effect->set_vec4("factor", half));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 3, 2);
+}
+
+TEST(EffectChainTest, ProgramBinaryCache) {
+	float data[] = {
+		0.0f, 0.25f, 0.3f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+
+	char cache_dir[] = "/tmp/movit-program-cache-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(cache_dir));
+
+	// The first pool has to compile everything, and writes it to disk.
+	{
+		ResourcePool resource_pool;
+		resource_pool.set_program_binary_cache_directory(cache_dir);
+		EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA16F_ARB, &resource_pool);
+		if (!movit_program_binaries_supported) {
+			fprintf(stderr, "Skipping test; no support for program binaries.\n");
+			rmdir(cache_dir);
+			return;
+		}
+		tester.get_chain()->add_effect(new RecordingIdentityEffect());
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+		expect_equal(data, out_data, 3, 2);
+
+		EXPECT_EQ(0u, resource_pool.get_program_binary_cache_hits());
+		EXPECT_LT(0u, resource_pool.get_program_binary_cache_misses());
+	}
+
+	// The second pool (standing in for a new process) should be able to
+	// load all of them, and still give the right answer, including when
+	// the program needs to be cloned.
+	{
+		ResourcePool resource_pool;
+		resource_pool.set_program_binary_cache_directory(cache_dir);
+		EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA16F_ARB, &resource_pool);
+		RecordingIdentityEffect *effect = new RecordingIdentityEffect();
+		tester.get_chain()->add_effect(effect);
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+		expect_equal(data, out_data, 3, 2);
+
+		EXPECT_LT(0u, resource_pool.get_program_binary_cache_hits());
+		EXPECT_EQ(0u, resource_pool.get_program_binary_cache_misses());
+
+		GLuint master_program_num = resource_pool.use_glsl_program(effect->last_glsl_program_num);
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+		expect_equal(data, out_data, 3, 2);
+		EXPECT_NE(effect->last_glsl_program_num, master_program_num);
+		resource_pool.unuse_glsl_program(master_program_num);
+	}
+
+	DIR *dir = opendir(cache_dir);
+	ASSERT_NE(nullptr, dir);
+	while (dirent *de = readdir(dir)) {
+		if (de->d_name[0] != '.') {
+			unlink((string(cache_dir) + "/" + de->d_name).c_str());
+		}
+	}
+	closedir(dir);
+	rmdir(cache_dir);
+}
+
 TEST(ComputeShaderTest, Identity) {
 	float data[] = {
 		0.0f, 0.25f, 0.3f,
@@ -1924,4 +2145,479 @@ TEST(ComputeShaderTest, StrongOneToOneButStillNotChained) {
 	expect_equal(data, out_data, 4, 2);
 }
 
+namespace {
+
+// Renders a chain with a few effects that sample a neighborhood, and
+// some that move things around, into a fresh FBO (cleared to 5.0);
+// either all of it or only the given region. Uses its own resource pool,
+// so that no texture contents can be left over from other chains.
+void render_region_test_chain(const float *data, unsigned width, unsigned height,
+                              const unsigned *region, float *out_data)
+{
+	const unsigned out_width = 48, out_height = 36;
+	ResourcePool pool;
+	EffectChain chain(out_width, out_height, &pool);
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_LINEAR;
+
+	FlatInput *input = new FlatInput(format, FORMAT_GRAYSCALE, GL_FLOAT, width, height);
+	input->set_pixel_data(data);
+	chain.add_input(input);
+
+	Effect *resample_effect = chain.add_effect(new ResampleEffect());
+	ASSERT_TRUE(resample_effect->set_int("width", 40));
+	ASSERT_TRUE(resample_effect->set_int("height", 30));
+	ASSERT_TRUE(resample_effect->set_float("zoom_x", 1.2f));
+	Effect *blur_effect = chain.add_effect(new BlurEffect());
+	ASSERT_TRUE(blur_effect->set_float("radius", 1.5f));
+	chain.add_effect(new MirrorEffect());
+	Effect *padding_effect = chain.add_effect(new PaddingEffect());
+	ASSERT_TRUE(padding_effect->set_int("width", out_width));
+	ASSERT_TRUE(padding_effect->set_int("height", out_height));
+	ASSERT_TRUE(padding_effect->set_float("top", 2.0f));
+	ASSERT_TRUE(padding_effect->set_float("left", 5.0f));
+	chain.add_output(format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+	chain.finalize();
+
+	GLuint texnum = pool.create_2d_texture(GL_RGBA32F, out_width, out_height);
+	GLuint fbo = pool.create_fbo(texnum);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	check_error();
+	glClearColor(5.0f, 5.0f, 5.0f, 5.0f);
+	check_error();
+	glClear(GL_COLOR_BUFFER_BIT);
+	check_error();
+
+	if (region == nullptr) {
+		chain.render_to_fbo(fbo, out_width, out_height);
+	} else {
+		chain.render_region_to_fbo(fbo, out_width, out_height, region[0], region[1], region[2], region[3]);
+	}
+
+	float temp[out_width * out_height * 4];
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	check_error();
+	glReadPixels(0, 0, out_width, out_height, GL_RGBA, GL_FLOAT, temp);
+	check_error();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	check_error();
+	for (unsigned i = 0; i < out_width * out_height; ++i) {
+		out_data[i] = temp[i * 4];
+	}
+
+	pool.release_fbo(fbo);
+	pool.release_2d_texture(texnum);
+}
+
+}  // namespace
+
+TEST(EffectChainTest, RegionOfInterestMatchesFullRender) {
+	const unsigned width = 32, height = 24;
+	const unsigned out_width = 48, out_height = 36;
+	float data[width * height];
+	for (unsigned i = 0; i < width * height; ++i) {
+		data[i] = (i * 7919 % 257) / 256.0f;
+	}
+
+	// x, y, width, height, with the origin in the bottom-left corner.
+	const unsigned region[] = { 20, 9, 11, 7 };
+	float region_data[out_width * out_height], full_data[out_width * out_height];
+	render_region_test_chain(data, width, height, region, region_data);
+	render_region_test_chain(data, width, height, nullptr, full_data);
+
+	// Inside the region, we should get exactly the same as for the full render.
+	// Outside it, the FBO should be untouched.
+	float expected_data[out_width * out_height];
+	for (unsigned y = 0; y < out_height; ++y) {
+		for (unsigned x = 0; x < out_width; ++x) {
+			const bool inside = (x >= region[0] && x < region[0] + region[2] &&
+			                     y >= region[1] && y < region[1] + region[3]);
+			expected_data[y * out_width + x] = inside ? full_data[y * out_width + x] : 5.0f;
+		}
+	}
+	expect_equal(expected_data, region_data, out_width, out_height, 1e-3, 1e-4);
+}
+
+namespace {
+
+// Renders input -> blur -> multiply, without any memoization,
+// to compare the memoized results against.
+void render_memoization_test_chain(const float *data, unsigned width, unsigned height,
+                                   float radius, float factor, float *out_data)
+{
+	EffectChainTester tester(data, width, height, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	Effect *blur_effect = tester.get_chain()->add_effect(new BlurEffect());
+	Effect *multiply_effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	const float factor_vec[] = { factor, factor, factor, 1.0f };
+	ASSERT_TRUE(blur_effect->set_float("radius", radius));
+	ASSERT_TRUE(multiply_effect->set_vec4("factor", factor_vec));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+}
+
+}  // namespace
+
+TEST(EffectChainTest, MemoizedPhasesAreReusedUntilSomethingChanges) {
+	const unsigned width = 16, height = 16;
+	float data[width * height], new_data[width * height];
+	for (unsigned i = 0; i < width * height; ++i) {
+		data[i] = (i * 7919 % 257) / 256.0f;
+		new_data[i] = (i * 6007 % 251) / 250.0f;
+	}
+	float out_data[width * height], expected_data[width * height];
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	FlatInput *input = static_cast<FlatInput *>(
+		tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR));
+	Effect *blur_effect = tester.get_chain()->add_effect(new BlurEffect());
+	Effect *multiply_effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	const float factor[] = { 2.0f, 2.0f, 2.0f, 1.0f };
+	ASSERT_TRUE(blur_effect->set_float("radius", 2.0f));
+	ASSERT_TRUE(multiply_effect->set_vec4("factor", factor));
+	tester.get_chain()->enable_phase_memoization(true);
+
+	// The first frame renders everything, and so does the second
+	// (to get the output of the static phases into textures of their own).
+	// From the third frame on, only the last phase needs to be rendered.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(0u, tester.get_chain()->get_num_reused_phases());
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	const uint64_t reused_per_frame = tester.get_chain()->get_num_reused_phases();
+	EXPECT_GT(reused_per_frame, 0u);
+
+	render_memoization_test_chain(data, width, height, 2.0f, 2.0f, expected_data);
+	expect_equal(expected_data, out_data, width, height);
+
+	// The multiplication is in the last phase, so changing it
+	// does not stop us from reusing the blur.
+	const float new_factor[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+	ASSERT_TRUE(multiply_effect->set_vec4("factor", new_factor));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(2 * reused_per_frame, tester.get_chain()->get_num_reused_phases());
+	render_memoization_test_chain(data, width, height, 2.0f, 0.5f, expected_data);
+	expect_equal(expected_data, out_data, width, height);
+
+	// Setting a parameter to the value it already has changes nothing.
+	ASSERT_TRUE(blur_effect->set_float("radius", 2.0f));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(3 * reused_per_frame, tester.get_chain()->get_num_reused_phases());
+
+	// But changing the blur, or the input, does.
+	ASSERT_TRUE(blur_effect->set_float("radius", 3.0f));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(3 * reused_per_frame, tester.get_chain()->get_num_reused_phases());
+	render_memoization_test_chain(data, width, height, 3.0f, 0.5f, expected_data);
+	expect_equal(expected_data, out_data, width, height);
+
+	input->set_pixel_data(new_data);
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(3 * reused_per_frame, tester.get_chain()->get_num_reused_phases());
+	render_memoization_test_chain(new_data, width, height, 3.0f, 0.5f, expected_data);
+	expect_equal(expected_data, out_data, width, height);
+
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	EXPECT_EQ(4 * reused_per_frame, tester.get_chain()->get_num_reused_phases());
+	expect_equal(expected_data, out_data, width, height);
+}
+
+// An effect that does nothing, but requests texture bounce
+// and counts how many times it has been rendered.
+class CountingIdentityEffect : public Effect {
+public:
+	explicit CountingIdentityEffect(unsigned *num_renders) : num_renders(num_renders) {}
+	string effect_type_id() const override { return "CountingIdentityEffect"; }
+	string output_fragment_shader() override { return read_file("identity.frag"); }
+	bool needs_texture_bounce() const override { return true; }
+	void set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num) override
+	{
+		Effect::set_gl_state(glsl_program_num, prefix, sampler_num);
+		++*num_renders;
+	}
+
+private:
+	unsigned *num_renders;
+};
+
+TEST(EffectChainTest, ExtraOutputSharesEarlierPhases) {
+	const float data[] = { 0.0f, 0.1f, 0.25f, 0.5f };
+	float expected_data[4 * 4], expected_extra_data[4 * 4];
+	for (unsigned i = 0; i < 4; ++i) {
+		for (unsigned c = 0; c < 3; ++c) {
+			expected_data[i * 4 + c] = data[i] * 0.5f;
+			expected_extra_data[i * 4 + c] = linear_to_srgb(data[i] * 2.0f);
+		}
+		expected_data[i * 4 + 3] = expected_extra_data[i * 4 + 3] = 1.0f;
+	}
+	float out_data[4 * 4], out_extra_data[4 * 4];
+
+	unsigned num_renders = 0;
+	EffectChainTester tester(data, 4, 1, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	tester.get_chain()->add_effect(new CountingIdentityEffect(&num_renders));
+	Effect *pre_effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	Effect *post_effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	const float pre_factor[] = { 2.0f, 2.0f, 2.0f, 1.0f };
+	const float post_factor[] = { 0.25f, 0.25f, 0.25f, 1.0f };
+	ASSERT_TRUE(pre_effect->set_vec4("factor", pre_factor));
+	ASSERT_TRUE(post_effect->set_vec4("factor", post_factor));
+
+	// The extra output gets its own conversion to sRGB.
+	ImageFormat extra_format;
+	extra_format.color_space = COLORSPACE_sRGB;
+	extra_format.gamma_curve = GAMMA_sRGB;
+	tester.get_chain()->add_extra_output(pre_effect, extra_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+
+	tester.run(vector<float *>{ out_data, out_extra_data }, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 4 * 4, 1);
+	expect_equal(expected_extra_data, out_extra_data, 4 * 4, 1);
+
+	// The part that both outputs need is only rendered once.
+	EXPECT_EQ(1u, num_renders);
+}
+
+TEST(EffectChainTest, ExtraOutputFromLastEffect) {
+	const float data[] = { 0.0f, 0.1f, 0.25f, 0.5f };
+	float expected_data[4 * 4], expected_extra_data[4 * 4];
+	for (unsigned i = 0; i < 4; ++i) {
+		for (unsigned c = 0; c < 3; ++c) {
+			expected_data[i * 4 + c] = data[i] * 2.0f;
+			expected_extra_data[i * 4 + c] = linear_to_srgb(data[i] * 2.0f);
+		}
+		expected_data[i * 4 + 3] = expected_extra_data[i * 4 + 3] = 1.0f;
+	}
+	float out_data[4 * 4], out_extra_data[4 * 4];
+
+	EffectChainTester tester(data, 4, 1, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	Effect *effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	const float factor[] = { 2.0f, 2.0f, 2.0f, 1.0f };
+	ASSERT_TRUE(effect->set_vec4("factor", factor));
+
+	ImageFormat extra_format;
+	extra_format.color_space = COLORSPACE_sRGB;
+	extra_format.gamma_curve = GAMMA_sRGB;
+	tester.get_chain()->add_extra_output(effect, extra_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+
+	tester.run(vector<float *>{ out_data, out_extra_data }, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 4 * 4, 1);
+	expect_equal(expected_extra_data, out_extra_data, 4 * 4, 1);
+}
+
+TEST(EffectChainTest, AsynchronousReadback) {
+	const unsigned width = 7, height = 5;
+	float data[width * height];
+	for (unsigned i = 0; i < width * height; ++i) {
+		data[i] = (i * 7919 % 257) / 256.0f;
+	}
+	float out_data[width * height];
+
+	EffectChainTester tester(data, width, height, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA32F);
+	Effect *multiply_effect = tester.get_chain()->add_effect(new MultiplyEffect());
+	const float factor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	ASSERT_TRUE(multiply_effect->set_vec4("factor", factor));
+
+	// Render normally once, so that the chain gets finalized.
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, width, height);
+
+	// Fill the entire ring, with a different factor for each frame,
+	// before looking at any of them.
+	EffectChain *chain = tester.get_chain();
+	const unsigned num_frames = chain->get_readback_ring_size();
+	vector<EffectChain::ReadbackTicket> tickets;
+	for (unsigned frame = 0; frame < num_frames; ++frame) {
+		const float frame_factor[] = { frame + 1.0f, frame + 1.0f, frame + 1.0f, 1.0f };
+		ASSERT_TRUE(multiply_effect->set_vec4("factor", frame_factor));
+		tickets.push_back(chain->render_to_readback(GL_RGBA32F, width, height, GL_RED, GL_FLOAT));
+	}
+
+	for (unsigned frame = 0; frame < num_frames; ++frame) {
+		const float *pixels = static_cast<const float *>(chain->map_readback(tickets[frame]));
+		EXPECT_TRUE(chain->is_readback_ready(tickets[frame]));
+
+		// The readback has the bottom row first.
+		float expected_data[width * height];
+		for (unsigned y = 0; y < height; ++y) {
+			for (unsigned x = 0; x < width; ++x) {
+				expected_data[(height - y - 1) * width + x] = data[y * width + x] * (frame + 1.0f);
+			}
+		}
+		expect_equal(expected_data, pixels, width, height);
+		chain->release_readback(tickets[frame]);
+	}
+
+	// Now that everything is released, the ring can be used again.
+	EffectChain::ReadbackTicket ticket = chain->render_to_readback(GL_RGBA32F, width, height, GL_RED, GL_FLOAT);
+	EXPECT_NE(tickets.back(), ticket);
+	chain->map_readback(ticket);
+	chain->release_readback(ticket);
+}
+
+TEST(EffectChainTest, PhaseTiming) {
+	float data[] = {
+		0.0f, 0.25f, 0.5f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	if (!movit_timer_queries_supported) {
+		fprintf(stderr, "Skipping test; no support for timer queries.\n");
+		return;
+	}
+	Effect *blur_effect = tester.get_chain()->add_effect(new BlurEffect());
+	ASSERT_TRUE(blur_effect->set_float("radius", 1.0f));
+
+	EffectChain *chain = tester.get_chain();
+	chain->enable_phase_timing(true);
+	const unsigned num_frames = 3;
+	for (unsigned frame = 0; frame < num_frames; ++frame) {
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	}
+
+	// The blur needs (at least) two phases, one of which renders
+	// to an intermediate texture.
+	vector<EffectChain::PhaseTiming> timings = chain->get_phase_timing();
+	ASSERT_GE(timings.size(), 2u);
+	EXPECT_EQ(GLenum(GL_NONE), timings.back().output_format);
+	EXPECT_NE(GLenum(GL_NONE), timings.front().output_format);
+	for (const EffectChain::PhaseTiming &timing : timings) {
+		EXPECT_FALSE(timing.effects.empty());
+		EXPECT_EQ(num_frames, timing.num_cpu_measurements);
+
+		// The results of the queries might not be in yet,
+		// but each one we have must be counted exactly once.
+		EXPECT_LE(timing.num_gpu_measurements, num_frames);
+		uint64_t histogram_sum = 0;
+		for (uint64_t count : timing.gpu_histogram) {
+			histogram_sum += count;
+		}
+		EXPECT_EQ(timing.num_gpu_measurements, histogram_sum);
+		EXPECT_LE(timing.gpu_min_ms, timing.gpu_avg_ms);
+		EXPECT_LE(timing.gpu_avg_ms, timing.gpu_max_ms);
+	}
+
+	const string trace = chain->get_phase_timing_trace();
+	EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+	EXPECT_NE(string::npos, trace.find("\"name\":\"Movit GPU\""));
+
+	chain->reset_phase_timing();
+	for (const EffectChain::PhaseTiming &timing : chain->get_phase_timing()) {
+		EXPECT_EQ(0u, timing.num_cpu_measurements);
+		EXPECT_EQ(0u, timing.num_gpu_measurements);
+	}
+}
+
+TEST(EffectChainTest, PhaseTimingTraceWithManyEffects) {
+	float data[] = {
+		0.0f, 0.25f, 0.5f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	if (!movit_timer_queries_supported) {
+		fprintf(stderr, "Skipping test; no support for timer queries.\n");
+		return;
+	}
+
+	// All of these go into the same phase, giving it a name that is
+	// much longer than any one trace event used to be.
+	const unsigned num_effects = 100;
+	for (unsigned i = 0; i < num_effects; ++i) {
+		tester.get_chain()->add_effect(new IdentityEffect());
+	}
+
+	EffectChain *chain = tester.get_chain();
+	chain->enable_phase_timing(true);
+	for (unsigned frame = 0; frame < 2; ++frame) {
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	}
+	expect_equal(data, out_data, 3, 2);
+
+	const string trace = chain->get_phase_timing_trace();
+	EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+	ASSERT_GE(trace.size(), 2u);
+	EXPECT_EQ("}\n", trace.substr(trace.size() - 2));
+
+	// The full name must be there, not cut off.
+	string effect_names;
+	for (unsigned i = 0; i < num_effects; ++i) {
+		if (i != 0) {
+			effect_names += ", ";
+		}
+		effect_names += "IdentityEffect";
+	}
+	EXPECT_NE(string::npos, trace.find("[FlatInput, " + effect_names + ", "));
+
+	// Braces and brackets must balance outside of strings,
+	// and every string must be closed.
+	vector<char> stack;
+	bool in_string = false;
+	for (char ch : trace) {
+		if (in_string) {
+			ASSERT_NE('\\', ch);  // We never need to escape anything.
+			if (ch == '"') {
+				in_string = false;
+			}
+		} else if (ch == '"') {
+			in_string = true;
+		} else if (ch == '{' || ch == '[') {
+			stack.push_back(ch);
+		} else if (ch == '}' || ch == ']') {
+			ASSERT_FALSE(stack.empty());
+			EXPECT_EQ(ch == '}' ? '{' : '[', stack.back());
+			stack.pop_back();
+		}
+	}
+	EXPECT_FALSE(in_string);
+	EXPECT_TRUE(stack.empty());
+}
+
+TEST(EffectChainTest, DebugLabels) {
+	float data[] = {
+		0.0f, 0.25f, 0.5f,
+		0.75f, 1.0f, 1.0f,
+	};
+	float out_data[6], labeled_out_data[6];
+	EffectChainTester tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	if (!movit_debug_labels_supported) {
+		fprintf(stderr, "Skipping test; no support for debug labels.\n");
+		return;
+	}
+	Effect *blur_effect = tester.get_chain()->add_effect(new BlurEffect());
+	ASSERT_TRUE(blur_effect->set_float("radius", 1.0f));
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	// Labels should not change the output, and all the debug groups
+	// should be popped again.
+	tester.get_chain()->enable_debug_labels(true);
+	tester.run(labeled_out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(out_data, labeled_out_data, 3, 2);
+
+	GLint depth;
+	glGetIntegerv(GL_DEBUG_GROUP_STACK_DEPTH, &depth);
+	EXPECT_EQ(1, depth);
+
+	// The pool labels what it creates from now on.
+	ResourcePool *resource_pool = tester.get_chain()->get_resource_pool();
+	GLuint texnum = resource_pool->create_2d_texture(GL_RGBA8, 3, 2);
+	char label[256];
+	glGetObjectLabel(GL_TEXTURE, texnum, sizeof(label), nullptr, label);
+	EXPECT_EQ(0, strncmp(label, "Movit texture", strlen("Movit texture")));
+	resource_pool->release_2d_texture(texnum);
+
+	// A phase with many effects gets names longer than the driver
+	// accepts; they should be truncated, not give GL errors.
+	EffectChainTester long_tester(data, 3, 2, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	for (unsigned i = 0; i < 50; ++i) {
+		long_tester.get_chain()->add_effect(new IdentityEffect());
+	}
+	long_tester.get_chain()->enable_debug_labels(true);
+	long_tester.run(labeled_out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, labeled_out_data, 3, 2);
+
+	glGetIntegerv(GL_DEBUG_GROUP_STACK_DEPTH, &depth);
+	EXPECT_EQ(1, depth);
+}
+
 }  // namespace movit
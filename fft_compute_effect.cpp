@@ -0,0 +1,144 @@
+#include <epoxy/gl.h>
+#include <math.h>
+#include <algorithm>
+#include <strings.h>
+
+#include "effect_chain.h"
+#include "effect_util.h"
+#include "fft_compute_effect.h"
+#include "util.h"
+
+using namespace std;
+
+namespace movit {
+
+FFTComputeEffect::FFTComputeEffect()
+	: input_width(1280),
+	  input_height(720),
+	  fft_size(64),
+	  direction(FFTPassEffect::HORIZONTAL),
+	  inverse(0),
+	  last_fft_size(-1),
+	  last_inverse(-1)
+{
+	register_int("fft_size", &fft_size);
+	register_int("direction", (int *)&direction);
+	register_int("inverse", &inverse);
+	register_uniform_sampler2d("twiddle_tex", &uniform_twiddle_tex);
+	glGenTextures(1, &tex);
+}
+
+FFTComputeEffect::~FFTComputeEffect()
+{
+	glDeleteTextures(1, &tex);
+}
+
+int FFTComputeEffect::threads_per_fft() const
+{
+	// One radix-4 butterfly per thread; a 2-point FFT has none,
+	// but still needs somebody to do its single radix-2 butterfly.
+	return max(fft_size / 4, 1);
+}
+
+int FFTComputeEffect::ffts_per_group() const
+{
+	// Small FFTs would give tiny workgroups, so put several lines
+	// in each one. 64 threads is a good size for most GPUs.
+	return max(64 / threads_per_fft(), 1);
+}
+
+string FFTComputeEffect::output_fragment_shader()
+{
+	assert(fft_size >= 2 && fft_size <= max_fft_size);
+	assert((fft_size & (fft_size - 1)) == 0);  // Must be power of two.
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"#define FFT_SIZE %d\n"
+		"#define LOG2_FFT_SIZE %d\n"
+		"#define THREADS_PER_FFT %d\n"
+		"#define FFTS_PER_GROUP %d\n"
+		"#define DIRECTION_VERTICAL %d\n",
+		fft_size, ffs(fft_size) - 1, threads_per_fft(), ffts_per_group(),
+		(direction == FFTPassEffect::VERTICAL));
+	return buf + read_file("fft_compute_effect.comp");
+}
+
+void FFTComputeEffect::get_compute_dimensions(unsigned output_width, unsigned output_height,
+                                              unsigned *x, unsigned *y, unsigned *z) const
+{
+	// One workgroup per FFT along the axis, and then enough of them
+	// to cover all the lines (see FFTS_PER_GROUP in the shader).
+	unsigned input_size, num_lines;
+	if (direction == FFTPassEffect::VERTICAL) {
+		input_size = output_height;
+		num_lines = output_width;
+	} else {
+		input_size = output_width;
+		num_lines = output_height;
+	}
+	assert(input_size % fft_size == 0);
+	*x = input_size / fft_size;
+	*y = div_round_up(num_lines, ffts_per_group());
+	*z = 1;
+}
+
+void FFTComputeEffect::set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num)
+{
+	Effect::set_gl_state(glsl_program_num, prefix, sampler_num);
+
+	// See FFTPassEffect::set_gl_state(). We always sample at texel centers,
+	// but there is no point in risking any interpolation.
+	Node *self = chain->find_node_for_effect(this);
+	glActiveTexture(chain->get_input_sampler(self, 0));
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	check_error();
+
+	glActiveTexture(GL_TEXTURE0 + *sampler_num);
+	check_error();
+	glBindTexture(GL_TEXTURE_2D, tex);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	check_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	check_error();
+
+	if (last_fft_size != fft_size || last_inverse != inverse) {
+		generate_twiddle_texture();
+	}
+
+	uniform_twiddle_tex = *sampler_num;
+	++*sampler_num;
+}
+
+void FFTComputeEffect::generate_twiddle_texture()
+{
+	// W_N^k = exp(∓2πik/N) for k in [0, N/2). Unlike FFTPassEffect, we
+	// keep these in fp32; the texture is tiny and read only a few times
+	// per butterfly, and the intermediate values are in fp32, too.
+	int num_twiddles = max(fft_size / 2, 1);
+	float *tmp = new float[num_twiddles * 2];
+	double mulfac;
+	if (inverse) {
+		mulfac = 2.0 * M_PI;
+	} else {
+		mulfac = -2.0 * M_PI;
+	}
+	for (int k = 0; k < num_twiddles; ++k) {
+		tmp[k * 2 + 0] = cos(mulfac * (k / double(fft_size)));
+		tmp[k * 2 + 1] = sin(mulfac * (k / double(fft_size)));
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, num_twiddles, 1, 0, GL_RG, GL_FLOAT, tmp);
+	check_error();
+
+	delete[] tmp;
+
+	last_fft_size = fft_size;
+	last_inverse = inverse;
+}
+
+}  // namespace movit
@@ -0,0 +1,110 @@
+#ifndef _MOVIT_FFT_COMPUTE_EFFECT_H
+#define _MOVIT_FFT_COMPUTE_EFFECT_H 1
+
+// A complete 1D FFT/IFFT in a single compute shader dispatch, as opposed to
+// FFTPassEffect, which needs one full-screen pass (and thus one texture
+// round-trip) for each of the log2(N) stages. The input and output
+// conventions are exactly the same as for a full chain of FFTPassEffects
+// (see fft_pass_effect.h): each pixel holds two complex numbers in (R,G)
+// and (B,A), the output is in-order and unnormalized, many FFTs are done
+// in parallel along the same axis, and vertical FFTs run top-to-bottom
+// in image space, not in OpenGL's bottom-left texture space.
+//
+// Each FFT is loaded into shared memory in bit-reversed order, and then
+// all the decimation-in-time stages are run there, without touching
+// textures except for the (very small) twiddle factor table. Two radix-2
+// stages are fused into one radix-4 butterfly per thread, which halves the
+// number of barriers; if log2(N) is odd, we start with a single radix-2
+// stage, which needs no twiddle factors. Since the intermediate values
+// never leave shared memory, they are also kept in full fp32 precision,
+// whereas the pass chain rounds to fp16 between every stage.
+//
+// The FFT needs to fit in shared memory, and the guaranteed minimum of
+// 32 kB gives us room for 2048 pixels; see max_fft_size. As with all
+// compute shader effects, you should check movit_compute_shaders_supported
+// before using this; FFTConvolutionEffect does so automatically and
+// falls back to FFTPassEffect if needed.
+
+#include <epoxy/gl.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+#include "effect.h"
+#include "fft_pass_effect.h"
+
+namespace movit {
+
+class FFTComputeEffect : public Effect {
+public:
+	FFTComputeEffect();
+	~FFTComputeEffect();
+	std::string effect_type_id() const override {
+		char buf[256];
+		if (inverse) {
+			snprintf(buf, sizeof(buf), "IFFTComputeEffect[%d]", fft_size);
+		} else {
+			snprintf(buf, sizeof(buf), "FFTComputeEffect[%d]", fft_size);
+		}
+		return buf;
+	}
+	std::string output_fragment_shader() override;
+
+	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
+
+	// See FFTPassEffect for why we need a texture bounce; the input must be
+	// a real texture so that we can set it to GL_NEAREST.
+	bool needs_texture_bounce() const override { return true; }
+	bool changes_output_size() const override { return true; }
+	bool sets_virtual_output_size() const override { return false; }
+	bool is_compute_shader() const override { return true; }
+	void get_compute_dimensions(unsigned output_width, unsigned output_height,
+	                            unsigned *x, unsigned *y, unsigned *z) const override;
+
+	void inform_input_size(unsigned input_num, unsigned width, unsigned height) override
+	{
+		assert(input_num == 0);
+		input_width = width;
+		input_height = height;
+	}
+
+	void get_output_size(unsigned *width, unsigned *height,
+	                     unsigned *virtual_width, unsigned *virtual_height) const override {
+		*width = *virtual_width = input_width;
+		*height = *virtual_height = input_height;
+	}
+
+	void inform_added(EffectChain *chain) override { this->chain = chain; }
+
+	// The largest FFT that fits in the minimum amount of shared memory
+	// OpenGL guarantees (GL_MAX_COMPUTE_SHARED_MEMORY_SIZE >= 32768),
+	// at one vec4 per pixel.
+	static const int max_fft_size = 2048;
+
+	// Uses the same values as FFTPassEffect.
+	typedef FFTPassEffect::Direction Direction;
+
+private:
+	void generate_twiddle_texture();
+
+	// How many threads work together on each FFT, and how many FFTs
+	// (lines) each workgroup processes. Must match the shader.
+	int threads_per_fft() const;
+	int ffts_per_group() const;
+
+	EffectChain *chain;
+	int input_width, input_height;
+	GLuint tex;
+	GLint uniform_twiddle_tex;
+
+	int fft_size;
+	Direction direction;
+	int inverse;  // 0 = forward (FFT), 1 = reverse (IFFT).
+
+	int last_fft_size;
+	int last_inverse;
+};
+
+}  // namespace movit
+
+#endif // !defined(_MOVIT_FFT_COMPUTE_EFFECT_H)
@@ -0,0 +1,213 @@
+// Unit tests for FFTComputeEffect.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <epoxy/gl.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "effect_chain.h"
+#include "fft_compute_effect.h"
+#include "fft_pass_effect.h"
+#include "fp16.h"
+#include "image_format.h"
+#include "test_util.h"
+
+using namespace std;
+
+namespace movit {
+
+namespace {
+
+// Generate a random number uniformly distributed between [-1.0, 1.0],
+// rounded to fp16 so that the input texture holds exactly the same
+// values as our reference.
+float uniform_random_fp16()
+{
+	return fp16_to_fp32(fp32_to_fp16(2.0 * ((float)rand() / RAND_MAX - 0.5)));
+}
+
+Effect *add_fft(EffectChain *chain, int fft_size, bool inverse, FFTPassEffect::Direction direction)
+{
+	Effect *fft_effect = chain->add_effect(new FFTComputeEffect());
+	bool ok = fft_effect->set_int("fft_size", fft_size);
+	ok |= fft_effect->set_int("inverse", inverse);
+	ok |= fft_effect->set_int("direction", direction);
+	assert(ok);
+	return fft_effect;
+}
+
+// A straightforward O(n²) DFT of a width x height RGBA image (top-to-bottom),
+// done along the given axis as FFTComputeEffect would, but in double precision.
+void reference_dft(const float *in, float *out, unsigned width, unsigned height,
+                   int fft_size, bool inverse, FFTPassEffect::Direction direction)
+{
+	const double mulfac = inverse ? 2.0 * M_PI : -2.0 * M_PI;
+	const int pixel_stride = (direction == FFTPassEffect::HORIZONTAL) ? 4 : width * 4;
+	const int line_stride = (direction == FFTPassEffect::HORIZONTAL) ? width * 4 : 4;
+	const unsigned num_lines = (direction == FFTPassEffect::HORIZONTAL) ? height : width;
+	const unsigned num_segments = ((direction == FFTPassEffect::HORIZONTAL) ? width : height) / fft_size;
+
+	for (unsigned line = 0; line < num_lines; ++line) {
+		for (unsigned segment = 0; segment < num_segments; ++segment) {
+			const int base = line * line_stride + segment * fft_size * pixel_stride;
+			for (int k = 0; k < fft_size; ++k) {
+				double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+				for (int n = 0; n < fft_size; ++n) {
+					const float *src = in + base + n * pixel_stride;
+					double angle = mulfac * ((long(n) * k) % fft_size) / fft_size;
+					double w_re = cos(angle), w_im = sin(angle);
+					sum[0] += src[0] * w_re - src[1] * w_im;
+					sum[1] += src[0] * w_im + src[1] * w_re;
+					sum[2] += src[2] * w_re - src[3] * w_im;
+					sum[3] += src[2] * w_im + src[3] * w_re;
+				}
+				for (int c = 0; c < 4; ++c) {
+					out[base + k * pixel_stride + c] = sum[c];
+				}
+			}
+		}
+	}
+}
+
+}  // namespace
+
+TEST(FFTComputeEffectTest, Impulse) {
+	DisableComputeShadersTemporarily disabler(false);
+	if (disabler.should_skip()) return;
+
+	const int fft_size = 16;
+	float in[fft_size * 4], out[fft_size * 4], expected_out[fft_size * 4];
+	for (int i = 0; i < fft_size; ++i) {
+		in[i * 4 + 0] = 0.0;
+		in[i * 4 + 1] = 0.0;
+		in[i * 4 + 2] = 0.0;
+		in[i * 4 + 3] = 0.0;
+		expected_out[i * 4 + 0] = 1.0;
+		expected_out[i * 4 + 1] = 0.0;
+		expected_out[i * 4 + 2] = 1.0;
+		expected_out[i * 4 + 3] = 0.0;
+	}
+	in[0] = 1.0;
+	in[2] = 1.0;
+
+	for (int inverse = 0; inverse <= 1; ++inverse) {
+		EffectChainTester tester(in, fft_size, 1, FORMAT_RGBA_PREMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+		add_fft(tester.get_chain(), fft_size, inverse, FFTPassEffect::HORIZONTAL);
+		tester.run(out, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+
+		expect_equal(expected_out, out, 4, fft_size);
+	}
+}
+
+// Checks all supported sizes, both directions, and several FFTs
+// (both repeats along the axis and lines) in parallel.
+TEST(FFTComputeEffectTest, MatchesReferenceDFT) {
+	DisableComputeShadersTemporarily disabler(false);
+	if (disabler.should_skip()) return;
+
+	srand(1234);
+	for (int fft_size = 2; fft_size <= FFTComputeEffect::max_fft_size; fft_size *= 2) {
+		for (int direction = FFTPassEffect::HORIZONTAL; direction <= FFTPassEffect::VERTICAL; ++direction) {
+			for (int inverse = 0; inverse <= 1; ++inverse) {
+				unsigned width, height;
+				if (direction == FFTPassEffect::HORIZONTAL) {
+					width = fft_size * 2;
+					height = 3;
+				} else {
+					width = 3;
+					height = fft_size * 2;
+				}
+				const unsigned num_values = width * height * 4;
+				unique_ptr<float[]> in(new float[num_values]);
+				unique_ptr<float[]> out(new float[num_values]);
+				unique_ptr<float[]> expected_out(new float[num_values]);
+				for (unsigned i = 0; i < num_values; ++i) {
+					in[i] = uniform_random_fp16();
+				}
+				reference_dft(in.get(), expected_out.get(), width, height, fft_size, inverse, FFTPassEffect::Direction(direction));
+
+				EffectChainTester tester(in.get(), width, height, FORMAT_RGBA_PREMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+				add_fft(tester.get_chain(), fft_size, inverse, FFTPassEffect::Direction(direction));
+				tester.run(out.get(), GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+
+				// The output magnitudes grow as sqrt(N), and the intermediate
+				// texture is fp16, so scale down before comparing.
+				const float scale = 1.0 / sqrt(fft_size);
+				for (unsigned i = 0; i < num_values; ++i) {
+					out[i] *= scale;
+					expected_out[i] *= scale;
+				}
+				SCOPED_TRACE(testing::Message() << "fft_size=" << fft_size << " direction=" << direction << " inverse=" << inverse);
+				expect_equal(expected_out.get(), out.get(), width * 4, height, 0.002, 0.0002);
+			}
+		}
+	}
+}
+
+// Same as the corresponding FFTPassEffect test, with the same
+// numbers verified using fft2() in Octave.
+TEST(FFTComputeEffectTest, TwoDimensional) {
+	DisableComputeShadersTemporarily disabler(false);
+	if (disabler.should_skip()) return;
+
+	const int fft_size = 16;
+	float in[fft_size * fft_size * 4], out[fft_size * fft_size * 4], expected_out[fft_size * fft_size * 4];
+	for (int y = 0; y < fft_size; ++y) {
+		for (int x = 0; x < fft_size; ++x) {
+			in[(y * fft_size + x) * 4 + 0] =
+				sin(2.0 * M_PI * (2 * x + 3 * y) / fft_size);
+			in[(y * fft_size + x) * 4 + 1] = 0.0;
+			in[(y * fft_size + x) * 4 + 2] = 0.0;
+			in[(y * fft_size + x) * 4 + 3] = 0.0;
+		}
+	}
+	memset(expected_out, 0, sizeof(expected_out));
+	expected_out[(3 * fft_size + 2) * 4 + 1] = -128.0;
+	expected_out[(13 * fft_size + 14) * 4 + 1] = 128.0;
+
+	EffectChainTester tester(in, fft_size, fft_size, FORMAT_RGBA_PREMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	add_fft(tester.get_chain(), fft_size, false, FFTPassEffect::HORIZONTAL);
+	add_fft(tester.get_chain(), fft_size, false, FFTPassEffect::VERTICAL);
+	tester.run(out, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+
+	expect_equal(expected_out, out, 4 * fft_size, fft_size, 0.25, 0.0005);
+}
+
+#ifdef HAVE_BENCHMARK
+// A full 64-point FFT, either as one FFTComputeEffect or as the
+// six-pass FFTPassEffect chain it replaces in FFTConvolutionEffect.
+// The sizes are the standard resolutions padded up to a multiple of 64.
+void BM_FFT64(benchmark::State &state, FFTPassEffect::Direction direction, const std::string &shader_type)
+{
+	DisableComputeShadersTemporarily disabler(shader_type == "fragment");
+	if (disabler.should_skip(&state)) return;
+
+	const int fft_size = 64;
+	EffectBenchmark bench(state, BENCHMARK_FP16, 1, FORMAT_RGBA_PREMULTIPLIED_ALPHA);
+	if (shader_type == "compute") {
+		Effect *fft_effect = bench.add_effect(new FFTComputeEffect());
+		ASSERT_TRUE(fft_effect->set_int("fft_size", fft_size));
+		ASSERT_TRUE(fft_effect->set_int("inverse", 0));
+		ASSERT_TRUE(fft_effect->set_int("direction", direction));
+	} else {
+		for (int i = 1; (1 << i) <= fft_size; ++i) {
+			Effect *fft_effect = (i == 1) ? bench.add_effect(new FFTPassEffect()) : bench.get_chain()->add_effect(new FFTPassEffect());
+			ASSERT_TRUE(fft_effect->set_int("fft_size", fft_size));
+			ASSERT_TRUE(fft_effect->set_int("pass_number", i));
+			ASSERT_TRUE(fft_effect->set_int("inverse", 0));
+			ASSERT_TRUE(fft_effect->set_int("direction", direction));
+		}
+	}
+	bench.run(OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+}
+BENCHMARK_CAPTURE(BM_FFT64, HorizontalFragment, FFTPassEffect::HORIZONTAL, "fragment")->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFT64, HorizontalCompute, FFTPassEffect::HORIZONTAL, "compute")->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFT64, VerticalFragment, FFTPassEffect::VERTICAL, "fragment")->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFT64, VerticalCompute, FFTPassEffect::VERTICAL, "compute")->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
+}  // namespace movit
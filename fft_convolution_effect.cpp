@@ -1,13 +1,23 @@
 #include <epoxy/gl.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
 
 #include "complex_modulate_effect.h"
 #include "effect_chain.h"
+#include "fft_compute_effect.h"
 #include "fft_convolution_effect.h"
 #include "fft_input.h"
 #include "fft_pass_effect.h"
+#include "flat_input.h"
+#include "init.h"
 #include "multiply_effect.h"
 #include "padding_effect.h"
+#include "resource_pool.h"
 #include "slice_effect.h"
 #include "util.h"
 
@@ -22,7 +32,11 @@ FFTConvolutionEffect::FFTConvolutionEffect(int input_width, int input_height, in
 	  convolve_height(convolve_height),
 	  fft_input(new FFTInput(convolve_width, convolve_height)),
 	  crop_effect(new PaddingEffect()),
-	  owns_effects(true) {
+	  owns_effects(true),
+	  measure_plans(0),
+	  plan_source(PLAN_NONE),
+	  has_forced_plan(false) {
+	register_int("measure_plans", &measure_plans);
 	CHECK(crop_effect->set_int("width", input_width));
 	CHECK(crop_effect->set_int("height", input_height));
 	CHECK(crop_effect->set_float("top", 0));
@@ -39,6 +53,61 @@ FFTConvolutionEffect::~FFTConvolutionEffect()
 
 namespace {
 
+// When measuring, how many of the best plans according to the estimate
+// we actually try, and how many times we render each of them.
+// The estimate is not _that_ bad, so there's little point in trying
+// everything, which could take minutes.
+const size_t max_measured_plans = 8;
+const int num_measure_runs = 5;
+
+// Whether we can do an FFT of the given size in a single compute shader
+// dispatch (see FFTComputeEffect), instead of one FFTPassEffect per pass.
+bool use_compute_fft(int fft_size)
+{
+	return movit_compute_shaders_supported && fft_size >= 2 && fft_size <= FFTComputeEffect::max_fft_size;
+}
+
+// Estimated number of texel fetches for doing FFTs of the given size
+// over the given number of pixels; see rewrite_graph().
+size_t fft_cost(int fft_size, size_t num_pixels)
+{
+	int num_passes = ffs(fft_size) - 1;
+	if (use_compute_fft(fft_size)) {
+		// Every pixel is read once, and each radix-4 butterfly
+		// (four pixels, two passes) reads three twiddle factors.
+		return num_pixels + num_passes * 3 * num_pixels / 8;
+	} else {
+		// log(N) FFT passes. Each pass reads two inputs per pixel,
+		// plus the support texture.
+		return num_passes * 3 * num_pixels;
+	}
+}
+
+// Returns the last Effect in the new chain.
+Effect *add_fft(EffectChain *chain, Effect *last_effect, int fft_size, FFTPassEffect::Direction direction, bool inverse)
+{
+	if (use_compute_fft(fft_size)) {
+		Effect *fft_effect = chain->add_effect(new FFTComputeEffect(), last_effect);
+		CHECK(fft_effect->set_int("fft_size", fft_size));
+		CHECK(fft_effect->set_int("direction", direction));
+		CHECK(fft_effect->set_int("inverse", inverse));
+		return fft_effect;
+	}
+
+	int num_passes = ffs(fft_size) - 1;
+	for (int i = 1; i <= num_passes; ++i) {
+		Effect *fft_effect = chain->add_effect(new FFTPassEffect(), last_effect);
+		CHECK(fft_effect->set_int("pass_number", i));
+		CHECK(fft_effect->set_int("fft_size", fft_size));
+		CHECK(fft_effect->set_int("direction", direction));
+		CHECK(fft_effect->set_int("inverse", inverse));
+
+		last_effect = fft_effect;
+	}
+
+	return last_effect;
+}
+
 // Returns the last Effect in the new chain.
 Effect *add_overlap_and_fft(EffectChain *chain, Effect *last_effect, int fft_size, int pad_size, FFTPassEffect::Direction direction)
 {
@@ -58,35 +127,13 @@ Effect *add_overlap_and_fft(EffectChain *chain, Effect *last_effect, int fft_siz
 		last_effect = overlap_effect;
 	}
 
-	// FFT.
-	int num_passes = ffs(fft_size) - 1;
-	for (int i = 1; i <= num_passes; ++i) {
-		Effect *fft_effect = chain->add_effect(new FFTPassEffect(), last_effect);
-		CHECK(fft_effect->set_int("pass_number", i));
-		CHECK(fft_effect->set_int("fft_size", fft_size));
-		CHECK(fft_effect->set_int("direction", direction));
-		CHECK(fft_effect->set_int("inverse", 0));
-
-		last_effect = fft_effect;
-	}
-
-	return last_effect;
+	return add_fft(chain, last_effect, fft_size, direction, /*inverse=*/false);
 }
 
 // Returns the last Effect in the new chain.
 Effect *add_ifft_and_discard(EffectChain *chain, Effect *last_effect, int fft_size, int pad_size, FFTPassEffect::Direction direction)
 {
-	// IFFT.
-	int num_passes = ffs(fft_size) - 1;
-	for (int i = 1; i <= num_passes; ++i) {
-		Effect *fft_effect = chain->add_effect(new FFTPassEffect(), last_effect);
-		CHECK(fft_effect->set_int("pass_number", i));
-		CHECK(fft_effect->set_int("fft_size", fft_size));
-		CHECK(fft_effect->set_int("direction", direction));
-		CHECK(fft_effect->set_int("inverse", 1));
-
-		last_effect = fft_effect;
-	}
+	last_effect = add_fft(chain, last_effect, fft_size, direction, /*inverse=*/true);
 
 	// Discard.
 	{
@@ -109,7 +156,7 @@ Effect *add_ifft_and_discard(EffectChain *chain, Effect *last_effect, int fft_si
 
 }  // namespace
 
-void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
+vector<FFTConvolutionEffect::Plan> FFTConvolutionEffect::estimate_plans() const
 {
 	int pad_width = convolve_width - 1;
 	int pad_height = convolve_height - 1;
@@ -123,8 +170,7 @@ void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
 	int max_y = next_power_of_two(input_height + pad_width);
 	int max_x = next_power_of_two(input_width + pad_height);
 
-	size_t best_cost = numeric_limits<size_t>::max();
-	int best_x = -1, best_y = -1, best_x_before_y_fft = -1, best_x_before_y_ifft = -1;
+	vector<pair<size_t, Plan>> candidates;
 
 	// Try both
 	//
@@ -155,72 +201,110 @@ void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
 						// First, the cost of the horizontal padding.
 						cost = output_width * input_height;
 
-						// log(X) FFT passes. Each pass reads two inputs per pixel,
-						// plus the support texture.
-						cost += (ffs(x) - 1) * 3 * output_width * input_height;
+						// The horizontal FFT.
+						cost += fft_cost(x, output_width * input_height);
 
 						// Now, horizontal padding.
 						cost += output_width * output_height;
 
-						// log(Y) FFT passes, now at full resolution.
-						cost += (ffs(y) - 1) * 3 * output_width * output_height;
+						// The vertical FFT, now at full resolution.
+						cost += fft_cost(y, output_width * output_height);
 					} else {
 						// First, the cost of the vertical padding.
 						cost = input_width * output_height;
 
-						// log(Y) FFT passes. Each pass reads two inputs per pixel,
-						// plus the support texture.
-						cost += (ffs(y) - 1) * 3 * input_width * output_height;
+						// The vertical FFT.
+						cost += fft_cost(y, input_width * output_height);
 
 						// Now, horizontal padding.
 						cost += output_width * output_height;
 
-						// log(X) FFT passes, now at full resolution.
-						cost += (ffs(x) - 1) * 3 * output_width * output_height;
+						// The horizontal FFT, now at full resolution.
+						cost += fft_cost(x, output_width * output_height);
 					}
 
 					// The actual modulation. Reads one pixel each from two textures.
 					cost += 2 * output_width * output_height;
 
 					if (x_before_y_ifft) {
-						// log(X) IFFT passes.
-						cost += (ffs(x) - 1) * 3 * output_width * output_height;
+						// Horizontal IFFT.
+						cost += fft_cost(x, output_width * output_height);
 
 						// Discard horizontally.
 						cost += input_width * output_height;
 
-						// log(Y) IFFT passes.
-						cost += (ffs(y) - 1) * 3 * input_width * output_height;
+						// Vertical IFFT.
+						cost += fft_cost(y, input_width * output_height);
 
 						// Discard horizontally.
 						cost += input_width * input_height;
 					} else {
-						// log(Y) IFFT passes.
-						cost += (ffs(y) - 1) * 3 * output_width * output_height;
+						// Vertical IFFT.
+						cost += fft_cost(y, output_width * output_height);
 
 						// Discard vertically.
 						cost += output_width * input_height;
 
-						// log(X) IFFT passes.
-						cost += (ffs(x) - 1) * 3 * output_width * input_height;
+						// Horizontal IFFT.
+						cost += fft_cost(x, output_width * input_height);
 
 						// Discard horizontally.
 						cost += input_width * input_height;
 					}
 
-					if (cost < best_cost) {
-						best_x = x;
-						best_y = y;
-						best_x_before_y_fft = x_before_y_fft;
-						best_x_before_y_ifft = x_before_y_ifft;
-						best_cost = cost;
-					}
+					candidates.emplace_back(cost, Plan{ x, y, x_before_y_fft, x_before_y_ifft });
 				}
 			}
 		}
 	}
 
-	const int fft_width = best_x, fft_height = best_y;
+	// Stable, so that ties are broken the same way as they always were
+	// (the first one tried wins).
+	stable_sort(candidates.begin(), candidates.end(),
+		[](const pair<size_t, Plan> &a, const pair<size_t, Plan> &b) {
+			return a.first < b.first;
+		});
+
+	vector<Plan> plans;
+	for (const pair<size_t, Plan> &candidate : candidates) {
+		plans.push_back(candidate.second);
+	}
+	return plans;
+}
+
+void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
+{
+	int pad_width = convolve_width - 1;
+	int pad_height = convolve_height - 1;
+
+	Plan plan;
+	if (has_forced_plan) {
+		plan = forced_plan;
+	} else if (!wisdom_file.empty() && load_wisdom(&plan)) {
+		plan_source = PLAN_FROM_WISDOM;
+	} else if (measure_plans) {
+		vector<Plan> plans = estimate_plans();
+		if (plans.size() > max_measured_plans) {
+			plans.resize(max_measured_plans);
+		}
+		double best_time = numeric_limits<double>::max();
+		for (const Plan &candidate : plans) {
+			double time = measure_plan(candidate, chain->get_resource_pool());
+			if (time < best_time) {
+				plan = candidate;
+				best_time = time;
+			}
+		}
+		plan_source = PLAN_MEASURED;
+		if (!wisdom_file.empty()) {
+			save_wisdom(plan);
+		}
+	} else {
+		plan = estimate_plans().front();
+		plan_source = PLAN_ESTIMATED;
+	}
+
+	const int fft_width = plan.fft_width, fft_height = plan.fft_height;
 
 	assert(self->incoming_links.size() == 1);
 	Node *last_node = self->incoming_links[0];
@@ -229,7 +313,7 @@ void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
 
 	// Do FFT.
 	Effect *last_effect = last_node->effect;
-	if (best_x_before_y_fft) {
+	if (plan.x_before_y_fft) {
 		last_effect = add_overlap_and_fft(chain, last_effect, fft_width, pad_width, FFTPassEffect::HORIZONTAL);
 		last_effect = add_overlap_and_fft(chain, last_effect, fft_height, pad_height, FFTPassEffect::VERTICAL);
 	} else {
@@ -256,7 +340,7 @@ void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
 	last_effect = modulate_effect;
 
 	// Finally, do IFFT.
-	if (best_x_before_y_ifft) {
+	if (plan.x_before_y_ifft) {
 		last_effect = add_ifft_and_discard(chain, last_effect, fft_width, pad_width, FFTPassEffect::HORIZONTAL);
 		last_effect = add_ifft_and_discard(chain, last_effect, fft_height, pad_height, FFTPassEffect::VERTICAL);
 	} else {
@@ -271,4 +355,159 @@ void FFTConvolutionEffect::rewrite_graph(EffectChain *chain, Node *self)
 	self->disabled = true;
 }
 
+double FFTConvolutionEffect::measure_plan(const Plan &plan, ResourcePool *resource_pool) const
+{
+	// The pixel and kernel values do not matter for the timing,
+	// so we just use zeros.
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_LINEAR;
+	vector<float> pixels(input_width * input_height * 4, 0.0f);
+	vector<float> kernel(convolve_width * convolve_height, 0.0f);
+
+	EffectChain measure_chain(input_width, input_height, resource_pool);
+	FlatInput *input = new FlatInput(format, FORMAT_RGBA_PREMULTIPLIED_ALPHA, GL_FLOAT, input_width, input_height);
+	input->set_pixel_data(pixels.data());
+	measure_chain.add_input(input);
+
+	FFTConvolutionEffect *effect = new FFTConvolutionEffect(input_width, input_height, convolve_width, convolve_height);
+	effect->has_forced_plan = true;
+	effect->forced_plan = plan;
+	effect->set_convolution_kernel(kernel.data());
+	measure_chain.add_effect(effect);
+	measure_chain.add_output(format, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+	measure_chain.finalize();
+
+	GLuint tex = resource_pool->create_2d_texture(GL_RGBA16F, input_width, input_height);
+	const vector<EffectChain::DestinationTexture> destinations{ { tex, GL_RGBA16F } };
+
+	// Run once first, to get the uploads and any lazy driver work
+	// (shader recompiles etc.) out of the way.
+	measure_chain.render_to_texture(destinations, input_width, input_height);
+	glFinish();
+	check_error();
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < num_measure_runs; ++i) {
+		measure_chain.render_to_texture(destinations, input_width, input_height);
+	}
+	glFinish();
+	check_error();
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	resource_pool->release_2d_texture(tex);
+	return elapsed / num_measure_runs;
+}
+
+string FFTConvolutionEffect::get_wisdom_key() const
+{
+	// Compute shaders change the cost of the FFTs completely
+	// (see fft_cost()), so the best plan depends on them, too.
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%d %d %d %d %d ",
+		input_width, input_height, convolve_width, convolve_height,
+		int(movit_compute_shaders_supported));
+	string key = buf;
+	key += (const char *)glGetString(GL_VENDOR);
+	key += ", ";
+	key += (const char *)glGetString(GL_RENDERER);
+	key += ", ";
+	key += (const char *)glGetString(GL_VERSION);
+	check_error();
+	return key;
+}
+
+// The wisdom file consists of lines of the form
+//
+//   <fft_width> <fft_height> <x_before_y_fft> <x_before_y_ifft> <key>
+//
+// where the key is given by get_wisdom_key(), and contains the driver
+// strings at the end (which may contain spaces, but not newlines).
+bool FFTConvolutionEffect::load_wisdom(Plan *plan) const
+{
+	FILE *fp = fopen(wisdom_file.c_str(), "r");
+	if (fp == nullptr) {
+		return false;
+	}
+
+	const string key = get_wisdom_key();
+	bool found = false;
+	char line[1024];
+	while (fgets(line, sizeof(line), fp) != nullptr) {
+		line[strcspn(line, "\n")] = 0;
+		Plan candidate;
+		int key_pos = -1;
+		if (sscanf(line, "%d %d %d %d %n", &candidate.fft_width, &candidate.fft_height,
+		           &candidate.x_before_y_fft, &candidate.x_before_y_ifft, &key_pos) == 4 &&
+		    key_pos != -1 && key == line + key_pos) {
+			// Later entries override earlier ones, so keep going.
+			*plan = candidate;
+			found = true;
+		}
+	}
+	fclose(fp);
+
+	// Don't trust anything that could make us build an invalid chain.
+	if (found &&
+	    (plan->fft_width <= 0 || (plan->fft_width & (plan->fft_width - 1)) != 0 ||
+	     plan->fft_height <= 0 || (plan->fft_height & (plan->fft_height - 1)) != 0 ||
+	     plan->fft_width < convolve_width || plan->fft_height < convolve_height)) {
+		fprintf(stderr, "%s: Ignoring invalid plan for %s\n", wisdom_file.c_str(), key.c_str());
+		found = false;
+	}
+	return found;
+}
+
+void FFTConvolutionEffect::save_wisdom(const Plan &plan) const
+{
+	const string key = get_wisdom_key();
+
+	// Keep all the other entries (dropping any old ones for the same key).
+	string contents;
+	FILE *fp = fopen(wisdom_file.c_str(), "r");
+	if (fp != nullptr) {
+		char line[1024];
+		while (fgets(line, sizeof(line), fp) != nullptr) {
+			int key_pos = -1;
+			int dummy[4];
+			string line_str = line;
+			if (!line_str.empty() && line_str.back() == '\n') {
+				line_str.pop_back();
+			}
+			if (sscanf(line, "%d %d %d %d %n", &dummy[0], &dummy[1], &dummy[2], &dummy[3], &key_pos) == 4 &&
+			    key_pos != -1 && key == line_str.substr(key_pos)) {
+				continue;
+			}
+			contents += line_str + "\n";
+		}
+		fclose(fp);
+	}
+
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%d %d %d %d ",
+		plan.fft_width, plan.fft_height, plan.x_before_y_fft, plan.x_before_y_ifft);
+	contents += buf + key + "\n";
+
+	// Write to a temporary file and then rename it into place, so that
+	// other processes sharing the same file never see a partial one.
+	// (See ResourcePool::save_program_binary().)
+	char tmp_suffix[32];
+	snprintf(tmp_suffix, sizeof(tmp_suffix), ".%d.tmp", int(getpid()));
+	const string tmp_filename = wisdom_file + tmp_suffix;
+
+	fp = fopen(tmp_filename.c_str(), "w");
+	if (fp == nullptr) {
+		perror(tmp_filename.c_str());
+		return;
+	}
+	bool ok = (fwrite(contents.data(), contents.size(), 1, fp) == 1);
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(tmp_filename.c_str(), wisdom_file.c_str()) == -1) {
+		perror(wisdom_file.c_str());
+		unlink(tmp_filename.c_str());
+	}
+}
+
 }  // namespace movit
@@ -54,6 +54,16 @@
 // by ~2x over simple estimation, but they also have much more freedom in
 // their execution model than we do.
 //
+// Following FFTW, you can ask for measuring, too (set “measure_plans” to 1):
+// In finalize(), the most promising plans according to the estimate are then
+// built and timed on the GPU, one by one, and the fastest one wins. This takes
+// a while (typically seconds), so you will want to give a wisdom file
+// (see set_wisdom_file()), where the winner is stored, keyed on the image size,
+// the kernel size and the OpenGL driver. Later runs (or later chains) with
+// the same parameters will then find it there and not measure again.
+// If no wisdom is found and measuring is not enabled, we fall back to the
+// estimate as usual.
+//
 // The output _size_ of a convolution can be defined in a couple of different
 // ways; in a sense, what's the most reasonable is using only the central part
 // of the result (the mode “valid” in MATLAB/Octave), since that is the only
@@ -66,14 +76,16 @@
 // an okay tradeoff.
 //
 // FFTConvolutionEffect does not do any actual pixel work by itself; it
-// rewrites itself into a long chain of SliceEffect, FFTPassEffect, FFTInput
-// and ComplexModulationEffect to do its bidding. Note that currently, due to
+// rewrites itself into a long chain of SliceEffect, FFTPassEffect (or
+// FFTComputeEffect, if compute shaders are available), FFTInput and
+// ComplexModulationEffect to do its bidding. Note that currently, due to
 // Movit limitations, we need to know the number of FFT passes at finalize()
 // time, which in turn means you cannot change image or kernel size on the fly.
 
 #include <assert.h>
 #include <epoxy/gl.h>
 #include <string>
+#include <vector>
 
 #include "effect.h"
 #include "fft_input.h"
@@ -81,6 +93,7 @@
 namespace movit {
 
 class PaddingEffect;
+class ResourcePool;
 
 class FFTConvolutionEffect : public Effect {
 public:
@@ -97,7 +110,36 @@ public:
 		fft_input->set_pixel_data(pixel_data);
 	}
 
+	// Where to look for (and, if measuring, store) the best plans for
+	// given sizes; see the comment at the top of the file. The file is
+	// a simple text file, and will be created if it does not exist.
+	// Several effects (and several processes) can share the same file.
+	// An empty string (the default) means not to use any wisdom.
+	void set_wisdom_file(const std::string &filename) { wisdom_file = filename; }
+
+	// How the plan was chosen in the last call to finalize().
+	enum PlanSource { PLAN_NONE, PLAN_ESTIMATED, PLAN_MEASURED, PLAN_FROM_WISDOM };
+	PlanSource get_plan_source() const { return plan_source; }
+
 private:
+	// The FFT sizes, and the order of the X and Y passes; see rewrite_graph().
+	struct Plan {
+		int fft_width, fft_height;
+		int x_before_y_fft, x_before_y_ifft;
+	};
+
+	// All possible plans, sorted by estimated cost, cheapest first.
+	std::vector<Plan> estimate_plans() const;
+
+	// Builds a chain with just this convolution (using the given plan)
+	// and returns the average time to render it, in seconds.
+	double measure_plan(const Plan &plan, ResourcePool *resource_pool) const;
+
+	// Looks for / stores a plan for our parameters in the wisdom file.
+	bool load_wisdom(Plan *plan) const;
+	void save_wisdom(const Plan &plan) const;
+	std::string get_wisdom_key() const;
+
 	int input_width, input_height;
 	int convolve_width, convolve_height;
 
@@ -106,6 +148,15 @@ private:
 	FFTInput *fft_input;
 	PaddingEffect *crop_effect;
 	bool owns_effects;
+
+	int measure_plans;
+	std::string wisdom_file;
+	PlanSource plan_source;
+
+	// Used by measure_plan(), so that the chains it builds
+	// do not start measuring themselves.
+	bool has_forced_plan;
+	Plan forced_plan;
 };
 
 }  // namespace movit
@@ -2,8 +2,15 @@
 
 #include <epoxy/gl.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
 
 #include "effect_chain.h"
+#include "fft_input.h"
 #include "gtest/gtest.h"
 #include "image_format.h"
 #include "test_util.h"
@@ -208,4 +215,159 @@ TEST(FFTConvolutionEffectTest, NegativeCoefficients) {
 	expect_equal(expected_data, out_data, size, size, 0.02, 0.003);
 }
 
+// FFTInput reuses its buffers and texture when the kernel changes;
+// make sure the old kernel does not linger anywhere.
+TEST(FFTConvolutionEffectTest, ChangeKernel) {
+	const int size = 4, convolve_size = 3;
+
+	float data[size * size] = {
+		0.1, 1.1, 2.1, 3.1,
+		0.2, 1.2, 2.2, 3.2,
+		0.3, 1.3, 2.3, 3.3,
+		0.4, 1.4, 2.4, 3.4,
+	};
+	float move_right_kernel[convolve_size * convolve_size] = {
+		0.0, 1.0, 0.0,
+		0.0, 0.0, 0.0,
+		0.0, 0.0, 0.0,
+	};
+	float move_down_kernel[convolve_size * convolve_size] = {
+		0.0, 0.0, 0.0,
+		1.0, 0.0, 0.0,
+		0.0, 0.0, 0.0,
+	};
+	float expected_move_right_data[size * size] = {
+		0.1, 0.1, 1.1, 2.1,
+		0.2, 0.2, 1.2, 2.2,
+		0.3, 0.3, 1.3, 2.3,
+		0.4, 0.4, 1.4, 2.4,
+	};
+	float expected_move_down_data[size * size] = {
+		0.1, 1.1, 2.1, 3.1,
+		0.1, 1.1, 2.1, 3.1,
+		0.2, 1.2, 2.2, 3.2,
+		0.3, 1.3, 2.3, 3.3,
+	};
+	float out_data[size * size];
+
+	EffectChainTester tester(nullptr, size, size, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+	tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, size, size);
+
+	FFTConvolutionEffect *fft_effect = new FFTConvolutionEffect(size, size, convolve_size, convolve_size);
+	tester.get_chain()->add_effect(fft_effect);
+
+	fft_effect->set_convolution_kernel(move_right_kernel);
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+	expect_equal(expected_move_right_data, out_data, size, size, 0.02, 0.003);
+
+	fft_effect->set_convolution_kernel(move_down_kernel);
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+	expect_equal(expected_move_down_data, out_data, size, size, 0.02, 0.003);
+}
+
+TEST(FFTConvolutionEffectTest, MeasuredPlanAndWisdom) {
+	const int size = 16, convolve_size = 3;
+	float data[size * size], out_data[size * size];
+	for (int i = 0; i < size * size; ++i) {
+		data[i] = (i % 7) * 0.1f;
+	}
+	float kernel[convolve_size * convolve_size] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f,
+	};
+
+	char wisdom_dir[] = "/tmp/movit-fft-wisdom-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(wisdom_dir));
+	const std::string wisdom_file = std::string(wisdom_dir) + "/wisdom";
+
+	// The first time, there is no wisdom, so we have to measure (and store the result).
+	// The second time, the plan should come straight from the file.
+	// The plan should not matter for the result, of course.
+	const FFTConvolutionEffect::PlanSource expected_sources[] = {
+		FFTConvolutionEffect::PLAN_MEASURED, FFTConvolutionEffect::PLAN_FROM_WISDOM
+	};
+	for (FFTConvolutionEffect::PlanSource expected_source : expected_sources) {
+		EffectChainTester tester(nullptr, size, size, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+		tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, size, size);
+
+		FFTConvolutionEffect *fft_effect = new FFTConvolutionEffect(size, size, convolve_size, convolve_size);
+		tester.get_chain()->add_effect(fft_effect);
+		fft_effect->set_convolution_kernel(kernel);
+		fft_effect->set_wisdom_file(wisdom_file);
+		ASSERT_TRUE(fft_effect->set_int("measure_plans", 1));
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+
+		EXPECT_EQ(expected_source, fft_effect->get_plan_source());
+		expect_equal(data, out_data, size, size, 0.02, 0.003);
+	}
+
+	// Without wisdom or measuring, we fall back to the estimate.
+	{
+		EffectChainTester tester(nullptr, size, size, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+		tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR, size, size);
+
+		FFTConvolutionEffect *fft_effect = new FFTConvolutionEffect(size, size, convolve_size, convolve_size);
+		tester.get_chain()->add_effect(fft_effect);
+		fft_effect->set_convolution_kernel(kernel);
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR, OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+
+		EXPECT_EQ(FFTConvolutionEffect::PLAN_ESTIMATED, fft_effect->get_plan_source());
+		expect_equal(data, out_data, size, size, 0.02, 0.003);
+	}
+
+	unlink(wisdom_file.c_str());
+	rmdir(wisdom_dir);
+}
+
+#ifdef HAVE_BENCHMARK
+// The “Fragment” variants force the FFTPassEffect chain even if compute
+// shaders are available, for comparison with FFTComputeEffect.
+void BM_FFTConvolutionEffect(benchmark::State &state, BenchmarkFormat format, int convolve_size, bool disable_compute_shaders)
+{
+	DisableComputeShadersTemporarily disabler(disable_compute_shaders);
+	std::unique_ptr<float[]> kernel(new float[convolve_size * convolve_size]);
+	for (int i = 0; i < convolve_size * convolve_size; ++i) {
+		kernel[i] = 1.0f / (convolve_size * convolve_size);
+	}
+
+	EffectBenchmark bench(state, format);
+	FFTConvolutionEffect *fft_effect = new FFTConvolutionEffect(state.range(0), state.range(1), convolve_size, convolve_size);
+	bench.add_effect(fft_effect);
+	fft_effect->set_convolution_kernel(kernel.get());
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_FFTConvolutionEffect, Int8Kernel16, BENCHMARK_INT8, 16, false)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTConvolutionEffect, Float16Kernel16, BENCHMARK_FP16, 16, false)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTConvolutionEffect, Float16Kernel64, BENCHMARK_FP16, 64, false)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTConvolutionEffect, Float16Kernel16Fragment, BENCHMARK_FP16, 16, true)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTConvolutionEffect, Float16Kernel64Fragment, BENCHMARK_FP16, 64, true)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Measures FFTInput's CPU-side work when the kernel changes: the FFTW transform,
+// conversion to fp16 and upload. Arguments are FFT size and kernel size.
+void BM_FFTInputTransform(benchmark::State &state)
+{
+	const int fft_size = state.range(0), convolve_size = state.range(1);
+	std::unique_ptr<float[]> kernel(new float[convolve_size * convolve_size]);
+	for (int i = 0; i < convolve_size * convolve_size; ++i) {
+		kernel[i] = rand() / (RAND_MAX + 1.0);
+	}
+
+	EffectChainTester tester(nullptr, 1, 1);  // For the resource pool.
+	FFTInput fft_input(convolve_size, convolve_size);
+	fft_input.inform_added(tester.get_chain());
+	ASSERT_TRUE(fft_input.set_int("fft_width", fft_size));
+	ASSERT_TRUE(fft_input.set_int("fft_height", fft_size));
+
+	for (auto _ : state) {
+		fft_input.set_pixel_data(kernel.get());
+		unsigned sampler_num = 0;
+		fft_input.set_gl_state(0, "", &sampler_num);
+	}
+	glFinish();
+}
+BENCHMARK(BM_FFTInputTransform)->Args({64, 16})->Args({128, 32})->Args({256, 64})->Args({512, 128})->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -2,6 +2,9 @@
 #include <assert.h>
 #include <epoxy/gl.h>
 #include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 #include "effect_util.h"
 #include "fp16.h"
@@ -13,13 +16,61 @@ using namespace std;
 
 namespace movit {
 
+namespace {
+
+// FFTW's planner is not thread-safe (only fftw_execute() and friends are),
+// and a plan for a given size is useful for every FFTInput of that size,
+// so we keep all of them in one place. The plans are never freed.
+mutex fftw_plan_lock;
+map<tuple<int, int, int>, fftw_plan> fftw_plans;  // Under fftw_plan_lock.
+int fftw_num_threads = 1;  // Under fftw_plan_lock.
+#ifdef HAVE_FFTW3_THREADS
+bool fftw_threads_initialized = false;  // Under fftw_plan_lock.
+#endif
+
+// Get a real-to-complex plan for the given size. The plan can be used
+// (with fftw_execute_dft_r2c()) on any arrays from fftw_malloc().
+fftw_plan get_r2c_plan(int width, int height, double *in, fftw_complex *out)
+{
+	lock_guard<mutex> lock(fftw_plan_lock);
+	const auto key = make_tuple(width, height, fftw_num_threads);
+	auto plan_it = fftw_plans.find(key);
+	if (plan_it != fftw_plans.end()) {
+		return plan_it->second;
+	}
+
+#ifdef HAVE_FFTW3_THREADS
+	if (!fftw_threads_initialized) {
+		fftw_init_threads();
+		fftw_threads_initialized = true;
+	}
+	fftw_plan_with_nthreads(fftw_num_threads);
+#endif
+
+	// Our FFTs should typically be small, so FFTW_ESTIMATE should be
+	// quite OK. (FFTW_MEASURE would also overwrite the arrays.)
+	fftw_plan plan = fftw_plan_dft_r2c_2d(height, width, in, out, FFTW_ESTIMATE);
+	assert(plan != nullptr);
+	fftw_plans.insert(make_pair(key, plan));
+	return plan;
+}
+
+}  // namespace
+
 FFTInput::FFTInput(unsigned width, unsigned height)
 	: texture_num(0),
+	  texture_width(0),
+	  texture_height(0),
+	  needs_update(true),
 	  fft_width(width),
 	  fft_height(height),
 	  convolve_width(width),
 	  convolve_height(height),
-	  pixel_data(nullptr)
+	  pixel_data(nullptr),
+	  buffer_width(0),
+	  buffer_height(0),
+	  fft_in(nullptr),
+	  fft_out(nullptr)
 {
 	register_int("fft_width", &fft_width);
 	register_int("fft_height", &fft_height);
@@ -31,48 +82,100 @@ FFTInput::~FFTInput()
 	if (texture_num != 0) {
 		resource_pool->release_2d_texture(texture_num);
 	}
+	free_buffers();
 }
 
-void FFTInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsigned *sampler_num)
+bool FFTInput::set_fftw_threads(int num_threads)
 {
-	glActiveTexture(GL_TEXTURE0 + *sampler_num);
-	check_error();
+#ifdef HAVE_FFTW3_THREADS
+	assert(num_threads >= 1);
+	lock_guard<mutex> lock(fftw_plan_lock);
+	fftw_num_threads = num_threads;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FFTInput::free_buffers()
+{
+	fftw_free(fft_in);
+	fftw_free(fft_out);
+	fft_in = nullptr;
+	fft_out = nullptr;
+}
+
+void FFTInput::compute_fft()
+{
+	assert(pixel_data != nullptr);
+
+	// Since the input is real, the output is Hermitian-symmetric, and FFTW
+	// only gives us the left half (plus one column) of it.
+	const int half_width = fft_width / 2 + 1;
+	if (buffer_width != fft_width || buffer_height != fft_height) {
+		free_buffers();
+		fft_in = (double *)fftw_malloc(sizeof(double) * fft_width * fft_height);
+		fft_out = fftw_malloc(sizeof(fftw_complex) * half_width * fft_height);
+		spectrum.resize(fft_width * fft_height * 2);
+		kernel_fp16.resize(fft_width * fft_height * 2);
+		buffer_width = fft_width;
+		buffer_height = fft_height;
+
+		// Zero pad. The kernel itself is overwritten below,
+		// but the rest stays zero as long as we keep the buffer.
+		memset(fft_in, 0, sizeof(double) * fft_width * fft_height);
+	}
 
-	if (texture_num == 0) {
-		assert(pixel_data != nullptr);
-
-		// Do the FFT. Our FFTs should typically be small enough and
-		// the data changed often enough that FFTW_ESTIMATE should be
-		// quite OK. Otherwise, we'd need to worry about caching these
-		// plans (possibly including FFTW wisdom).
-		fftw_complex *in = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * fft_width * fft_height);
-		fftw_complex *out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * fft_width * fft_height);
-		fftw_plan p = fftw_plan_dft_2d(fft_height, fft_width, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
-
-		// Zero pad.
-		for (int i = 0; i < fft_height * fft_width; ++i) {
-			in[i][0] = 0.0;
-			in[i][1] = 0.0;
+	fftw_complex *out = (fftw_complex *)fft_out;
+	fftw_plan plan = get_r2c_plan(fft_width, fft_height, fft_in, out);
+
+	for (unsigned y = 0; y < convolve_height; ++y) {
+		const float *src = pixel_data + y * convolve_width;
+		double *dst = fft_in + y * fft_width;
+		for (unsigned x = 0; x < convolve_width; ++x) {
+			dst[x] = src[x];
 		}
-		for (unsigned y = 0; y < convolve_height; ++y) {
-			for (unsigned x = 0; x < convolve_width; ++x) {
-				int i = y * fft_width + x;
-				in[i][0] = pixel_data[y * convolve_width + x];
-				in[i][1] = 0.0;
-			}
+	}
+
+	fftw_execute_dft_r2c(plan, fft_in, out);
+
+	// Fill in the right half from the symmetry X[y][x] = conj(X[-y][-x]).
+	for (int y = 0; y < fft_height; ++y) {
+		double *dst = &spectrum[y * fft_width * 2];
+		const fftw_complex *src = out + y * half_width;
+		memcpy(dst, src, sizeof(fftw_complex) * min(half_width, fft_width));
+
+		const fftw_complex *mirror_src = out + ((fft_height - y) % fft_height) * half_width;
+		for (int x = half_width; x < fft_width; ++x) {
+			dst[x * 2 + 0] = mirror_src[fft_width - x][0];
+			dst[x * 2 + 1] = -mirror_src[fft_width - x][1];
 		}
+	}
 
-		fftw_execute(p);
+	fp64_to_fp16_array(spectrum.data(), kernel_fp16.data(), spectrum.size());
+}
 
-		// Convert to fp16.
-		fp16_int_t *kernel = new fp16_int_t[fft_width * fft_height * 2];
-		for (int i = 0; i < fft_width * fft_height; ++i) {
-			kernel[i * 2 + 0] = fp32_to_fp16(out[i][0]);
-			kernel[i * 2 + 1] = fp32_to_fp16(out[i][1]);
+void FFTInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsigned *sampler_num)
+{
+	glActiveTexture(GL_TEXTURE0 + *sampler_num);
+	check_error();
+
+	if (needs_update) {
+		compute_fft();
+
+		// Keep the texture if we can, so that an animated kernel
+		// does not cause a new allocation every frame.
+		if (texture_num != 0 && (texture_width != fft_width || texture_height != fft_height)) {
+			resource_pool->release_2d_texture(texture_num);
+			texture_num = 0;
+		}
+		if (texture_num == 0) {
+			texture_num = resource_pool->create_2d_texture(GL_RG16F, fft_width, fft_height);
+			texture_width = fft_width;
+			texture_height = fft_height;
 		}
 
 		// (Re-)upload the texture.
-		texture_num = resource_pool->create_2d_texture(GL_RG16F, fft_width, fft_height);
 		glBindTexture(GL_TEXTURE_2D, texture_num);
 		check_error();
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -81,7 +184,7 @@ void FFTInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsig
 		check_error();
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		check_error();
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fft_width, fft_height, GL_RG, GL_HALF_FLOAT, kernel);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fft_width, fft_height, GL_RG, GL_HALF_FLOAT, kernel_fp16.data());
 		check_error();
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		check_error();
@@ -90,9 +193,7 @@ void FFTInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsig
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		check_error();
 
-		fftw_free(in);
-		fftw_free(out);
-		delete[] kernel;
+		needs_update = false;
 	} else {
 		glBindTexture(GL_TEXTURE_2D, texture_num);
 		check_error();
@@ -111,10 +212,8 @@ string FFTInput::output_fragment_shader()
 
 void FFTInput::invalidate_pixel_data()
 {
-	if (texture_num != 0) {
-		resource_pool->release_2d_texture(texture_num);
-		texture_num = 0;
-	}
+	needs_update = true;
+	bump_generation();
 }
 
 bool FFTInput::set_int(const std::string& key, int value)
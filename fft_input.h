@@ -12,14 +12,24 @@
 // frames.) As an extra bonus, we can then do it in double precision and round
 // precisely to fp16 afterwards.
 //
+// Kernels may still change every frame (e.g. for an animated blur), so we
+// try to keep the CPU side cheap: The FFTW plans are cached (per size, for
+// the lifetime of the process), the buffers and the texture are reused
+// as long as the size stays the same, and since the kernel is real,
+// we use a real-to-complex transform, which does about half the work.
+// For large kernels, you can also let FFTW use multiple threads;
+// see set_fftw_threads().
+//
 // This class is tested as part of by FFTConvolutionEffectTest.
 
 #include <epoxy/gl.h>
 #include <assert.h>
 #include <string>
+#include <vector>
 
 #include "effect.h"
 #include "effect_chain.h"
+#include "fp16.h"
 #include "image_format.h"
 #include "input.h"
 
@@ -69,13 +79,35 @@ public:
 
 	bool set_int(const std::string& key, int value) override;
 
+	// Lets FFTW use up to the given number of threads for each transform
+	// (the default is one). This is a process-wide setting, and only affects
+	// transform sizes that have not been planned yet. Returns false (and
+	// does nothing) if Movit was built without FFTW's thread support.
+	static bool set_fftw_threads(int num_threads);
+
 private:
+	// Allocate buffers (if the size has changed), FFT the kernel and
+	// convert it to fp16 in <kernel_fp16>.
+	void compute_fft();
+	void free_buffers();
+
 	GLuint texture_num;
+	int texture_width, texture_height;
+	bool needs_update;
 	int fft_width, fft_height;
 	unsigned convolve_width, convolve_height;
 	const float *pixel_data;
 	ResourcePool *resource_pool;
 	GLint uniform_tex;
+
+	// Reused between updates as long as the size is the same.
+	// <fft_in> and <fft_out> come from fftw_malloc(), since the cached
+	// plans require the same alignment as the arrays they were made for.
+	int buffer_width, buffer_height;
+	double *fft_in;
+	void *fft_out;  // Really fftw_complex *; we don't want fftw3.h in our headers.
+	std::vector<double> spectrum;
+	std::vector<fp16_int_t> kernel_fp16;
 };
 
 }  // namespace movit
@@ -337,4 +337,24 @@ TEST(FFTPassEffectTest, BigFFTAccuracy) {
 	}
 }
 
+#ifdef HAVE_BENCHMARK
+// A single pass of a 64-point FFT; a full FFT (see FFTConvolutionEffect)
+// consists of six such passes in each direction. The sizes are the standard
+// resolutions padded up to a multiple of the FFT size, as the FFT requires.
+void BM_FFTPassEffect(benchmark::State &state, FFTPassEffect::Direction direction, int pass_number)
+{
+	EffectBenchmark bench(state, BENCHMARK_FP16, 1, FORMAT_RGBA_PREMULTIPLIED_ALPHA);
+	Effect *fft_effect = bench.add_effect(new FFTPassEffect());
+	ASSERT_TRUE(fft_effect->set_int("fft_size", 64));
+	ASSERT_TRUE(fft_effect->set_int("pass_number", pass_number));
+	ASSERT_TRUE(fft_effect->set_int("inverse", 0));
+	ASSERT_TRUE(fft_effect->set_int("direction", direction));
+	bench.run(OUTPUT_ALPHA_FORMAT_PREMULTIPLIED);
+}
+BENCHMARK_CAPTURE(BM_FFTPassEffect, HorizontalFirstPass, FFTPassEffect::HORIZONTAL, 1)->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTPassEffect, HorizontalLastPass, FFTPassEffect::HORIZONTAL, 6)->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FFTPassEffect, VerticalFirstPass, FFTPassEffect::VERTICAL, 1)->Args({768, 576})->Args({1280, 768})->Args({1920, 1088})->Args({3840, 2176})->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -1,10 +1,12 @@
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
 #include <epoxy/gl.h>
 
 #include "effect_util.h"
 #include "flat_input.h"
 #include "resource_pool.h"
+#include "upload_ring.h"
 #include "util.h"
 
 using namespace std;
@@ -22,7 +24,13 @@ FlatInput::FlatInput(ImageFormat image_format, MovitPixelFormat pixel_format_in,
 	  height(height),
 	  pitch(width),
 	  owns_texture(false),
+	  texture_internal_format(0),
+	  texture_width(0),
+	  texture_height(0),
+	  upload_pending(true),
+	  mipmaps_valid(false),
 	  pixel_data(nullptr),
+	  upload_ring(nullptr),
 	  fixup_swap_rb(false),
 	  fixup_red_to_grayscale(false)
 {
@@ -59,6 +67,7 @@ FlatInput::FlatInput(ImageFormat image_format, MovitPixelFormat pixel_format_in,
 FlatInput::~FlatInput()
 {
 	possibly_release_texture();
+	delete upload_ring;
 }
 
 void FlatInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsigned *sampler_num)
@@ -66,7 +75,8 @@ void FlatInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsi
 	glActiveTexture(GL_TEXTURE0 + *sampler_num);
 	check_error();
 
-	if (texture_num == 0 && (pbo != 0 || pixel_data != nullptr)) {
+	if ((texture_num == 0 || (owns_texture && upload_pending)) &&
+	    (pbo != 0 || pixel_data != nullptr)) {
 		// Translate the input format to OpenGL's enums.
 		GLint internal_format;
 		GLenum format;
@@ -134,41 +144,64 @@ void FlatInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsi
 			assert(false);
 		}
 
+		// Keep our texture from last time if it still fits, so that we only
+		// need to upload new contents into it; going back and forth to the
+		// resource pool every frame is not free.
+		if (texture_num != 0 &&
+		    (texture_internal_format != internal_format ||
+		     texture_width != width ||
+		     texture_height != height)) {
+			possibly_release_texture();
+		}
+		if (texture_num == 0) {
+			texture_num = resource_pool->create_2d_texture(internal_format, width, height);
+			glBindTexture(GL_TEXTURE_2D, texture_num);
+			check_error();
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			check_error();
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			check_error();
+			texture_internal_format = internal_format;
+			texture_width = width;
+			texture_height = height;
+			owns_texture = true;
+		} else {
+			glBindTexture(GL_TEXTURE_2D, texture_num);
+			check_error();
+		}
+
 		// (Re-)upload the texture.
-		texture_num = resource_pool->create_2d_texture(internal_format, width, height);
-		glBindTexture(GL_TEXTURE_2D, texture_num);
-		check_error();
 		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
 		check_error();
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
-		check_error();
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		check_error();
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
 		check_error();
 		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, pixel_data);
 		check_error();
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-		check_error();
-		if (needs_mipmaps) {
-			glGenerateMipmap(GL_TEXTURE_2D);
-			check_error();
+		if (upload_ring != nullptr && pbo != 0 && pbo == upload_ring->get_pbo()) {
+			upload_ring->upload_done(uintptr_t(pixel_data));
 		}
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		check_error();
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		check_error();
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		check_error();
 		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 		check_error();
-		owns_texture = true;
+		upload_pending = false;
+		mipmaps_valid = false;
 	} else {
 		glBindTexture(GL_TEXTURE_2D, texture_num);
 		check_error();
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+	}
+
+	// Only (re)generate mipmaps when somebody is going to use them. We don't
+	// touch textures we don't own; see the comment on set_texture_num().
+	if (owns_texture && needs_mipmaps && !mipmaps_valid) {
+		glGenerateMipmap(GL_TEXTURE_2D);
 		check_error();
+		mipmaps_valid = true;
 	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+	check_error();
 
 	// Bind it to a sampler.
 	uniform_tex = *sampler_num;
@@ -183,9 +216,51 @@ string FlatInput::output_fragment_shader()
 	return buf + read_file("flat_input.frag");
 }
 
+void *FlatInput::get_write_buffer()
+{
+	size_t bytes_per_component;
+	if (type == GL_FLOAT) {
+		bytes_per_component = sizeof(float);
+	} else if (type == GL_HALF_FLOAT) {
+		bytes_per_component = sizeof(fp16_int_t);
+	} else if (type == GL_UNSIGNED_SHORT) {
+		bytes_per_component = sizeof(unsigned short);
+	} else {
+		assert(type == GL_UNSIGNED_BYTE);
+		bytes_per_component = 1;
+	}
+
+	size_t num_components;
+	if (pixel_format == FORMAT_R) {
+		num_components = 1;
+	} else if (pixel_format == FORMAT_RG) {
+		num_components = 2;
+	} else if (pixel_format == FORMAT_RGB) {
+		num_components = 3;
+	} else {
+		num_components = 4;
+	}
+
+	if (upload_ring == nullptr) {
+		upload_ring = new UploadRing;
+	}
+	return upload_ring->begin_write(size_t(pitch) * height * num_components * bytes_per_component);
+}
+
+void FlatInput::commit_write_buffer()
+{
+	assert(upload_ring != nullptr);
+	const size_t offset = upload_ring->commit_write();
+	pixel_data = BUFFER_OFFSET(offset);
+	pbo = upload_ring->get_pbo();
+	invalidate_pixel_data();
+}
+
 void FlatInput::invalidate_pixel_data()
 {
-	possibly_release_texture();
+	// We keep our texture (if any), and upload into it in set_gl_state().
+	upload_pending = true;
+	bump_generation();
 }
 
 void FlatInput::possibly_release_texture()
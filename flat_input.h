@@ -14,6 +14,7 @@
 namespace movit {
 
 class ResourcePool;
+class UploadRing;
 
 // A FlatInput is the normal, “classic” case of an input, where everything
 // comes from a single 2D array with chunky pixels.
@@ -105,6 +106,23 @@ public:
 
 	void invalidate_pixel_data();
 
+	// An alternative to set_pixel_data() that avoids both the extra copy
+	// from a client pointer and having to manage PBOs yourself:
+	// get_write_buffer() returns a pointer into a ring of buffers owned by
+	// the input, mapped so that the GPU can upload straight from it,
+	// with room for <pitch> x <height> pixels of the input's format and type.
+	// Write the next frame into it, then call commit_write_buffer(), which
+	// works like set_pixel_data(); the render then only needs to issue
+	// the texture upload.
+	//
+	// Both calls must be made with the OpenGL context current, but the
+	// writing itself (e.g. by a decoder) can happen on any thread.
+	// The ring has three slots, so you can write up to two frames ahead
+	// of what is being rendered without blocking. The pointer is only
+	// valid until commit_write_buffer().
+	void *get_write_buffer();
+	void commit_write_buffer();
+
 	// Note: Sets pitch to width, so even if your pitch is unchanged,
 	// you will need to re-set it after this call.
 	void set_width(unsigned width)
@@ -139,6 +157,10 @@ public:
 	// for releasing it yourself. In particular, if you call invalidate_pixel_data()
 	// or anything calling it, the texture will silently be removed from the input.
 	//
+	// NOTE: If you use EffectChain::enable_phase_memoization() and change the
+	// contents of the texture, you must call set_texture_num() again (the same
+	// texture number is fine); otherwise, the chain might reuse old results.
+	//
 	// NOTE: Doing this in a situation where can_output_linear_gamma() is true
 	// can yield unexpected results, as the downstream effect can expect the texture
 	// to be uploaded with the sRGB flag on.
@@ -147,6 +169,7 @@ public:
 		possibly_release_texture();
 		this->texture_num = texture_num;
 		this->owns_texture = false;
+		bump_generation();
 	}
 
 	void inform_added(EffectChain *chain) override
@@ -165,8 +188,18 @@ private:
 	int output_linear_gamma, needs_mipmaps;
 	unsigned width, height, pitch;
 	bool owns_texture;
+
+	// If we own <texture_num>, what it was created as, so that we can
+	// reuse it as long as the pixel data keeps the same shape.
+	// <upload_pending> is set if its contents are stale, and <mipmaps_valid>
+	// if we have generated mipmaps for the current contents.
+	GLint texture_internal_format;
+	unsigned texture_width, texture_height;
+	bool upload_pending, mipmaps_valid;
+
 	const void *pixel_data;
 	ResourcePool *resource_pool;
+	UploadRing *upload_ring;  // Created on first use of get_write_buffer().
 	bool fixup_swap_rb, fixup_red_to_grayscale;
 	GLint uniform_tex;
 };
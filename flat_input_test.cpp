@@ -2,6 +2,11 @@
 
 #include <epoxy/gl.h>
 #include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
 
 #include "effect_chain.h"
 #include "flat_input.h"
@@ -270,6 +275,38 @@ TEST(FlatInput, PBO) {
 	glDeleteBuffers(1, &pbo);
 }
 
+TEST(FlatInput, WriteBuffer) {
+	const int width = 3;
+	const int height = 2;
+
+	float data[width * height] = {
+		0.0, 1.0, 0.5,
+		0.5, 0.5, 0.2,
+	};
+	float out_data[width * height];
+
+	EffectChainTester tester(nullptr, width, height);
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_LINEAR;
+
+	FlatInput *input = new FlatInput(format, FORMAT_GRAYSCALE, GL_FLOAT, width, height);
+	tester.get_chain()->add_input(input);
+
+	// Go around the ring more than once, so that we also reuse slots
+	// the GPU has uploaded from before.
+	for (unsigned frame = 0; frame < 5; ++frame) {
+		data[frame] = 0.1f * frame;
+		float *ptr = static_cast<float *>(input->get_write_buffer());
+		memcpy(ptr, data, sizeof(data));
+		input->commit_write_buffer();
+
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+		expect_equal(data, out_data, width, height);
+	}
+}
+
 TEST(FlatInput, ExternalTexture) {
 	const int size = 5;
 
@@ -388,6 +425,45 @@ TEST(FlatInput, ExternalTextureMipmapState) {
 	expect_equal(expected_data, out_data, 1, 1);
 }
 
+TEST(FlatInput, UpdatedDataRegeneratesMipmaps) {
+	const int width = 4;
+	const int height = 4;
+
+	float data[width * height] = {
+		1.0, 0.0, 0.0, 0.0,
+		0.0, 0.0, 0.0, 0.0,
+		0.0, 0.0, 0.0, 0.0,
+		0.0, 0.0, 0.0, 0.0,
+	};
+	float expected_data[] = {
+		0.0625,
+	};
+	float out_data[1];
+
+	EffectChainTester tester(nullptr, 1, 1, FORMAT_RGB, COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_LINEAR;
+
+	FlatInput *input = new FlatInput(format, FORMAT_GRAYSCALE, GL_FLOAT, width, height);
+	input->set_pixel_data(data);
+	tester.get_chain()->add_input(input);
+	tester.get_chain()->add_effect(new MipmapNeedingEffect);
+
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 1, 1);
+
+	// The input keeps its texture and uploads into it,
+	// so the mipmaps need to be made anew.
+	data[15] = 1.0;
+	expected_data[0] = 0.125;
+	input->invalidate_pixel_data();
+
+	tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 1, 1);
+}
+
 TEST(FlatInput, NoData) {
 	const int width = 2;
 	const int height = 4;
@@ -408,4 +484,47 @@ TEST(FlatInput, NoData) {
 	// Don't care what the output was, just that it does not crash.
 }
 
+#ifdef HAVE_BENCHMARK
+// Uploads a new frame every time, as for a live source.
+void BM_FlatInput(benchmark::State &state, MovitPixelFormat pixel_format, GLenum type)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	const unsigned num_values = width * height * 4;  // Enough for any pixel format.
+	unique_ptr<fp16_int_t[]> out_data(new fp16_int_t[width * height * 4]);
+
+	EffectChainTester tester(nullptr, width, height, pixel_format, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA16F);
+	vector<unsigned char> data_int8;
+	vector<fp16_int_t> data_fp16;
+	vector<float> data_fp32;
+	FlatInput *input;
+	if (type == GL_UNSIGNED_BYTE) {
+		for (unsigned i = 0; i < num_values; ++i) {
+			data_int8.push_back(rand() & 0xff);
+		}
+		input = static_cast<FlatInput *>(tester.add_input(data_int8.data(), pixel_format, COLORSPACE_sRGB, GAMMA_sRGB));
+		tester.set_benchmark_frame_callback([input, &data_int8] { input->set_pixel_data(data_int8.data()); });
+	} else if (type == GL_HALF_FLOAT) {
+		for (unsigned i = 0; i < num_values; ++i) {
+			data_fp16.push_back(fp32_to_fp16(rand() / (RAND_MAX + 1.0)));
+		}
+		input = static_cast<FlatInput *>(tester.add_input(data_fp16.data(), pixel_format, COLORSPACE_sRGB, GAMMA_LINEAR));
+		tester.set_benchmark_frame_callback([input, &data_fp16] { input->set_pixel_data_fp16(data_fp16.data()); });
+	} else {
+		assert(type == GL_FLOAT);
+		for (unsigned i = 0; i < num_values; ++i) {
+			data_fp32.push_back(rand() / (RAND_MAX + 1.0));
+		}
+		input = static_cast<FlatInput *>(tester.add_input(data_fp32.data(), pixel_format, COLORSPACE_sRGB, GAMMA_LINEAR));
+		tester.set_benchmark_frame_callback([input, &data_fp32] { input->set_pixel_data(data_fp32.data()); });
+	}
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+}
+BENCHMARK_CAPTURE(BM_FlatInput, GrayscaleInt8, FORMAT_GRAYSCALE, GL_UNSIGNED_BYTE)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FlatInput, RGBAInt8, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_UNSIGNED_BYTE)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FlatInput, BGRAInt8, FORMAT_BGRA_POSTMULTIPLIED_ALPHA, GL_UNSIGNED_BYTE)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FlatInput, RGBAFloat16, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_HALF_FLOAT)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FlatInput, RGBAFloat32, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_FLOAT)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -1,6 +1,8 @@
 #ifndef _MOVIT_FP16_H
 #define _MOVIT_FP16_H 1
 
+#include <stddef.h>
+
 #ifdef __F16C__
 #include <immintrin.h>
 #endif
@@ -120,6 +122,25 @@ static inline fp16_int_t fp32_to_fp16(float x)
 
 #endif
 
+// Converts an array of values to fp16 (e.g. for upload to a texture).
+// With f16c, four values are converted at a time; otherwise, this is simply
+// a loop over fp32_to_fp16(). Like fp32_to_fp16(), the values go through
+// fp32 on the way, so the results are exactly the same either way.
+static inline void fp64_to_fp16_array(const double *src, fp16_int_t *dst, size_t num_values)
+{
+	size_t i = 0;
+#ifdef __F16C__
+	for ( ; i + 4 <= num_values; i += 4) {
+		__m128 f = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(src + i)),
+		                         _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2)));
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_cvtps_ph(f, 0));
+	}
+#endif
+	for ( ; i < num_values; ++i) {
+		dst[i] = fp32_to_fp16(src[i]);
+	}
+}
+
 // Overloads for use in templates.
 static inline float to_fp32(double x) { return x; }
 static inline float to_fp32(float x) { return x; }
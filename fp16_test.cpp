@@ -1,5 +1,6 @@
 #include "fp16.h"
 
+#include <stdlib.h>
 #include <cmath>
 #include <gtest/gtest.h>
 
@@ -92,4 +93,25 @@ TEST(FP16Test, Denormals) {
 	EXPECT_EQ(0x03ff, fp32_to_fp16(smallest_fp16_non_denormal - smallest_fp16_denormal).val);
 }
 
+// The array version should give exactly the same results as the scalar one,
+// including for the tail that does not fill a whole vector.
+TEST(FP16Test, Array) {
+	const size_t num_values = 1031;
+	double src[num_values];
+	fp16_int_t dst[num_values];
+	srand(1234);
+	for (size_t i = 0; i < num_values; ++i) {
+		src[i] = (rand() / (RAND_MAX + 1.0) - 0.5) * 1e5 * pow(10.0, -int(i % 12));
+	}
+	src[0] = 0.0;
+	src[1] = 1.0 / 0.0;
+	src[2] = 65520.0;  // Rounds to infinity.
+	src[3] = -5.9604644775390625e-08;  // Denormal.
+
+	fp64_to_fp16_array(src, dst, num_values);
+	for (size_t i = 0; i < num_values; ++i) {
+		EXPECT_EQ(fp32_to_fp16(src[i]).val, dst[i].val) << "i=" << i << ", value=" << src[i];
+	}
+}
+
 }  // namespace movit
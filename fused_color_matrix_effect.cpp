@@ -0,0 +1,49 @@
+#include <Eigen/Core>
+
+#include "fused_color_matrix_effect.h"
+#include "util.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace movit {
+
+FusedColorMatrixEffect::FusedColorMatrixEffect(const vector<const Effect *> &sources)
+	: sources(sources)
+{
+	register_uniform_mat3("color_matrix", &uniform_color_matrix);
+}
+
+string FusedColorMatrixEffect::output_fragment_shader()
+{
+	return read_file("fused_color_matrix_effect.frag");
+}
+
+void FusedColorMatrixEffect::set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num)
+{
+	uniform_color_matrix = get_color_matrix();
+}
+
+Matrix3d FusedColorMatrixEffect::get_color_matrix() const
+{
+	// Since we right-multiply the RGB column vector, the matrix
+	// concatenation order needs to be the opposite of the operation order.
+	Matrix3d m = Matrix3d::Identity();
+	for (const Effect *source : sources) {
+		m = source->get_color_matrix() * m;
+	}
+	return m;
+}
+
+unsigned FusedColorMatrixEffect::get_generation() const
+{
+	// Generations only ever go up, so the sum changes
+	// whenever any of them do.
+	unsigned generation = Effect::get_generation();
+	for (const Effect *source : sources) {
+		generation += source->get_generation();
+	}
+	return generation;
+}
+
+}  // namespace movit
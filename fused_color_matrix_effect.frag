@@ -0,0 +1,8 @@
+// Implicit uniforms:
+// uniform mat3 PREFIX(color_matrix);
+
+vec4 FUNCNAME(vec2 tc) {
+	vec4 x = INPUT(tc);
+	x.rgb = PREFIX(color_matrix) * x.rgb;
+	return x;
+}
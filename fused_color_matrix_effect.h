@@ -0,0 +1,51 @@
+#ifndef _MOVIT_FUSED_COLOR_MATRIX_EFFECT_H
+#define _MOVIT_FUSED_COLOR_MATRIX_EFFECT_H 1
+
+// An effect that stands in for a run of effects that are all pure
+// 3x3 color matrices (see Effect::is_color_matrix()), doing all of them
+// in a single matrix multiplication. Inserted by EffectChain during
+// finalize(); the original effects are kept (disabled) in the chain,
+// so that the user can keep changing their parameters as usual.
+// The combined matrix is recomputed on the CPU every frame.
+
+#include <epoxy/gl.h>
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+#include "effect.h"
+
+namespace movit {
+
+class FusedColorMatrixEffect : public Effect {
+private:
+	// Should not be instantiated by end users.
+	// <sources> is in the order the effects are applied.
+	explicit FusedColorMatrixEffect(const std::vector<const Effect *> &sources);
+	friend class EffectChain;
+
+public:
+	std::string effect_type_id() const override { return "FusedColorMatrixEffect"; }
+	std::string output_fragment_shader() override;
+	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
+
+	// The sources might have had different requirements here,
+	// but they have already been taken care of when we are inserted.
+	bool needs_srgb_primaries() const override { return false; }
+	AlphaHandling alpha_handling() const override { return DONT_CARE_ALPHA_TYPE; }
+	bool strong_one_to_one_sampling() const override { return true; }
+
+	bool is_color_matrix() const override { return true; }
+	Eigen::Matrix3d get_color_matrix() const override;
+
+	// Our output changes whenever any of the sources change.
+	unsigned get_generation() const override;
+
+private:
+	std::vector<const Effect *> sources;
+	Eigen::Matrix3d uniform_color_matrix;
+};
+
+}  // namespace movit
+
+#endif // !defined(_MOVIT_FUSED_COLOR_MATRIX_EFFECT_H)
@@ -0,0 +1,95 @@
+// Unit tests for FusedColorMatrixEffect, ie., the fusion of effects that are
+// pure color matrices (see Effect::is_color_matrix()) in EffectChain.
+
+#include <epoxy/gl.h>
+
+#include "effect_chain.h"
+#include "gtest/gtest.h"
+#include "image_format.h"
+#include "saturation_effect.h"
+#include "test_util.h"
+#include "white_balance_effect.h"
+
+namespace movit {
+
+TEST(FusedColorMatrixEffectTest, AdjacentMatricesAreFused) {
+	float data[] = {
+		0.0f, 0.0f, 0.0f, 1.0f,
+		0.5f, 0.5f, 0.5f, 0.3f,
+		0.3f, 0.1f, 0.1f, 1.0f,
+	};
+	float out_data[3 * 4];
+	EffectChainTester tester(data, 3, 1, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	Effect *desaturate_effect = tester.get_chain()->add_effect(new SaturationEffect());
+	Effect *white_balance_effect = tester.get_chain()->add_effect(new WhiteBalanceEffect());
+	Effect *saturate_effect = tester.get_chain()->add_effect(new SaturationEffect());
+	ASSERT_TRUE(desaturate_effect->set_float("saturation", 0.5f));
+	ASSERT_TRUE(saturate_effect->set_float("saturation", 2.0f));
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+
+	// Halving and then doubling the saturation gives back the original,
+	// and white balance with the default settings does nothing.
+	expect_equal(data, out_data, 4, 3);
+
+	// All of them should have been replaced by a single effect.
+	EXPECT_TRUE(tester.get_chain()->find_node_for_effect(desaturate_effect)->disabled);
+	EXPECT_TRUE(tester.get_chain()->find_node_for_effect(white_balance_effect)->disabled);
+	EXPECT_TRUE(tester.get_chain()->find_node_for_effect(saturate_effect)->disabled);
+}
+
+TEST(FusedColorMatrixEffectTest, ParametersCanChangeAfterFusion) {
+	float data[] = {
+		0.0f, 0.0f, 0.0f, 1.0f,
+		0.5f, 0.5f, 0.5f, 0.3f,
+		1.0f, 0.0f, 0.0f, 1.0f,
+		0.0f, 1.0f, 0.0f, 0.7f,
+		0.0f, 0.0f, 1.0f, 1.0f,
+	};
+	float expected_data[] = {
+		0.0f, 0.0f, 0.0f, 1.0f,
+		0.5f, 0.5f, 0.5f, 0.3f,
+		0.2126f, 0.2126f, 0.2126f, 1.0f,
+		0.7152f, 0.7152f, 0.7152f, 0.7f,
+		0.0722f, 0.0722f, 0.0722f, 1.0f,
+	};
+	float out_data[5 * 4];
+	EffectChainTester tester(data, 5, 1, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	Effect *first_effect = tester.get_chain()->add_effect(new SaturationEffect());
+	Effect *second_effect = tester.get_chain()->add_effect(new SaturationEffect());
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(data, out_data, 4, 5);
+
+	// Now remove all color; the second effect is no longer in the chain
+	// as such, but the fused matrix should follow its parameters.
+	ASSERT_TRUE(second_effect->set_float("saturation", 0.0f));
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 4, 5);
+
+	// Same for the first.
+	ASSERT_TRUE(first_effect->set_float("saturation", 0.0f));
+	ASSERT_TRUE(second_effect->set_float("saturation", 1.0f));
+	tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	expect_equal(expected_data, out_data, 4, 5);
+}
+
+#ifdef HAVE_BENCHMARK
+// Three matrix effects in a row, which should all be fused into one.
+void BM_FusedColorMatrixEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *desaturate_effect = bench.add_effect(new SaturationEffect());
+	Effect *white_balance_effect = bench.get_chain()->add_effect(new WhiteBalanceEffect());
+	Effect *saturate_effect = bench.get_chain()->add_effect(new SaturationEffect());
+	const float neutral_color[3] = { 0.6f, 0.5f, 0.4f };
+	ASSERT_TRUE(desaturate_effect->set_float("saturation", 0.5f));
+	ASSERT_TRUE(white_balance_effect->set_vec3("neutral_color", neutral_color));
+	ASSERT_TRUE(saturate_effect->set_float("saturation", 1.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_FusedColorMatrixEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FusedColorMatrixEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FusedColorMatrixEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
+}  // namespace movit
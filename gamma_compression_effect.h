@@ -30,6 +30,7 @@ public:
 
 	bool needs_srgb_primaries() const override { return false; }
 	bool strong_one_to_one_sampling() const override { return true; }
+	bool is_color_function() const override { return true; }
 
 	// Actually needs postmultiplied input as well as outputting it.
 	// EffectChain will take care of that.
@@ -7,6 +7,9 @@
 
 #include <epoxy/gl.h>
 #include <math.h>
+#include <stdlib.h>
+
+#include <memory>
 
 #include "gtest/gtest.h"
 #include "gtest/gtest-message.h"
@@ -209,4 +212,30 @@ TEST(GammaCompressionEffectTest, Rec2020_12Bit_Inaccuracy) {
 	expect_equal(expected_data, out_data, 4096, 1, 1.2 / 4095.0, 1e-5);
 }
 
+#ifdef HAVE_BENCHMARK
+// Linear fp16 in, nonlinear out.
+void BM_GammaCompressionEffect(benchmark::State &state, GammaCurve gamma_curve, GLenum framebuffer_format)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	std::unique_ptr<fp16_int_t[]> data(new fp16_int_t[width * height * 4]);
+	for (unsigned i = 0; i < width * height * 4; ++i) {
+		data[i] = fp32_to_fp16(rand() / (RAND_MAX + 1.0));
+	}
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR, framebuffer_format);
+	tester.add_input(data.get(), FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR);
+	if (framebuffer_format == GL_RGB10_A2) {
+		std::unique_ptr<uint32_t[]> out_data(new uint32_t[width * height]);
+		tester.benchmark_10_10_10_2(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, gamma_curve);
+	} else {
+		std::unique_ptr<unsigned char[]> out_data(new unsigned char[width * height * 4]);
+		tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, gamma_curve);
+	}
+}
+BENCHMARK_CAPTURE(BM_GammaCompressionEffect, sRGB, GAMMA_sRGB, GL_RGBA8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GammaCompressionEffect, Rec709, GAMMA_REC_709, GL_RGBA8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GammaCompressionEffect, Rec2020_10Bit, GAMMA_REC_2020_10_BIT, GL_RGB10_A2)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -2,6 +2,9 @@
 
 #include <epoxy/gl.h>
 #include <math.h>
+#include <stdlib.h>
+
+#include <memory>
 
 #include "gamma_expansion_effect.h"
 #include "gtest/gtest.h"
@@ -247,4 +250,25 @@ TEST(GammaExpansionEffectTest, Rec2020_12Bit_Inaccuracy) {
 	test_accuracy(expected_data, out_data, 4096, 1e-3, 0.01, 2.50, 1e-4);
 }
 
+#ifdef HAVE_BENCHMARK
+// Nonlinear fp16 in, linear out; 8-bit sRGB input would use sRGB textures instead.
+void BM_GammaExpansionEffect(benchmark::State &state, GammaCurve gamma_curve)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	std::unique_ptr<fp16_int_t[]> data(new fp16_int_t[width * height * 4]);
+	std::unique_ptr<fp16_int_t[]> out_data(new fp16_int_t[width * height * 4]);
+	for (unsigned i = 0; i < width * height * 4; ++i) {
+		data[i] = fp32_to_fp16(rand() / (RAND_MAX + 1.0));
+	}
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, GAMMA_LINEAR, GL_RGBA16F);
+	tester.add_input(data.get(), FORMAT_RGBA_POSTMULTIPLIED_ALPHA, COLORSPACE_sRGB, gamma_curve);
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, GAMMA_LINEAR);
+}
+BENCHMARK_CAPTURE(BM_GammaExpansionEffect, sRGB, GAMMA_sRGB)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GammaExpansionEffect, Rec709, GAMMA_REC_709)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GammaExpansionEffect, Rec2020_12Bit, GAMMA_REC_2020_12_BIT)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
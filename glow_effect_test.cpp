@@ -111,4 +111,19 @@ TEST(GlowEffectTest, GlowsOntoZeroAlpha) {
 	expect_equal(expected_data, out_data, 4, size);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_GlowEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *glow_effect = bench.add_effect(new GlowEffect());
+	ASSERT_TRUE(glow_effect->set_float("radius", 20.0f));
+	ASSERT_TRUE(glow_effect->set_float("blurred_mix_amount", 0.5f));
+	ASSERT_TRUE(glow_effect->set_float("highlight_cutoff", 0.3f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_GlowEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GlowEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -15,7 +15,11 @@ namespace movit {
 bool movit_initialized = false;
 MovitDebugLevel movit_debug_level = MOVIT_DEBUG_ON;
 float movit_texel_subpixel_precision;
-bool movit_timer_queries_supported, movit_compute_shaders_supported;
+bool movit_timer_queries_supported, movit_compute_shaders_supported, movit_program_binaries_supported;
+bool movit_parallel_shader_compile_supported;
+bool movit_debug_labels_supported;
+int movit_max_label_length, movit_max_debug_message_length;
+bool movit_uniform_buffers_supported, movit_persistent_buffers_supported;
 int movit_num_wrongly_rounded;
 MovitShaderModel movit_shader_model;
 
@@ -321,6 +325,38 @@ bool check_extensions()
 		   epoxy_has_gl_extension("GL_ARB_shader_image_load_store") &&
 	           epoxy_has_gl_extension("GL_ARB_shader_image_size"))));
 
+	// ResourcePool can store linked programs on disk, but only if the driver
+	// lets us get them out again. Some drivers expose the extension but
+	// no binary formats, which is equivalent to not supporting it.
+	movit_program_binaries_supported = false;
+	if (epoxy_gl_version() >= 41 || epoxy_has_gl_extension("GL_ARB_get_program_binary")) {
+		GLint num_formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+		check_error();
+		movit_program_binaries_supported = (num_formats > 0);
+	}
+
+	// Lets us poll whether a program is done compiling. The default number of
+	// compiler threads is already implementation-defined, so we don't touch it.
+	movit_parallel_shader_compile_supported =
+		epoxy_has_gl_extension("GL_KHR_parallel_shader_compile");
+
+	// Used for the ring of uniform buffers in EffectChain.
+	movit_persistent_buffers_supported =
+		(epoxy_gl_version() >= 44 || epoxy_has_gl_extension("GL_ARB_buffer_storage"));
+
+	// Only used for making our objects easier to find in debugging
+	// and profiling tools; see EffectChain::enable_debug_labels().
+	movit_debug_labels_supported =
+		(epoxy_gl_version() >= 43 || epoxy_has_gl_extension("GL_KHR_debug"));
+	movit_max_label_length = movit_max_debug_message_length = 0;
+	if (movit_debug_labels_supported) {
+		glGetIntegerv(GL_MAX_LABEL_LENGTH, &movit_max_label_length);
+		check_error();
+		glGetIntegerv(GL_MAX_DEBUG_MESSAGE_LENGTH, &movit_max_debug_message_length);
+		check_error();
+	}
+
 	return true;
 }
 
@@ -423,6 +459,10 @@ bool init_movit(const string& data_directory, MovitDebugLevel debug_level)
 		movit_shader_model = MOVIT_ESSL_300;
 	}
 
+	// All OpenGL versions that give us GLSL 1.50 or ESSL 3.00
+	// have uniform buffer objects.
+	movit_uniform_buffers_supported = (movit_shader_model != MOVIT_GLSL_130);
+
 	measure_texel_subpixel_precision();
 	measure_roundoff_problems();
 
@@ -71,6 +71,35 @@ extern bool movit_timer_queries_supported;
 // Note that certain OpenGL implementations might only allow this in core mode.
 extern bool movit_compute_shaders_supported;
 
+// Whether the OpenGL driver supports fetching and loading linked programs
+// as binaries (GL_ARB_get_program_binary), with at least one binary format.
+// Used by ResourcePool's on-disk program cache.
+extern bool movit_program_binaries_supported;
+
+// Whether we can put uniforms in uniform blocks backed by uniform buffer
+// objects (UBOs). This needs GLSL 1.40 or newer, so it is only used
+// with the GLSL 1.50 and ESSL 3.00 shader models.
+extern bool movit_uniform_buffers_supported;
+
+// Whether we can have buffers persistently mapped into our address space
+// while the GPU is using them (GL_ARB_buffer_storage).
+extern bool movit_persistent_buffers_supported;
+
+// Whether the OpenGL driver can compile shaders in the background and tell
+// us when it is done (GL_KHR_parallel_shader_compile). If not, asynchronous
+// compilation (see EffectChain::enable_asynchronous_compilation()) still
+// works, but we cannot poll for completion.
+extern bool movit_parallel_shader_compile_supported;
+
+// Whether we can name objects and group commands for debugging and
+// profiling tools (GL_KHR_debug); see EffectChain::enable_debug_labels().
+extern bool movit_debug_labels_supported;
+
+// The longest object label (GL_MAX_LABEL_LENGTH) and debug group name
+// (GL_MAX_DEBUG_MESSAGE_LENGTH) the driver accepts, including the
+// terminating zero. Only valid if movit_debug_labels_supported.
+extern int movit_max_label_length, movit_max_debug_message_length;
+
 // What shader model we are compiling for. This only affects the choice
 // of a few files (like header.frag); most of the shaders are the same.
 enum MovitShaderModel {
@@ -146,4 +146,23 @@ TEST(LiftGammaGainEffectTest, NegativeLiftIsClamped) {
 	expect_equal(expected_data, out_data, 4, 5, 0.03, 0.003);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_LiftGammaGainEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *lgg_effect = bench.add_effect(new LiftGammaGainEffect());
+	const float lift[3] = { 0.05f, 0.0f, 0.02f };
+	const float gamma[3] = { 0.8f, 0.9f, 1.1f };
+	const float gain[3] = { 1.1f, 1.0f, 0.9f };
+	ASSERT_TRUE(lgg_effect->set_vec3("lift", lift));
+	ASSERT_TRUE(lgg_effect->set_vec3("gamma", gamma));
+	ASSERT_TRUE(lgg_effect->set_vec3("gain", gain));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_LiftGammaGainEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_LiftGammaGainEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_LiftGammaGainEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -136,4 +136,19 @@ TEST(LumaMixEffectTest, Inverse) {
 	expect_equal(expected_data_049, out_data, 2, 2);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_LumaMixEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format, 3);
+	Effect *luma_mix_effect = bench.add_effect(new LumaMixEffect());
+	ASSERT_TRUE(luma_mix_effect->set_float("transition_width", 0.5f));
+	ASSERT_TRUE(luma_mix_effect->set_float("progress", 0.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_LumaMixEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_LumaMixEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_LumaMixEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -141,4 +141,19 @@ TEST(MixEffectTest, MixesLinearlyDespitesRGBInputsAndOutputs) {
 	expect_equal(expected_data, out_data, 2, 2);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_MixEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format, 2);
+	Effect *mix_effect = bench.add_effect(new MixEffect());
+	ASSERT_TRUE(mix_effect->set_float("strength_first", 0.5f));
+	ASSERT_TRUE(mix_effect->set_float("strength_second", 0.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_MixEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MixEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MixEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
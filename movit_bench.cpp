@@ -0,0 +1,622 @@
+// A standalone benchmark of a few chains that are typical for live video
+// production, for tracking Movit's performance over time. Unlike the
+// microbenchmarks in the unit tests, it needs neither SDL nor a display;
+// it creates a surfaceless EGL context, so it can run on e.g. Mesa's
+// llvmpipe on a continuous integration machine without a GPU.
+//
+// Usage: movit_bench [OPTIONS] [CHAIN...]
+//
+//   --frames N         Number of frames to render per chain (default 100).
+//   --output FILE      Write the results as JSON to FILE instead of stdout.
+//   --baseline FILE    Compare against the results in FILE (as written by
+//                      an earlier --output), and exit with an error if any
+//                      chain has become slower than the tolerance allows.
+//   --tolerance F      Allowed slowdown as a fraction (default 0.1, ie., 10%).
+//   --data-dir DIR     Where to find the shaders (default the current directory).
+//   --list             List the available chains and exit.
+//
+// If no chains are given, all of them are run. For each chain, we report
+// the time finalize() took (mostly shader compilation), throughput in
+// frames per second, and the per-phase timing from
+// EffectChain::get_phase_timing() (GPU times only if the driver supports
+// timer queries). Throughput is measured without phase timing enabled,
+// since it waits for the GPU; the phase timing is from a separate run.
+
+#include <epoxy/egl.h>
+#include <epoxy/gl.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "blur_effect.h"
+#include "deinterlace_effect.h"
+#include "effect.h"
+#include "effect_chain.h"
+#include "fft_convolution_effect.h"
+#include "flat_input.h"
+#include "glow_effect.h"
+#include "image_format.h"
+#include "init.h"
+#include "overlay_effect.h"
+#include "resample_effect.h"
+#include "resource_pool.h"
+#include "unsharp_mask_effect.h"
+#include "util.h"
+#include "ycbcr.h"
+#include "ycbcr_input.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace movit;
+
+namespace {
+
+// A chain to benchmark, with everything it needs to render a frame.
+struct BenchChain {
+	EffectChain *chain;
+	unsigned width, height;
+
+	// One texture per render target; for Y'CbCr, there can be several.
+	vector<GLenum> output_formats;
+
+	// Called before each frame is rendered, e.g. to upload a new input frame.
+	function<void(unsigned frame_num)> prepare_frame;
+
+	// Input data, kept alive for as long as the chain is.
+	vector<vector<unsigned char>> buffers;
+};
+
+struct BenchDefinition {
+	const char *name;
+	const char *description;
+	void (*build)(BenchChain *bench);
+};
+
+// Fills a buffer with something that is not constant, so that
+// no driver can take shortcuts.
+vector<unsigned char> make_test_data(size_t bytes, unsigned seed)
+{
+	vector<unsigned char> data(bytes);
+	unsigned state = seed * 2654435761u + 1;
+	for (size_t i = 0; i < bytes; ++i) {
+		state = state * 1103515245u + 12345u;
+		data[i] = state >> 24;
+	}
+	return data;
+}
+
+YCbCrFormat make_rec709_format(unsigned chroma_subsampling_x, unsigned chroma_subsampling_y)
+{
+	YCbCrFormat ycbcr_format;
+	ycbcr_format.luma_coefficients = YCBCR_REC_709;
+	ycbcr_format.full_range = false;
+	ycbcr_format.num_levels = 256;
+	ycbcr_format.chroma_subsampling_x = chroma_subsampling_x;
+	ycbcr_format.chroma_subsampling_y = chroma_subsampling_y;
+	ycbcr_format.cb_x_position = 0.0f;  // Left-sited, as in MPEG-2 and H.264.
+	ycbcr_format.cb_y_position = 0.5f;
+	ycbcr_format.cr_x_position = 0.0f;
+	ycbcr_format.cr_y_position = 0.5f;
+	return ycbcr_format;
+}
+
+// The typical path for a camera or file source in a vision mixer:
+// 1080p Y'CbCr 4:2:0 in, scaled down to 720p, with a graphics overlay
+// on top, and Y'CbCr out. Movit cannot subsample chroma in the output,
+// so we render luma and chroma to separate textures, as you would
+// if the next step (e.g. a video encoder) wants 4:2:2 or 4:2:0.
+void build_ycbcr_resample_overlay(BenchChain *bench)
+{
+	const unsigned in_width = 1920, in_height = 1080;
+	bench->width = 1280;
+	bench->height = 720;
+
+	ImageFormat inout_format;
+	inout_format.color_space = COLORSPACE_REC_709;
+	inout_format.gamma_curve = GAMMA_REC_709;
+
+	EffectChain *chain = new EffectChain(bench->width, bench->height);
+	bench->chain = chain;
+
+	YCbCrInput *input = new YCbCrInput(inout_format, make_rec709_format(2, 2), in_width, in_height);
+	bench->buffers.push_back(make_test_data(in_width * in_height, 1));
+	bench->buffers.push_back(make_test_data(in_width * in_height / 4, 2));
+	bench->buffers.push_back(make_test_data(in_width * in_height / 4, 3));
+	chain->add_input(input);
+
+	Effect *resample_effect = chain->add_effect(new ResampleEffect());
+	CHECK(resample_effect->set_int("width", bench->width));
+	CHECK(resample_effect->set_int("height", bench->height));
+
+	ImageFormat logo_format;
+	logo_format.color_space = COLORSPACE_sRGB;
+	logo_format.gamma_curve = GAMMA_sRGB;
+	FlatInput *logo = new FlatInput(logo_format, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_UNSIGNED_BYTE, bench->width, bench->height);
+	bench->buffers.push_back(make_test_data(bench->width * bench->height * 4, 4));
+	logo->set_pixel_data(bench->buffers.back().data());
+	chain->add_input(logo);
+	chain->add_effect(new OverlayEffect(), resample_effect, logo);
+
+	chain->add_ycbcr_output(inout_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED,
+		make_rec709_format(1, 1), YCBCR_OUTPUT_SPLIT_Y_AND_CBCR);
+	chain->set_dither_bits(8);
+	bench->output_formats = { GL_R8, GL_RG8 };
+
+	// A new camera frame every time; the logo stays.
+	bench->prepare_frame = [bench, input](unsigned frame_num) {
+		for (unsigned channel = 0; channel < 3; ++channel) {
+			input->set_pixel_data(channel, bench->buffers[channel].data());
+		}
+	};
+}
+
+// A stack of typical “look” effects on a 720p RGBA source.
+void build_blur_glow_stack(BenchChain *bench)
+{
+	bench->width = 1280;
+	bench->height = 720;
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_sRGB;
+
+	EffectChain *chain = new EffectChain(bench->width, bench->height);
+	bench->chain = chain;
+
+	FlatInput *input = new FlatInput(format, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_UNSIGNED_BYTE, bench->width, bench->height);
+	bench->buffers.push_back(make_test_data(bench->width * bench->height * 4, 5));
+	chain->add_input(input);
+
+	Effect *glow_effect = chain->add_effect(new GlowEffect());
+	CHECK(glow_effect->set_float("radius", 20.0f));
+	CHECK(glow_effect->set_float("blurred_mix_amount", 0.5f));
+	CHECK(glow_effect->set_float("highlight_cutoff", 0.3f));
+	Effect *blur_effect = chain->add_effect(new BlurEffect());
+	CHECK(blur_effect->set_float("radius", 3.0f));
+	Effect *unsharp_mask_effect = chain->add_effect(new UnsharpMaskEffect());
+	CHECK(unsharp_mask_effect->set_float("radius", 2.0f));
+	CHECK(unsharp_mask_effect->set_float("amount", 0.5f));
+
+	chain->add_output(format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+	chain->set_dither_bits(8);
+	bench->output_formats = { GL_RGBA8 };
+
+	bench->prepare_frame = [bench, input](unsigned frame_num) {
+		input->set_pixel_data(bench->buffers[0].data());
+	};
+}
+
+// 1080i Y'CbCr 4:2:2 (as from an SDI capture card) to 1080p, using
+// the last five fields.
+void build_deinterlace(BenchChain *bench)
+{
+	const unsigned field_height = 540;
+	const unsigned num_fields = 5;
+	bench->width = 1920;
+	bench->height = field_height * 2;
+
+	ImageFormat inout_format;
+	inout_format.color_space = COLORSPACE_REC_709;
+	inout_format.gamma_curve = GAMMA_REC_709;
+
+	EffectChain *chain = new EffectChain(bench->width, bench->height);
+	bench->chain = chain;
+
+	vector<YCbCrInput *> inputs;
+	vector<Effect *> input_effects;
+	for (unsigned field_num = 0; field_num < num_fields; ++field_num) {
+		YCbCrInput *input = new YCbCrInput(inout_format, make_rec709_format(2, 1), bench->width, field_height);
+		chain->add_input(input);
+		inputs.push_back(input);
+		input_effects.push_back(input);
+	}
+	// Luma and chroma for each of the fields we rotate between.
+	for (unsigned field_num = 0; field_num < num_fields; ++field_num) {
+		bench->buffers.push_back(make_test_data(bench->width * field_height, 10 + field_num));
+		bench->buffers.push_back(make_test_data(bench->width / 2 * field_height, 20 + field_num));
+		bench->buffers.push_back(make_test_data(bench->width / 2 * field_height, 30 + field_num));
+	}
+	Effect *deinterlace_effect = chain->add_effect(new DeinterlaceEffect(), input_effects);
+
+	chain->add_output(inout_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+	chain->set_dither_bits(8);
+	bench->output_formats = { GL_RGBA8 };
+
+	// Each frame, the fields move one step back, and the field parity flips.
+	bench->prepare_frame = [bench, inputs, deinterlace_effect](unsigned frame_num) {
+		for (unsigned field_num = 0; field_num < inputs.size(); ++field_num) {
+			const unsigned buffer_num = ((frame_num + field_num) % inputs.size()) * 3;
+			for (unsigned channel = 0; channel < 3; ++channel) {
+				inputs[field_num]->set_pixel_data(channel, bench->buffers[buffer_num + channel].data());
+			}
+		}
+		CHECK(deinterlace_effect->set_int("current_field_position", frame_num % 2));
+	};
+}
+
+// A large convolution (e.g. for a lens blur with a custom bokeh shape),
+// which is done with FFTs.
+void build_fft_convolution(BenchChain *bench)
+{
+	const unsigned kernel_size = 32;
+	bench->width = 1280;
+	bench->height = 720;
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_sRGB;
+
+	EffectChain *chain = new EffectChain(bench->width, bench->height);
+	bench->chain = chain;
+
+	FlatInput *input = new FlatInput(format, FORMAT_RGBA_POSTMULTIPLIED_ALPHA, GL_UNSIGNED_BYTE, bench->width, bench->height);
+	bench->buffers.push_back(make_test_data(bench->width * bench->height * 4, 40));
+	chain->add_input(input);
+
+	// A disc, normalized to sum to one.
+	vector<float> kernel(kernel_size * kernel_size);
+	float sum = 0.0f;
+	for (unsigned y = 0; y < kernel_size; ++y) {
+		for (unsigned x = 0; x < kernel_size; ++x) {
+			const float dx = x - 0.5f * (kernel_size - 1), dy = y - 0.5f * (kernel_size - 1);
+			const float k = (hypot(dx, dy) <= 0.5f * kernel_size) ? 1.0f : 0.0f;
+			kernel[y * kernel_size + x] = k;
+			sum += k;
+		}
+	}
+	for (float &k : kernel) {
+		k /= sum;
+	}
+	FFTConvolutionEffect *fft_effect = new FFTConvolutionEffect(bench->width, bench->height, kernel_size, kernel_size);
+	chain->add_effect(fft_effect);
+	fft_effect->set_convolution_kernel(kernel.data());
+
+	chain->add_output(format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+	bench->output_formats = { GL_RGBA16F };
+
+	bench->prepare_frame = [bench, input](unsigned frame_num) {
+		input->set_pixel_data(bench->buffers[0].data());
+	};
+}
+
+const BenchDefinition bench_definitions[] = {
+	{ "ycbcr_resample_overlay", "1080p Y'CbCr 4:2:0 -> resample to 720p -> overlay -> split Y'CbCr", build_ycbcr_resample_overlay },
+	{ "blur_glow_stack", "720p RGBA -> glow -> blur -> unsharp mask", build_blur_glow_stack },
+	{ "deinterlace", "1080i Y'CbCr 4:2:2, five fields -> deinterlace to 1080p", build_deinterlace },
+	{ "fft_convolution", "720p RGBA -> 32x32 FFT convolution", build_fft_convolution },
+};
+
+struct BenchResult {
+	string name;
+	unsigned width, height;
+	double finalize_ms;
+	double ms_per_frame, frames_per_second;
+	vector<EffectChain::PhaseTiming> phase_timing;
+};
+
+double milliseconds_since(steady_clock::time_point start)
+{
+	return duration<double, milli>(steady_clock::now() - start).count();
+}
+
+BenchResult run_bench(const BenchDefinition &definition, unsigned num_frames)
+{
+	BenchChain bench;
+	definition.build(&bench);
+	EffectChain *chain = bench.chain;
+
+	BenchResult result;
+	result.name = definition.name;
+	result.width = bench.width;
+	result.height = bench.height;
+
+	steady_clock::time_point start = steady_clock::now();
+	chain->finalize();
+	glFinish();
+	result.finalize_ms = milliseconds_since(start);
+
+	ResourcePool *resource_pool = chain->get_resource_pool();
+	vector<GLuint> textures;
+	for (GLenum format : bench.output_formats) {
+		textures.push_back(resource_pool->create_2d_texture(format, bench.width, bench.height));
+	}
+	textures.resize(4, 0);
+	GLuint fbo = resource_pool->create_fbo(textures[0], textures[1], textures[2], textures[3]);
+
+	auto render_frames = [&](unsigned first_frame, unsigned count) {
+		for (unsigned frame_num = first_frame; frame_num < first_frame + count; ++frame_num) {
+			bench.prepare_frame(frame_num);
+			chain->render_to_fbo(fbo, bench.width, bench.height);
+		}
+		glFinish();
+		check_error();
+	};
+
+	// Warm up, so that all textures are allocated and uploaded once.
+	const unsigned num_warmup_frames = 3;
+	render_frames(0, num_warmup_frames);
+
+	start = steady_clock::now();
+	render_frames(num_warmup_frames, num_frames);
+	result.ms_per_frame = milliseconds_since(start) / num_frames;
+	result.frames_per_second = 1e3 / result.ms_per_frame;
+
+	if (movit_timer_queries_supported) {
+		chain->enable_phase_timing(true);
+	}
+	chain->reset_phase_timing();
+	render_frames(num_warmup_frames + num_frames, num_frames);
+	if (movit_timer_queries_supported) {
+		// Pick up the last queries, which might not have been done
+		// when the last frame finished rendering.
+		render_frames(num_warmup_frames + 2 * num_frames, 1);
+	}
+	result.phase_timing = chain->get_phase_timing();
+
+	resource_pool->release_fbo(fbo);
+	for (GLuint texnum : textures) {
+		if (texnum != 0) {
+			resource_pool->release_2d_texture(texnum);
+		}
+	}
+	delete chain;
+	return result;
+}
+
+void write_results(FILE *fp, const vector<BenchResult> &results, unsigned num_frames)
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"renderer\": \"%s\",\n", (const char *)glGetString(GL_RENDERER));
+	fprintf(fp, "  \"frames\": %u,\n", num_frames);
+	fprintf(fp, "  \"chains\": [\n");
+	for (unsigned i = 0; i < results.size(); ++i) {
+		const BenchResult &result = results[i];
+		fprintf(fp, "    {\n");
+		fprintf(fp, "      \"name\": \"%s\",\n", result.name.c_str());
+		fprintf(fp, "      \"width\": %u,\n", result.width);
+		fprintf(fp, "      \"height\": %u,\n", result.height);
+		fprintf(fp, "      \"finalize_ms\": %.3f,\n", result.finalize_ms);
+		fprintf(fp, "      \"ms_per_frame\": %.3f,\n", result.ms_per_frame);
+		fprintf(fp, "      \"frames_per_second\": %.3f,\n", result.frames_per_second);
+		fprintf(fp, "      \"phases\": [\n");
+		for (unsigned phase_num = 0; phase_num < result.phase_timing.size(); ++phase_num) {
+			const EffectChain::PhaseTiming &timing = result.phase_timing[phase_num];
+			string effects;
+			for (const string &effect : timing.effects) {
+				effects += (effects.empty() ? "\"" : ", \"") + effect + "\"";
+			}
+			fprintf(fp, "        { \"effects\": [%s], \"output_width\": %u, \"output_height\": %u, "
+				"\"gpu_min_ms\": %.3f, \"gpu_avg_ms\": %.3f, \"gpu_max_ms\": %.3f, "
+				"\"cpu_set_gl_state_ms\": %.3f, \"cpu_setup_uniforms_ms\": %.3f, \"cpu_draw_ms\": %.3f }%s\n",
+				effects.c_str(), timing.output_width, timing.output_height,
+				timing.gpu_min_ms, timing.gpu_avg_ms, timing.gpu_max_ms,
+				timing.cpu_set_gl_state_ms, timing.cpu_setup_uniforms_ms, timing.cpu_draw_ms,
+				(phase_num + 1 == result.phase_timing.size()) ? "" : ",");
+		}
+		fprintf(fp, "      ]\n");
+		fprintf(fp, "    }%s\n", (i + 1 == results.size()) ? "" : ",");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+}
+
+// Reads the frames per second for each chain from a file written by
+// write_results(). This is not a general JSON parser; it only understands
+// our own output.
+bool read_baseline(const char *filename, map<string, double> *frames_per_second)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == nullptr) {
+		perror(filename);
+		return false;
+	}
+	string contents;
+	char buf[4096];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		contents.append(buf, len);
+	}
+	fclose(fp);
+
+	const string name_key = "\"name\": \"", fps_key = "\"frames_per_second\": ";
+	size_t pos = 0;
+	while ((pos = contents.find(name_key, pos)) != string::npos) {
+		pos += name_key.size();
+		size_t name_end = contents.find('"', pos);
+		size_t fps_pos = contents.find(fps_key, pos);
+		if (name_end == string::npos || fps_pos == string::npos) {
+			fprintf(stderr, "%s: Not a movit_bench result file.\n", filename);
+			return false;
+		}
+		(*frames_per_second)[contents.substr(pos, name_end - pos)] =
+			strtod(contents.c_str() + fps_pos + fps_key.size(), nullptr);
+		pos = fps_pos;
+	}
+	return true;
+}
+
+// Returns false if any of the chains has regressed by more than <tolerance>.
+bool compare_to_baseline(const vector<BenchResult> &results, const map<string, double> &baseline, double tolerance)
+{
+	bool ok = true;
+	for (const BenchResult &result : results) {
+		const auto baseline_it = baseline.find(result.name);
+		if (baseline_it == baseline.end() || baseline_it->second <= 0.0) {
+			fprintf(stderr, "%-25s %8.1f fps  (not in baseline)\n", result.name.c_str(), result.frames_per_second);
+			continue;
+		}
+		const double change = result.frames_per_second / baseline_it->second - 1.0;
+		const bool regressed = (change < -tolerance);
+		fprintf(stderr, "%-25s %8.1f fps  (baseline %.1f fps, %+.1f%%)%s\n",
+			result.name.c_str(), result.frames_per_second, baseline_it->second,
+			change * 100.0, regressed ? "  REGRESSION" : "");
+		if (regressed) {
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Makes an OpenGL 3.2 core context that does not render to any window
+// or other surface; we only ever render to FBOs anyway.
+bool create_headless_context()
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if (epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+		display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "Could not initialize EGL.\n");
+		return false;
+	}
+	if (!epoxy_has_egl_extension(display, "EGL_KHR_surfaceless_context")) {
+		fprintf(stderr, "EGL_KHR_surfaceless_context is not supported.\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "Desktop OpenGL is not supported by EGL.\n");
+		return false;
+	}
+
+	// We never create a surface, so we do not really need a config;
+	// some surfaceless platforms do not even expose any.
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	if (!epoxy_has_egl_extension(display, "EGL_KHR_no_config_context")) {
+		const EGLint config_attribs[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLint num_configs = 0;
+		if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+			fprintf(stderr, "No suitable EGL config found.\n");
+			return false;
+		}
+	}
+
+	// Use a core context, because Mesa only allows certain OpenGL versions in core.
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Could not create an OpenGL 3.2 core context.\n");
+		return false;
+	}
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Could not make the OpenGL context current.\n");
+		return false;
+	}
+	return true;
+}
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [--frames N] [--output FILE] [--baseline FILE] [--tolerance F] [--data-dir DIR] [--list] [CHAIN...]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+	unsigned num_frames = 100;
+	const char *output_filename = nullptr;
+	const char *baseline_filename = nullptr;
+	double tolerance = 0.1;
+	string data_directory = ".";
+	vector<const BenchDefinition *> to_run;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool has_arg = (i + 1 < argc);
+		if (strcmp(argv[i], "--frames") == 0 && has_arg) {
+			num_frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--output") == 0 && has_arg) {
+			output_filename = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && has_arg) {
+			baseline_filename = argv[++i];
+		} else if (strcmp(argv[i], "--tolerance") == 0 && has_arg) {
+			tolerance = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--data-dir") == 0 && has_arg) {
+			data_directory = argv[++i];
+		} else if (strcmp(argv[i], "--list") == 0) {
+			for (const BenchDefinition &definition : bench_definitions) {
+				printf("%-25s %s\n", definition.name, definition.description);
+			}
+			return 0;
+		} else if (argv[i][0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			const BenchDefinition *found = nullptr;
+			for (const BenchDefinition &definition : bench_definitions) {
+				if (strcmp(argv[i], definition.name) == 0) {
+					found = &definition;
+				}
+			}
+			if (found == nullptr) {
+				fprintf(stderr, "Unknown chain '%s'; use --list to see the available ones.\n", argv[i]);
+				return 1;
+			}
+			to_run.push_back(found);
+		}
+	}
+	if (num_frames == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (to_run.empty()) {
+		for (const BenchDefinition &definition : bench_definitions) {
+			to_run.push_back(&definition);
+		}
+	}
+
+	map<string, double> baseline;
+	if (baseline_filename != nullptr && !read_baseline(baseline_filename, &baseline)) {
+		return 1;
+	}
+
+	if (!create_headless_context()) {
+		return 1;
+	}
+	if (!init_movit(data_directory, MOVIT_DEBUG_OFF)) {
+		return 1;
+	}
+
+	vector<BenchResult> results;
+	for (const BenchDefinition *definition : to_run) {
+		fprintf(stderr, "Running %s...\n", definition->name);
+		results.push_back(run_bench(*definition, num_frames));
+	}
+
+	FILE *fp = stdout;
+	if (output_filename != nullptr) {
+		fp = fopen(output_filename, "w");
+		if (fp == nullptr) {
+			perror(output_filename);
+			return 1;
+		}
+	}
+	write_results(fp, results, num_frames);
+	if (fp != stdout) {
+		fclose(fp);
+	}
+
+	if (baseline_filename != nullptr && !compare_to_baseline(results, baseline, tolerance)) {
+		return 2;
+	}
+	return 0;
+}
@@ -103,4 +103,17 @@ TEST(OverlayEffectTest, PhotoshopReferenceTest) {
 	expect_equal(expected_data, out_data, 4, 1);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_OverlayEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format, 2);
+	bench.add_effect(new OverlayEffect());
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_OverlayEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_OverlayEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_OverlayEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -127,6 +127,20 @@ void PaddingEffect::inform_input_size(unsigned input_num, unsigned width, unsign
 	input_height = height;
 }
 
+Region PaddingEffect::get_needed_input_region(unsigned input_num, const Region &output_region) const
+{
+	// Convert to input texels (see set_gl_state()), and add a texel
+	// in each direction in case top/left are not integers.
+	const float offset_x = left;
+	const float offset_y = output_height - input_height - top;
+	Region ret;
+	ret.x0 = (output_region.x0 * output_width - offset_x - 1.0f) / input_width;
+	ret.x1 = (output_region.x1 * output_width - offset_x + 1.0f) / input_width;
+	ret.y0 = (output_region.y0 * output_height - offset_y - 1.0f) / input_height;
+	ret.y1 = (output_region.y1 * output_height - offset_y + 1.0f) / input_height;
+	return ret;
+}
+
 IntegralPaddingEffect::IntegralPaddingEffect() {}
 
 bool IntegralPaddingEffect::set_int(const std::string &key, int value)
@@ -48,6 +48,7 @@ public:
 	bool sets_virtual_output_size() const override { return false; }
 	void get_output_size(unsigned *width, unsigned *height, unsigned *virtual_width, unsigned *virtual_height) const override;
 	void inform_input_size(unsigned input_num, unsigned width, unsigned height) override;
+	Region get_needed_input_region(unsigned input_num, const Region &output_region) const override;
 
 private:
 	RGBATuple border_color;
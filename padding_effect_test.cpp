@@ -346,4 +346,25 @@ TEST(PaddingEffectTest, BorderOffsetLeftAndRight) {
 	expect_equal(expected_data, out_data, 4, 2);
 }
 
+#ifdef HAVE_BENCHMARK
+// Moves the image a bit, so that there is both some border and some cropping,
+// like when placing a picture-in-picture.
+void BM_PaddingEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *padding_effect = bench.add_effect(new PaddingEffect());
+	const RGBATuple border_color(0.0f, 0.0f, 0.0f, 1.0f);
+	ASSERT_TRUE(padding_effect->set_int("width", state.range(0)));
+	ASSERT_TRUE(padding_effect->set_int("height", state.range(1)));
+	ASSERT_TRUE(padding_effect->set_float("top", 16.0f));
+	ASSERT_TRUE(padding_effect->set_float("left", 32.0f));
+	ASSERT_TRUE(padding_effect->set_vec4("border_color", (float *)&border_color));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_PaddingEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_PaddingEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_PaddingEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
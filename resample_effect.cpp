@@ -9,16 +9,28 @@
 #include <math.h>
 #include <stdio.h>
 #include <algorithm>
+#include <atomic>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
 #include <Eigen/Sparse>
 #include <Eigen/SparseQR>
 #include <Eigen/OrderingMethods>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "effect_chain.h"
 #include "effect_util.h"
 #include "fp16.h"
 #include "init.h"
 #include "resample_effect.h"
+#include "resource_pool.h"
 #include "util.h"
 
 using namespace Eigen;
@@ -197,48 +209,6 @@ void normalize_sum(Tap<T>* vals, unsigned num)
 	}
 }
 
-// Make use of the bilinear filtering in the GPU to reduce the number of samples
-// we need to make. This is a bit more complex than BlurEffect since we cannot combine
-// two neighboring samples if their weights have differing signs, so we first need to
-// figure out the maximum number of samples. Then, we downconvert all the weights to
-// that number -- we could have gone for a variable-length system, but this is simpler,
-// and the gains would probably be offset by the extra cost of checking when to stop.
-//
-// The greedy strategy for combining samples is optimal.
-template<class DestFloat>
-unsigned combine_many_samples(const Tap<float> *weights, unsigned src_size, unsigned src_samples, unsigned dst_samples, unique_ptr<Tap<DestFloat>[]> *bilinear_weights)
-{
-	float num_subtexels = src_size / movit_texel_subpixel_precision;
-	float inv_num_subtexels = movit_texel_subpixel_precision / src_size;
-	float pos1_pos2_diff = 1.0f / src_size;
-	float inv_pos1_pos2_diff = src_size;
-
-	unsigned max_samples_saved = UINT_MAX;
-	for (unsigned y = 0; y < dst_samples && max_samples_saved > 0; ++y) {
-		unsigned num_samples_saved = combine_samples<DestFloat>(weights + y * src_samples, nullptr, num_subtexels, inv_num_subtexels, src_samples, max_samples_saved, pos1_pos2_diff, inv_pos1_pos2_diff);
-		max_samples_saved = min(max_samples_saved, num_samples_saved);
-	}
-
-	// Now that we know the right width, actually combine the samples.
-	unsigned src_bilinear_samples = src_samples - max_samples_saved;
-	bilinear_weights->reset(new Tap<DestFloat>[dst_samples * src_bilinear_samples]);
-	for (unsigned y = 0; y < dst_samples; ++y) {
-		Tap<DestFloat> *bilinear_weights_ptr = bilinear_weights->get() + y * src_bilinear_samples;
-		unsigned num_samples_saved = combine_samples(
-			weights + y * src_samples,
-			bilinear_weights_ptr,
-			num_subtexels,
-			inv_num_subtexels,
-			src_samples,
-			max_samples_saved,
-			pos1_pos2_diff,
-			inv_pos1_pos2_diff);
-		assert(num_samples_saved == max_samples_saved);
-		normalize_sum(bilinear_weights_ptr, src_bilinear_samples);
-	}
-	return src_bilinear_samples;
-}
-
 // Compute the sum of squared errors between the ideal weights (which are
 // assumed to fall exactly on pixel centers) and the weights that result
 // from sampling at <bilinear_weights>. The primary reason for the difference
@@ -297,6 +267,112 @@ double compute_sum_sq_error(const Tap<float>* weights, unsigned num_weights,
 	return sum_sq_error;
 }
 
+// See for_each_row_range(). Starting a thread costs on the order of tens
+// of microseconds, which is about what a few thousand taps take.
+const size_t min_taps_for_threading = 4096;
+const unsigned max_weight_threads = 4;
+
+// Calls func(begin, end) for consecutive ranges of rows covering [0, num_rows).
+// Computing weights is all done on the CPU, and typically on the rendering
+// thread, so if there are many rows (e.g. for a 4K zoom that changes every
+// frame), we split them among a few threads. <work_per_row> is roughly
+// the number of taps in each row. Each row must be independent of the others;
+// then, the results do not depend on the number of threads.
+template<class Func>
+void for_each_row_range(unsigned num_rows, unsigned work_per_row, const Func &func)
+{
+	unsigned num_threads = 1;
+	if (size_t(num_rows) * work_per_row >= min_taps_for_threading) {
+		num_threads = min(max(thread::hardware_concurrency(), 1u), max_weight_threads);
+		num_threads = min(num_threads, num_rows);
+	}
+	if (num_threads <= 1) {
+		func(0u, num_rows);
+		return;
+	}
+
+	vector<thread> threads;
+	for (unsigned i = 1; i < num_threads; ++i) {
+		unsigned begin = size_t(num_rows) * i / num_threads;
+		unsigned end = size_t(num_rows) * (i + 1) / num_threads;
+		threads.emplace_back([&func, begin, end]{ func(begin, end); });
+	}
+	func(0u, num_rows / num_threads);
+	for (thread &t : threads) {
+		t.join();
+	}
+}
+
+// Make use of the bilinear filtering in the GPU to reduce the number of samples
+// we need to make. This is a bit more complex than BlurEffect since we cannot combine
+// two neighboring samples if their weights have differing signs, so we first need to
+// figure out the maximum number of samples. Then, we downconvert all the weights to
+// that number -- we could have gone for a variable-length system, but this is simpler,
+// and the gains would probably be offset by the extra cost of checking when to stop.
+//
+// The greedy strategy for combining samples is optimal.
+//
+// If any row gets a sum of squared errors (see compute_sum_sq_error())
+// above <max_sum_sq_error>, we give up right away (since the caller would
+// only throw away the result anyway), clear <bilinear_weights> and return 0.
+// Give infinity to skip the check.
+template<class DestFloat>
+unsigned combine_many_samples(const Tap<float> *weights, unsigned src_size, unsigned src_samples, unsigned dst_samples, float max_sum_sq_error, unique_ptr<Tap<DestFloat>[]> *bilinear_weights)
+{
+	float num_subtexels = src_size / movit_texel_subpixel_precision;
+	float inv_num_subtexels = movit_texel_subpixel_precision / src_size;
+	float pos1_pos2_diff = 1.0f / src_size;
+	float inv_pos1_pos2_diff = src_size;
+
+	// Since combine_samples() gives min(max_samples_saved, what the row could save),
+	// we can start every range of rows from scratch and then take the minimum.
+	mutex max_samples_saved_lock;
+	unsigned max_samples_saved = UINT_MAX;  // Under max_samples_saved_lock.
+	for_each_row_range(dst_samples, src_samples, [&](unsigned begin, unsigned end) {
+		unsigned range_max_samples_saved = UINT_MAX;
+		for (unsigned y = begin; y < end && range_max_samples_saved > 0; ++y) {
+			unsigned num_samples_saved = combine_samples<DestFloat>(weights + y * src_samples, nullptr, num_subtexels, inv_num_subtexels, src_samples, range_max_samples_saved, pos1_pos2_diff, inv_pos1_pos2_diff);
+			range_max_samples_saved = min(range_max_samples_saved, num_samples_saved);
+		}
+		lock_guard<mutex> lock(max_samples_saved_lock);
+		max_samples_saved = min(max_samples_saved, range_max_samples_saved);
+	});
+
+	// Now that we know the right width, actually combine the samples.
+	unsigned src_bilinear_samples = src_samples - max_samples_saved;
+	bilinear_weights->reset(new Tap<DestFloat>[dst_samples * src_bilinear_samples]);
+	atomic<bool> error_too_large(false);
+	for_each_row_range(dst_samples, src_samples, [&](unsigned begin, unsigned end) {
+		for (unsigned y = begin; y < end && !error_too_large; ++y) {
+			Tap<DestFloat> *bilinear_weights_ptr = bilinear_weights->get() + y * src_bilinear_samples;
+			unsigned num_samples_saved = combine_samples(
+				weights + y * src_samples,
+				bilinear_weights_ptr,
+				num_subtexels,
+				inv_num_subtexels,
+				src_samples,
+				max_samples_saved,
+				pos1_pos2_diff,
+				inv_pos1_pos2_diff);
+			assert(num_samples_saved == max_samples_saved);
+			normalize_sum(bilinear_weights_ptr, src_bilinear_samples);
+
+			if (max_sum_sq_error != HUGE_VALF &&
+			    compute_sum_sq_error(weights + y * src_samples, src_samples,
+			                         bilinear_weights_ptr, src_bilinear_samples,
+			                         src_size) > max_sum_sq_error) {
+				error_too_large = true;
+			}
+		}
+	});
+
+	if (error_too_large) {
+		bilinear_weights->reset();
+		return 0;
+	}
+	return src_bilinear_samples;
+}
+
 }  // namespace
 
 ResampleEffect::ResampleEffect()
@@ -444,7 +520,9 @@ SingleResamplePassEffect::SingleResamplePassEffect(ResampleEffect *parent)
 	  last_output_width(-1),
 	  last_output_height(-1),
 	  last_offset(0.0 / 0.0),  // NaN.
-	  last_zoom(0.0 / 0.0)  // NaN.
+	  last_zoom(0.0 / 0.0),  // NaN.
+	  resource_pool(nullptr),
+	  weight_texnum(0)
 {
 	register_int("direction", (int *)&direction);
 	register_int("input_width", &input_width);
@@ -466,6 +544,9 @@ SingleResamplePassEffect::SingleResamplePassEffect(ResampleEffect *parent)
 
 SingleResamplePassEffect::~SingleResamplePassEffect()
 {
+	if (weight_texnum != 0) {
+		resource_pool->release_keyed_texture(weight_texnum);
+	}
 }
 
 string SingleResamplePassEffect::output_fragment_shader()
@@ -502,35 +583,103 @@ void SingleResamplePassEffect::update_texture(GLuint glsl_program_num, const str
 		assert(false);
 	}
 
-	ScalingWeights weights = calculate_bilinear_scaling_weights(src_size, dst_size, zoom, offset);
-	src_bilinear_samples = weights.src_bilinear_samples;
-	num_loops = weights.num_loops;
-	slice_height = 1.0f / weights.num_loops;
+	shared_ptr<const ScalingWeights> weights = get_cached_bilinear_scaling_weights(src_size, dst_size, zoom, offset);
+	src_bilinear_samples = weights->src_bilinear_samples;
+	num_loops = weights->num_loops;
+	slice_height = 1.0f / weights->num_loops;
+
+	// The texture contents are given by the same parameters as the weights,
+	// so identical passes (in chains sharing a ResourcePool) can share it.
+	// %a is exact, so different floats always give different keys.
+	char key[256];
+	snprintf(key, sizeof(key), "ResampleEffect weights: src_size=%u dst_size=%u zoom=%a offset=%a precision=%a",
+		src_size, dst_size, zoom, offset, movit_texel_subpixel_precision);
 
-	// Encode as a two-component texture. Note the GL_REPEAT.
 	glActiveTexture(GL_TEXTURE0 + *sampler_num);
 	check_error();
-	glBindTexture(GL_TEXTURE_2D, tex.get_texnum());
-	check_error();
 
-	GLenum type, internal_format;
-	void *pixels;
-	assert((weights.bilinear_weights_fp16 == nullptr) != (weights.bilinear_weights_fp32 == nullptr));
-	if (weights.bilinear_weights_fp32 != nullptr) {
-		type = GL_FLOAT;
-		internal_format = GL_RG32F;
-		pixels = weights.bilinear_weights_fp32.get();
-	} else {
-		type = GL_HALF_FLOAT;
-		internal_format = GL_RG16F;
-		pixels = weights.bilinear_weights_fp16.get();
-	}
+	ResourcePool *new_resource_pool = chain->get_resource_pool();
+	GLuint new_weight_texnum = new_resource_pool->acquire_keyed_texture(key, [&weights]{
+		// Encode as a two-component texture. Note the GL_REPEAT.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		check_error();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		check_error();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		check_error();
 
-	tex.update(weights.src_bilinear_samples, weights.dst_samples, internal_format, GL_RG, type, pixels);
+		GLenum type, internal_format;
+		const void *pixels;
+		assert((weights->bilinear_weights_fp16 == nullptr) != (weights->bilinear_weights_fp32 == nullptr));
+		if (weights->bilinear_weights_fp32 != nullptr) {
+			type = GL_FLOAT;
+			internal_format = GL_RG32F;
+			pixels = weights->bilinear_weights_fp32.get();
+		} else {
+			type = GL_HALF_FLOAT;
+			internal_format = GL_RG16F;
+			pixels = weights->bilinear_weights_fp16.get();
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, weights->src_bilinear_samples, weights->dst_samples, 0, GL_RG, type, pixels);
+		check_error();
+	});
+
+	if (weight_texnum != 0) {
+		resource_pool->release_keyed_texture(weight_texnum);
+	}
+	resource_pool = new_resource_pool;
+	weight_texnum = new_weight_texnum;
 }
 
 namespace {
 
+// Fill in <num_taps> taps for the source pixels starting at <first_src_y>,
+// with the kernel centered around <center_src_y> + <subpixel_offset>. This is the same as calling
+// lanczos_weight_cached() for each tap, and gives bit-exact the same result,
+// but we do four taps at a time if we can. (The table lookups are still
+// scalar, since SSE2 has no gather instruction.)
+void sample_kernel(int first_src_y, float center_src_y, float subpixel_offset, float radius_scaling_factor,
+                   float inv_src_size, unsigned num_taps, Tap<float> *taps)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128 center = _mm_set1_ps(center_src_y);
+	const __m128 subpixel = _mm_set1_ps(subpixel_offset);
+	const __m128 scale = _mm_set1_ps(radius_scaling_factor);
+	const __m128 inv_size = _mm_set1_ps(inv_src_size);
+	const __m128 sign_bit = _mm_set1_ps(-0.0f);
+	const __m128 radius = _mm_set1_ps(LANCZOS_RADIUS);
+	const __m128 table_scale = _mm_set1_ps(LANCZOS_TABLE_SIZE / LANCZOS_RADIUS);
+	const __m128 half = _mm_set1_ps(0.5f);
+	for ( ; i + 4 <= num_taps; i += 4) {
+		__m128 src_y = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(first_src_y + int(i)), _mm_setr_epi32(0, 1, 2, 3)));
+		__m128 x = _mm_andnot_ps(sign_bit, _mm_mul_ps(scale, _mm_sub_ps(_mm_sub_ps(src_y, center), subpixel)));  // fabs().
+		__m128 outside = _mm_cmpgt_ps(x, radius);
+
+		// Point taps outside the kernel at table entry 0; they are zeroed out below.
+		__m128 table_pos = _mm_mul_ps(x, table_scale);
+		__m128i table_pos_int = _mm_andnot_si128(_mm_castps_si128(outside), _mm_cvttps_epi32(table_pos));
+		__m128 table_pos_frac = _mm_sub_ps(table_pos, _mm_cvtepi32_ps(table_pos_int));
+		alignas(16) int idx[4];
+		_mm_store_si128((__m128i *)idx, table_pos_int);
+		__m128 lower = _mm_setr_ps(lanczos_table[idx[0]], lanczos_table[idx[1]], lanczos_table[idx[2]], lanczos_table[idx[3]]);
+		__m128 upper = _mm_setr_ps(lanczos_table[idx[0] + 1], lanczos_table[idx[1] + 1], lanczos_table[idx[2] + 1], lanczos_table[idx[3] + 1]);
+		__m128 weight = _mm_add_ps(lower, _mm_mul_ps(table_pos_frac, _mm_sub_ps(upper, lower)));
+		weight = _mm_mul_ps(_mm_andnot_ps(outside, weight), scale);
+
+		__m128 pos = _mm_mul_ps(_mm_add_ps(src_y, half), inv_size);
+		_mm_storeu_ps(&taps[i].weight, _mm_unpacklo_ps(weight, pos));
+		_mm_storeu_ps(&taps[i + 2].weight, _mm_unpackhi_ps(weight, pos));
+	}
+#endif
+	for ( ; i < num_taps; ++i) {
+		int src_y = first_src_y + int(i);
+		float weight = lanczos_weight_cached(radius_scaling_factor * (src_y - center_src_y - subpixel_offset));
+		taps[i].weight = weight * radius_scaling_factor;
+		taps[i].pos = (src_y + 0.5f) * inv_src_size;
+	}
+}
+
 ScalingWeights calculate_scaling_weights(unsigned src_size, unsigned dst_size, float zoom, float offset)
 {
 	// Only needed if run from outside ResampleEffect.
@@ -613,21 +762,19 @@ ScalingWeights calculate_scaling_weights(unsigned src_size, unsigned dst_size, f
 	float subpixel_offset = offset - lrintf(offset);  // The part not covered by whole_pixel_offset.
 	assert(subpixel_offset >= -0.5f && subpixel_offset <= 0.5f);
 	float inv_scaling_factor = 1.0f / scaling_factor;
-	for (unsigned y = 0; y < dst_samples; ++y) {
-		// Find the point around which we want to sample the source image,
-		// compensating for differing pixel centers as the scale changes.
-		float center_src_y = (y + 0.5f) * inv_scaling_factor - 0.5f;
-		int base_src_y = lrintf(center_src_y);
-
-		// Now sample <int_radius> pixels on each side around that point.
-		float inv_src_size = 1.0 / float(src_size);
-		for (int i = 0; i < src_samples; ++i) {
-			int src_y = base_src_y + i - int_radius;
-			float weight = lanczos_weight_cached(radius_scaling_factor * (src_y - center_src_y - subpixel_offset));
-			weights[y * src_samples + i].weight = weight * radius_scaling_factor;
-			weights[y * src_samples + i].pos = (src_y + 0.5f) * inv_src_size;
+	float inv_src_size = 1.0 / float(src_size);
+	for_each_row_range(dst_samples, src_samples, [&](unsigned begin, unsigned end) {
+		for (unsigned y = begin; y < end; ++y) {
+			// Find the point around which we want to sample the source image,
+			// compensating for differing pixel centers as the scale changes.
+			float center_src_y = (y + 0.5f) * inv_scaling_factor - 0.5f;
+			int base_src_y = lrintf(center_src_y);
+
+			// Now sample <int_radius> pixels on each side around that point.
+			sample_kernel(base_src_y - int_radius, center_src_y, subpixel_offset, radius_scaling_factor,
+			              inv_src_size, src_samples, &weights[y * src_samples]);
 		}
-	}
+	});
 
 	ScalingWeights ret;
 	ret.src_bilinear_samples = src_samples;
@@ -652,23 +799,10 @@ ScalingWeights calculate_bilinear_scaling_weights(unsigned src_size, unsigned ds
 	// samples, since one would assume overall errors in the shape don't matter as much.
 	const float max_error = 2.0f / (255.0f * 255.0f);
 	unique_ptr<Tap<fp16_int_t>[]> bilinear_weights_fp16;
-	int src_bilinear_samples = combine_many_samples(weights.get(), src_size, src_samples, ret.dst_samples, &bilinear_weights_fp16);
+	int src_bilinear_samples = combine_many_samples(weights.get(), src_size, src_samples, ret.dst_samples, max_error, &bilinear_weights_fp16);
 	unique_ptr<Tap<float>[]> bilinear_weights_fp32 = nullptr;
-	double max_sum_sq_error_fp16 = 0.0;
-	for (unsigned y = 0; y < ret.dst_samples; ++y) {
-		double sum_sq_error_fp16 = compute_sum_sq_error(
-			weights.get() + y * src_samples, src_samples,
-			bilinear_weights_fp16.get() + y * src_bilinear_samples, src_bilinear_samples,
-			src_size);
-		max_sum_sq_error_fp16 = std::max(max_sum_sq_error_fp16, sum_sq_error_fp16);
-		if (max_sum_sq_error_fp16 > max_error) {
-			break;
-		}
-	}
-
-	if (max_sum_sq_error_fp16 > max_error) {
-		bilinear_weights_fp16.reset();
-		src_bilinear_samples = combine_many_samples(weights.get(), src_size, src_samples, ret.dst_samples, &bilinear_weights_fp32);
+	if (bilinear_weights_fp16 == nullptr) {
+		src_bilinear_samples = combine_many_samples(weights.get(), src_size, src_samples, ret.dst_samples, HUGE_VALF, &bilinear_weights_fp32);
 	}
 
 	ret.src_bilinear_samples = src_bilinear_samples;
@@ -677,6 +811,81 @@ ScalingWeights calculate_bilinear_scaling_weights(unsigned src_size, unsigned ds
 	return ret;
 }
 
+namespace {
+
+// calculate_bilinear_scaling_weights() is fairly expensive, and it is common
+// to have many SingleResamplePassEffects (e.g. in a multiviewer) that all
+// want exactly the same weights, often at the same time (e.g. on a scene
+// change), so we keep the most recently used ones around, shared between
+// all instances and threads. Entries are futures, so that if two threads
+// want the same weights at the same time, only one of them computes them,
+// while unrelated weights can be computed in parallel.
+// The weights also depend on movit_texel_subpixel_precision, which normally
+// never changes after init, but it is cheap to be sure.
+typedef tuple<unsigned, unsigned, float, float, float> ScalingWeightsKey;  // src_size, dst_size, zoom, offset, precision.
+typedef pair<ScalingWeightsKey, shared_future<shared_ptr<const ScalingWeights>>> ScalingWeightsEntry;
+const size_t scaling_weights_cache_max_size = 64;
+mutex scaling_weights_cache_lock;
+list<ScalingWeightsEntry> scaling_weights_lru;  // Under scaling_weights_cache_lock. Most recently used first.
+map<ScalingWeightsKey, list<ScalingWeightsEntry>::iterator> scaling_weights_cache;  // Under scaling_weights_cache_lock.
+
+}  // namespace
+
+shared_ptr<const ScalingWeights> get_cached_bilinear_scaling_weights(unsigned src_size, unsigned dst_size, float zoom, float offset)
+{
+	const ScalingWeightsKey key(src_size, dst_size, zoom, offset, movit_texel_subpixel_precision);
+	promise<shared_ptr<const ScalingWeights>> weights_promise;
+	shared_future<shared_ptr<const ScalingWeights>> weights_future;
+	bool compute = false;
+	{
+		lock_guard<mutex> lock(scaling_weights_cache_lock);
+		auto cache_it = scaling_weights_cache.find(key);
+		if (cache_it != scaling_weights_cache.end()) {
+			// Move to the front of the LRU list.
+			scaling_weights_lru.splice(scaling_weights_lru.begin(), scaling_weights_lru, cache_it->second);
+			weights_future = cache_it->second->second;
+		} else {
+			weights_future = weights_promise.get_future().share();
+			compute = true;
+			scaling_weights_lru.emplace_front(key, weights_future);
+			scaling_weights_cache.insert(make_pair(key, scaling_weights_lru.begin()));
+			if (scaling_weights_lru.size() > scaling_weights_cache_max_size) {
+				scaling_weights_cache.erase(scaling_weights_lru.back().first);
+				scaling_weights_lru.pop_back();
+			}
+		}
+	}
+
+	if (compute) {
+		weights_promise.set_value(shared_ptr<const ScalingWeights>(
+			new ScalingWeights(calculate_bilinear_scaling_weights(src_size, dst_size, zoom, offset))));
+	}
+	return weights_future.get();
+}
+
+Region SingleResamplePassEffect::get_needed_input_region(unsigned input_num, const Region &output_region) const
+{
+	// See calculate_scaling_weights(); the center of the kernel for
+	// a given output position is at x * src_size / zoom + offset
+	// (in input texels), and it extends out to about <int_radius>
+	// texels on each side. Add a bit extra for the bilinear taps.
+	const float src_size = (direction == HORIZONTAL) ? input_width : input_height;
+	const float dst_size = (direction == HORIZONTAL) ? output_width : output_height;
+	const float scaling_factor = zoom * dst_size / src_size;
+	const float padding = (LANCZOS_RADIUS / min(scaling_factor, 1.0f) + 2.0f) / src_size;
+	const float scale = 1.0f / zoom, bias = offset / src_size;
+
+	Region ret = output_region;
+	if (direction == HORIZONTAL) {
+		ret.x0 = output_region.x0 * scale + bias - padding;
+		ret.x1 = output_region.x1 * scale + bias + padding;
+	} else {
+		ret.y0 = output_region.y0 * scale + bias - padding;
+		ret.y1 = output_region.y1 * scale + bias + padding;
+	}
+	return ret;
+}
+
 void SingleResamplePassEffect::set_gl_state(GLuint glsl_program_num, const string &prefix, unsigned *sampler_num)
 {
 	Effect::set_gl_state(glsl_program_num, prefix, sampler_num);
@@ -703,7 +912,7 @@ void SingleResamplePassEffect::set_gl_state(GLuint glsl_program_num, const strin
 
 	glActiveTexture(GL_TEXTURE0 + *sampler_num);
 	check_error();
-	glBindTexture(GL_TEXTURE_2D, tex.get_texnum());
+	glBindTexture(GL_TEXTURE_2D, weight_texnum);
 	check_error();
 
 	uniform_sample_tex = *sampler_num;
@@ -28,6 +28,7 @@ namespace movit {
 
 class EffectChain;
 class Node;
+class ResourcePool;
 class SingleResamplePassEffect;
 
 // Public so that it can be benchmarked externally.
@@ -44,8 +45,17 @@ struct ScalingWeights {
 	std::unique_ptr<Tap<fp16_int_t>[]> bilinear_weights_fp16;
 	std::unique_ptr<Tap<float>[]> bilinear_weights_fp32;
 };
+
+// Thread-safe. For large sizes, the work is split among a few short-lived
+// threads, so that e.g. a zoom that changes every frame does not hold up
+// the rendering thread for too long.
 ScalingWeights calculate_bilinear_scaling_weights(unsigned src_size, unsigned dst_size, float zoom, float offset);
 
+// Same, but from a process-wide cache of the most recently used weights
+// (see resample_effect.cpp); computes them only if they are not there.
+// Thread-safe.
+std::shared_ptr<const ScalingWeights> get_cached_bilinear_scaling_weights(unsigned src_size, unsigned dst_size, float zoom, float offset);
+
 // A simple manager for support data stored in a 2D texture.
 // Consider moving it to a shared location of more classes
 // should need similar functionality.
@@ -130,6 +140,8 @@ public:
 		*virtual_height = *height = this->output_height;
 	}
 
+	Region get_needed_input_region(unsigned input_num, const Region &output_region) const override;
+
 	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
 	
 	enum Direction { HORIZONTAL = 0, VERTICAL = 1 };
@@ -151,7 +163,11 @@ private:
 	float last_offset, last_zoom;
 	int src_bilinear_samples, num_loops;
 	float slice_height;
-	Support2DTexture tex;
+
+	// The weight texture, shared with all other SingleResamplePassEffects
+	// in the same ResourcePool that use the same weights.
+	ResourcePool *resource_pool;
+	GLuint weight_texnum;
 };
 
 }  // namespace movit
@@ -11,6 +11,7 @@
 #include "fp16.h"
 #include "image_format.h"
 #include "init.h"
+#include "mix_effect.h"
 #include "resample_effect.h"
 #include "test_util.h"
 
@@ -436,6 +437,76 @@ TEST(ResampleEffectTest, Precision) {
 	expect_equal(expected_data, out_data, size, 1);
 }
 
+TEST(ResampleEffectTest, ScalingWeightsAreCached) {
+	shared_ptr<const ScalingWeights> weights = get_cached_bilinear_scaling_weights(1920, 480, 1.0f, 0.0f);
+	EXPECT_EQ(weights, get_cached_bilinear_scaling_weights(1920, 480, 1.0f, 0.0f));
+	EXPECT_NE(weights, get_cached_bilinear_scaling_weights(1920, 480, 1.0f, 0.5f));
+	EXPECT_NE(weights, get_cached_bilinear_scaling_weights(1920, 480, 1.01f, 0.0f));
+
+	// Must be the same as if we computed them ourselves.
+	ScalingWeights expected_weights = calculate_bilinear_scaling_weights(1920, 480, 1.0f, 0.0f);
+	ASSERT_EQ(expected_weights.src_bilinear_samples, weights->src_bilinear_samples);
+	ASSERT_EQ(expected_weights.dst_samples, weights->dst_samples);
+	EXPECT_EQ(expected_weights.num_loops, weights->num_loops);
+	ASSERT_EQ(expected_weights.bilinear_weights_fp16 == nullptr, weights->bilinear_weights_fp16 == nullptr);
+	const unsigned num_taps = weights->src_bilinear_samples * weights->dst_samples;
+	for (unsigned i = 0; i < num_taps; ++i) {
+		if (weights->bilinear_weights_fp16 != nullptr) {
+			EXPECT_EQ(expected_weights.bilinear_weights_fp16[i].weight.val, weights->bilinear_weights_fp16[i].weight.val);
+			EXPECT_EQ(expected_weights.bilinear_weights_fp16[i].pos.val, weights->bilinear_weights_fp16[i].pos.val);
+		} else {
+			EXPECT_EQ(expected_weights.bilinear_weights_fp32[i].weight, weights->bilinear_weights_fp32[i].weight);
+			EXPECT_EQ(expected_weights.bilinear_weights_fp32[i].pos, weights->bilinear_weights_fp32[i].pos);
+		}
+	}
+}
+
+// Two identical scalers in the same chain share the weights (and the
+// weight texture); make sure that still gives the right result for both.
+TEST(ResampleEffectTest, IdenticalScalersShareWeights) {
+	const int width = 4, height = 4;
+	float data[width * height] = {
+		0.0, 0.0, 0.0, 0.0,
+		0.0, 1.0, 0.0, 0.0,
+		0.0, 0.0, 0.0, 0.0,
+		0.0, 0.0, 0.0, 0.0,
+	};
+	float out_data[width * height], expected_data[width * height];
+
+	// One scaler alone.
+	{
+		EffectChainTester tester(data, width, height, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+		Effect *resample_effect = tester.get_chain()->add_effect(new ResampleEffect());
+		ASSERT_TRUE(resample_effect->set_int("width", width));
+		ASSERT_TRUE(resample_effect->set_int("height", height));
+		ASSERT_TRUE(resample_effect->set_float("zoom_x", 1.5f));
+		tester.run(expected_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	}
+
+	// Two of them, whose outputs are then added together.
+	{
+		EffectChainTester tester(nullptr, width, height);
+		Effect *input1 = tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+		Effect *input2 = tester.add_input(data, FORMAT_GRAYSCALE, COLORSPACE_sRGB, GAMMA_LINEAR);
+		Effect *resample1 = tester.get_chain()->add_effect(new ResampleEffect(), input1);
+		Effect *resample2 = tester.get_chain()->add_effect(new ResampleEffect(), input2);
+		for (Effect *resample_effect : { resample1, resample2 }) {
+			ASSERT_TRUE(resample_effect->set_int("width", width));
+			ASSERT_TRUE(resample_effect->set_int("height", height));
+			ASSERT_TRUE(resample_effect->set_float("zoom_x", 1.5f));
+		}
+		Effect *mix_effect = tester.get_chain()->add_effect(new MixEffect(), resample1, resample2);
+		ASSERT_TRUE(mix_effect->set_float("strength_first", 1.0f));
+		ASSERT_TRUE(mix_effect->set_float("strength_second", 1.0f));
+		tester.run(out_data, GL_RED, COLORSPACE_sRGB, GAMMA_LINEAR);
+	}
+
+	for (int i = 0; i < width * height; ++i) {
+		expected_data[i] *= 2.0f;
+	}
+	expect_equal(expected_data, out_data, width, height);
+}
+
 #ifdef HAVE_BENCHMARK
 template<> inline uint8_t from_fp32<uint8_t>(float x) { return lrintf(x * 255.0f); }
 
@@ -480,6 +551,10 @@ BENCHMARK_CAPTURE(BM_ResampleEffectHalf, Float16Upscale, GAMMA_LINEAR, "fragment
 BENCHMARK_CAPTURE(BM_ResampleEffectInt8, Int8Downscale, GAMMA_REC_709, "fragment")->Args({1280, 720, 640, 360})->Args({1280, 720, 320, 180})->Args({1280, 720, 321, 181})->UseRealTime()->Unit(benchmark::kMicrosecond);
 BENCHMARK_CAPTURE(BM_ResampleEffectHalf, Float16Downscale, GAMMA_LINEAR, "fragment")->Args({1280, 720, 640, 360})->Args({1280, 720, 320, 180})->Args({1280, 720, 321, 181})->UseRealTime()->Unit(benchmark::kMicrosecond);
 
+// Conversions between the standard resolutions, as for mixing sources of different formats.
+BENCHMARK_CAPTURE(BM_ResampleEffectInt8, Int8Standard, GAMMA_REC_709, "fragment")->Args({720, 576, 1920, 1080})->Args({1280, 720, 1920, 1080})->Args({1920, 1080, 1280, 720})->Args({1920, 1080, 3840, 2160})->Args({3840, 2160, 1920, 1080})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ResampleEffectHalf, Float16Standard, GAMMA_LINEAR, "fragment")->Args({720, 576, 1920, 1080})->Args({1280, 720, 1920, 1080})->Args({1920, 1080, 1280, 720})->Args({1920, 1080, 3840, 2160})->Args({3840, 2160, 1920, 1080})->UseRealTime()->Unit(benchmark::kMicrosecond);
+
 void BM_ComputeBilinearScalingWeights(benchmark::State &state)
 {
 	constexpr unsigned src_size = 1280;
@@ -498,6 +573,24 @@ void BM_ComputeBilinearScalingWeights(benchmark::State &state)
 }
 BENCHMARK(BM_ComputeBilinearScalingWeights)->Unit(benchmark::kMicrosecond);
 
+// Like a zoom that changes every frame (which defeats any caching),
+// at the standard sizes. Arguments are source and destination size.
+void BM_ComputeBilinearScalingWeightsAnimatedZoom(benchmark::State &state)
+{
+	const unsigned src_size = state.range(0), dst_size = state.range(1);
+	float old_precision = movit_texel_subpixel_precision;
+	movit_texel_subpixel_precision = 1.0f / 64.0f;  // A typical GPU; see above.
+
+	float zoom = 1.2f;
+	for (auto _ : state) {
+		ScalingWeights weights = calculate_bilinear_scaling_weights(src_size, dst_size, zoom, 0.3f);
+		zoom += 1e-4f;
+	}
+
+	movit_texel_subpixel_precision = old_precision;
+}
+BENCHMARK(BM_ComputeBilinearScalingWeightsAnimatedZoom)->Args({1280, 1280})->Args({1920, 1920})->Args({3840, 3840})->Args({2160, 2160})->Args({3840, 480})->Unit(benchmark::kMicrosecond);
+
 #endif
 
 }  // namespace movit
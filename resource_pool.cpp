@@ -1,11 +1,17 @@
 #include <assert.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <string>
 #include <utility>
+#include <vector>
 #include <epoxy/gl.h>
 
 #include "init.h"
@@ -13,9 +19,21 @@
 #include "util.h"
 
 using namespace std;
+using namespace std::chrono;
 
 namespace movit {
 
+namespace {
+
+atomic<uint64_t> next_pool_id(1);
+
+double seconds_since(steady_clock::time_point start)
+{
+	return duration<double>(steady_clock::now() - start).count();
+}
+
+}  // namespace
+
 ResourcePool::ResourcePool(size_t program_freelist_max_length,
                            size_t texture_freelist_max_bytes,
                            size_t fbo_freelist_max_length,
@@ -24,7 +42,18 @@ ResourcePool::ResourcePool(size_t program_freelist_max_length,
 	  texture_freelist_max_bytes(texture_freelist_max_bytes),
 	  fbo_freelist_max_length(fbo_freelist_max_length),
 	  vao_freelist_max_length(vao_freelist_max_length),
-	  texture_freelist_bytes(0)
+	  program_binary_cache_hits(0),
+	  program_binary_cache_misses(0),
+	  texture_cache_hits(0),
+	  texture_cache_misses(0),
+	  program_cache_hits(0),
+	  program_cache_misses(0),
+	  num_shader_compiles(0),
+	  num_program_links(0),
+	  compile_seconds(0.0),
+	  debug_labels(false),
+	  texture_freelist_bytes(0),
+	  pool_id(next_pool_id++)
 {
 	pthread_mutex_init(&lock, nullptr);
 }
@@ -41,55 +70,73 @@ ResourcePool::~ResourcePool()
 
 	for (GLuint free_texture_num : texture_freelist) {
 		assert(texture_formats.count(free_texture_num) != 0);
+		report_texture_eviction(free_texture_num, texture_formats[free_texture_num]);
 		texture_freelist_bytes -= estimate_texture_size(texture_formats[free_texture_num]);
 		texture_formats.erase(free_texture_num);
 		glDeleteTextures(1, &free_texture_num);
 		check_error();
 	}
+	texture_freelist_buckets.clear();
 	assert(texture_formats.empty());
 	assert(texture_freelist_bytes == 0);
 
-	void *context = get_gl_context_identifier();
-	cleanup_unlinked_fbos(context);
+	for (GLuint free_texture_num : keyed_texture_freelist) {
+		assert(keyed_textures.count(free_texture_num) != 0);
+		assert(keyed_textures[free_texture_num].refcount == 0);
+		report_eviction(EVICTED_TEXTURE, free_texture_num);
+		delete_keyed_texture(free_texture_num);
+	}
+	assert(keyed_textures.empty());
 
-	for (const auto &context_and_fbos : fbo_freelist) {
-		if (context_and_fbos.first != context) {
+	void *context = get_gl_context_identifier();
+	for (const auto &context_and_state : context_states) {
+		ContextState *state = context_and_state.second;
+		if (context_and_state.first == context) {
+			shrink_fbo_freelist(state, 0);
+		} else {
 			// If this does not hold, the client should have called clean_context() earlier.
-			assert(context_and_fbos.second.empty());
-			continue;
-		}
-		for (FBOFormatIterator fbo_it : context_and_fbos.second) {
-			glDeleteFramebuffers(1, &fbo_it->second.fbo_num);
-			check_error();
-			fbo_formats.erase(fbo_it);
+			assert(state->fbo_freelist.empty());
 		}
+		assert(state->fbo_formats.empty());
+		pthread_mutex_destroy(&state->lock);
+		delete state;
 	}
-
-	assert(fbo_formats.empty());
 }
 
-void ResourcePool::delete_program(GLuint glsl_program_num)
+void ResourcePool::delete_cached_program_instances(GLuint glsl_program_num)
 {
-	bool found_program = false;
-	for (map<pair<string, string>, GLuint>::iterator program_it = programs.begin();
-	     program_it != programs.end();
-	     ++program_it) {
-		if (program_it->second == glsl_program_num) {
-			programs.erase(program_it);
-			found_program = true;
-			break;
+	for (const auto &context_and_state : context_states) {
+		ContextState *state = context_and_state.second;
+		pthread_mutex_lock(&state->lock);
+		auto instances_it = state->free_program_instances.find(glsl_program_num);
+		if (instances_it != state->free_program_instances.end()) {
+			for (GLuint instance_program_num : instances_it->second) {
+				glDeleteProgram(instance_program_num);
+				program_masters.erase(instance_program_num);
+				program_last_users.erase(instance_program_num);
+				state->program_masters.erase(instance_program_num);
+				state->program_last_users.erase(instance_program_num);
+			}
+			state->free_program_instances.erase(instances_it);
 		}
+		pthread_mutex_unlock(&state->lock);
 	}
-	for (map<string, GLuint>::iterator program_it = compute_programs.begin();
-	     program_it != compute_programs.end();
-	     ++program_it) {
-		if (program_it->second == glsl_program_num) {
-			compute_programs.erase(program_it);
-			found_program = true;
-			break;
-		}
+}
+
+void ResourcePool::delete_program(GLuint glsl_program_num)
+{
+	report_eviction(EVICTED_PROGRAM, glsl_program_num);
+
+	auto key_it = program_keys.find(glsl_program_num);
+	if (key_it != program_keys.end()) {
+		programs.erase(key_it->second);
+		program_keys.erase(key_it);
+	} else {
+		auto compute_key_it = compute_program_keys.find(glsl_program_num);
+		assert(compute_key_it != compute_program_keys.end());
+		compute_programs.erase(compute_key_it->second);
+		compute_program_keys.erase(compute_key_it);
 	}
-	assert(found_program);
 
 	map<GLuint, stack<GLuint>>::iterator instance_list_it = program_instances.find(glsl_program_num);
 	assert(instance_list_it != program_instances.end());
@@ -99,8 +146,11 @@ void ResourcePool::delete_program(GLuint glsl_program_num)
 		instance_list_it->second.pop();
 		glDeleteProgram(instance_program_num);
 		program_masters.erase(instance_program_num);
+		program_last_users.erase(instance_program_num);
 	}
+	delete_cached_program_instances(glsl_program_num);
 	program_instances.erase(instance_list_it);
+	pending_programs.erase(glsl_program_num);
 
 	map<GLuint, ShaderSpec>::iterator shader_it =
 		program_shaders.find(glsl_program_num);
@@ -110,11 +160,15 @@ void ResourcePool::delete_program(GLuint glsl_program_num)
 			compute_program_shaders.find(glsl_program_num);
 		assert(compute_shader_it != compute_program_shaders.end());
 
-		glDeleteShader(compute_shader_it->second.cs_obj);
+		if (compute_shader_it->second.cs_obj != 0) {
+			glDeleteShader(compute_shader_it->second.cs_obj);
+		}
 		compute_program_shaders.erase(compute_shader_it);
 	} else {
-		glDeleteShader(shader_it->second.vs_obj);
-		glDeleteShader(shader_it->second.fs_obj);
+		if (shader_it->second.vs_obj != 0) {
+			glDeleteShader(shader_it->second.vs_obj);
+			glDeleteShader(shader_it->second.fs_obj);
+		}
 		program_shaders.erase(shader_it);
 	}
 }
@@ -122,6 +176,15 @@ void ResourcePool::delete_program(GLuint glsl_program_num)
 GLuint ResourcePool::compile_glsl_program(const string& vertex_shader,
                                           const string& fragment_shader,
                                           const vector<string>& fragment_shader_outputs)
+{
+	GLuint glsl_program_num = start_compile_glsl_program(vertex_shader, fragment_shader, fragment_shader_outputs);
+	finish_glsl_program(glsl_program_num);
+	return glsl_program_num;
+}
+
+GLuint ResourcePool::start_compile_glsl_program(const string& vertex_shader,
+                                                const string& fragment_shader,
+                                                const vector<string>& fragment_shader_outputs)
 {
 	GLuint glsl_program_num;
 	pthread_mutex_lock(&lock);
@@ -140,23 +203,55 @@ GLuint ResourcePool::compile_glsl_program(const string& vertex_shader,
 		// Already in the cache.
 		glsl_program_num = programs[key];
 		increment_program_refcount(glsl_program_num);
+		++program_cache_hits;
 	} else {
-		// Not in the cache. Compile the shaders.
-		GLuint vs_obj = compile_shader(vertex_shader, GL_VERTEX_SHADER);
-		check_error();
-		GLuint fs_obj = compile_shader(fragment_shader_processed, GL_FRAGMENT_SHADER);
-		check_error();
-		glsl_program_num = link_program(vs_obj, fs_obj, fragment_shader_outputs);
+		// Not in the cache. See if an earlier run left it in the
+		// on-disk cache; if not, compile the shaders.
+		++program_cache_misses;
+		steady_clock::time_point start = steady_clock::now();
+		ShaderSpec spec;
+		spec.vs_obj = spec.fs_obj = 0;
+		spec.fragment_shader_outputs = fragment_shader_outputs;
+		spec.program_binary_format = GL_NONE;
+
+		string cache_key;
+		glsl_program_num = 0;
+		if (program_binary_cache_enabled()) {
+			// The outputs are already part of the fragment shader text.
+			cache_key = get_program_binary_cache_key(
+				"// Vertex shader:\n" + vertex_shader +
+				"// Fragment shader:\n" + fragment_shader_processed);
+			glsl_program_num = load_program_binary(
+				cache_key, &spec.program_binary_format, &spec.program_binary);
+		}
+		if (glsl_program_num == 0) {
+			// Note that we don't wait for the compile or link to finish;
+			// that happens in finish_glsl_program().
+			spec.vs_obj = start_compile_shader(vertex_shader, GL_VERTEX_SHADER);
+			check_error();
+			spec.fs_obj = start_compile_shader(fragment_shader_processed, GL_FRAGMENT_SHADER);
+			check_error();
+			glsl_program_num = link_program(spec.vs_obj, spec.fs_obj, fragment_shader_outputs, !cache_key.empty());
+			num_shader_compiles += 2;
+			++num_program_links;
+
+			PendingProgram pending;
+			pending.shaders.push_back(make_pair(spec.vs_obj, vertex_shader));
+			pending.shaders.push_back(make_pair(spec.fs_obj, fragment_shader_processed));
+			pending.cache_key = cache_key;
+			pending_programs.insert(make_pair(glsl_program_num, pending));
+		}
+		compile_seconds += seconds_since(start);
 
 		output_debug_shader(fragment_shader_processed, "frag");
 
-		programs.insert(make_pair(key, glsl_program_num));
-		add_master_program(glsl_program_num);
+		if (debug_labels) {
+			glObjectLabel(GL_PROGRAM, glsl_program_num, -1, "Movit program");
+			check_error();
+		}
 
-		ShaderSpec spec;
-		spec.vs_obj = vs_obj;
-		spec.fs_obj = fs_obj;
-		spec.fragment_shader_outputs = fragment_shader_outputs;
+		program_keys.insert(make_pair(glsl_program_num, programs.insert(make_pair(key, glsl_program_num)).first));
+		add_master_program(glsl_program_num);
 		program_shaders.insert(make_pair(glsl_program_num, spec));
 	}
 	pthread_mutex_unlock(&lock);
@@ -165,10 +260,15 @@ GLuint ResourcePool::compile_glsl_program(const string& vertex_shader,
 
 GLuint ResourcePool::link_program(GLuint vs_obj,
                                   GLuint fs_obj,
-                                  const vector<string>& fragment_shader_outputs)
+                                  const vector<string>& fragment_shader_outputs,
+                                  bool binary_retrievable)
 {
 	GLuint glsl_program_num = glCreateProgram();
 	check_error();
+	if (binary_retrievable) {
+		glProgramParameteri(glsl_program_num, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		check_error();
+	}
 	glAttachShader(glsl_program_num, vs_obj);
 	check_error();
 	glAttachShader(glsl_program_num, fs_obj);
@@ -185,6 +285,11 @@ GLuint ResourcePool::link_program(GLuint vs_obj,
 	glLinkProgram(glsl_program_num);
 	check_error();
 
+	return glsl_program_num;
+}
+
+void ResourcePool::check_link_status(GLuint glsl_program_num)
+{
 	GLint success;
 	glGetProgramiv(glsl_program_num, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE) {
@@ -193,8 +298,42 @@ GLuint ResourcePool::link_program(GLuint vs_obj,
 		fprintf(stderr, "Error linking program: %s\n", error_log);
 		exit(1);
 	}
+}
 
-	return glsl_program_num;
+bool ResourcePool::is_glsl_program_ready(GLuint glsl_program_num)
+{
+	pthread_mutex_lock(&lock);
+	bool ready = true;
+	if (pending_programs.count(glsl_program_num) && movit_parallel_shader_compile_supported) {
+		GLint completed;
+		glGetProgramiv(glsl_program_num, GL_COMPLETION_STATUS_KHR, &completed);
+		check_error();
+		ready = (completed == GL_TRUE);
+	}
+	pthread_mutex_unlock(&lock);
+	return ready;
+}
+
+void ResourcePool::finish_glsl_program(GLuint glsl_program_num)
+{
+	pthread_mutex_lock(&lock);
+	auto pending_it = pending_programs.find(glsl_program_num);
+	if (pending_it != pending_programs.end()) {
+		steady_clock::time_point start = steady_clock::now();
+
+		// This will block if the driver is not done yet. We check the shaders
+		// first, since that gives much better error messages.
+		for (const pair<GLuint, string> &shader : pending_it->second.shaders) {
+			check_shader_compiled(shader.first, shader.second);
+		}
+		check_link_status(glsl_program_num);
+		if (!pending_it->second.cache_key.empty()) {
+			save_program_binary(pending_it->second.cache_key, glsl_program_num);
+		}
+		pending_programs.erase(pending_it);
+		compile_seconds += seconds_since(start);
+	}
+	pthread_mutex_unlock(&lock);
 }
 
 void ResourcePool::release_glsl_program(GLuint glsl_program_num)
@@ -218,6 +357,13 @@ void ResourcePool::release_glsl_program(GLuint glsl_program_num)
 }
 
 GLuint ResourcePool::compile_glsl_compute_program(const string& compute_shader)
+{
+	GLuint glsl_program_num = start_compile_glsl_compute_program(compute_shader);
+	finish_glsl_program(glsl_program_num);
+	return glsl_program_num;
+}
+
+GLuint ResourcePool::start_compile_glsl_compute_program(const string& compute_shader)
 {
 	GLuint glsl_program_num;
 	pthread_mutex_lock(&lock);
@@ -227,50 +373,396 @@ GLuint ResourcePool::compile_glsl_compute_program(const string& compute_shader)
 		// Already in the cache.
 		glsl_program_num = compute_programs[key];
 		increment_program_refcount(glsl_program_num);
+		++program_cache_hits;
 	} else {
-		// Not in the cache. Compile the shader.
-		GLuint cs_obj = compile_shader(compute_shader, GL_COMPUTE_SHADER);
-		check_error();
-		glsl_program_num = link_compute_program(cs_obj);
+		// Not in the cache. Try the on-disk cache, or compile the shader.
+		++program_cache_misses;
+		steady_clock::time_point start = steady_clock::now();
+		ComputeShaderSpec spec;
+		spec.cs_obj = 0;
+		spec.program_binary_format = GL_NONE;
+
+		string cache_key;
+		glsl_program_num = 0;
+		if (program_binary_cache_enabled()) {
+			cache_key = get_program_binary_cache_key("// Compute shader:\n" + compute_shader);
+			glsl_program_num = load_program_binary(
+				cache_key, &spec.program_binary_format, &spec.program_binary);
+		}
+		if (glsl_program_num == 0) {
+			spec.cs_obj = start_compile_shader(compute_shader, GL_COMPUTE_SHADER);
+			check_error();
+			glsl_program_num = link_compute_program(spec.cs_obj, !cache_key.empty());
+			++num_shader_compiles;
+			++num_program_links;
+
+			PendingProgram pending;
+			pending.shaders.push_back(make_pair(spec.cs_obj, compute_shader));
+			pending.cache_key = cache_key;
+			pending_programs.insert(make_pair(glsl_program_num, pending));
+		}
+		compile_seconds += seconds_since(start);
 
 		output_debug_shader(compute_shader, "comp");
 
-		compute_programs.insert(make_pair(key, glsl_program_num));
-		add_master_program(glsl_program_num);
+		if (debug_labels) {
+			glObjectLabel(GL_PROGRAM, glsl_program_num, -1, "Movit compute program");
+			check_error();
+		}
 
-		ComputeShaderSpec spec;
-		spec.cs_obj = cs_obj;
+		compute_program_keys.insert(make_pair(glsl_program_num, compute_programs.insert(make_pair(key, glsl_program_num)).first));
+		add_master_program(glsl_program_num);
 		compute_program_shaders.insert(make_pair(glsl_program_num, spec));
 	}
 	pthread_mutex_unlock(&lock);
 	return glsl_program_num;
 }
 
-GLuint ResourcePool::link_compute_program(GLuint cs_obj)
+GLuint ResourcePool::link_compute_program(GLuint cs_obj, bool binary_retrievable)
 {
 	GLuint glsl_program_num = glCreateProgram();
 	check_error();
+	if (binary_retrievable) {
+		glProgramParameteri(glsl_program_num, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		check_error();
+	}
 	glAttachShader(glsl_program_num, cs_obj);
 	check_error();
 	glLinkProgram(glsl_program_num);
 	check_error();
 
+	return glsl_program_num;
+}
+
+GLuint ResourcePool::link_program_binary(GLenum binary_format, const string &binary)
+{
+	// Make sure the driver still supports this format; if not, glProgramBinary()
+	// would give GL_INVALID_ENUM instead of just failing the link.
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	check_error();
+	vector<GLint> formats(num_formats);
+	if (num_formats > 0) {
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+		check_error();
+	}
+	if (find(formats.begin(), formats.end(), GLint(binary_format)) == formats.end()) {
+		return 0;
+	}
+
+	GLuint glsl_program_num = glCreateProgram();
+	check_error();
+	glProgramBinary(glsl_program_num, binary_format, binary.data(), binary.size());
+	check_error();
+
+	// The driver is allowed to reject the binary for any reason
+	// (e.g. it was made by a different driver version), so this is not an error.
 	GLint success;
 	glGetProgramiv(glsl_program_num, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE) {
-		GLchar error_log[1024] = {0};
-		glGetProgramInfoLog(glsl_program_num, 1024, nullptr, error_log);
-		fprintf(stderr, "Error linking program: %s\n", error_log);
-		exit(1);
+		glDeleteProgram(glsl_program_num);
+		check_error();
+		return 0;
 	}
 
 	return glsl_program_num;
 }
 
-GLuint ResourcePool::use_glsl_program(GLuint glsl_program_num)
+void ResourcePool::set_program_binary_cache_directory(const string &directory)
 {
+	pthread_mutex_lock(&lock);
+	program_binary_cache_directory = directory;
+	pthread_mutex_unlock(&lock);
+}
+
+size_t ResourcePool::get_program_binary_cache_hits()
+{
+	pthread_mutex_lock(&lock);
+	size_t ret = program_binary_cache_hits;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+size_t ResourcePool::get_program_binary_cache_misses()
+{
+	pthread_mutex_lock(&lock);
+	size_t ret = program_binary_cache_misses;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+ResourcePool::Stats ResourcePool::get_stats()
+{
+	Stats stats;
+	stats.texture_live_bytes = stats.texture_free_bytes = 0;
+	stats.fbo_cache.hits = stats.fbo_cache.misses = 0;
+	stats.vao_cache.hits = stats.vao_cache.misses = 0;
+
+	pthread_mutex_lock(&lock);
+	for (const auto &texture_num_and_format : texture_formats) {
+		const Texture2D &texture_format = texture_num_and_format.second;
+		TextureFormatStats &format_stats = stats.textures[texture_format.internal_format];  // Zero-initialized if new.
+		++format_stats.num_live;
+		format_stats.live_bytes += estimate_texture_size(texture_format);
+	}
+
+	// Move the ones on the freelist over from live to free.
+	for (GLuint texture_num : texture_freelist) {
+		const Texture2D &texture_format = texture_formats[texture_num];
+		TextureFormatStats &format_stats = stats.textures[texture_format.internal_format];
+		const size_t bytes = estimate_texture_size(texture_format);
+		--format_stats.num_live;
+		format_stats.live_bytes -= bytes;
+		++format_stats.num_free;
+		format_stats.free_bytes += bytes;
+	}
+	for (const auto &format_and_stats : stats.textures) {
+		stats.texture_live_bytes += format_and_stats.second.live_bytes;
+		stats.texture_free_bytes += format_and_stats.second.free_bytes;
+	}
+	assert(stats.texture_free_bytes == texture_freelist_bytes);
+
+	stats.texture_cache.hits = texture_cache_hits;
+	stats.texture_cache.misses = texture_cache_misses;
+	stats.program_cache.hits = program_cache_hits;
+	stats.program_cache.misses = program_cache_misses;
+	stats.num_shader_compiles = num_shader_compiles;
+	stats.num_program_links = num_program_links;
+	stats.compile_seconds = compile_seconds;
+
+	for (const auto &context_and_state : context_states) {
+		ContextState *state = context_and_state.second;
+		ContextStats &context_stats = stats.contexts[context_and_state.first];
+		pthread_mutex_lock(&state->lock);
+		context_stats.num_fbos = state->fbo_formats.size();
+		context_stats.num_free_fbos = state->fbo_freelist.size();
+		context_stats.num_vaos = state->vao_formats.size();
+		context_stats.num_free_vaos = state->vao_freelist.size();
+		context_stats.fbo_cache.hits = state->fbo_cache_hits;
+		context_stats.fbo_cache.misses = state->fbo_cache_misses;
+		context_stats.vao_cache.hits = state->vao_cache_hits;
+		context_stats.vao_cache.misses = state->vao_cache_misses;
+		pthread_mutex_unlock(&state->lock);
+
+		stats.fbo_cache.hits += context_stats.fbo_cache.hits;
+		stats.fbo_cache.misses += context_stats.fbo_cache.misses;
+		stats.vao_cache.hits += context_stats.vao_cache.hits;
+		stats.vao_cache.misses += context_stats.vao_cache.misses;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return stats;
+}
+
+void ResourcePool::set_eviction_callback(const EvictionCallback &callback)
+{
+	eviction_callback = callback;
+}
+
+void ResourcePool::enable_debug_labels(bool enable)
+{
+	if (enable) {
+		assert(movit_debug_labels_supported);
+	}
+	debug_labels = enable;
+}
+
+void ResourcePool::report_eviction(EvictedResourceType type, GLuint object_num)
+{
+	if (eviction_callback) {
+		Eviction eviction;
+		eviction.type = type;
+		eviction.object_num = object_num;
+		eviction.internal_format = 0;
+		eviction.width = eviction.height = 0;
+		eviction.bytes = 0;
+		eviction_callback(eviction);
+	}
+}
+
+void ResourcePool::report_texture_eviction(GLuint texture_num, const Texture2D &texture_format)
+{
+	if (eviction_callback) {
+		Eviction eviction;
+		eviction.type = EVICTED_TEXTURE;
+		eviction.object_num = texture_num;
+		eviction.internal_format = texture_format.internal_format;
+		eviction.width = texture_format.width;
+		eviction.height = texture_format.height;
+		eviction.bytes = estimate_texture_size(texture_format);
+		eviction_callback(eviction);
+	}
+}
+
+bool ResourcePool::program_binary_cache_enabled() const
+{
+	return movit_program_binaries_supported && !program_binary_cache_directory.empty();
+}
+
+namespace {
+
+// The header of each file in the on-disk program cache. It is followed by
+// the full cache key (so that we can detect hash collisions), and then
+// the program binary itself.
+struct ProgramBinaryHeader {
+	char magic[8];  // "MovitPB1", not zero-terminated.
+	uint32_t binary_format;
+	uint32_t key_length;
+	uint32_t binary_length;
+};
+
+const char program_binary_magic[8] = { 'M', 'o', 'v', 'i', 't', 'P', 'B', '1' };
+
+// 64-bit FNV-1a. We don't need anything cryptographically strong,
+// but it needs to be stable across runs (unlike std::hash).
+uint64_t fnv1a_hash(const string &str)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (char ch : str) {
+		hash ^= uint8_t(ch);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+}  // namespace
+
+string ResourcePool::get_program_binary_cache_key(const string &shader_source)
+{
+	string key;
+	key += "// Vendor: " + string((const char *)glGetString(GL_VENDOR)) + "\n";
+	key += "// Renderer: " + string((const char *)glGetString(GL_RENDERER)) + "\n";
+	key += "// Version: " + string((const char *)glGetString(GL_VERSION)) + "\n";
+	check_error();
+	key += shader_source;
+	return key;
+}
+
+string ResourcePool::get_program_binary_filename(const string &cache_key) const
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "/movit-%016llx.bin", (unsigned long long)fnv1a_hash(cache_key));
+	return program_binary_cache_directory + buf;
+}
+
+GLuint ResourcePool::load_program_binary(const string &cache_key, GLenum *binary_format, string *binary)
+{
+	const string filename = get_program_binary_filename(cache_key);
+	FILE *fp = fopen(filename.c_str(), "rb");
+	if (fp == nullptr) {
+		++program_binary_cache_misses;
+		return 0;
+	}
+
+	ProgramBinaryHeader header;
+	string key;
+	bool ok = (fread(&header, sizeof(header), 1, fp) == 1 &&
+	           memcmp(header.magic, program_binary_magic, sizeof(header.magic)) == 0 &&
+	           header.key_length == cache_key.size());
+	if (ok) {
+		key.resize(header.key_length);
+		binary->resize(header.binary_length);
+		ok = (fread(&key[0], key.size(), 1, fp) == 1 &&
+		      key == cache_key &&
+		      header.binary_length > 0 &&
+		      fread(&(*binary)[0], binary->size(), 1, fp) == 1);
+	}
+	fclose(fp);
+
+	GLuint glsl_program_num = 0;
+	if (ok) {
+		*binary_format = header.binary_format;
+		glsl_program_num = link_program_binary(*binary_format, *binary);
+		++num_program_links;
+	}
+	if (glsl_program_num == 0) {
+		// Corrupted file, hash collision, or the driver doesn't want it anymore.
+		// Fall back to compiling, which will also overwrite the file.
+		binary->clear();
+		*binary_format = GL_NONE;
+		++program_binary_cache_misses;
+		return 0;
+	}
+
+	++program_binary_cache_hits;
+	return glsl_program_num;
+}
+
+void ResourcePool::save_program_binary(const string &cache_key, GLuint glsl_program_num)
+{
+	GLint binary_length = 0;
+	glGetProgramiv(glsl_program_num, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+	check_error();
+	if (binary_length <= 0) {
+		return;
+	}
+
+	string binary;
+	binary.resize(binary_length);
+	GLenum binary_format;
+	GLsizei written_length = 0;
+	glGetProgramBinary(glsl_program_num, binary_length, &written_length, &binary_format, &binary[0]);
+	check_error();
+	binary.resize(written_length);
+
+	ProgramBinaryHeader header;
+	memcpy(header.magic, program_binary_magic, sizeof(header.magic));
+	header.binary_format = binary_format;
+	header.key_length = cache_key.size();
+	header.binary_length = binary.size();
+
+	// Write to a temporary file and then rename it into place, so that
+	// other processes sharing the same directory never see a partial file.
+	const string filename = get_program_binary_filename(cache_key);
+	char tmp_suffix[32];
+	snprintf(tmp_suffix, sizeof(tmp_suffix), ".%d.tmp", int(getpid()));
+	const string tmp_filename = filename + tmp_suffix;
+
+	FILE *fp = fopen(tmp_filename.c_str(), "wb");
+	if (fp == nullptr) {
+		perror(tmp_filename.c_str());
+		return;
+	}
+	bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	           fwrite(cache_key.data(), cache_key.size(), 1, fp) == 1 &&
+	           fwrite(binary.data(), binary.size(), 1, fp) == 1);
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(tmp_filename.c_str(), filename.c_str()) == -1) {
+		perror(filename.c_str());
+		unlink(tmp_filename.c_str());
+	}
+}
+
+GLuint ResourcePool::use_glsl_program(GLuint glsl_program_num, const void *user, bool *uniforms_preserved)
+{
+	ContextState *state = get_context_state();
+
+	// If we have an unused instance cached for this context,
+	// we don't need to touch the shared state at all.
+	pthread_mutex_lock(&state->lock);
+	auto cached_it = state->free_program_instances.find(glsl_program_num);
+	if (cached_it != state->free_program_instances.end() && !cached_it->second.empty()) {
+		GLuint instance_program_num = cached_it->second.back();
+		cached_it->second.pop_back();
+
+		// Note that a user of nullptr will invalidate the uniforms for everybody else.
+		const void *&last_user = state->program_last_users[instance_program_num];
+		if (uniforms_preserved != nullptr) {
+			*uniforms_preserved = (user != nullptr && last_user == user);
+		}
+		last_user = user;
+		pthread_mutex_unlock(&state->lock);
+
+		glUseProgram(instance_program_num);
+		return instance_program_num;
+	}
+	pthread_mutex_unlock(&state->lock);
+
 	pthread_mutex_lock(&lock);
 	assert(program_instances.count(glsl_program_num));
+	assert(pending_programs.count(glsl_program_num) == 0);  // Call finish_glsl_program() first.
 	stack<GLuint> &instances = program_instances[glsl_program_num];
 
 	GLuint instance_program_num;
@@ -281,31 +773,95 @@ GLuint ResourcePool::use_glsl_program(GLuint glsl_program_num)
 	} else {
 		// We need to clone this program. (unuse_glsl_program()
 		// will later put it onto the list.)
+		steady_clock::time_point start = steady_clock::now();
 		map<GLuint, ShaderSpec>::iterator shader_it =
 			program_shaders.find(glsl_program_num);
 		if (shader_it == program_shaders.end()) {
 			// Should be a compute shader.
 			map<GLuint, ComputeShaderSpec>::iterator compute_shader_it =
 				compute_program_shaders.find(glsl_program_num);
-			instance_program_num = link_compute_program(
-				compute_shader_it->second.cs_obj);
+			if (compute_shader_it->second.cs_obj == 0) {
+				// Loaded from the on-disk cache.
+				instance_program_num = link_program_binary(
+					compute_shader_it->second.program_binary_format,
+					compute_shader_it->second.program_binary);
+				assert(instance_program_num != 0);
+			} else {
+				instance_program_num = link_compute_program(
+					compute_shader_it->second.cs_obj, false);
+				check_link_status(instance_program_num);
+			}
+		} else if (shader_it->second.vs_obj == 0) {
+			// A regular fragment shader, loaded from the on-disk cache.
+			instance_program_num = link_program_binary(
+				shader_it->second.program_binary_format,
+				shader_it->second.program_binary);
+			assert(instance_program_num != 0);
 		} else {
 			// A regular fragment shader.
 			instance_program_num = link_program(
 				shader_it->second.vs_obj,
 				shader_it->second.fs_obj,
-				shader_it->second.fragment_shader_outputs);
+				shader_it->second.fragment_shader_outputs,
+				false);
+			check_link_status(instance_program_num);
 		}
+		++num_program_links;
+		compile_seconds += seconds_since(start);
 		program_masters.insert(make_pair(instance_program_num, glsl_program_num));
+
+		if (debug_labels) {
+			char label[64];
+			snprintf(label, sizeof(label), "Movit program (clone of %u)", glsl_program_num);
+			glObjectLabel(GL_PROGRAM, instance_program_num, -1, label);
+			check_error();
+		}
 	}
+
+	// Note that a user of nullptr will invalidate the uniforms for everybody else.
+	const void *&last_user = program_last_users[instance_program_num];
+	if (uniforms_preserved != nullptr) {
+		*uniforms_preserved = (user != nullptr && last_user == user);
+	}
+	last_user = user;
 	pthread_mutex_unlock(&lock);
 
+	// Remember it for this context, so that unuse_glsl_program()
+	// can put it in our cache.
+	pthread_mutex_lock(&state->lock);
+	state->program_masters[instance_program_num] = glsl_program_num;
+	state->program_last_users[instance_program_num] = user;
+	pthread_mutex_unlock(&state->lock);
+
 	glUseProgram(instance_program_num);
 	return instance_program_num;
 }
 
 void ResourcePool::unuse_glsl_program(GLuint instance_program_num)
 {
+	ContextState *state = get_context_state();
+
+	// Unless this context already has enough unused instances of this program,
+	// just keep it here for next time.
+	const void *last_user = nullptr;
+	pthread_mutex_lock(&state->lock);
+	auto state_master_it = state->program_masters.find(instance_program_num);
+	if (state_master_it != state->program_masters.end()) {
+		vector<GLuint> &cached_instances = state->free_program_instances[state_master_it->second];
+		if (cached_instances.size() < max_cached_program_instances) {
+			cached_instances.push_back(instance_program_num);
+			pthread_mutex_unlock(&state->lock);
+			return;
+		}
+		last_user = state->program_last_users[instance_program_num];
+		state->program_masters.erase(state_master_it);
+		state->program_last_users.erase(instance_program_num);
+	} else {
+		// Used in some other context (which it shouldn't be); we don't
+		// know who has set its uniforms last, so assume nobody.
+	}
+	pthread_mutex_unlock(&state->lock);
+
 	pthread_mutex_lock(&lock);
 
 	auto master_it = program_masters.find(instance_program_num);
@@ -315,6 +871,7 @@ void ResourcePool::unuse_glsl_program(GLuint instance_program_num)
 	stack<GLuint> &instances = program_instances[master_it->second];
 
 	instances.push(instance_program_num);
+	program_last_users[instance_program_num] = last_user;
 
 	pthread_mutex_unlock(&lock);
 }
@@ -326,21 +883,17 @@ GLuint ResourcePool::create_2d_texture(GLint internal_format, GLsizei width, GLs
 
 	pthread_mutex_lock(&lock);
 	// See if there's a texture on the freelist we can use.
-	for (auto freelist_it = texture_freelist.begin();
-	     freelist_it != texture_freelist.end();
-	     ++freelist_it) {
-		GLuint texture_num = *freelist_it;
+	auto bucket_it = texture_freelist_buckets.find(Texture2DKey(internal_format, width, height));
+	if (bucket_it != texture_freelist_buckets.end()) {
+		GLuint texture_num = bucket_it->second.front();
 		map<GLuint, Texture2D>::const_iterator format_it = texture_formats.find(texture_num);
 		assert(format_it != texture_formats.end());
-		if (format_it->second.internal_format == internal_format &&
-		    format_it->second.width == width &&
-		    format_it->second.height == height) {
-			texture_freelist_bytes -= estimate_texture_size(format_it->second);
-			texture_freelist.erase(freelist_it);
-			pthread_mutex_unlock(&lock);
-			return texture_num;
-		}
+		remove_from_texture_freelist(texture_num, format_it->second);
+		++texture_cache_hits;
+		pthread_mutex_unlock(&lock);
+		return texture_num;
 	}
+	++texture_cache_misses;
 
 	// Find any reasonable format given the internal format; OpenGL validates it
 	// even though we give nullptr as pointer.
@@ -432,6 +985,13 @@ GLuint ResourcePool::create_2d_texture(GLint internal_format, GLsizei width, GLs
 	glBindTexture(GL_TEXTURE_2D, 0);
 	check_error();
 
+	if (debug_labels) {
+		char label[64];
+		snprintf(label, sizeof(label), "Movit texture (format 0x%x, %dx%d)", internal_format, width, height);
+		glObjectLabel(GL_TEXTURE, texture_num, -1, label);
+		check_error();
+	}
+
 	Texture2D texture_format;
 	texture_format.internal_format = internal_format;
 	texture_format.width = width;
@@ -446,16 +1006,21 @@ GLuint ResourcePool::create_2d_texture(GLint internal_format, GLsizei width, GLs
 void ResourcePool::release_2d_texture(GLuint texture_num)
 {
 	pthread_mutex_lock(&lock);
-	texture_freelist.push_front(texture_num);
-	assert(texture_formats.count(texture_num) != 0);
-	texture_freelist_bytes += estimate_texture_size(texture_formats[texture_num]);
+	auto format_it = texture_formats.find(texture_num);
+	assert(format_it != texture_formats.end());
+	Texture2D &texture_format = format_it->second;
+	list<GLuint> &bucket = texture_freelist_buckets[Texture2DKey(texture_format.internal_format, texture_format.width, texture_format.height)];
+	texture_format.freelist_it = texture_freelist.insert(texture_freelist.begin(), texture_num);
+	texture_format.bucket_it = bucket.insert(bucket.begin(), texture_num);
+	texture_freelist_bytes += estimate_texture_size(texture_format);
 
 	while (texture_freelist_bytes > texture_freelist_max_bytes) {
 		GLuint free_texture_num = texture_freelist.back();
-		texture_freelist.pop_back();
-		assert(texture_formats.count(free_texture_num) != 0);
-		texture_freelist_bytes -= estimate_texture_size(texture_formats[free_texture_num]);
-		texture_formats.erase(free_texture_num);
+		auto free_format_it = texture_formats.find(free_texture_num);
+		assert(free_format_it != texture_formats.end());
+		remove_from_texture_freelist(free_texture_num, free_format_it->second);
+		report_texture_eviction(free_texture_num, free_format_it->second);
+		texture_formats.erase(free_format_it);
 		glDeleteTextures(1, &free_texture_num);
 		check_error();
 
@@ -463,20 +1028,123 @@ void ResourcePool::release_2d_texture(GLuint texture_num)
 		// not be in the right context, so don't delete it right away;
 		// the cleanup in release_fbo() (which calls cleanup_unlinked_fbos())
 		// will take care of actually doing that later.
-		for (auto &key_and_fbo : fbo_formats) {
-			for (unsigned i = 0; i < num_fbo_attachments; ++i) {
-				if (key_and_fbo.second.texture_num[i] == free_texture_num) {
-					key_and_fbo.second.texture_num[i] = GL_INVALID_INDEX;
+		for (const auto &context_and_state : context_states) {
+			ContextState *state = context_and_state.second;
+			pthread_mutex_lock(&state->lock);
+			for (auto &fbo_num_and_fbo : state->fbo_formats) {
+				for (unsigned i = 0; i < num_fbo_attachments; ++i) {
+					if (fbo_num_and_fbo.second.texture_num[i] == free_texture_num) {
+						fbo_num_and_fbo.second.texture_num[i] = GL_INVALID_INDEX;
+					}
 				}
 			}
+			pthread_mutex_unlock(&state->lock);
 		}
 	}
 	pthread_mutex_unlock(&lock);
 }
 
+GLuint ResourcePool::acquire_keyed_texture(const string &key, const function<void()> &upload)
+{
+	pthread_mutex_lock(&lock);
+	auto texture_num_it = keyed_texture_nums.find(key);
+	if (texture_num_it != keyed_texture_nums.end()) {
+		GLuint texture_num = texture_num_it->second;
+		KeyedTexture &texture = keyed_textures[texture_num];
+		if (texture.refcount++ == 0) {
+			keyed_texture_freelist.erase(texture.freelist_it);
+		}
+		if (texture.upload_fence != nullptr) {
+			GLenum status = glClientWaitSync(texture.upload_fence, 0, 0);
+			check_error();
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+				glDeleteSync(texture.upload_fence);
+				check_error();
+				texture.upload_fence = nullptr;
+			} else if (texture.upload_context != get_gl_context_identifier()) {
+				// The uploading context might still be working on it
+				// (possibly in another thread); make our commands wait.
+				// In the same context, the commands are already in order.
+				glWaitSync(texture.upload_fence, 0, GL_TIMEOUT_IGNORED);
+				check_error();
+			}
+		}
+		pthread_mutex_unlock(&lock);
+		return texture_num;
+	}
+
+	GLuint texture_num;
+	glGenTextures(1, &texture_num);
+	check_error();
+	glBindTexture(GL_TEXTURE_2D, texture_num);
+	check_error();
+	upload();
+
+	// Other contexts can only wait for the fence once it has been
+	// flushed to the GPU.
+	GLsync upload_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	check_error();
+	glFlush();
+	check_error();
+
+	keyed_texture_nums.insert(make_pair(key, texture_num));
+	KeyedTexture &texture = keyed_textures[texture_num];
+	texture.key = key;
+	texture.refcount = 1;
+	texture.upload_fence = upload_fence;
+	texture.upload_context = get_gl_context_identifier();
+	pthread_mutex_unlock(&lock);
+	return texture_num;
+}
+
+void ResourcePool::delete_keyed_texture(GLuint texture_num)
+{
+	auto texture_it = keyed_textures.find(texture_num);
+	assert(texture_it != keyed_textures.end());
+	if (texture_it->second.upload_fence != nullptr) {
+		glDeleteSync(texture_it->second.upload_fence);
+		check_error();
+	}
+	keyed_texture_nums.erase(texture_it->second.key);
+	keyed_textures.erase(texture_it);
+	glDeleteTextures(1, &texture_num);
+	check_error();
+}
+
+void ResourcePool::release_keyed_texture(GLuint texture_num)
+{
+	pthread_mutex_lock(&lock);
+	auto texture_it = keyed_textures.find(texture_num);
+	assert(texture_it != keyed_textures.end());
+	KeyedTexture &texture = texture_it->second;
+	assert(texture.refcount > 0);
+	if (--texture.refcount == 0) {
+		texture.freelist_it = keyed_texture_freelist.insert(keyed_texture_freelist.begin(), texture_num);
+		if (keyed_texture_freelist.size() > keyed_texture_freelist_max_length) {
+			GLuint free_texture_num = keyed_texture_freelist.back();
+			keyed_texture_freelist.pop_back();
+			report_eviction(EVICTED_TEXTURE, free_texture_num);
+			delete_keyed_texture(free_texture_num);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void ResourcePool::remove_from_texture_freelist(GLuint texture_num, const Texture2D &texture_format)
+{
+	auto bucket_it = texture_freelist_buckets.find(Texture2DKey(texture_format.internal_format, texture_format.width, texture_format.height));
+	assert(bucket_it != texture_freelist_buckets.end());
+	bucket_it->second.erase(texture_format.bucket_it);
+	if (bucket_it->second.empty()) {
+		texture_freelist_buckets.erase(bucket_it);
+	}
+	texture_freelist.erase(texture_format.freelist_it);
+	texture_freelist_bytes -= estimate_texture_size(texture_format);
+}
+
 GLuint ResourcePool::create_fbo(GLuint texture0_num, GLuint texture1_num, GLuint texture2_num, GLuint texture3_num)
 {
-	void *context = get_gl_context_identifier();
+	ContextState *state = get_context_state();
 
 	// Make sure we are filled from the bottom.
 	assert(texture0_num != 0);
@@ -487,22 +1155,22 @@ GLuint ResourcePool::create_fbo(GLuint texture0_num, GLuint texture1_num, GLuint
 		assert(texture3_num == 0);
 	}
 
-	pthread_mutex_lock(&lock);
-	if (fbo_freelist.count(context) != 0) {
-		// See if there's an FBO on the freelist we can use.
-		auto end = fbo_freelist[context].end();
-		for (auto freelist_it = fbo_freelist[context].begin(); freelist_it != end; ++freelist_it) {
-			FBOFormatIterator fbo_it = *freelist_it;
-			if (fbo_it->second.texture_num[0] == texture0_num &&
-			    fbo_it->second.texture_num[1] == texture1_num &&
-			    fbo_it->second.texture_num[2] == texture2_num &&
-			    fbo_it->second.texture_num[3] == texture3_num) {
-				fbo_freelist[context].erase(freelist_it);
-				pthread_mutex_unlock(&lock);
-				return fbo_it->second.fbo_num;
-			}
+	pthread_mutex_lock(&state->lock);
+	// See if there's an FBO on the freelist we can use.
+	auto end = state->fbo_freelist.end();
+	for (auto freelist_it = state->fbo_freelist.begin(); freelist_it != end; ++freelist_it) {
+		FBOFormatIterator fbo_it = *freelist_it;
+		if (fbo_it->second.texture_num[0] == texture0_num &&
+		    fbo_it->second.texture_num[1] == texture1_num &&
+		    fbo_it->second.texture_num[2] == texture2_num &&
+		    fbo_it->second.texture_num[3] == texture3_num) {
+			state->fbo_freelist.erase(freelist_it);
+			++state->fbo_cache_hits;
+			pthread_mutex_unlock(&state->lock);
+			return fbo_it->second.fbo_num;
 		}
 	}
+	++state->fbo_cache_misses;
 
 	// Create a new one.
 	FBO fbo_format;
@@ -540,49 +1208,55 @@ GLuint ResourcePool::create_fbo(GLuint texture0_num, GLuint texture1_num, GLuint
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	check_error();
 
-	pair<void *, GLuint> key(context, fbo_format.fbo_num);
-	assert(fbo_formats.count(key) == 0);
-	fbo_formats.insert(make_pair(key, fbo_format));
+	if (debug_labels) {
+		char label[64];
+		snprintf(label, sizeof(label), "Movit FBO (texture %u)", texture0_num);
+		glObjectLabel(GL_FRAMEBUFFER, fbo_format.fbo_num, -1, label);
+		check_error();
+	}
 
-	pthread_mutex_unlock(&lock);
+	assert(state->fbo_formats.count(fbo_format.fbo_num) == 0);
+	state->fbo_formats.insert(make_pair(fbo_format.fbo_num, fbo_format));
+
+	pthread_mutex_unlock(&state->lock);
 	return fbo_format.fbo_num;
 }
 
 void ResourcePool::release_fbo(GLuint fbo_num)
 {
-	void *context = get_gl_context_identifier();
+	ContextState *state = get_context_state();
 
-	pthread_mutex_lock(&lock);
-	FBOFormatIterator fbo_it = fbo_formats.find(make_pair(context, fbo_num));
-	assert(fbo_it != fbo_formats.end());
-	fbo_freelist[context].push_front(fbo_it);
+	pthread_mutex_lock(&state->lock);
+	FBOFormatIterator fbo_it = state->fbo_formats.find(fbo_num);
+	assert(fbo_it != state->fbo_formats.end());
+	state->fbo_freelist.push_front(fbo_it);
 
 	// Now that we're in this context, free up any FBOs that are connected
 	// to deleted textures (in release_2d_texture).
-	cleanup_unlinked_fbos(context);
+	cleanup_unlinked_fbos(state);
 
-	shrink_fbo_freelist(context, fbo_freelist_max_length);
-	pthread_mutex_unlock(&lock);
+	shrink_fbo_freelist(state, fbo_freelist_max_length);
+	pthread_mutex_unlock(&state->lock);
 }
 
 GLuint ResourcePool::create_vec2_vao(const set<GLint> &attribute_indices, GLuint vbo_num)
 {
-	void *context = get_gl_context_identifier();
-
-	pthread_mutex_lock(&lock);
-	if (vao_freelist.count(context) != 0) {
-		// See if there's a VAO the freelist we can use.
-		auto end = vao_freelist[context].end();
-		for (auto freelist_it = vao_freelist[context].begin(); freelist_it != end; ++freelist_it) {
-			VAOFormatIterator vao_it = *freelist_it;
-			if (vao_it->second.vbo_num == vbo_num &&
-			    vao_it->second.attribute_indices == attribute_indices) {
-				vao_freelist[context].erase(freelist_it);
-				pthread_mutex_unlock(&lock);
-				return vao_it->second.vao_num;
-			}
+	ContextState *state = get_context_state();
+
+	pthread_mutex_lock(&state->lock);
+	// See if there's a VAO the freelist we can use.
+	auto end = state->vao_freelist.end();
+	for (auto freelist_it = state->vao_freelist.begin(); freelist_it != end; ++freelist_it) {
+		VAOFormatIterator vao_it = *freelist_it;
+		if (vao_it->second.vbo_num == vbo_num &&
+		    vao_it->second.attribute_indices == attribute_indices) {
+			state->vao_freelist.erase(freelist_it);
+			++state->vao_cache_hits;
+			pthread_mutex_unlock(&state->lock);
+			return vao_it->second.vao_num;
 		}
 	}
+	++state->vao_cache_misses;
 
 	// Create a new one.
 	VAO vao_format;
@@ -608,44 +1282,100 @@ GLuint ResourcePool::create_vec2_vao(const set<GLint> &attribute_indices, GLuint
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	check_error();
 
-	pair<void *, GLuint> key(context, vao_format.vao_num);
-	assert(vao_formats.count(key) == 0);
-	vao_formats.insert(make_pair(key, vao_format));
+	if (debug_labels) {
+		glObjectLabel(GL_VERTEX_ARRAY, vao_format.vao_num, -1, "Movit VAO");
+		check_error();
+	}
+
+	assert(state->vao_formats.count(vao_format.vao_num) == 0);
+	state->vao_formats.insert(make_pair(vao_format.vao_num, vao_format));
 
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&state->lock);
 	return vao_format.vao_num;
 }
 
 void ResourcePool::release_vec2_vao(GLuint vao_num)
 {
-	void *context = get_gl_context_identifier();
+	ContextState *state = get_context_state();
 
-	pthread_mutex_lock(&lock);
-	VAOFormatIterator vao_it = vao_formats.find(make_pair(context, vao_num));
-	assert(vao_it != vao_formats.end());
-	vao_freelist[context].push_front(vao_it);
+	pthread_mutex_lock(&state->lock);
+	VAOFormatIterator vao_it = state->vao_formats.find(vao_num);
+	assert(vao_it != state->vao_formats.end());
+	state->vao_freelist.push_front(vao_it);
 
-	shrink_vao_freelist(context, vao_freelist_max_length);
-	pthread_mutex_unlock(&lock);
+	shrink_vao_freelist(state, vao_freelist_max_length);
+	pthread_mutex_unlock(&state->lock);
 }
 
 void ResourcePool::clean_context()
+{
+	ContextState *state = get_context_state();
+
+	// FBOs and VAOs are the only non-shareable resources we hold.
+	// Cached program instances can be used from any context,
+	// so give them back to the shared pool instead.
+	vector<pair<GLuint, const void *>> instances_and_last_users;
+	pthread_mutex_lock(&state->lock);
+	shrink_fbo_freelist(state, 0);
+	shrink_vao_freelist(state, 0);
+	for (const auto &master_and_instances : state->free_program_instances) {
+		for (GLuint instance_program_num : master_and_instances.second) {
+			instances_and_last_users.emplace_back(instance_program_num, state->program_last_users[instance_program_num]);
+		}
+	}
+	state->free_program_instances.clear();
+	state->program_masters.clear();
+	state->program_last_users.clear();
+	pthread_mutex_unlock(&state->lock);
+
+	pthread_mutex_lock(&lock);
+	for (const auto &instance_and_last_user : instances_and_last_users) {
+		const GLuint instance_program_num = instance_and_last_user.first;
+		assert(program_masters.count(instance_program_num));
+		program_instances[program_masters[instance_program_num]].push(instance_program_num);
+		program_last_users[instance_program_num] = instance_and_last_user.second;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+ResourcePool::ContextState *ResourcePool::get_context_state()
 {
 	void *context = get_gl_context_identifier();
 
-	// Currently, we only need to worry about FBOs and VAOs, as they are the only
-	// non-shareable resources we hold.
-	shrink_fbo_freelist(context, 0);
-	fbo_freelist.erase(context);
+	// Remember the state we found the last time in this thread, so that
+	// the common case of a thread sticking to one pool and one context
+	// does not need <lock> at all. States live as long as the pool does,
+	// and <pool_id> makes sure we don't pick up a state from a pool
+	// that has been deleted.
+	struct LastContextState {
+		uint64_t pool_id;
+		void *context;
+		ContextState *state;
+	};
+	static thread_local LastContextState last = { 0, nullptr, nullptr };
+	if (last.pool_id == pool_id && last.context == context) {
+		return last.state;
+	}
 
-	shrink_vao_freelist(context, 0);
-	vao_freelist.erase(context);
+	pthread_mutex_lock(&lock);
+	ContextState *&state = context_states[context];
+	if (state == nullptr) {
+		state = new ContextState;
+		pthread_mutex_init(&state->lock, nullptr);
+		state->fbo_cache_hits = state->fbo_cache_misses = 0;
+		state->vao_cache_hits = state->vao_cache_misses = 0;
+	}
+	last.pool_id = pool_id;
+	last.context = context;
+	last.state = state;
+	pthread_mutex_unlock(&lock);
+	return last.state;
 }
 
-void ResourcePool::cleanup_unlinked_fbos(void *context)
+void ResourcePool::cleanup_unlinked_fbos(ContextState *state)
 {
-	auto end = fbo_freelist[context].end();
-	for (auto freelist_it = fbo_freelist[context].begin(); freelist_it != end; ) {
+	auto end = state->fbo_freelist.end();
+	for (auto freelist_it = state->fbo_freelist.begin(); freelist_it != end; ) {
 		FBOFormatIterator fbo_it = *freelist_it;
 
 		bool all_unlinked = true;
@@ -657,36 +1387,39 @@ void ResourcePool::cleanup_unlinked_fbos(void *context)
 			}
 		}
 		if (all_unlinked) {
+			report_eviction(EVICTED_FBO, fbo_it->second.fbo_num);
 			glDeleteFramebuffers(1, &fbo_it->second.fbo_num);
 			check_error();
-			fbo_formats.erase(fbo_it);
-			fbo_freelist[context].erase(freelist_it++);
+			state->fbo_formats.erase(fbo_it);
+			state->fbo_freelist.erase(freelist_it++);
 		} else {
 			freelist_it++;
 		}
 	}
 }
 
-void ResourcePool::shrink_fbo_freelist(void *context, size_t max_length)
+void ResourcePool::shrink_fbo_freelist(ContextState *state, size_t max_length)
 {
-	list<FBOFormatIterator> &freelist = fbo_freelist[context];
+	list<FBOFormatIterator> &freelist = state->fbo_freelist;
 	while (freelist.size() > max_length) {
 		FBOFormatIterator free_fbo_it = freelist.back();
+		report_eviction(EVICTED_FBO, free_fbo_it->second.fbo_num);
 		glDeleteFramebuffers(1, &free_fbo_it->second.fbo_num);
 		check_error();
-		fbo_formats.erase(free_fbo_it);
+		state->fbo_formats.erase(free_fbo_it);
 		freelist.pop_back();
 	}
 }
 
-void ResourcePool::shrink_vao_freelist(void *context, size_t max_length)
+void ResourcePool::shrink_vao_freelist(ContextState *state, size_t max_length)
 {
-	list<VAOFormatIterator> &freelist = vao_freelist[context];
+	list<VAOFormatIterator> &freelist = state->vao_freelist;
 	while (freelist.size() > max_length) {
 		VAOFormatIterator free_vao_it = freelist.back();
+		report_eviction(EVICTED_VAO, free_vao_it->second.vao_num);
 		glDeleteVertexArrays(1, &free_vao_it->second.vao_num);
 		check_error();
-		vao_formats.erase(free_vao_it);
+		state->vao_formats.erase(free_vao_it);
 		freelist.pop_back();
 	}
 }
@@ -731,6 +1464,15 @@ void ResourcePool::add_master_program(GLuint program_num)
 	program_masters.insert(make_pair(program_num, program_num));
 }
 
+size_t ResourcePool::estimate_texture_size(GLint internal_format, GLsizei width, GLsizei height)
+{
+	Texture2D texture_format;
+	texture_format.internal_format = internal_format;
+	texture_format.width = width;
+	texture_format.height = height;
+	return estimate_texture_size(texture_format);
+}
+
 size_t ResourcePool::estimate_texture_size(const Texture2D &texture_format)
 {
 	size_t bytes_per_pixel;
@@ -14,7 +14,12 @@
 //
 // Thread-safety: All functions except the constructor and destructor can be
 // safely called from multiple threads at the same time, provided they have
-// separate (but sharing) OpenGL contexts.
+// separate (but sharing) OpenGL contexts. Most state is shared and protected
+// by a single mutex, but the calls that EffectChain makes for every phase
+// it renders (use_glsl_program(), create_fbo(), create_vec2_vao() and their
+// counterparts) normally only touch state for the current context, which has
+// its own mutex; thus, threads rendering in separate contexts do not need to
+// wait for each other there.
 //
 // Memory management (only relevant if you use multiple contexts): Some objects,
 // like FBOs, are not shareable across contexts, and can only be deleted from
@@ -25,11 +30,15 @@
 #include <epoxy/gl.h>
 #include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
 #include <list>
 #include <map>
 #include <set>
 #include <stack>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -54,6 +63,114 @@ public:
 	             size_t vao_freelist_max_length = 100);  // Per context.
 	~ResourcePool();
 
+	// Enables a persistent on-disk cache of linked GLSL programs, stored in
+	// <directory> (which must already exist and be writable). Whenever a
+	// program is not in the in-memory cache, we will first look for it on disk
+	// (as saved by glGetProgramBinary() from an earlier run) and only compile
+	// and link the shaders if it is not there, or if the driver refuses to
+	// load it. This can save a lot of startup time for applications with many
+	// EffectChains. Cache entries are keyed on the full shader source and the
+	// GL vendor, renderer and version strings, so a driver upgrade will simply
+	// cause misses (and new entries to be written); old entries are never
+	// cleaned up, though.
+	//
+	// An empty string (the default) disables the cache. The cache is also
+	// silently disabled if the driver does not support program binaries;
+	// see movit_program_binaries_supported.
+	void set_program_binary_cache_directory(const std::string &directory);
+
+	// How many programs have been loaded from the on-disk cache (hits),
+	// and how many had to be compiled from source because they were not
+	// found there or could not be loaded (misses). Programs found in the
+	// in-memory cache count as neither. Both are always zero if the on-disk
+	// cache is not enabled.
+	size_t get_program_binary_cache_hits();
+	size_t get_program_binary_cache_misses();
+
+	// A snapshot of what the pool is holding on to, and how well the
+	// caches are working, e.g. for exporting to a monitoring system or
+	// for deciding on a good value for texture_freelist_max_bytes.
+	// All byte counts come from estimate_texture_size(), so the caveats
+	// at the constructor apply.
+	struct TextureFormatStats {
+		size_t num_live, live_bytes;  // Given out to clients.
+		size_t num_free, free_bytes;  // On the freelist.
+	};
+
+	// A hit is a request that could be served from a freelist (for programs,
+	// from the in-memory cache of compiled programs); a miss is one
+	// where we had to create a new object.
+	struct CacheStats {
+		uint64_t hits, misses;
+	};
+
+	// FBOs and VAOs for a single context, including the ones on its freelists.
+	struct ContextStats {
+		size_t num_fbos, num_free_fbos;
+		size_t num_vaos, num_free_vaos;
+		CacheStats fbo_cache, vao_cache;
+	};
+
+	struct Stats {
+		// Keyed by internal format. Formats the pool currently holds no
+		// textures of are not included.
+		std::map<GLint, TextureFormatStats> textures;
+		size_t texture_live_bytes, texture_free_bytes;  // Sums over all formats.
+
+		// The FBO and VAO numbers are sums over all contexts.
+		CacheStats texture_cache, fbo_cache, vao_cache, program_cache;
+
+		// How many shaders we have compiled and programs we have linked
+		// (including clones made by use_glsl_program() and programs
+		// loaded from the on-disk cache), and how much wall-clock time the
+		// calling threads have spent on it, including waiting for the driver
+		// in finish_glsl_program(). With GL_KHR_parallel_shader_compile,
+		// the driver may have spent more time than this in its own threads.
+		uint64_t num_shader_compiles, num_program_links;
+		double compile_seconds;
+
+		// Keyed by context, as identified by get_gl_context_identifier().
+		std::map<void *, ContextStats> contexts;
+	};
+	Stats get_stats();
+
+	// Something that was deleted from one of the freelists, either because
+	// the freelist grew too long (or, for textures, too large), because
+	// clean_context() was called, or because the ResourcePool is being
+	// destroyed. FBOs are also deleted when the textures they point to are.
+	enum EvictedResourceType {
+		EVICTED_TEXTURE,
+		EVICTED_PROGRAM,
+		EVICTED_FBO,
+		EVICTED_VAO
+	};
+	struct Eviction {
+		EvictedResourceType type;
+		GLuint object_num;
+
+		// For textures only; zero for everything else.
+		GLint internal_format;
+		GLsizei width, height;
+		size_t bytes;
+	};
+	typedef std::function<void(const Eviction &)> EvictionCallback;
+
+	// Sets a function to be called for every eviction; an empty function
+	// (the default) disables the callback. The callback is called
+	// with the pool's locks held, from whatever thread caused the eviction,
+	// so it must be quick and must not call back into the ResourcePool.
+	// Unlike the other functions, this is not thread-safe; set the
+	// callback before the pool is used from other threads.
+	void set_eviction_callback(const EvictionCallback &callback);
+
+	// If enabled, every program, texture, FBO and VAO the pool creates from
+	// now on gets a label (using glObjectLabel()) saying what it is,
+	// so that they are easier to tell apart in debugging and profiling tools.
+	// EffectChain::enable_debug_labels() turns this on for its pool, and
+	// also relabels the objects with what they are used for.
+	// Requires movit_debug_labels_supported. Off by default.
+	void enable_debug_labels(bool enable);
+
 	// All remaining functions are intended for calls from EffectChain only.
 
 	// Compile the given vertex+fragment shader pair, or fetch an already
@@ -75,6 +192,28 @@ public:
 	GLuint compile_glsl_compute_program(const std::string& compile_shader);
 	void release_glsl_compute_program(GLuint glsl_program_num);
 
+	// Like compile_glsl_program() and compile_glsl_compute_program(),
+	// but does not wait for the driver to finish compiling and linking;
+	// this allows it to compile several programs in parallel
+	// (if it supports GL_KHR_parallel_shader_compile), or at least
+	// lets the caller do other work in the meantime. You must call
+	// finish_glsl_program() on the returned program before using it for
+	// anything, including querying uniform locations.
+	GLuint start_compile_glsl_program(const std::string& vertex_shader,
+	                                  const std::string& fragment_shader,
+	                                  const std::vector<std::string>& frag_shader_outputs);
+	GLuint start_compile_glsl_compute_program(const std::string& compile_shader);
+
+	// Returns true if finish_glsl_program() on the given program will not
+	// block (as far as we can know; without GL_KHR_parallel_shader_compile,
+	// this always returns true).
+	bool is_glsl_program_ready(GLuint glsl_program_num);
+
+	// Waits until the given program is compiled and linked, and checks
+	// that it succeeded (exits with an error message if not). Does nothing
+	// if the program is already finished, e.g. because it came from the cache.
+	void finish_glsl_program(GLuint glsl_program_num);
+
 	// Since uniforms belong to the program and not to the context,
 	// a given GLSL program number can't be used by more than one thread
 	// at a time. Thus, if two threads want to use the same program
@@ -84,7 +223,17 @@ public:
 	// program number that was used; this must be given to
 	// unuse_glsl_program() to release it. unuse_glsl_program() does not
 	// actually change any OpenGL state, though.
-	GLuint use_glsl_program(GLuint glsl_program_num);
+	//
+	// If <user> is not nullptr, <uniforms_preserved> is set to whether the
+	// returned instance was last used by the same user (typically an
+	// EffectChain phase), ie., whether it still has the uniform values that
+	// user set the last time. This allows the caller to skip setting uniforms
+	// that have not changed.
+	//
+	// unuse_glsl_program() should be called in the same context as
+	// use_glsl_program(); unused instances are kept in a small cache
+	// for that context, so that the next use does not need the global lock.
+	GLuint use_glsl_program(GLuint glsl_program_num, const void *user = nullptr, bool *uniforms_preserved = nullptr);
 	void unuse_glsl_program(GLuint instance_program_num);
 
 	// Allocate a 2D texture of the given internal format and dimensions,
@@ -94,6 +243,28 @@ public:
 	GLuint create_2d_texture(GLint internal_format, GLsizei width, GLsizei height);
 	void release_2d_texture(GLuint texture_num);
 
+	// Fetch a small, read-only texture whose contents are fully determined
+	// by <key> (e.g. ResampleEffect's weights for a given scaling), so that
+	// all users of the pool asking for the same key share one texture.
+	// If there is none, we make a new texture, bind it to GL_TEXTURE_2D
+	// on the active texture unit and call <upload> to fill it in (with
+	// the pool's lock held, so it must not call back into the pool).
+	// Other contexts sharing the pool may get the same texture right away,
+	// so the upload is fenced, and they wait (on the GPU) for that fence
+	// before using it.
+	// Keeps ownership of the texture; you must call release_keyed_texture()
+	// when you no longer want it. Unused textures are kept around in case
+	// somebody wants the same key later; once there are more than
+	// keyed_texture_freelist_max_length of them, the least recently
+	// used are deleted.
+	GLuint acquire_keyed_texture(const std::string &key, const std::function<void()> &upload);
+	void release_keyed_texture(GLuint texture_num);
+	static const size_t keyed_texture_freelist_max_length = 64;
+
+	// A coarse estimate of how many bytes a texture of the given format
+	// and dimensions takes; see the caveats at the constructor.
+	static size_t estimate_texture_size(GLint internal_format, GLsizei width, GLsizei height);
+
 	// Allocate an FBO with the the given texture(s) bound as framebuffer attachment(s),
 	// or fetch a previous used if possible. Unbinds GL_FRAMEBUFFER afterwards.
 	// Keeps ownership of the FBO; you must call release_fbo() of deleting
@@ -136,15 +307,23 @@ private:
 	// Delete the given program and both its shaders.
 	void delete_program(GLuint program_num);
 
+	struct ContextState;
+
+	// Find (or create) the state for the current context. Does not need
+	// <lock> in the common case; see ContextState.
+	ContextState *get_context_state();
+
 	// Deletes all FBOs for the given context that belong to deleted textures.
-	void cleanup_unlinked_fbos(void *context);
+	// Must be called with <state->lock> held.
+	void cleanup_unlinked_fbos(ContextState *state);
 
-	// Remove FBOs off the end of the freelist for <context>, until it
-	// is no more than <max_length> elements long.
-	void shrink_fbo_freelist(void *context, size_t max_length);
+	// Remove FBOs off the end of the freelist for the given context, until it
+	// is no more than <max_length> elements long. Must be called with
+	// <state->lock> held.
+	void shrink_fbo_freelist(ContextState *state, size_t max_length);
 
 	// Same, for VAOs.
-	void shrink_vao_freelist(void *context, size_t max_length);
+	void shrink_vao_freelist(ContextState *state, size_t max_length);
 
 	// Increment the refcount, or take it off the freelist if it's zero.
 	void increment_program_refcount(GLuint program_num);
@@ -158,11 +337,47 @@ private:
 
 	// Link the given vertex and fragment shaders into a full GLSL program.
 	// See compile_glsl_program() for explanation of <fragment_shader_outputs>.
+	// Does not check whether linking succeeded; see check_link_status().
+	// If <binary_retrievable> is true, the driver is told that we will
+	// want to fetch the program binary afterwards (for the on-disk cache).
 	static GLuint link_program(GLuint vs_obj,
 	                           GLuint fs_obj,
-	                           const std::vector<std::string>& fragment_shader_outputs);
+	                           const std::vector<std::string>& fragment_shader_outputs,
+	                           bool binary_retrievable);
+
+	static GLuint link_compute_program(GLuint cs_obj, bool binary_retrievable);
+
+	// Exits with an error message if the given program failed to link.
+	// Blocks until the link is done.
+	static void check_link_status(GLuint glsl_program_num);
+
+	// Create a new program from the given program binary, as returned by
+	// glGetProgramBinary(). Returns 0 if the driver rejects the binary.
+	static GLuint link_program_binary(GLenum binary_format, const std::string &binary);
+
+	// Whether we should consult the on-disk cache at all.
+	// Must be called with <lock> held.
+	bool program_binary_cache_enabled() const;
+
+	// Try to load a program with the given shader source (as described by
+	// <cache_key>, which includes the OpenGL driver strings) from the on-disk
+	// cache. Returns 0 on a miss. On a hit, the program binary and its format
+	// are also returned, so that we can create clones of it later.
+	// Updates the hit/miss counters. Must be called with <lock> held.
+	GLuint load_program_binary(const std::string &cache_key,
+	                           GLenum *binary_format,
+	                           std::string *binary);
+
+	// Write the given (freshly linked) program to the on-disk cache.
+	// Failures are reported, but are not fatal.
+	void save_program_binary(const std::string &cache_key, GLuint glsl_program_num);
 
-	static GLuint link_compute_program(GLuint cs_obj);
+	// Make a key for the on-disk cache from the given shader source,
+	// by adding the OpenGL driver strings.
+	static std::string get_program_binary_cache_key(const std::string &shader_source);
+
+	// Where to store the cache entry for the given key.
+	std::string get_program_binary_filename(const std::string &cache_key) const;
 
 	// Protects all the other elements in the class.
 	pthread_mutex_t lock;
@@ -175,6 +390,12 @@ private:
 	// A mapping from compute shader source string to compiled program number.
 	std::map<std::string, GLuint> compute_programs;
 
+	// The inverses of <programs> and <compute_programs>, so that
+	// delete_program() does not have to search through them.
+	// Iterators into std::map stay valid until the element is erased.
+	std::map<GLuint, std::map<std::pair<std::string, std::string>, GLuint>::iterator> program_keys;
+	std::map<GLuint, std::map<std::string, GLuint>::iterator> compute_program_keys;
+
 	// A mapping from compiled program number to number of current users.
 	// Once this reaches zero, the program is taken out of this map and instead
 	// put on the freelist (after which it may be deleted).
@@ -182,14 +403,23 @@ private:
 
 	// A mapping from program number to vertex and fragment shaders.
 	// Contains everything needed to re-link the program.
+	//
+	// If the program was loaded from the on-disk cache, there are no shader
+	// objects (vs_obj and fs_obj are zero), and clones are instead made from
+	// <program_binary>, which is empty otherwise.
 	struct ShaderSpec {
 		GLuint vs_obj, fs_obj;
 		std::vector<std::string> fragment_shader_outputs;
+		GLenum program_binary_format;
+		std::string program_binary;
 	};
 	std::map<GLuint, ShaderSpec> program_shaders;
 
+	// Same, for compute shaders.
 	struct ComputeShaderSpec {
 		GLuint cs_obj;
+		GLenum program_binary_format;
+		std::string program_binary;
 	};
 	std::map<GLuint, ComputeShaderSpec> compute_program_shaders;
 
@@ -203,15 +433,55 @@ private:
 	// (inverse of program_instances).
 	std::map<GLuint, GLuint> program_masters;
 
+	// For each program instance, the user given to use_glsl_program()
+	// the last time it was used (if any). See use_glsl_program().
+	std::map<GLuint, const void *> program_last_users;
+
 	// A list of programs that are no longer in use, most recently freed first.
 	// Once this reaches <program_freelist_max_length>, the last element
 	// will be deleted.
 	std::list<GLuint> program_freelist;
 
+	// Programs that have been submitted to the driver (see
+	// start_compile_glsl_program()), but where we have not yet checked
+	// that compilation and linking succeeded. We keep the shader sources,
+	// so that we can give good error messages, and the key for the
+	// on-disk cache, since we cannot get the binary out before the link is done.
+	struct PendingProgram {
+		std::vector<std::pair<GLuint, std::string>> shaders;
+		std::string cache_key;  // Empty if the on-disk cache is disabled.
+	};
+	std::map<GLuint, PendingProgram> pending_programs;
+
+	// See set_program_binary_cache_directory(). Empty if disabled.
+	std::string program_binary_cache_directory;
+	size_t program_binary_cache_hits, program_binary_cache_misses;
+
+	// For get_stats(). The FBO and VAO counters are in ContextState.
+	uint64_t texture_cache_hits, texture_cache_misses;
+	uint64_t program_cache_hits, program_cache_misses;
+	uint64_t num_shader_compiles, num_program_links;
+	double compile_seconds;
+
+	// See set_eviction_callback().
+	EvictionCallback eviction_callback;
+
+	// See enable_debug_labels(). Atomic, since it is read without <lock>
+	// when creating FBOs and VAOs.
+	std::atomic<bool> debug_labels;
+
+	// Calls <eviction_callback>, if set.
+	void report_eviction(EvictedResourceType type, GLuint object_num);
+
 	struct Texture2D {
 		GLint internal_format;
 		GLsizei width, height;
+
+		// Where the texture is in <texture_freelist> and in its bucket
+		// in <texture_freelist_buckets>. Only valid while it is on the freelist.
+		std::list<GLuint>::iterator freelist_it, bucket_it;
 	};
+	typedef std::tuple<GLint, GLsizei, GLsizei> Texture2DKey;  // Format, width, height.
 
 	// A mapping from texture number to format details. This is filled if the
 	// texture is given out to a client or on the freelist, but not if it is
@@ -221,11 +491,45 @@ private:
 	// A list of all textures that are release but not freed (most recently freed
 	// first), and an estimate of their current memory usage. Once
 	// <texture_freelist_bytes> goes above <texture_freelist_max_bytes>,
-	// elements are deleted off the end of the list until we are under the limit
-	// again.
+	// elements are deleted off the end of the list (ie., least recently
+	// used first) until we are under the limit again.
 	std::list<GLuint> texture_freelist;
 	size_t texture_freelist_bytes;
 
+	// The same textures, split by format and dimensions (again most recently
+	// freed first), so that create_2d_texture() does not need to search
+	// through the entire freelist. Empty buckets are removed.
+	std::map<Texture2DKey, std::list<GLuint>> texture_freelist_buckets;
+
+	// Textures given out by acquire_keyed_texture(), keyed both ways.
+	// The refcount is the number of current users; when it reaches zero,
+	// the texture goes on <keyed_texture_freelist> (most recently freed
+	// first), and comes off it again if somebody asks for the same key.
+	// <upload_fence> is signaled when the upload from <upload_context> is
+	// done on the GPU; it is deleted (set to nullptr) once we have seen it
+	// signaled, since nobody needs to wait for it after that.
+	struct KeyedTexture {
+		std::string key;
+		int refcount;
+		std::list<GLuint>::iterator freelist_it;  // Only valid if refcount == 0.
+		GLsync upload_fence;
+		void *upload_context;
+	};
+	std::map<std::string, GLuint> keyed_texture_nums;
+	std::map<GLuint, KeyedTexture> keyed_textures;
+	std::list<GLuint> keyed_texture_freelist;
+
+	// Delete a keyed texture that nobody uses anymore, including its fence.
+	// Must be called with <lock> held.
+	void delete_keyed_texture(GLuint texture_num);
+
+	// Take the given texture off <texture_freelist> and its bucket.
+	// Must be called with <lock> held.
+	void remove_from_texture_freelist(GLuint texture_num, const Texture2D &texture_format);
+
+	// Same as report_eviction(), for a texture.
+	void report_texture_eviction(GLuint texture_num, const Texture2D &texture_format);
+
 	static const unsigned num_fbo_attachments = 4;
 	struct FBO {
 		GLuint fbo_num;
@@ -233,19 +537,7 @@ private:
 		// 0 means the output isn't bound.
 		GLuint texture_num[num_fbo_attachments];
 	};
-
-	// For each context, a mapping from FBO number to format details. This is
-	// filled if the FBO is given out to a client or on the freelist, but
-	// not if it is deleted from the freelist.
-	std::map<std::pair<void *, GLuint>, FBO> fbo_formats;
-	typedef std::map<std::pair<void *, GLuint>, FBO>::iterator FBOFormatIterator;
-
-	// For each context, a list of all FBOs that are released but not freed
-	// (most recently freed first). Once this reaches <fbo_freelist_max_length>,
-	// the last element will be deleted.
-	//
-	// We store iterators directly into <fbo_format> for efficiency.
-	std::map<void *, std::list<FBOFormatIterator>> fbo_freelist;
+	typedef std::map<GLuint, FBO>::iterator FBOFormatIterator;
 
 	// Very similar, for VAOs.
 	struct VAO {
@@ -253,9 +545,67 @@ private:
 		std::set<GLint> attribute_indices;
 		GLuint vbo_num;
 	};
-	std::map<std::pair<void *, GLuint>, VAO> vao_formats;
-	typedef std::map<std::pair<void *, GLuint>, VAO>::iterator VAOFormatIterator;
-	std::map<void *, std::list<VAOFormatIterator>> vao_freelist;
+	typedef std::map<GLuint, VAO>::iterator VAOFormatIterator;
+
+	// Everything that belongs to a single context. FBOs and VAOs cannot be
+	// shared between contexts anyway, and we also keep a cache of unused
+	// program instances per context, so that rendering a phase does not
+	// need <lock> at all unless it misses the cache. Each state has its own
+	// mutex; since a context is only current in one thread at a time,
+	// it is essentially never contended.
+	//
+	// If both locks are needed, <lock> must be taken first.
+	// States are never deleted before the ResourcePool itself, so that
+	// get_context_state() can remember the last one in a thread-local
+	// variable without holding a lock.
+	struct ContextState {
+		pthread_mutex_t lock;
+
+		// A mapping from FBO number to format details. This is filled if
+		// the FBO is given out to a client or on the freelist, but
+		// not if it is deleted from the freelist.
+		std::map<GLuint, FBO> fbo_formats;
+
+		// A list of all FBOs that are released but not freed (most recently
+		// freed first). Once this reaches <fbo_freelist_max_length>,
+		// the last element will be deleted.
+		//
+		// We store iterators directly into <fbo_formats> for efficiency.
+		std::list<FBOFormatIterator> fbo_freelist;
+
+		// Same, for VAOs.
+		std::map<GLuint, VAO> vao_formats;
+		std::list<VAOFormatIterator> vao_freelist;
+
+		// For each master program, instances that were given out in
+		// this context and are now unused (at most
+		// <max_cached_program_instances> of them; further ones are given
+		// back to <program_instances>).
+		std::map<GLuint, std::vector<GLuint>> free_program_instances;
+
+		// For each program instance given out in this context, its master
+		// and its last user (see use_glsl_program()). While an instance is
+		// in here, these replace the entries in <program_last_users>.
+		std::map<GLuint, GLuint> program_masters;
+		std::map<GLuint, const void *> program_last_users;
+
+		// For get_stats().
+		uint64_t fbo_cache_hits, fbo_cache_misses;
+		uint64_t vao_cache_hits, vao_cache_misses;
+	};
+	static const size_t max_cached_program_instances = 2;
+
+	// Protected by <lock>. See ContextState.
+	std::map<void *, ContextState *> context_states;
+
+	// A number that is unique for each ResourcePool ever created,
+	// so that get_context_state() can recognize its own states
+	// even if another pool has since been created at the same address.
+	uint64_t pool_id;
+
+	// Delete all program instances of the given master that are cached
+	// in any context (see ContextState). Must be called with <lock> held.
+	void delete_cached_program_instances(GLuint glsl_program_num);
 
 	// See the caveats at the constructor.
 	static size_t estimate_texture_size(const Texture2D &texture_format);
@@ -0,0 +1,336 @@
+// Unit tests for ResourcePool.
+
+#include <SDL2/SDL.h>
+#include <epoxy/gl.h>
+#include <string>
+#include <vector>
+#ifdef HAVE_BENCHMARK
+#include <benchmark/benchmark.h>
+#include <set>
+#include <thread>
+#endif
+
+#include "gtest/gtest.h"
+#include "resource_pool.h"
+
+using namespace std;
+
+namespace movit {
+
+TEST(ResourcePoolTest, TexturesAreReusedByFormatAndSize) {
+	ResourcePool pool;
+	GLuint rgba8_tex = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint rgba16f_tex = pool.create_2d_texture(GL_RGBA16F, 16, 16);
+	GLuint wide_tex = pool.create_2d_texture(GL_RGBA8, 32, 16);
+	pool.release_2d_texture(rgba8_tex);
+	pool.release_2d_texture(rgba16f_tex);
+	pool.release_2d_texture(wide_tex);
+
+	// Each request gets the one texture that matches, regardless
+	// of where it is in the freelist.
+	EXPECT_EQ(rgba16f_tex, pool.create_2d_texture(GL_RGBA16F, 16, 16));
+	EXPECT_EQ(rgba8_tex, pool.create_2d_texture(GL_RGBA8, 16, 16));
+	EXPECT_EQ(wide_tex, pool.create_2d_texture(GL_RGBA8, 32, 16));
+
+	// Nothing matches now, so this must be a new one.
+	GLuint new_tex = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	EXPECT_NE(rgba8_tex, new_tex);
+	EXPECT_NE(rgba16f_tex, new_tex);
+	EXPECT_NE(wide_tex, new_tex);
+
+	pool.release_2d_texture(rgba8_tex);
+	pool.release_2d_texture(rgba16f_tex);
+	pool.release_2d_texture(wide_tex);
+	pool.release_2d_texture(new_tex);
+}
+
+TEST(ResourcePoolTest, FreelistEvictsLeastRecentlyReleased) {
+	const size_t texture_bytes = ResourcePool::estimate_texture_size(GL_RGBA8, 16, 16);
+	ResourcePool pool(100, 2 * texture_bytes);
+
+	GLuint tex0 = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint tex1 = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint tex2 = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	pool.release_2d_texture(tex0);
+	pool.release_2d_texture(tex1);
+	pool.release_2d_texture(tex2);
+
+	// Only two fit in the freelist, so the one released first is gone.
+	EXPECT_FALSE(glIsTexture(tex0));
+	EXPECT_TRUE(glIsTexture(tex1));
+	EXPECT_TRUE(glIsTexture(tex2));
+
+	// The most recently released comes out first.
+	EXPECT_EQ(tex2, pool.create_2d_texture(GL_RGBA8, 16, 16));
+	EXPECT_EQ(tex1, pool.create_2d_texture(GL_RGBA8, 16, 16));
+	pool.release_2d_texture(tex1);
+	pool.release_2d_texture(tex2);
+}
+
+TEST(ResourcePoolTest, KeyedTexturesAreShared) {
+	ResourcePool pool;
+	int num_uploads = 0;
+	auto upload = [&num_uploads]{
+		const float data[2] = { 1.0f, 2.0f };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1, 1, 0, GL_RG, GL_FLOAT, data);
+		++num_uploads;
+	};
+
+	// The same key gives the same texture, and we only upload once.
+	GLuint tex0 = pool.acquire_keyed_texture("a", upload);
+	GLuint tex1 = pool.acquire_keyed_texture("a", upload);
+	GLuint other_tex = pool.acquire_keyed_texture("b", upload);
+	EXPECT_EQ(tex0, tex1);
+	EXPECT_NE(tex0, other_tex);
+	EXPECT_EQ(2, num_uploads);
+
+	// Unused textures stay around until somebody wants them again.
+	pool.release_keyed_texture(tex0);
+	pool.release_keyed_texture(tex1);
+	EXPECT_TRUE(glIsTexture(tex0));
+	EXPECT_EQ(tex0, pool.acquire_keyed_texture("a", upload));
+	EXPECT_EQ(2, num_uploads);
+	pool.release_keyed_texture(tex0);
+
+	// ...but only so many of them.
+	for (size_t i = 0; i < ResourcePool::keyed_texture_freelist_max_length; ++i) {
+		pool.release_keyed_texture(pool.acquire_keyed_texture("c" + to_string(i), upload));
+	}
+	EXPECT_FALSE(glIsTexture(tex0));
+	EXPECT_TRUE(glIsTexture(other_tex));
+	pool.release_keyed_texture(other_tex);
+}
+
+TEST(ResourcePoolTest, KeyedTexturesAreSharedBetweenContexts) {
+	SDL_Window *window = SDL_GL_GetCurrentWindow();
+	SDL_GLContext main_context = SDL_GL_GetCurrentContext();
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	SDL_GLContext other_context = SDL_GL_CreateContext(window);
+	ASSERT_NE(nullptr, other_context);
+
+	ResourcePool pool;
+	int num_uploads = 0;
+	auto upload = [&num_uploads]{
+		const float data[2] = { 1.0f, 2.0f };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1, 1, 0, GL_RG, GL_FLOAT, data);
+		++num_uploads;
+	};
+
+	// Upload in one context, and immediately use it from the other one,
+	// without any glFinish() in between. The pool needs to make the
+	// second context wait for the upload.
+	SDL_GL_MakeCurrent(window, main_context);
+	GLuint tex0 = pool.acquire_keyed_texture("a", upload);
+	SDL_GL_MakeCurrent(window, other_context);
+	GLuint tex1 = pool.acquire_keyed_texture("a", upload);
+	EXPECT_EQ(tex0, tex1);
+	EXPECT_EQ(1, num_uploads);
+
+	float data[2] = { 0.0f, 0.0f };
+	glBindTexture(GL_TEXTURE_2D, tex1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	EXPECT_EQ(1.0f, data[0]);
+	EXPECT_EQ(2.0f, data[1]);
+	pool.release_keyed_texture(tex1);
+
+	SDL_GL_MakeCurrent(window, main_context);
+	SDL_GL_DeleteContext(other_context);
+	pool.release_keyed_texture(tex0);
+}
+
+TEST(ResourcePoolTest, ProgramInstancesAreReused) {
+	ResourcePool pool;
+	GLuint glsl_program_num = pool.compile_glsl_program(
+		"#version 150\nin vec2 position;\nvoid main() { gl_Position = vec4(position, 0.0, 1.0); }\n",
+		"#version 150\nout vec4 FragColor;\nvoid main() { FragColor = vec4(1.0); }\n",
+		{});
+	int user1, user2;
+
+	bool uniforms_preserved;
+	GLuint instance = pool.use_glsl_program(glsl_program_num, &user1, &uniforms_preserved);
+	EXPECT_FALSE(uniforms_preserved);
+
+	// While it is in use, we need to get a different instance.
+	GLuint other_instance = pool.use_glsl_program(glsl_program_num, &user2, &uniforms_preserved);
+	EXPECT_NE(instance, other_instance);
+	EXPECT_FALSE(uniforms_preserved);
+	pool.unuse_glsl_program(other_instance);
+	pool.unuse_glsl_program(instance);
+
+	// The most recently unused one comes back first, and it knows
+	// who used it last.
+	EXPECT_EQ(instance, pool.use_glsl_program(glsl_program_num, &user1, &uniforms_preserved));
+	EXPECT_TRUE(uniforms_preserved);
+	EXPECT_EQ(other_instance, pool.use_glsl_program(glsl_program_num, &user1, &uniforms_preserved));
+	EXPECT_FALSE(uniforms_preserved);
+	pool.unuse_glsl_program(instance);
+	pool.unuse_glsl_program(other_instance);
+
+	pool.release_glsl_program(glsl_program_num);
+}
+
+TEST(ResourcePoolTest, Stats) {
+	const size_t texture_bytes = ResourcePool::estimate_texture_size(GL_RGBA8, 16, 16);
+	ResourcePool pool(100, texture_bytes);
+
+	GLuint tex0 = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint tex1 = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint float_tex = pool.create_2d_texture(GL_RGBA16F, 16, 16);
+	pool.release_2d_texture(tex0);
+
+	ResourcePool::Stats stats = pool.get_stats();
+	ASSERT_EQ(2u, stats.textures.size());
+	EXPECT_EQ(1u, stats.textures[GL_RGBA8].num_live);
+	EXPECT_EQ(texture_bytes, stats.textures[GL_RGBA8].live_bytes);
+	EXPECT_EQ(1u, stats.textures[GL_RGBA8].num_free);
+	EXPECT_EQ(texture_bytes, stats.textures[GL_RGBA8].free_bytes);
+	EXPECT_EQ(1u, stats.textures[GL_RGBA16F].num_live);
+	EXPECT_EQ(0u, stats.textures[GL_RGBA16F].num_free);
+	EXPECT_EQ(texture_bytes, stats.texture_free_bytes);
+	EXPECT_EQ(0u, stats.texture_cache.hits);
+	EXPECT_EQ(3u, stats.texture_cache.misses);
+
+	EXPECT_EQ(tex0, pool.create_2d_texture(GL_RGBA8, 16, 16));
+	GLuint fbo = pool.create_fbo(tex0);
+	pool.release_fbo(fbo);
+	EXPECT_EQ(fbo, pool.create_fbo(tex0));
+	pool.release_fbo(fbo);
+
+	GLuint glsl_program_num = pool.compile_glsl_program(
+		"#version 150\nin vec2 position;\nvoid main() { gl_Position = vec4(position, 0.0, 1.0); }\n",
+		"#version 150\nout vec4 FragColor;\nvoid main() { FragColor = vec4(1.0); }\n",
+		{});
+	EXPECT_EQ(glsl_program_num, pool.compile_glsl_program(
+		"#version 150\nin vec2 position;\nvoid main() { gl_Position = vec4(position, 0.0, 1.0); }\n",
+		"#version 150\nout vec4 FragColor;\nvoid main() { FragColor = vec4(1.0); }\n",
+		{}));
+	pool.release_glsl_program(glsl_program_num);
+	pool.release_glsl_program(glsl_program_num);
+
+	stats = pool.get_stats();
+	EXPECT_EQ(1u, stats.texture_cache.hits);
+	EXPECT_EQ(1u, stats.fbo_cache.hits);
+	EXPECT_EQ(1u, stats.fbo_cache.misses);
+	ASSERT_EQ(1u, stats.contexts.size());
+	EXPECT_EQ(1u, stats.contexts.begin()->second.num_fbos);
+	EXPECT_EQ(1u, stats.contexts.begin()->second.num_free_fbos);
+	EXPECT_EQ(1u, stats.program_cache.hits);
+	EXPECT_EQ(1u, stats.program_cache.misses);
+	EXPECT_EQ(2u, stats.num_shader_compiles);
+	EXPECT_EQ(1u, stats.num_program_links);
+	EXPECT_GT(stats.compile_seconds, 0.0);
+
+	// Only one texture fits in the freelist, so releasing a second one
+	// evicts the one that has been there the longest.
+	vector<ResourcePool::Eviction> evictions;
+	pool.set_eviction_callback([&evictions](const ResourcePool::Eviction &eviction) {
+		evictions.push_back(eviction);
+	});
+	pool.release_2d_texture(tex1);
+	pool.release_2d_texture(tex0);
+	ASSERT_EQ(1u, evictions.size());
+	EXPECT_EQ(ResourcePool::EVICTED_TEXTURE, evictions[0].type);
+	EXPECT_EQ(tex1, evictions[0].object_num);
+	EXPECT_EQ(GL_RGBA8, evictions[0].internal_format);
+	EXPECT_EQ(texture_bytes, evictions[0].bytes);
+
+	pool.release_2d_texture(float_tex);
+	pool.set_eviction_callback(nullptr);
+}
+
+#ifdef HAVE_BENCHMARK
+// Measures a create_2d_texture() / release_2d_texture() pair, with a given
+// number of textures of other sizes on the freelist. The texture we ask for
+// is the least recently released one, ie., the worst case for a linear search.
+void BM_ResourcePoolCreateRelease(benchmark::State &state)
+{
+	const unsigned freelist_length = state.range(0);
+	ResourcePool pool;
+
+	vector<GLuint> textures;
+	for (unsigned i = 0; i < freelist_length; ++i) {
+		textures.push_back(pool.create_2d_texture(GL_R8, i + 1, 1));
+	}
+	for (GLuint texture_num : textures) {
+		pool.release_2d_texture(texture_num);
+	}
+
+	// Releasing puts the texture at the front of the freelist, so going
+	// through the sizes in order means we always ask for the one at the back.
+	unsigned width = 1;
+	for (auto _ : state) {
+		GLuint texture_num = pool.create_2d_texture(GL_R8, width, 1);
+		pool.release_2d_texture(texture_num);
+		if (++width > freelist_length) {
+			width = 1;
+		}
+	}
+}
+BENCHMARK(BM_ResourcePoolCreateRelease)->RangeMultiplier(4)->Range(1, 4096)->Unit(benchmark::kNanosecond);
+
+// Simulates several threads rendering chains in their own contexts, all sharing
+// the same pool, by doing the pool calls EffectChain does for each phase.
+// Ideally, the time per item should not go up with the number of threads
+// (as long as there are enough cores).
+void BM_ResourcePoolContention(benchmark::State &state)
+{
+	const unsigned num_threads = state.range(0);
+	const unsigned phases_per_thread = 1000;
+
+	SDL_Window *window = SDL_GL_GetCurrentWindow();
+	SDL_GLContext main_context = SDL_GL_GetCurrentContext();
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	vector<SDL_GLContext> contexts;
+	for (unsigned i = 0; i < num_threads; ++i) {
+		contexts.push_back(SDL_GL_CreateContext(window));
+		SDL_GL_MakeCurrent(window, main_context);
+	}
+
+	ResourcePool pool;
+	GLuint glsl_program_num = pool.compile_glsl_program(
+		"#version 150\nin vec2 position;\nvoid main() { gl_Position = vec4(position, 0.0, 1.0); }\n",
+		"#version 150\nout vec4 FragColor;\nvoid main() { FragColor = vec4(1.0); }\n",
+		{});
+	GLuint texnum = pool.create_2d_texture(GL_RGBA8, 16, 16);
+	GLuint vbo;
+	glGenBuffers(1, &vbo);
+	glFinish();
+
+	for (auto _ : state) {
+		vector<thread> threads;
+		for (unsigned i = 0; i < num_threads; ++i) {
+			threads.emplace_back([&, i] {
+				SDL_GL_MakeCurrent(window, contexts[i]);
+				for (unsigned j = 0; j < phases_per_thread; ++j) {
+					GLuint instance_program_num = pool.use_glsl_program(glsl_program_num, &contexts[i]);
+					GLuint fbo = pool.create_fbo(texnum);
+					GLuint vao = pool.create_vec2_vao({ 0 }, vbo);
+					pool.release_vec2_vao(vao);
+					pool.release_fbo(fbo);
+					pool.unuse_glsl_program(instance_program_num);
+				}
+				SDL_GL_MakeCurrent(window, nullptr);
+			});
+		}
+		for (thread &t : threads) {
+			t.join();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * num_threads * phases_per_thread);
+
+	for (unsigned i = 0; i < num_threads; ++i) {
+		SDL_GL_MakeCurrent(window, contexts[i]);
+		pool.clean_context();
+		SDL_GL_MakeCurrent(window, main_context);
+		SDL_GL_DeleteContext(contexts[i]);
+	}
+	glDeleteBuffers(1, &vbo);
+	pool.release_2d_texture(texnum);
+	pool.release_glsl_program(glsl_program_num);
+}
+BENCHMARK(BM_ResourcePoolContention)->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
+}  // namespace movit
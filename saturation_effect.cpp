@@ -1,6 +1,9 @@
+#include <Eigen/Core>
+
 #include "saturation_effect.h"
 #include "util.h"
 
+using namespace Eigen;
 using namespace std;
 
 namespace movit {
@@ -16,4 +19,13 @@ string SaturationEffect::output_fragment_shader()
 	return read_file("saturation_effect.frag");
 }
 
+Matrix3d SaturationEffect::get_color_matrix() const
+{
+	// mix(vec3(luminance), x.rgb, saturation), where luminance is
+	// the Rec. 709 weights (as a row vector) times x.rgb.
+	RowVector3d luminance_weights(0.2126, 0.7152, 0.0722);
+	return saturation * Matrix3d::Identity() +
+		(1.0 - saturation) * Vector3d::Ones() * luminance_weights;
+}
+
 }  // namespace movit
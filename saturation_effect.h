@@ -7,6 +7,7 @@
 // (saturation=1). Extrapolating that curve further (ie., saturation > 1)
 // gives us increased saturation if so desired.
 
+#include <Eigen/Core>
 #include <string>
 
 #include "effect.h"
@@ -21,6 +22,9 @@ public:
 	bool strong_one_to_one_sampling() const override { return true; }
 	std::string output_fragment_shader() override;
 
+	bool is_color_matrix() const override { return true; }
+	Eigen::Matrix3d get_color_matrix() const override;
+
 private:
 	float saturation;
 };
@@ -69,4 +69,18 @@ TEST(SaturationEffectTest, DoubleSaturation) {
 	expect_equal(expected_data, out_data, 4, 3);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_SaturationEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *saturation_effect = bench.add_effect(new SaturationEffect());
+	ASSERT_TRUE(saturation_effect->set_float("saturation", 0.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_SaturationEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SaturationEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SaturationEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -169,4 +169,21 @@ TEST(SliceEffectTest, VerticalOverlapOffsetsFromTop) {
 	expect_equal(expected_data, out_data, 2, 6);
 }
 
+#ifdef HAVE_BENCHMARK
+// Overlapping slices, like FFTConvolutionEffect sets up.
+void BM_SliceEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *slice_effect = bench.add_effect(new SliceEffect());
+	ASSERT_TRUE(slice_effect->set_int("input_slice_size", 64));
+	ASSERT_TRUE(slice_effect->set_int("output_slice_size", 64));
+	ASSERT_TRUE(slice_effect->set_int("offset", -16));
+	ASSERT_TRUE(slice_effect->set_int("direction", SliceEffect::HORIZONTAL));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_SliceEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SliceEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
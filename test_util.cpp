@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <epoxy/gl.h>
 #include <gtest/gtest.h>
@@ -51,8 +52,8 @@ void init_movit_for_test()
 
 EffectChainTester::EffectChainTester(const float *data, unsigned width, unsigned height,
                                      MovitPixelFormat pixel_format, Colorspace color_space, GammaCurve gamma_curve,
-                                     GLenum framebuffer_format)
-	: chain(width, height, get_static_pool()),
+                                     GLenum framebuffer_format, ResourcePool *resource_pool)
+	: chain(width, height, resource_pool ? resource_pool : get_static_pool()),
 	  width(width),
 	  height(height),
 	  framebuffer_format(framebuffer_format),
@@ -252,6 +253,9 @@ void EffectChainTester::internal_run(const std::vector<T *> &out_data, GLenum fo
 		glFinish();
 	        size_t iters = benchmark_state->max_iterations;
 		for (auto _ : *benchmark_state) {
+			if (benchmark_frame_callback) {
+				benchmark_frame_callback();
+			}
 			chain.render_to_texture(textures, width, height);
 			if (--iters == 0) {
 				glFinish();
@@ -520,6 +524,92 @@ bool DisableComputeShadersTemporarily::should_skip(benchmark::State *benchmark_s
 	}
 	return false;
 }
+
+void standard_resolutions(benchmark::internal::Benchmark *b)
+{
+	b->Args({720, 576})->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160});
+}
+
+namespace {
+
+GammaCurve gamma_curve_for_benchmark_format(BenchmarkFormat format)
+{
+	switch (format) {
+	case BENCHMARK_INT8:
+		return GAMMA_sRGB;
+	case BENCHMARK_FP16:
+		return GAMMA_LINEAR;
+	case BENCHMARK_INT10:
+		return GAMMA_REC_2020_10_BIT;
+	}
+	assert(false);
+	return GAMMA_LINEAR;
+}
+
+GLenum framebuffer_format_for_benchmark_format(BenchmarkFormat format)
+{
+	switch (format) {
+	case BENCHMARK_INT8:
+		return GL_RGBA8;
+	case BENCHMARK_FP16:
+		return GL_RGBA16F;
+	case BENCHMARK_INT10:
+		return GL_RGB10_A2;
+	}
+	assert(false);
+	return GL_RGBA8;
+}
+
+}  // namespace
+
+EffectBenchmark::EffectBenchmark(benchmark::State &state, BenchmarkFormat format, unsigned num_inputs, MovitPixelFormat pixel_format)
+	: state(state),
+	  format(format),
+	  width(state.range(0)),
+	  height(state.range(1)),
+	  tester(nullptr, width, height, pixel_format, COLORSPACE_sRGB, gamma_curve_for_benchmark_format(format), framebuffer_format_for_benchmark_format(format))
+{
+	const GammaCurve gamma_curve = gamma_curve_for_benchmark_format(format);
+	const unsigned num_values = width * height * 4;  // Enough for any pixel format.
+	for (unsigned input_num = 0; input_num < num_inputs; ++input_num) {
+		if (format == BENCHMARK_INT8) {
+			unique_ptr<unsigned char[]> data(new unsigned char[num_values]);
+			for (unsigned i = 0; i < num_values; ++i) {
+				data[i] = rand() & 0xff;
+			}
+			inputs.push_back(tester.add_input(data.get(), pixel_format, COLORSPACE_sRGB, gamma_curve));
+			data_int8.push_back(move(data));
+		} else {
+			unique_ptr<fp16_int_t[]> data(new fp16_int_t[num_values]);
+			for (unsigned i = 0; i < num_values; ++i) {
+				data[i] = fp32_to_fp16(rand() / (RAND_MAX + 1.0));
+			}
+			inputs.push_back(tester.add_input(data.get(), pixel_format, COLORSPACE_sRGB, gamma_curve));
+			data_fp16.push_back(move(data));
+		}
+	}
+}
+
+Effect *EffectBenchmark::add_effect(Effect *effect)
+{
+	return tester.get_chain()->add_effect(effect, inputs);
+}
+
+void EffectBenchmark::run(OutputAlphaFormat alpha_format)
+{
+	const GammaCurve gamma_curve = gamma_curve_for_benchmark_format(format);
+	if (format == BENCHMARK_INT8) {
+		unique_ptr<unsigned char[]> out_data(new unsigned char[width * height * 4]);
+		tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, gamma_curve, alpha_format);
+	} else if (format == BENCHMARK_FP16) {
+		unique_ptr<fp16_int_t[]> out_data(new fp16_int_t[width * height * 4]);
+		tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, gamma_curve, alpha_format);
+	} else {
+		assert(format == BENCHMARK_INT10);
+		unique_ptr<uint32_t[]> out_data(new uint32_t[width * height]);
+		tester.benchmark_10_10_10_2(state, out_data.get(), GL_RGBA, COLORSPACE_sRGB, gamma_curve, alpha_format);
+	}
+}
 #endif
 
 }  // namespace movit
@@ -4,6 +4,9 @@
 #include <epoxy/gl.h>
 #ifdef HAVE_BENCHMARK
 #include <benchmark/benchmark.h>
+#include <functional>
+#include <memory>
+#include <vector>
 #endif
 #include "effect_chain.h"
 #include "fp16.h"
@@ -12,14 +15,17 @@
 namespace movit {
 
 class Input;
+class ResourcePool;
 
 class EffectChainTester {
 public:
+	// If <resource_pool> is nullptr, a pool shared between all testers is used.
 	EffectChainTester(const float *data, unsigned width, unsigned height,
 	                  MovitPixelFormat pixel_format = FORMAT_GRAYSCALE,
 	                  Colorspace color_space = COLORSPACE_sRGB,
 	                  GammaCurve gamma_curve = GAMMA_LINEAR,
-	                  GLenum framebuffer_format = GL_RGBA16F_ARB);
+	                  GLenum framebuffer_format = GL_RGBA16F_ARB,
+	                  ResourcePool *resource_pool = nullptr);
 	~EffectChainTester();
 	
 	EffectChain *get_chain() { return &chain; }
@@ -43,14 +49,21 @@ public:
 	void benchmark(benchmark::State &state, const std::vector<unsigned char *> &out_data, GLenum format, Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
 	void benchmark(benchmark::State &state, uint16_t *out_data, GLenum format, Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
 	void benchmark_10_10_10_2(benchmark::State &state, uint32_t *out_data, GLenum format, Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+
+	// Called before each frame in the benchmark loop (but not before the
+	// warmup frame), e.g. to upload new input data or change parameters,
+	// so that the CPU work involved is included in the timing.
+	void set_benchmark_frame_callback(std::function<void()> callback) { benchmark_frame_callback = callback; }
 #endif
 
 	void add_output(const ImageFormat &format, OutputAlphaFormat alpha_format);
 	void add_ycbcr_output(const ImageFormat &format, OutputAlphaFormat alpha_format, const YCbCrFormat &ycbcr_format, YCbCrOutputSplitting output_splitting = YCBCR_OUTPUT_INTERLEAVED, GLenum output_type = GL_UNSIGNED_BYTE);
 
-private:
-	void finalize_chain(Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format);
+	// Normally called by the first run(), but can be called explicitly
+	// if a test needs to look at the chain between finalize() and rendering.
+	void finalize_chain(Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
 
+private:
 	template<class T>
 	void internal_run(const std::vector<T *> &out_data, GLenum format, Colorspace color_space, GammaCurve gamma_curve, OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED
 #ifdef HAVE_BENCHMARK
@@ -63,7 +76,58 @@ private:
 	GLenum framebuffer_format;
 	bool output_added;
 	bool finalized;
+#ifdef HAVE_BENCHMARK
+	std::function<void()> benchmark_frame_callback;
+#endif
+};
+
+#ifdef HAVE_BENCHMARK
+// The resolutions we benchmark effects at (as width and height arguments):
+// 576p, 720p, 1080p and 2160p. Use as ->Apply(standard_resolutions).
+void standard_resolutions(benchmark::internal::Benchmark *b);
+
+// The pixel formats we benchmark effects at. BENCHMARK_INT8 is 8-bit sRGB
+// in and out, BENCHMARK_FP16 is linear fp16 in and out, and BENCHMARK_INT10
+// is fp16 in and 10-bit out, both with the Rec. 2020 10-bit curve.
+enum BenchmarkFormat {
+	BENCHMARK_INT8,
+	BENCHMARK_FP16,
+	BENCHMARK_INT10,
+};
+
+// Sets up an EffectChainTester with <num_inputs> inputs of random data, of
+// the size given by the benchmark's first two arguments, so that benchmarking
+// a single effect takes only a few lines:
+//
+//   EffectBenchmark bench(state, BENCHMARK_INT8);
+//   Effect *effect = bench.add_effect(new SaturationEffect());
+//   ASSERT_TRUE(effect->set_float("saturation", 0.5f));
+//   bench.run();
+class EffectBenchmark {
+public:
+	EffectBenchmark(benchmark::State &state, BenchmarkFormat format, unsigned num_inputs = 1,
+	                MovitPixelFormat pixel_format = FORMAT_RGBA_POSTMULTIPLIED_ALPHA);
+
+	EffectChainTester *get_tester() { return &tester; }
+	EffectChain *get_chain() { return tester.get_chain(); }
+	const std::vector<Effect *> &get_inputs() const { return inputs; }
+
+	// Adds the given effect to the chain, with all the inputs as its inputs.
+	Effect *add_effect(Effect *effect);
+
+	// Finalizes the chain (if needed) and runs the benchmark loop.
+	void run(OutputAlphaFormat alpha_format = OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED);
+
+private:
+	benchmark::State &state;
+	BenchmarkFormat format;
+	unsigned width, height;
+	EffectChainTester tester;
+	std::vector<Effect *> inputs;
+	std::vector<std::unique_ptr<unsigned char[]>> data_int8;
+	std::vector<std::unique_ptr<fp16_int_t[]>> data_fp16;
 };
+#endif
 
 void expect_equal(const float *ref, const float *result, unsigned width, unsigned height, float largest_difference_limit = 1.5 / 255.0, float rms_limit = 0.2 / 255.0);
 void expect_equal(const unsigned char *ref, const unsigned char *result, unsigned width, unsigned height, unsigned largest_difference_limit = 1, float rms_limit = 0.2);
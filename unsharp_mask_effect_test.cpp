@@ -75,4 +75,18 @@ TEST(UnsharpMaskEffectTest, UnblursGaussianBlur) {
 	expect_equal(expected_data, out_data, size, size, 0.1, 0.001);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_UnsharpMaskEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *unsharp_mask_effect = bench.add_effect(new UnsharpMaskEffect());
+	ASSERT_TRUE(unsharp_mask_effect->set_float("radius", 2.0f));
+	ASSERT_TRUE(unsharp_mask_effect->set_float("amount", 0.5f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_UnsharpMaskEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_UnsharpMaskEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -0,0 +1,141 @@
+#include <epoxy/gl.h>
+#include <assert.h>
+
+#include "init.h"
+#include "upload_ring.h"
+#include "util.h"
+
+namespace movit {
+
+UploadRing::UploadRing()
+	: pbo(0),
+	  persistent_mapped(nullptr),
+	  slot_stride(0),
+	  current_slot(num_slots - 1),
+	  writing(false)
+{
+	for (unsigned i = 0; i < num_slots; ++i) {
+		fences[i] = nullptr;
+	}
+}
+
+UploadRing::~UploadRing()
+{
+	free_buffer();
+}
+
+void UploadRing::free_buffer()
+{
+	for (unsigned i = 0; i < num_slots; ++i) {
+		if (fences[i] != nullptr) {
+			glDeleteSync(fences[i]);
+			check_error();
+			fences[i] = nullptr;
+		}
+	}
+	if (pbo != 0) {
+		// Also unmaps it, if needed. OpenGL keeps the storage alive
+		// for any uploads that are still pending.
+		glDeleteBuffers(1, &pbo);
+		check_error();
+		pbo = 0;
+	}
+	persistent_mapped = nullptr;
+	slot_stride = 0;
+}
+
+unsigned char *UploadRing::begin_write(size_t slot_size)
+{
+	assert(!writing);
+	assert(slot_size > 0);
+
+	if (slot_size > slot_stride) {
+		free_buffer();
+
+		// Keep the slots nicely aligned, so that any offset into them
+		// is also valid for the larger pixel types.
+		slot_stride = (slot_size + 63) & ~size_t(63);
+		const size_t total_size = slot_stride * num_slots;
+
+		glGenBuffers(1, &pbo);
+		check_error();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+		check_error();
+		if (movit_persistent_buffers_supported) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, total_size, nullptr, flags);
+			check_error();
+			persistent_mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, total_size, flags);
+			check_error();
+			assert(persistent_mapped != nullptr);
+		} else {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, total_size, nullptr, GL_STREAM_DRAW);
+			check_error();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		check_error();
+	}
+
+	current_slot = (current_slot + 1) % num_slots;
+	GLsync fence = fences[current_slot];
+	if (fence != nullptr) {
+		GLenum ret;
+		do {
+			ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);  // 1 second.
+			check_error();
+		} while (ret == GL_TIMEOUT_EXPIRED);
+		assert(ret != GL_WAIT_FAILED);
+		glDeleteSync(fence);
+		check_error();
+		fences[current_slot] = nullptr;
+	}
+
+	writing = true;
+	const size_t offset = current_slot * slot_stride;
+	if (persistent_mapped != nullptr) {
+		return persistent_mapped + offset;
+	}
+
+	// The fence above has already made sure the GPU is done with this slot,
+	// so there is no need for the driver to synchronize.
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+	check_error();
+	unsigned char *ptr = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, offset, slot_stride,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	check_error();
+	assert(ptr != nullptr);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	check_error();
+	return ptr;
+}
+
+size_t UploadRing::commit_write()
+{
+	assert(writing);
+	writing = false;
+	if (persistent_mapped == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+		check_error();
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+		check_error();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		check_error();
+	}
+	return current_slot * slot_stride;
+}
+
+void UploadRing::upload_done(size_t offset)
+{
+	const unsigned slot = offset / slot_stride;
+	assert(slot < num_slots);
+	if (fences[slot] != nullptr) {
+		// Uploaded more than once (e.g. after invalidate_pixel_data());
+		// the newest fence covers all of the uploads.
+		glDeleteSync(fences[slot]);
+		check_error();
+	}
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	check_error();
+}
+
+}  // namespace movit
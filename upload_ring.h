@@ -0,0 +1,60 @@
+#ifndef _MOVIT_UPLOAD_RING_H
+#define _MOVIT_UPLOAD_RING_H 1
+
+// A ring of slots in a pixel unpack buffer, for inputs that want to give the
+// user somewhere to write the next frame directly into GPU-visible memory
+// (see FlatInput::get_write_buffer() and YCbCrInput::get_write_buffer()).
+//
+// If GL_ARB_buffer_storage is supported, the buffer is mapped once,
+// persistently and coherently, and we use fences to make sure we never
+// hand out a slot that the GPU is still uploading from. If not, each slot
+// is mapped (unsynchronized, since the fences still protect us) when it is
+// handed out and unmapped when it is committed.
+//
+// All calls must happen with the OpenGL context current, but the actual
+// writing into the slot, between begin_write() and commit_write(), can
+// happen from any thread.
+
+#include <epoxy/gl.h>
+#include <stddef.h>
+
+namespace movit {
+
+class UploadRing {
+public:
+	UploadRing();
+	~UploadRing();
+
+	// Returns a pointer to the next slot in the ring, which will be at least
+	// <slot_size> bytes large. Blocks if the GPU is still reading from it
+	// (which should only happen if you are more than two frames ahead).
+	// If the slot size is larger than it used to be, the buffer is reallocated,
+	// so earlier slots are no longer valid.
+	unsigned char *begin_write(size_t slot_size);
+
+	// Finishes writing into the slot returned by begin_write().
+	// Returns the byte offset of the slot within get_pbo().
+	size_t commit_write();
+
+	// Tells the ring that all OpenGL commands reading from the slot at the
+	// given offset (as returned by commit_write(), or anything within that
+	// slot) have been issued, so that it can put a fence after them.
+	void upload_done(size_t offset);
+
+	GLuint get_pbo() const { return pbo; }
+
+private:
+	void free_buffer();
+
+	static const unsigned num_slots = 3;
+	GLuint pbo;
+	unsigned char *persistent_mapped;  // nullptr if not using persistent mapping.
+	size_t slot_stride;  // Zero if nothing is allocated yet.
+	unsigned current_slot;
+	bool writing;
+	GLsync fences[num_slots];
+};
+
+}  // namespace movit
+
+#endif // !defined(_MOVIT_UPLOAD_RING_H)
@@ -139,13 +139,24 @@ string read_version_dependent_file(const string &base, const string &extension)
 }
 
 GLuint compile_shader(const string &shader_src, GLenum type)
+{
+	GLuint obj = start_compile_shader(shader_src, type);
+	check_shader_compiled(obj, shader_src);
+	return obj;
+}
+
+GLuint start_compile_shader(const string &shader_src, GLenum type)
 {
 	GLuint obj = glCreateShader(type);
 	const GLchar* source[] = { shader_src.data() };
 	const GLint length[] = { (GLint)shader_src.size() };
 	glShaderSource(obj, 1, source, length);
 	glCompileShader(obj);
+	return obj;
+}
 
+void check_shader_compiled(GLuint obj, const string &shader_src)
+{
 	GLchar info_log[4096];
 	GLsizei log_length = sizeof(info_log) - 1;
 	glGetShaderInfoLog(obj, log_length, &log_length, info_log);
@@ -172,8 +183,6 @@ GLuint compile_shader(const string &shader_src, GLenum type)
 		fprintf(stderr, "Failed to compile shader:\n%s\n", src_with_lines.c_str());
 		exit(1);
 	}
-
-	return obj;
 }
 
 void print_3x3_matrix(const Eigen::Matrix3d& m)
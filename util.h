@@ -34,6 +34,13 @@ std::string read_version_dependent_file(const std::string &base, const std::stri
 // and return the object number.
 GLuint compile_shader(const std::string &shader_src, GLenum type);
 
+// The two halves of compile_shader(), for when you do not want to wait
+// for the driver to finish compiling right away (e.g. because it supports
+// GL_KHR_parallel_shader_compile). check_shader_compiled() will block until
+// the compile is done, and exits with an error message if it failed.
+GLuint start_compile_shader(const std::string &shader_src, GLenum type);
+void check_shader_compiled(GLuint obj, const std::string &shader_src);
+
 // Print a 3x3 matrix to standard output. Useful for debugging.
 void print_3x3_matrix(const Eigen::Matrix3d &m);
 
@@ -94,4 +94,19 @@ TEST(VignetteEffectTest, BurstFromUpperLeftCorner) {
 	expect_equal(expected_data, out_data, width, height);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_VignetteEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *vignette_effect = bench.add_effect(new VignetteEffect());
+	ASSERT_TRUE(vignette_effect->set_float("radius", 0.5f));
+	ASSERT_TRUE(vignette_effect->set_float("inner_radius", 0.2f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_VignetteEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_VignetteEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_VignetteEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
@@ -21,6 +21,9 @@ public:
 
 	void set_gl_state(GLuint glsl_program_num, const std::string &prefix, unsigned *sampler_num) override;
 
+	bool is_color_matrix() const override { return true; }
+	Eigen::Matrix3d get_color_matrix() const override;
+
 private:
 	// The neutral color, in linear sRGB.
 	RGBTriplet neutral_color;
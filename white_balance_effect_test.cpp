@@ -105,4 +105,20 @@ TEST(WhiteBalanceEffectTest, HigherColorTemperatureIncreasesBlue) {
 	EXPECT_GT(out_data[4 * 1 + 1] - out_data[4 * 1 + 0], 0.05);
 }
 
+#ifdef HAVE_BENCHMARK
+void BM_WhiteBalanceEffect(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	Effect *white_balance_effect = bench.add_effect(new WhiteBalanceEffect());
+	const float neutral_color[3] = { 0.6f, 0.5f, 0.4f };
+	ASSERT_TRUE(white_balance_effect->set_vec3("neutral_color", neutral_color));
+	ASSERT_TRUE(white_balance_effect->set_float("output_color_temperature", 5000.0f));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_WhiteBalanceEffect, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_WhiteBalanceEffect, Float16, BENCHMARK_FP16)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_WhiteBalanceEffect, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
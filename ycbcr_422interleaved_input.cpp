@@ -25,6 +25,7 @@ YCbCr422InterleavedInput::YCbCr422InterleavedInput(const ImageFormat &image_form
 {
 	pbo = 0;
 	texture_num[0] = texture_num[1] = 0;
+	upload_pending[0] = upload_pending[1] = true;
 
 	assert(ycbcr_format.chroma_subsampling_x == 2);
 	assert(ycbcr_format.chroma_subsampling_y == 1);
@@ -56,8 +57,7 @@ void YCbCr422InterleavedInput::set_gl_state(GLuint glsl_program_num, const strin
 		glActiveTexture(GL_TEXTURE0 + *sampler_num + channel);
 		check_error();
 
-		if (texture_num[channel] == 0) {
-			// (Re-)upload the texture.
+		if (texture_num[channel] == 0 || upload_pending[channel]) {
 			GLuint format, internal_format;
 			if (channel == CHANNEL_LUMA) {
 				format = GL_RG;
@@ -68,11 +68,24 @@ void YCbCr422InterleavedInput::set_gl_state(GLuint glsl_program_num, const strin
 				internal_format = GL_RGBA8;
 			}
 
-			texture_num[channel] = resource_pool->create_2d_texture(internal_format, widths[channel], height);
-			glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
-			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			check_error();
+			// The size and format never change, so once we have a texture,
+			// we keep it and only upload new contents into it.
+			if (texture_num[channel] == 0) {
+				texture_num[channel] = resource_pool->create_2d_texture(internal_format, widths[channel], height);
+				glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				check_error();
+			} else {
+				glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
+				check_error();
+			}
+
+			// (Re-)upload the texture.
 			glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
 			check_error();
 			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -83,10 +96,7 @@ void YCbCr422InterleavedInput::set_gl_state(GLuint glsl_program_num, const strin
 			check_error();
 			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			check_error();
+			upload_pending[channel] = false;
 		} else {
 			glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
 			check_error();
@@ -132,12 +142,9 @@ string YCbCr422InterleavedInput::output_fragment_shader()
 
 void YCbCr422InterleavedInput::invalidate_pixel_data()
 {
-	for (unsigned channel = 0; channel < 2; ++channel) {
-		if (texture_num[channel] != 0) {
-			resource_pool->release_2d_texture(texture_num[channel]);
-			texture_num[channel] = 0;
-		}
-	}
+	// We keep our textures (if any), and upload into them in set_gl_state().
+	upload_pending[CHANNEL_LUMA] = upload_pending[CHANNEL_CHROMA] = true;
+	bump_generation();
 }
 
 bool YCbCr422InterleavedInput::set_int(const std::string& key, int value)
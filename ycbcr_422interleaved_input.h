@@ -123,6 +123,7 @@ private:
 		CHANNEL_CHROMA
 	};
 	GLuint texture_num[2];
+	bool upload_pending[2];  // Contents of texture_num[] are stale.
 	GLuint widths[2];
 	unsigned pitches[2];
 
@@ -2,8 +2,10 @@
 
 #include <epoxy/gl.h>
 #include <stddef.h>
+#include <stdlib.h>
 
 #include <string>
+#include <memory>
 
 #include "effect_chain.h"
 #include "gtest/gtest.h"
@@ -257,4 +259,41 @@ TEST(YCbCr422InterleavedInputTest, PBO) {
 	glDeleteBuffers(1, &pbo);
 }
 
+#ifdef HAVE_BENCHMARK
+// Uploads a new frame every time, as for a live source.
+void BM_YCbCr422InterleavedInput(benchmark::State &state)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	unique_ptr<unsigned char[]> data(new unsigned char[width * height * 2]);
+	unique_ptr<unsigned char[]> out_data(new unsigned char[width * height * 4]);
+	for (unsigned i = 0; i < width * height * 2; ++i) {
+		data[i] = rand() & 0xff;
+	}
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_REC_709;
+	format.gamma_curve = GAMMA_REC_709;
+
+	YCbCrFormat ycbcr_format;
+	ycbcr_format.luma_coefficients = YCBCR_REC_709;
+	ycbcr_format.full_range = false;
+	ycbcr_format.num_levels = 256;
+	ycbcr_format.chroma_subsampling_x = 2;
+	ycbcr_format.chroma_subsampling_y = 1;
+	ycbcr_format.cb_x_position = 0.0f;
+	ycbcr_format.cb_y_position = 0.5f;
+	ycbcr_format.cr_x_position = 0.0f;
+	ycbcr_format.cr_y_position = 0.5f;
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_GRAYSCALE, COLORSPACE_REC_709, GAMMA_REC_709, GL_RGBA8);
+	YCbCr422InterleavedInput *input = new YCbCr422InterleavedInput(format, ycbcr_format, width, height);
+	input->set_pixel_data(data.get());
+	tester.get_chain()->add_input(input);
+	tester.set_benchmark_frame_callback([input, &data] { input->set_pixel_data(data.get()); });
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_REC_709, GAMMA_REC_709);
+}
+BENCHMARK(BM_YCbCr422InterleavedInput)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
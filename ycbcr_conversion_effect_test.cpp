@@ -5,6 +5,9 @@
 #include <epoxy/gl.h>
 #include <math.h>
 
+#include <memory>
+#include <vector>
+
 #include "effect_chain.h"
 #include "gtest/gtest.h"
 #include "image_format.h"
@@ -624,4 +627,60 @@ TEST(YCbCrConversionEffectTest, TenBitOutputInSixteen) {
 	expect_equal(expected_data, out_data, 4 * width, height, 2);
 }
 
+#ifdef HAVE_BENCHMARK
+namespace {
+
+YCbCrFormat make_benchmark_ycbcr_format(unsigned num_levels)
+{
+	YCbCrFormat ycbcr_format;
+	ycbcr_format.luma_coefficients = YCBCR_REC_709;
+	ycbcr_format.full_range = false;
+	ycbcr_format.num_levels = num_levels;
+	ycbcr_format.chroma_subsampling_x = 1;
+	ycbcr_format.chroma_subsampling_y = 1;
+	ycbcr_format.cb_x_position = 0.5f;
+	ycbcr_format.cb_y_position = 0.5f;
+	ycbcr_format.cr_x_position = 0.5f;
+	ycbcr_format.cr_y_position = 0.5f;
+	return ycbcr_format;
+}
+
+}  // namespace
+
+void BM_YCbCrConversionEffectInterleaved(benchmark::State &state, BenchmarkFormat format)
+{
+	EffectBenchmark bench(state, format);
+	ImageFormat image_format;
+	image_format.color_space = COLORSPACE_sRGB;
+	image_format.gamma_curve = (format == BENCHMARK_INT10) ? GAMMA_REC_2020_10_BIT : GAMMA_sRGB;
+	bench.get_tester()->add_ycbcr_output(image_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED,
+		make_benchmark_ycbcr_format(format == BENCHMARK_INT10 ? 1024 : 256));
+	bench.run();
+}
+BENCHMARK_CAPTURE(BM_YCbCrConversionEffectInterleaved, Int8, BENCHMARK_INT8)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrConversionEffectInterleaved, Int10, BENCHMARK_INT10)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+void BM_YCbCrConversionEffectMultiple(benchmark::State &state, YCbCrOutputSplitting splitting)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	const unsigned num_outputs = (splitting == YCBCR_OUTPUT_PLANAR) ? 3 : 2;
+	std::vector<std::unique_ptr<unsigned char[]>> out_data;
+	std::vector<unsigned char *> out_ptrs;
+	for (unsigned i = 0; i < num_outputs; ++i) {
+		out_data.emplace_back(new unsigned char[width * height * 2]);
+		out_ptrs.push_back(out_data.back().get());
+	}
+
+	EffectBenchmark bench(state, BENCHMARK_INT8);
+	ImageFormat image_format;
+	image_format.color_space = COLORSPACE_sRGB;
+	image_format.gamma_curve = GAMMA_sRGB;
+	bench.get_tester()->add_ycbcr_output(image_format, OUTPUT_ALPHA_FORMAT_POSTMULTIPLIED, make_benchmark_ycbcr_format(256), splitting);
+	bench.get_tester()->benchmark(state, out_ptrs, GL_RG, COLORSPACE_sRGB, GAMMA_sRGB);
+}
+BENCHMARK_CAPTURE(BM_YCbCrConversionEffectMultiple, Planar, YCBCR_OUTPUT_PLANAR)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrConversionEffectMultiple, SplitYAndCbCr, YCBCR_OUTPUT_SPLIT_Y_AND_CBCR)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit
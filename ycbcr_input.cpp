@@ -2,11 +2,13 @@
 #include <Eigen/LU>
 #include <epoxy/gl.h>
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "effect_util.h"
 #include "resource_pool.h"
+#include "upload_ring.h"
 #include "util.h"
 #include "ycbcr.h"
 #include "ycbcr_input.h"
@@ -28,7 +30,9 @@ YCbCrInput::YCbCrInput(const ImageFormat &image_format,
 	  type(type),
 	  width(width),
 	  height(height),
-	  resource_pool(nullptr)
+	  resource_pool(nullptr),
+	  upload_ring(nullptr),
+	  write_buffer(nullptr)
 {
 	pbos[0] = pbos[1] = pbos[2] = 0;
 	texture_num[0] = texture_num[1] = texture_num[2] = 0;
@@ -38,6 +42,12 @@ YCbCrInput::YCbCrInput(const ImageFormat &image_format,
 
 	pixel_data[0] = pixel_data[1] = pixel_data[2] = nullptr;
 	owns_texture[0] = owns_texture[1] = owns_texture[2] = false;
+	for (unsigned channel = 0; channel < 3; ++channel) {
+		texture_internal_format[channel] = 0;
+		texture_width[channel] = texture_height[channel] = 0;
+		upload_pending[channel] = true;
+		mipmaps_valid[channel] = false;
+	}
 
 	register_uniform_sampler2d("tex_y", &uniform_tex_y);
 
@@ -67,6 +77,7 @@ YCbCrInput::~YCbCrInput()
 	for (unsigned channel = 0; channel < num_channels; ++channel) {
 		possibly_release_texture(channel);
 	}
+	delete upload_ring;
 }
 
 void YCbCrInput::set_gl_state(GLuint glsl_program_num, const string& prefix, unsigned *sampler_num)
@@ -83,11 +94,13 @@ void YCbCrInput::set_gl_state(GLuint glsl_program_num, const string& prefix, uns
 	uniform_cr_offset.y = compute_chroma_offset(
 		ycbcr_format.cr_y_position, ycbcr_format.chroma_subsampling_y, heights[2]);
 
+	bool uploaded_from_ring = false;
 	for (unsigned channel = 0; channel < num_channels; ++channel) {
 		glActiveTexture(GL_TEXTURE0 + *sampler_num + channel);
 		check_error();
 
-		if (texture_num[channel] == 0 && (pbos[channel] != 0 || pixel_data[channel] != nullptr)) {
+		if ((texture_num[channel] == 0 || (owns_texture[channel] && upload_pending[channel])) &&
+		    (pbos[channel] != 0 || pixel_data[channel] != nullptr)) {
 			GLenum format, internal_format;
 			if (channel == 0 && ycbcr_input_splitting == YCBCR_INPUT_INTERLEAVED) {
 				if (type == GL_UNSIGNED_INT_2_10_10_10_REV) {
@@ -119,12 +132,31 @@ void YCbCrInput::set_gl_state(GLuint glsl_program_num, const string& prefix, uns
 				}
 			}
 
+			// Keep our texture from last time if it still fits; see FlatInput.
+			if (texture_num[channel] != 0 &&
+			    (texture_internal_format[channel] != internal_format ||
+			     texture_width[channel] != widths[channel] ||
+			     texture_height[channel] != heights[channel])) {
+				possibly_release_texture(channel);
+			}
+			if (texture_num[channel] == 0) {
+				texture_num[channel] = resource_pool->create_2d_texture(internal_format, widths[channel], heights[channel]);
+				glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				check_error();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				check_error();
+				texture_internal_format[channel] = internal_format;
+				texture_width[channel] = widths[channel];
+				texture_height[channel] = heights[channel];
+				owns_texture[channel] = true;
+			} else {
+				glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
+				check_error();
+			}
+
 			// (Re-)upload the texture.
-			texture_num[channel] = resource_pool->create_2d_texture(internal_format, widths[channel], heights[channel]);
-			glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
-			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
-			check_error();
 			glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, pbos[channel]);
 			check_error();
 			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -133,27 +165,33 @@ void YCbCrInput::set_gl_state(GLuint glsl_program_num, const string& prefix, uns
 			check_error();
 			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, widths[channel], heights[channel], format, type, pixel_data[channel]);
 			check_error();
-			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-			check_error();
-			if (needs_mipmaps) {
-				glGenerateMipmap(GL_TEXTURE_2D);
-				check_error();
+			if (upload_ring != nullptr && pbos[channel] != 0 && pbos[channel] == upload_ring->get_pbo()) {
+				uploaded_from_ring = true;
 			}
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 			check_error();
-			owns_texture[channel] = true;
+			upload_pending[channel] = false;
+			mipmaps_valid[channel] = false;
 		} else {
 			glBindTexture(GL_TEXTURE_2D, texture_num[channel]);
 			check_error();
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+		}
+
+		if (owns_texture[channel] && needs_mipmaps && !mipmaps_valid[channel]) {
+			glGenerateMipmap(GL_TEXTURE_2D);
 			check_error();
+			mipmaps_valid[channel] = true;
 		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, needs_mipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+		check_error();
 	}
 
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 	check_error();
+	if (uploaded_from_ring) {
+		// All channels come from the same slot.
+		upload_ring->upload_done(uintptr_t(pixel_data[0]));
+	}
 
 	// Bind samplers.
 	uniform_tex_y = *sampler_num + 0;
@@ -201,13 +239,71 @@ void YCbCrInput::change_ycbcr_format(const YCbCrFormat &ycbcr_format)
 		assert(ycbcr_format.chroma_subsampling_y == 1);
 	}
 	this->ycbcr_format = ycbcr_format;
+	bump_generation();
+}
+
+size_t YCbCrInput::get_channel_bytes(unsigned channel) const
+{
+	size_t bytes_per_sample;
+	if (channel == 0 && ycbcr_input_splitting == YCBCR_INPUT_INTERLEAVED) {
+		if (type == GL_UNSIGNED_INT_2_10_10_10_REV) {
+			bytes_per_sample = sizeof(uint32_t);
+		} else if (type == GL_UNSIGNED_SHORT) {
+			bytes_per_sample = 3 * sizeof(uint16_t);
+		} else {
+			bytes_per_sample = 3;
+		}
+	} else if (channel == 1 && ycbcr_input_splitting == YCBCR_INPUT_SPLIT_Y_AND_CBCR) {
+		bytes_per_sample = (type == GL_UNSIGNED_SHORT) ? 2 * sizeof(uint16_t) : 2;
+	} else {
+		bytes_per_sample = (type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : 1;
+	}
+	return size_t(pitch[channel]) * heights[channel] * bytes_per_sample;
+}
+
+void *YCbCrInput::get_write_buffer(unsigned channel)
+{
+	assert(channel < num_channels);
+	if (write_buffer == nullptr) {
+		size_t slot_size = 0;
+		for (unsigned i = 0; i < num_channels; ++i) {
+			// Keep each channel aligned, for the larger types.
+			slot_size += (get_channel_bytes(i) + 15) & ~size_t(15);
+		}
+		if (upload_ring == nullptr) {
+			upload_ring = new UploadRing;
+		}
+		write_buffer = upload_ring->begin_write(slot_size);
+	}
+
+	size_t offset = 0;
+	for (unsigned i = 0; i < channel; ++i) {
+		offset += (get_channel_bytes(i) + 15) & ~size_t(15);
+	}
+	return write_buffer + offset;
+}
+
+void YCbCrInput::commit_write_buffer()
+{
+	assert(write_buffer != nullptr);
+	write_buffer = nullptr;
+
+	size_t offset = upload_ring->commit_write();
+	for (unsigned channel = 0; channel < num_channels; ++channel) {
+		pixel_data[channel] = (const unsigned char *)BUFFER_OFFSET(offset);
+		pbos[channel] = upload_ring->get_pbo();
+		offset += (get_channel_bytes(channel) + 15) & ~size_t(15);
+	}
+	invalidate_pixel_data();
 }
 
 void YCbCrInput::invalidate_pixel_data()
 {
+	// We keep our textures (if any), and upload into them in set_gl_state().
 	for (unsigned channel = 0; channel < 3; ++channel) {
-		possibly_release_texture(channel);
+		upload_pending[channel] = true;
 	}
+	bump_generation();
 }
 
 bool YCbCrInput::set_int(const std::string& key, int value)
@@ -31,6 +31,7 @@
 namespace movit {
 
 class ResourcePool;
+class UploadRing;
 
 // Whether the data is planar (Y', Cb and Cr in one texture each) or not.
 enum YCbCrInputSplitting {
@@ -117,6 +118,15 @@ public:
 
 	void invalidate_pixel_data();
 
+	// Like FlatInput::get_write_buffer() and FlatInput::commit_write_buffer(),
+	// but per channel: get_write_buffer() returns where to write the given
+	// channel (<pitch> x <height> samples of the channel's size), and
+	// commit_write_buffer() then sets the pixel data of all channels at once.
+	// All channels of a frame are in the same slot of the ring, which is
+	// picked by the first call to get_write_buffer() after a commit.
+	void *get_write_buffer(unsigned channel);
+	void commit_write_buffer();
+
 	// Note: Sets pitch to width, so even if your pitch is unchanged,
 	// you will need to re-set it after this call.
 	void set_width(unsigned width)
@@ -159,6 +169,7 @@ public:
 		possibly_release_texture(channel);
 		this->texture_num[channel] = texture_num;
 		this->owns_texture[channel] = false;
+		bump_generation();
 	}
 
 	// You can change the Y'CbCr format freely, also after finalize,
@@ -182,6 +193,9 @@ private:
 	// Release the texture in the given channel if we have any, and it is owned by us.
 	void possibly_release_texture(unsigned channel);
 
+	// The number of bytes each channel takes up in a slot of the upload ring.
+	size_t get_channel_bytes(unsigned channel) const;
+
 	ImageFormat image_format;
 	YCbCrFormat ycbcr_format;
 	GLuint num_channels;
@@ -199,7 +213,18 @@ private:
 	const unsigned char *pixel_data[3];
 	unsigned pitch[3];
 	bool owns_texture[3];
+
+	// Per channel; see the corresponding members in FlatInput.
+	GLenum texture_internal_format[3];
+	unsigned texture_width[3], texture_height[3];
+	bool upload_pending[3], mipmaps_valid[3];
+
 	ResourcePool *resource_pool;
+
+	// Created on first use of get_write_buffer(). <write_buffer> is non-null
+	// between get_write_buffer() and commit_write_buffer().
+	UploadRing *upload_ring;
+	unsigned char *write_buffer;
 };
 
 }  // namespace movit
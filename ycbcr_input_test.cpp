@@ -2,6 +2,11 @@
 
 #include <epoxy/gl.h>
 #include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
 
 #include <Eigen/Core>
 #include <Eigen/LU>
@@ -613,6 +618,66 @@ TEST(YCbCrInputTest, PBO) {
 	glDeleteBuffers(1, &pbo);
 }
 
+TEST(YCbCrInputTest, WriteBuffer) {
+	const int width = 1;
+	const int height = 5;
+
+	// Pure-color test inputs, calculated with the formulas in Rec. 601
+	// section 2.5.4.
+	unsigned char y[width * height] = {
+		16, 235, 81, 145, 41,
+	};
+	unsigned char cb[width * height] = {
+		128, 128, 90, 54, 240,
+	};
+	unsigned char cr[width * height] = {
+		128, 128, 240, 34, 110,
+	};
+	float expected_data[4 * width * height] = {
+		0.0, 0.0, 0.0, 1.0,
+		1.0, 1.0, 1.0, 1.0,
+		1.0, 0.0, 0.0, 1.0,
+		0.0, 1.0, 0.0, 1.0,
+		0.0, 0.0, 1.0, 1.0,
+	};
+	float out_data[4 * width * height];
+
+	EffectChainTester tester(nullptr, width, height);
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_sRGB;
+	format.gamma_curve = GAMMA_sRGB;
+
+	YCbCrFormat ycbcr_format;
+	ycbcr_format.luma_coefficients = YCBCR_REC_601;
+	ycbcr_format.full_range = false;
+	ycbcr_format.num_levels = 256;
+	ycbcr_format.chroma_subsampling_x = 1;
+	ycbcr_format.chroma_subsampling_y = 1;
+	ycbcr_format.cb_x_position = 0.5f;
+	ycbcr_format.cb_y_position = 0.5f;
+	ycbcr_format.cr_x_position = 0.5f;
+	ycbcr_format.cr_y_position = 0.5f;
+
+	YCbCrInput *input = new YCbCrInput(format, ycbcr_format, width, height);
+	tester.get_chain()->add_input(input);
+
+	// Write the channels out of order, to check that they still end up
+	// in the right places.
+	for (unsigned frame = 0; frame < 4; ++frame) {
+		memcpy(input->get_write_buffer(2), cr, sizeof(cr));
+		memcpy(input->get_write_buffer(0), y, sizeof(y));
+		memcpy(input->get_write_buffer(1), cb, sizeof(cb));
+		input->commit_write_buffer();
+
+		tester.run(out_data, GL_RGBA, COLORSPACE_sRGB, GAMMA_sRGB);
+
+		// Y'CbCr isn't 100% accurate (the input values are rounded),
+		// so we need some leeway.
+		expect_equal(expected_data, out_data, 4 * width, height, 0.025, 0.002);
+	}
+}
+
 TEST(YCbCrInputTest, CombinedCbAndCr) {
 	const int width = 1;
 	const int height = 5;
@@ -1130,4 +1195,75 @@ TEST(EffectChainTest, MipmapGenerationWorks) {
 	expect_equal(expected_data_rgba, out_data, width * 4, height, 0.025, 0.002);
 }
 
+#ifdef HAVE_BENCHMARK
+// Uploads a new frame every time, as for a live source.
+void BM_YCbCrInput(benchmark::State &state, YCbCrInputSplitting splitting, GLenum type, unsigned chroma_subsampling_x, unsigned chroma_subsampling_y)
+{
+	const unsigned width = state.range(0), height = state.range(1);
+	const unsigned chroma_width = width / chroma_subsampling_x, chroma_height = height / chroma_subsampling_y;
+	const unsigned bytes_per_value = (type == GL_UNSIGNED_SHORT) ? 2 : 1;
+
+	vector<size_t> channel_bytes;
+	if (splitting == YCBCR_INPUT_PLANAR) {
+		channel_bytes = { width * height * bytes_per_value, chroma_width * chroma_height * bytes_per_value, chroma_width * chroma_height * bytes_per_value };
+	} else if (splitting == YCBCR_INPUT_SPLIT_Y_AND_CBCR) {
+		channel_bytes = { width * height * bytes_per_value, chroma_width * chroma_height * 2 * bytes_per_value };
+	} else {
+		assert(splitting == YCBCR_INPUT_INTERLEAVED);
+		channel_bytes = { width * height * ((type == GL_UNSIGNED_INT_2_10_10_10_REV) ? 4 : 3 * bytes_per_value) };
+	}
+	vector<unique_ptr<uint32_t[]>> data;
+	for (size_t bytes : channel_bytes) {
+		data.emplace_back(new uint32_t[(bytes + 3) / 4]);
+		for (size_t i = 0; i < (bytes + 3) / 4; ++i) {
+			// Keep 16-bit values within the 10-bit range.
+			data.back()[i] = (type == GL_UNSIGNED_SHORT) ? (rand() & 0x03ff03ff) : rand();
+		}
+	}
+	unique_ptr<unsigned char[]> out_data(new unsigned char[width * height * 4]);
+
+	ImageFormat format;
+	format.color_space = COLORSPACE_REC_709;
+	format.gamma_curve = GAMMA_REC_709;
+
+	YCbCrFormat ycbcr_format;
+	ycbcr_format.luma_coefficients = YCBCR_REC_709;
+	ycbcr_format.full_range = false;
+	ycbcr_format.num_levels = (type == GL_UNSIGNED_BYTE) ? 256 : 1024;
+	ycbcr_format.chroma_subsampling_x = chroma_subsampling_x;
+	ycbcr_format.chroma_subsampling_y = chroma_subsampling_y;
+	ycbcr_format.cb_x_position = 0.0f;
+	ycbcr_format.cb_y_position = 0.5f;
+	ycbcr_format.cr_x_position = 0.0f;
+	ycbcr_format.cr_y_position = 0.5f;
+
+	EffectChainTester tester(nullptr, width, height, FORMAT_GRAYSCALE, COLORSPACE_REC_709, GAMMA_REC_709, GL_RGBA8);
+	YCbCrInput *input = new YCbCrInput(format, ycbcr_format, width, height, splitting, type);
+	tester.get_chain()->add_input(input);
+
+	auto upload = [input, type, &data] {
+		for (unsigned channel = 0; channel < data.size(); ++channel) {
+			if (type == GL_UNSIGNED_SHORT) {
+				input->set_pixel_data(channel, reinterpret_cast<const uint16_t *>(data[channel].get()));
+			} else if (type == GL_UNSIGNED_INT_2_10_10_10_REV) {
+				input->set_pixel_data(channel, data[channel].get());
+			} else {
+				input->set_pixel_data(channel, reinterpret_cast<const unsigned char *>(data[channel].get()));
+			}
+		}
+	};
+	upload();
+	tester.set_benchmark_frame_callback(upload);
+	tester.benchmark(state, out_data.get(), GL_RGBA, COLORSPACE_REC_709, GAMMA_REC_709);
+}
+BENCHMARK_CAPTURE(BM_YCbCrInput, Planar420Int8, YCBCR_INPUT_PLANAR, GL_UNSIGNED_BYTE, 2, 2)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Planar422Int10, YCBCR_INPUT_PLANAR, GL_UNSIGNED_SHORT, 2, 1)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Split420Int8, YCBCR_INPUT_SPLIT_Y_AND_CBCR, GL_UNSIGNED_BYTE, 2, 2)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Split422Int8, YCBCR_INPUT_SPLIT_Y_AND_CBCR, GL_UNSIGNED_BYTE, 2, 1)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Split422Int10, YCBCR_INPUT_SPLIT_Y_AND_CBCR, GL_UNSIGNED_SHORT, 2, 1)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Interleaved444Int8, YCBCR_INPUT_INTERLEAVED, GL_UNSIGNED_BYTE, 1, 1)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_YCbCrInput, Interleaved444Int10, YCBCR_INPUT_INTERLEAVED, GL_UNSIGNED_INT_2_10_10_10_REV, 1, 1)->Apply(standard_resolutions)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+#endif
+
 }  // namespace movit